@@ -7,6 +7,7 @@
 #include <config.h>
 #include <consensus/validation.h>
 #include <miner.h>
+#include <net_processing_internal.h>
 #include <primitives/transaction.h>
 #include <script/script.h>
 #include <script/standard.h>
@@ -18,6 +19,7 @@
 
 #include <list>
 #include <queue>
+#include <set>
 #include <vector>
 
 /// This file contains benchmarks focusing on chained transactions in the
@@ -152,6 +154,40 @@ static void benchATMP(const Config& config,
 }
 
 
+/// Run benchmark on resolving orphans: all transactions of the chain but the
+/// first are received as orphans, then the first one arrives and the orphans
+/// are added to the mempool.
+static void benchOrphanChain(const Config& config,
+                             benchmark::State& state,
+                             const std::vector<CTransactionRef> chainedTxs)
+{
+    const Amount absurdFee(Amount::zero());
+
+    LOCK2(::cs_main, internal::g_cs_orphans);
+    assert(g_mempool.size() == 0);
+    BENCHMARK_LOOP {
+        for (size_t i = 1; i < chainedTxs.size(); ++i) {
+            bool ok = internal::AddOrphanTx(chainedTxs[i], 0 /* peer */);
+            assert(ok);
+        }
+        CValidationState vstate;
+        bool ok = AcceptToMemoryPool(
+                config, g_mempool, vstate, chainedTxs.front(),
+                nullptr /* pfMissingInputs */,
+                false /* bypass_limits */,
+                absurdFee);
+        assert(ok);
+        std::set<TxId> orphan_work_set{chainedTxs[1]->GetId()};
+        while (!orphan_work_set.empty()) {
+            internal::AcceptOrphans(config, orphan_work_set);
+        }
+        assert(g_mempool.size() == chainedTxs.size());
+        assert(internal::mapOrphanTransactions.empty());
+        g_mempool.clear();
+    }
+}
+
+
 /// Run benchmark that reorganizes blocks with one-input-one-output transaction
 /// chains in them.
 ///
@@ -354,6 +390,23 @@ static void MempoolAcceptance511TxTree(benchmark::State& state) {
 }
 
 
+/// Resolve a chain of 50 1-input-1-output transactions, 49 of which are orphans.
+static void OrphanResolution50ChainedTxs(benchmark::State& state) {
+    const Config &config = GetConfig();
+    const std::vector<CTransactionRef> chainedTxs
+        = oneInOneOutChain(config, createUTXOs(config, 1).back(), 50);
+    benchOrphanChain(config, state, chainedTxs);
+}
+
+/// Resolve a chain of 500 1-input-1-output transactions, 499 of which are orphans.
+static void OrphanResolution500ChainedTxs(benchmark::State& state) {
+    const Config &config = GetConfig();
+    const std::vector<CTransactionRef> chainedTxs
+        = oneInOneOutChain(config, createUTXOs(config, 1).back(), 500);
+    benchOrphanChain(config, state, chainedTxs);
+}
+
+
 /// Try to reorg a chain of depth 10 where each block has a 50 tx 1-input-1-output chain.
 static void Reorg10BlocksWith50TxChain(benchmark::State& state) {
     const Config &config = GetConfig();
@@ -428,6 +481,9 @@ BENCHMARK(MempoolAcceptance500ChainedTxs, 6);
 BENCHMARK(MempoolAcceptance63TxTree, 800);
 BENCHMARK(MempoolAcceptance511TxTree, 80);
 
+BENCHMARK(OrphanResolution50ChainedTxs, 600);
+BENCHMARK(OrphanResolution500ChainedTxs, 6);
+
 BENCHMARK(Reorg10BlocksWith50TxChain, 10);
 BENCHMARK(Reorg10BlocksWith500TxChain, 1);
 BENCHMARK(Reorg10BlocksWith50TxChainSkipMempool, 25);
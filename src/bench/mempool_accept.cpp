@@ -0,0 +1,165 @@
+// Copyright (c) 2026 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <amount.h>
+#include <bench/bench.h>
+#include <coins.h>
+#include <config.h>
+#include <consensus/validation.h>
+#include <key.h>
+#include <keystore.h>
+#include <primitives/transaction.h>
+#include <script/sign.h>
+#include <script/standard.h>
+#include <test/setup_common.h>
+#include <test/util.h>
+#include <txmempool.h>
+#include <util/defer.h>
+#include <util/system.h>
+#include <validation.h>
+
+#include <algorithm>
+#include <cassert>
+#include <vector>
+
+/// This file contains benchmarks of accepting batches of independent signed
+/// transactions to the mempool, one after another under cs_main, through the
+/// parallel prevalidation stage first, and through AcceptToMemoryPoolBatch().
+
+/// The number of transactions of a batch
+static constexpr size_t BATCH_SIZE = 1000;
+
+/// Mine a block whose coinbase pays to `key`, and once it is mature a block
+/// with a transaction that splits it into `n` outputs to `key`, which it
+/// returns.
+static CTransactionRef createFanOut(const Config &config,
+                                    const CBasicKeyStore &keystore,
+                                    const CKey &key, size_t n) {
+    const CScript scriptPubKey =
+        GetScriptForDestination(key.GetPubKey().GetID());
+    const CTxIn coinbase = MineBlock(config, scriptPubKey);
+    for (int i = 0; i < COINBASE_MATURITY; ++i) {
+        MineBlock(config, CScript() << OP_TRUE);
+    }
+    const CTxOut out =
+        WITH_LOCK(cs_main, return pcoinsTip->AccessCoin(coinbase.prevout))
+            .GetTxOut();
+
+    CMutableTransaction tx;
+    tx.vin.emplace_back(coinbase.prevout);
+    const Amount nValue = (out.nValue - 10 * CENT) / int64_t(n);
+    tx.vout.assign(n, CTxOut(nValue, scriptPubKey));
+    const bool ok = SignSignature(keystore, scriptPubKey, tx, 0, out,
+                                  SigHashType().withFork(),
+                                  STANDARD_SCRIPT_VERIFY_FLAGS, std::nullopt);
+    assert(ok);
+    const CTransactionRef txFanOut = MakeTransactionRef(tx);
+    {
+        LOCK(cs_main);
+        CValidationState vstate;
+        const bool accepted = AcceptToMemoryPool(
+            config, g_mempool, vstate, txFanOut, nullptr /* pfMissingInputs */,
+            false /* bypass_limits */, Amount::zero());
+        assert(accepted);
+    }
+    MineBlock(config, CScript() << OP_TRUE);
+    assert(g_mempool.size() == 0);
+    return txFanOut;
+}
+
+/// Create `nBatches` batches of BATCH_SIZE transactions, each of which spends
+/// one of the outputs of `txFanOut`. The batches differ in their lock times,
+/// so that none of their signatures are found in the signature cache.
+static std::vector<std::vector<CTransactionRef>>
+createBatches(const CBasicKeyStore &keystore, const CTransaction &txFanOut,
+              size_t nBatches) {
+    std::vector<std::vector<CTransactionRef>> batches(nBatches);
+    for (size_t i = 0; i < nBatches; ++i) {
+        batches[i].reserve(BATCH_SIZE);
+        for (size_t j = 0; j < BATCH_SIZE; ++j) {
+            CMutableTransaction tx;
+            tx.nLockTime = i;
+            tx.vin.emplace_back(COutPoint(txFanOut.GetId(), j));
+            tx.vout.emplace_back(txFanOut.vout[j].nValue - 1000 * SATOSHI,
+                                 txFanOut.vout[j].scriptPubKey);
+            const bool ok = SignSignature(
+                keystore, txFanOut, tx, 0, SigHashType().withFork(),
+                STANDARD_SCRIPT_VERIFY_FLAGS, std::nullopt);
+            assert(ok);
+            batches[i].push_back(MakeTransactionRef(tx));
+        }
+    }
+    return batches;
+}
+
+enum class AcceptMode { SERIAL, PREVALIDATED, BATCH };
+
+static void benchAcceptBatches(benchmark::State &state, AcceptMode mode) {
+    const Config &config = GetConfig();
+    CKey key;
+    key.MakeNewKey(true);
+    CBasicKeyStore keystore;
+    const bool added = keystore.AddKey(key);
+    assert(added);
+
+    const CTransactionRef txFanOut =
+        createFanOut(config, keystore, key, BATCH_SIZE);
+    const auto batches =
+        createBatches(keystore, *txFanOut, state.m_num_iters);
+
+    // Use all cores, and restore the worker threads of the test setup after.
+    const int nThreads = std::max(GetNumCores() - 1, 1);
+    StopScriptCheckWorkerThreads();
+    StartScriptCheckWorkerThreads(nThreads);
+    Defer restoreThreads([] {
+        StopScriptCheckWorkerThreads();
+        StartScriptCheckWorkerThreads(2);
+    });
+
+    auto batch = batches.begin();
+    BENCHMARK_LOOP {
+        assert(batch != batches.end());
+        if (mode == AcceptMode::BATCH) {
+            const auto results = AcceptToMemoryPoolBatch(
+                config, g_mempool, *batch, {}, false /* bypass_limits */,
+                Amount::zero());
+            assert(g_mempool.size() == results.size());
+        } else {
+            if (mode == AcceptMode::PREVALIDATED) {
+                PrevalidateMemPoolTransactions(config, g_mempool, *batch,
+                                               false /* bypass_limits */);
+            }
+            LOCK(cs_main);
+            for (const CTransactionRef &tx : *batch) {
+                CValidationState vstate;
+                const bool ok = AcceptToMemoryPool(
+                    config, g_mempool, vstate, tx,
+                    nullptr /* pfMissingInputs */, false /* bypass_limits */,
+                    Amount::zero());
+                assert(ok);
+            }
+        }
+        WITH_LOCK(cs_main, g_mempool.clear());
+        ++batch;
+    }
+}
+
+/// Accept 1000 transactions one after another, as if they came from peers.
+static void MempoolAcceptSerial(benchmark::State &state) {
+    benchAcceptBatches(state, AcceptMode::SERIAL);
+}
+
+/// Accept 1000 transactions after verifying their scripts on all cores.
+static void MempoolAcceptPrevalidated(benchmark::State &state) {
+    benchAcceptBatches(state, AcceptMode::PREVALIDATED);
+}
+
+/// Accept 1000 transactions with AcceptToMemoryPoolBatch().
+static void MempoolAcceptBatch(benchmark::State &state) {
+    benchAcceptBatches(state, AcceptMode::BATCH);
+}
+
+BENCHMARK(MempoolAcceptSerial, 5);
+BENCHMARK(MempoolAcceptPrevalidated, 5);
+BENCHMARK(MempoolAcceptBatch, 5);
@@ -0,0 +1,169 @@
+// Copyright (c) 2026 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <amount.h>
+#include <bench/bench.h>
+#include <primitives/transaction.h>
+#include <script/script.h>
+#include <txmempool.h>
+#include <validation.h>
+
+#include <tinyformat.h>
+
+#include <cassert>
+#include <map>
+#include <string>
+#include <vector>
+
+/// This file contains benchmarks of maintaining and walking the links between
+/// the transactions of the mempool and their in-mempool parents and children.
+
+/// The number of transactions of the tree
+static constexpr size_t TREE_SIZE = 10000;
+
+/// Create a binary tree of transactions, in which every transaction but the
+/// root spends one of the two outputs of its parent. Parents come first.
+static std::vector<CTransactionRef> createTree() {
+    std::vector<CTransactionRef> txs;
+    txs.reserve(TREE_SIZE);
+    for (size_t i = 0; i < TREE_SIZE; ++i) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        if (i > 0) {
+            tx.vin[0].prevout = COutPoint(txs[(i - 1) / 2]->GetId(), i % 2);
+        }
+        tx.vin[0].scriptSig = CScript() << OP_1;
+        tx.vout.assign(2, CTxOut(COIN, CScript() << OP_TRUE));
+        txs.push_back(MakeTransactionRef(tx));
+    }
+    return txs;
+}
+
+/// Create a transaction with TREE_SIZE - 1 outputs, followed by a child
+/// spending each of them.
+static std::vector<CTransactionRef> createFan() {
+    std::vector<CTransactionRef> txs;
+    txs.reserve(TREE_SIZE);
+    CMutableTransaction root;
+    root.vin.resize(1);
+    root.vin[0].scriptSig = CScript() << OP_1;
+    root.vout.assign(TREE_SIZE - 1, CTxOut(COIN, CScript() << OP_TRUE));
+    txs.push_back(MakeTransactionRef(root));
+    for (size_t i = 0; i + 1 < TREE_SIZE; ++i) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(txs[0]->GetId(), i);
+        tx.vin[0].scriptSig = CScript() << OP_1;
+        tx.vout.assign(1, CTxOut(COIN, CScript() << OP_TRUE));
+        txs.push_back(MakeTransactionRef(tx));
+    }
+    return txs;
+}
+
+/// Add the transactions, which list parents before their children, to the
+/// mempool.
+static void addTxs(const std::vector<CTransactionRef> &txs, CTxMemPool &pool)
+    EXCLUSIVE_LOCKS_REQUIRED(cs_main, pool.cs) {
+    for (const CTransactionRef &tx : txs) {
+        pool.addUnchecked(CTxMemPoolEntry(tx, 1000 * SATOSHI, 0, false, 1,
+                                          LockPoints()));
+    }
+}
+
+/// Add the tree to the mempool, then remove it with all its descendants.
+static void MempoolAddRemoveTree(benchmark::State &state) {
+    const std::vector<CTransactionRef> txs = createTree();
+    CTxMemPool pool;
+    LOCK2(cs_main, pool.cs);
+    BENCHMARK_LOOP {
+        addTxs(txs, pool);
+        pool.removeRecursive(*txs[0]);
+        assert(pool.size() == 0);
+    }
+}
+
+/// Collect the in-mempool ancestors of every transaction of the tree.
+static void MempoolAncestorsTree(benchmark::State &state) {
+    const std::vector<CTransactionRef> txs = createTree();
+    CTxMemPool pool;
+    LOCK2(cs_main, pool.cs);
+    addTxs(txs, pool);
+    BENCHMARK_LOOP {
+        size_t nAncestors = 0;
+        for (const CTransactionRef &tx : txs) {
+            CTxMemPool::setEntries setAncestors;
+            const CTxMemPool::txiter it = *pool.GetIter(tx->GetId());
+            pool.CalculateMemPoolAncestors(*it, setAncestors, false);
+            nAncestors += setAncestors.size();
+        }
+        assert(nAncestors > TREE_SIZE);
+    }
+}
+
+/// Get the ancestor stats of every transaction of the tree, after a removal
+/// from the mempool has dropped the memoized ones.
+static void MempoolAncestorStatsTree(benchmark::State &state) {
+    const std::vector<CTransactionRef> txs = createTree();
+    CMutableTransaction unrelated;
+    unrelated.vin.resize(1);
+    unrelated.vin[0].scriptSig = CScript() << OP_2;
+    unrelated.vout.assign(1, CTxOut(COIN, CScript() << OP_TRUE));
+    const CTransactionRef unrelatedTx = MakeTransactionRef(unrelated);
+    CTxMemPool pool;
+    LOCK2(cs_main, pool.cs);
+    addTxs(txs, pool);
+    BENCHMARK_LOOP {
+        pool.addUnchecked(CTxMemPoolEntry(unrelatedTx, 1000 * SATOSHI, 0, false,
+                                          1, LockPoints()));
+        pool.removeRecursive(*unrelatedTx);
+        uint64_t nAncestors = 0;
+        for (const CTransactionRef &tx : txs) {
+            nAncestors += pool.GetAncestorStats(*pool.GetIter(tx->GetId())).count;
+        }
+        assert(nAncestors > TREE_SIZE);
+    }
+}
+
+/// DynamicMemoryUsage() of the mempool after the last evaluation of each
+/// memory benchmark, by benchmark name.
+static std::map<std::string, size_t> mapMemoryUsage;
+
+/// Add the transactions to an empty mempool, and record how much memory the
+/// mempool then uses.
+static void MempoolMemory(benchmark::State &state,
+                          const std::vector<CTransactionRef> &txs) {
+    size_t nUsage = 0;
+    BENCHMARK_LOOP {
+        CTxMemPool pool;
+        LOCK2(cs_main, pool.cs);
+        addTxs(txs, pool);
+        nUsage = pool.DynamicMemoryUsage();
+    }
+    mapMemoryUsage[state.GetName()] = nUsage;
+}
+
+static void MempoolMemoryCompleted(const benchmark::State &state,
+                                   benchmark::Printer &printer) {
+    const size_t nUsage = mapMemoryUsage.at(state.GetName());
+    printer.appendExtraDataForCategory(
+        "MempoolMemory", {{"name", state.GetName()},
+                          {"bytes", strprintf("%d", nUsage)},
+                          {"bytes per tx", strprintf("%d", nUsage / TREE_SIZE)}});
+}
+
+static void MempoolMemoryTree(benchmark::State &state) {
+    MempoolMemory(state, createTree());
+}
+
+static void MempoolMemoryFan(benchmark::State &state) {
+    MempoolMemory(state, createFan());
+}
+
+BENCHMARK(MempoolAddRemoveTree, 5);
+BENCHMARK(MempoolAncestorsTree, 5);
+BENCHMARK(MempoolAncestorStatsTree, 5);
+static const benchmark::BenchRunner bench_MempoolMemoryTree(
+    "MempoolMemoryTree", MempoolMemoryTree, 5, MempoolMemoryCompleted);
+static const benchmark::BenchRunner bench_MempoolMemoryFan(
+    "MempoolMemoryFan", MempoolMemoryFan, 5, MempoolMemoryCompleted);
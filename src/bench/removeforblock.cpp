@@ -183,7 +183,22 @@ static void RemoveForBlock8MB_UnconfChains(benchmark::State& state) {
     benchRemoveForBlock(config, state, 450'000, 8, true);
 }
 
+/// Fill a mempool with 100k txs, then repeatedly test removeForBlock with a 32MB block containing nearly all of them
+static void RemoveForBlock100kTx(benchmark::State& state) {
+    const Config& config = GetConfig();
+    benchRemoveForBlock(config, state, 100'000, 32, false);
+}
+
+/// Fill a mempool with 100k txs in unconfirmed chains, then repeatedly test removeForBlock with a 32MB block
+/// containing nearly all of them, parents and children alike
+static void RemoveForBlock100kTx_UnconfChains(benchmark::State& state) {
+    const Config& config = GetConfig();
+    benchRemoveForBlock(config, state, 100'000, 32, true);
+}
+
 BENCHMARK(RemoveForBlock32MB, 1);
 BENCHMARK(RemoveForBlock8MB, 1);
 BENCHMARK(RemoveForBlock32MB_UnconfChains, 1);
 BENCHMARK(RemoveForBlock8MB_UnconfChains, 1);
+BENCHMARK(RemoveForBlock100kTx, 1);
+BENCHMARK(RemoveForBlock100kTx_UnconfChains, 1);
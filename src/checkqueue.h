@@ -144,8 +144,9 @@ public:
     explicit CCheckQueue(unsigned int nBatchSizeIn)
         : nBatchSize(nBatchSizeIn) {}
 
-    //! Create a pool of new worker threads.
-    void StartWorkerThreads(const int threads_num)
+    //! Create a pool of new worker threads, named "<thread_name>.<n>".
+    void StartWorkerThreads(const int threads_num,
+                            const char *thread_name = "scriptch")
     {
         {
              LOCK(m_mutex);
@@ -155,8 +156,8 @@ public:
          }
          assert(m_worker_threads.empty());
          for (int n = 0; n < threads_num; ++n) {
-             m_worker_threads.emplace_back([this, n]() {
-                 util::ThreadRename(strprintf("scriptch.%i", n));
+             m_worker_threads.emplace_back([this, n, thread_name]() {
+                 util::ThreadRename(strprintf("%s.%i", thread_name, n));
                  Loop(false /* worker thread */);
              });
          }
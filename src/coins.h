@@ -11,6 +11,7 @@
 #include <memusage.h>
 #include <primitives/blockhash.h>
 #include <serialize.h>
+#include <support/allocators/pool.h>
 #include <util/saltedhashers.h>
 
 #include <cassert>
@@ -91,8 +92,23 @@ struct CCoinsCacheEntry {
         : coin(std::move(coinIn)), flags(0) {}
 };
 
-typedef std::unordered_map<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher>
-    CCoinsMap;
+/**
+ * PoolAllocator's MAX_BLOCK_SIZE_BYTES parameter here uses sizeof the data, and
+ * adds the size of 4 pointers. We do not know the exact node size used in the
+ * std::unordered_node implementation because it is implementation defined.
+ * Most implementations have an overhead of 1 or 2 pointers, so nodes can be
+ * connected in a linked list, and in some cases the hash value is stored as
+ * well. Using an additional sizeof(void*)*4 for MAX_BLOCK_SIZE_BYTES should
+ * thus be sufficient so that all implementations can allocate the nodes from
+ * the PoolAllocator.
+ */
+using CCoinsMap = std::unordered_map<
+    COutPoint, CCoinsCacheEntry, SaltedOutpointHasher, std::equal_to<COutPoint>,
+    PoolAllocator<std::pair<const COutPoint, CCoinsCacheEntry>,
+                  sizeof(std::pair<const COutPoint, CCoinsCacheEntry>) +
+                      sizeof(void *) * 4>>;
+
+using CCoinsMapMemoryResource = CCoinsMap::allocator_type::ResourceType;
 
 /** Cursor for iterating over CoinsView state */
 class CCoinsViewCursor {
@@ -163,6 +179,7 @@ public:
     BlockHash GetBestBlock() const override;
     std::vector<BlockHash> GetHeadBlocks() const override;
     void SetBackend(CCoinsView &viewIn);
+    CCoinsView *GetBackend() const { return base; }
     bool BatchWrite(CCoinsMap &mapCoins, const BlockHash &hashBlock) override;
     CCoinsViewCursor *Cursor(bool snapshot = false) const override;
     size_t EstimateSize() const override;
@@ -178,6 +195,11 @@ protected:
      * declared as "const".
      */
     mutable BlockHash hashBlock;
+    /**
+     * The nodes of cacheCoins are carved out of large chunks owned by this
+     * resource, which are all released at once when the cache is flushed.
+     */
+    mutable CCoinsMapMemoryResource m_cache_coins_memory_resource{};
     mutable CCoinsMap cacheCoins;
 
     /* Cached dynamic memory usage for the inner Coin objects. */
@@ -229,6 +251,14 @@ public:
     void AddCoin(const COutPoint &outpoint, Coin coin,
                  bool potential_overwrite);
 
+    /**
+     * Insert a coin that was looked up in the backing view by other means (for
+     * instance by the parallel block input prefetcher), exactly as if it had
+     * been fetched on demand. This is a no-op if the cache already has an
+     * entry for the outpoint, so modified entries are never clobbered.
+     */
+    void EmplaceFetchedCoin(const COutPoint &outpoint, Coin &&coin);
+
     /**
      * Spend a coin. Pass moveto in order to get the deleted data.
      * If no unspent output exists for the passed outpoint, this call has no
@@ -256,6 +286,16 @@ public:
     //! Calculate the size of the cache (in bytes)
     size_t DynamicMemoryUsage() const;
 
+    /**
+     * Force a reallocation of the cache map. This is required when downsizing
+     * the cache because the map's allocator may be hanging onto a lot of
+     * memory despite having called .clear().
+     *
+     * See:
+     * https://stackoverflow.com/questions/42114044/how-to-release-unordered-map-memory
+     */
+    void ReallocateCache();
+
     /**
      * Amount of bitcoins coming in to a transaction
      * Note that lightweight clients may not know anything besides the hash of
@@ -83,6 +83,9 @@ typedef char *sockopt_arg_type;
 // __APPLE__ poll is broke https://github.com/bitcoin/bitcoin/pull/14336#issuecomment-437384408
 #if defined(__linux__)
 #define USE_POLL
+// epoll is available on every Linux we support and lets the socket handler keep its socket registrations between
+// iterations, see -socketevents
+#define USE_EPOLL
 #endif
 
 bool static inline IsSelectableSocket(const SOCKET& s) {
@@ -11,6 +11,13 @@
 
 #include <stdexcept>
 
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 FlatFileSeq::FlatFileSeq(fs::path dir, const char *prefix, size_t chunk_size)
     : m_dir(std::move(dir)), m_prefix(prefix), m_chunk_size(chunk_size) {
     if (chunk_size == 0) {
@@ -97,3 +104,39 @@ bool FlatFileSeq::Flush(const FlatFilePos &pos, bool finalize) {
     fclose(file);
     return true;
 }
+
+MappedFlatFile::~MappedFlatFile() {
+#ifndef WIN32
+    munmap(const_cast<uint8_t *>(m_data), m_size);
+#endif
+}
+
+std::shared_ptr<const MappedFlatFile>
+FlatFileSeq::Map(const FlatFilePos &pos) const {
+#ifdef WIN32
+    return nullptr;
+#else
+    if (pos.IsNull()) {
+        return nullptr;
+    }
+    const fs::path path = FileName(pos);
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        LogPrintf("Unable to open file %s\n", path.string());
+        return nullptr;
+    }
+    struct stat st;
+    void *addr = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        addr = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    // The mapping keeps the file open.
+    close(fd);
+    if (addr == MAP_FAILED) {
+        LogPrintf("Unable to map file %s\n", path.string());
+        return nullptr;
+    }
+    return std::shared_ptr<const MappedFlatFile>(new MappedFlatFile(
+        static_cast<const uint8_t *>(addr), size_t(st.st_size)));
+#endif
+}
@@ -8,7 +8,10 @@
 
 #include <fs.h>
 #include <serialize.h>
+#include <span.h>
 
+#include <cstdint>
+#include <memory>
 #include <string>
 
 struct FlatFilePos {
@@ -39,6 +42,29 @@ struct FlatFilePos {
     std::string ToString() const;
 };
 
+/**
+ * A read-only memory mapping of a whole file of a FlatFileSeq, which stays
+ * valid for as long as the object exists. See FlatFileSeq::Map().
+ */
+class MappedFlatFile {
+private:
+    const uint8_t *const m_data;
+    const size_t m_size;
+
+    MappedFlatFile(const uint8_t *data, size_t size)
+        : m_data(data), m_size(size) {}
+
+    friend class FlatFileSeq;
+
+public:
+    MappedFlatFile(const MappedFlatFile &) = delete;
+    MappedFlatFile &operator=(const MappedFlatFile &) = delete;
+    ~MappedFlatFile();
+
+    /** The contents of the file as of when it was mapped. */
+    Span<const uint8_t> GetData() const { return {m_data, m_size}; }
+};
+
 /**
  * FlatFileSeq represents a sequence of numbered files storing raw data. This
  * class facilitates access to and efficient management of these files.
@@ -89,4 +115,15 @@ public:
      * @return true on success, false on failure.
      */
     bool Flush(const FlatFilePos &pos, bool finalize = false);
+
+    /**
+     * Map the file at the given position into memory, read-only. Data
+     * written to the file within the size it had when it was mapped is
+     * visible through the mapping. Accessing the mapping beyond the end of
+     * the file after it was truncated is not allowed.
+     *
+     * @return The mapping, or nullptr if the file does not exist, is empty,
+     * or memory mapping is not supported on this platform.
+     */
+    std::shared_ptr<const MappedFlatFile> Map(const FlatFilePos &pos) const;
 };
@@ -0,0 +1,183 @@
+// Copyright (c) 2026 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <index/coinstatsindex.h>
+
+#include <chain.h>
+#include <coins.h>
+#include <node/blockstorage.h>
+#include <primitives/block.h>
+#include <streams.h>
+#include <uint256.h>
+#include <undo.h>
+#include <util/system.h>
+#include <version.h>
+
+#include <vector>
+
+constexpr char DB_BLOCK_HASH = 's';
+
+std::unique_ptr<CoinStatsIndex> g_coin_stats_index;
+
+/**
+ * Access to the coinstatsindex database (indexes/coinstats/)
+ *
+ * Besides the locator of the chain the database is synced to, the database
+ * stores the IndexedCoinsStats of every indexed block, by block hash.
+ */
+class CoinStatsIndex::DB : public BaseIndex::DB {
+public:
+    explicit DB(size_t n_cache_size, bool f_memory = false,
+                bool f_wipe = false);
+
+    /// Read the statistics as of the given block. Returns false if the block
+    /// is not indexed.
+    bool ReadStats(const BlockHash &hash, IndexedCoinsStats &stats) const;
+
+    /// Write the statistics as of the given block.
+    bool WriteStats(const BlockHash &hash, const IndexedCoinsStats &stats);
+};
+
+CoinStatsIndex::DB::DB(size_t n_cache_size, bool f_memory, bool f_wipe)
+    : BaseIndex::DB(GetDataDir() / "indexes" / "coinstats", n_cache_size,
+                    f_memory, f_wipe) {}
+
+bool CoinStatsIndex::DB::ReadStats(const BlockHash &hash,
+                                   IndexedCoinsStats &stats) const {
+    return Read(std::make_pair(DB_BLOCK_HASH, hash), stats);
+}
+
+bool CoinStatsIndex::DB::WriteStats(const BlockHash &hash,
+                                    const IndexedCoinsStats &stats) {
+    return Write(std::make_pair(DB_BLOCK_HASH, hash), stats);
+}
+
+/**
+ * The coinbases of these two blocks duplicate those of earlier blocks and
+ * overwrote their outputs in the UTXO set (see BIP30 in ConnectBlock()). The
+ * outputs are identical but for their height, so return the height of the
+ * overwritten coinbase, or 0 if pindex is not one of these blocks.
+ */
+static int GetBIP30OverwrittenHeight(const CBlockIndex *pindex) {
+    if (pindex->nHeight == 91842 &&
+        pindex->GetBlockHash() ==
+            uint256S("0x00000000000a4d0a398161ffc163c503763b1f4360639393e0e4c8e"
+                     "300e0caec")) {
+        return 91812;
+    }
+    if (pindex->nHeight == 91880 &&
+        pindex->GetBlockHash() ==
+            uint256S("0x00000000000743f190a18c5577a3c2d2a1f610ae9601ac046a38084"
+                     "ccb7cd721")) {
+        return 91722;
+    }
+    return 0;
+}
+
+CoinStatsIndex::CoinStatsIndex(size_t n_cache_size, bool f_memory, bool f_wipe)
+    : BaseIndex("coinstatsindex"),
+      m_db(std::make_unique<CoinStatsIndex::DB>(n_cache_size, f_memory,
+                                                f_wipe)) {}
+
+CoinStatsIndex::~CoinStatsIndex() {}
+
+void CoinStatsIndex::ApplyCoin(IndexedCoinsStats &stats,
+                               const COutPoint &outpoint, const Coin &coin,
+                               bool fAdd) {
+    const CTxOut &out = coin.GetTxOut();
+    std::vector<uint8_t> element;
+    CVectorWriter(SER_NETWORK, PROTOCOL_VERSION, element, 0, outpoint,
+                  uint32_t(coin.GetHeight() * 2 + coin.IsCoinBase()), out);
+
+    const uint64_t bogosize = 32 /* txid */ + 4 /* vout index */ +
+                              4 /* height + coinbase */ + 8 /* amount */ +
+                              2 /* scriptPubKey len */ +
+                              out.scriptPubKey.size() /* scriptPubKey */;
+    const uint64_t nTokens = out.tokenDataPtr ? 1 : 0;
+    const uint64_t nNFTs = out.tokenDataPtr && out.tokenDataPtr->HasNFT();
+    if (fAdd) {
+        stats.multiset.Add(element);
+        stats.nTransactionOutputs++;
+        stats.nBogoSize += bogosize;
+        stats.nTotalAmount += out.nValue;
+        stats.nTokenOutputs += nTokens;
+        stats.nNFTOutputs += nNFTs;
+    } else {
+        stats.multiset.Remove(element);
+        stats.nTransactionOutputs--;
+        stats.nBogoSize -= bogosize;
+        stats.nTotalAmount -= out.nValue;
+        stats.nTokenOutputs -= nTokens;
+        stats.nNFTOutputs -= nNFTs;
+    }
+}
+
+bool CoinStatsIndex::WriteBlock(const CBlock &block,
+                                const CBlockIndex *pindex) {
+    IndexedCoinsStats stats;
+
+    // The outputs of the genesis block are not spendable, so the UTXO set
+    // starts out empty.
+    if (pindex->nHeight > 0) {
+        if (!m_db->ReadStats(pindex->pprev->GetBlockHash(), stats)) {
+            return error("%s: previous block %s is not indexed", __func__,
+                         pindex->pprev->GetBlockHash().ToString());
+        }
+
+        CBlockUndo blockundo;
+        if (!UndoReadFromDisk(blockundo, pindex)) {
+            return error("%s: failed to read undo data of block %s", __func__,
+                         pindex->GetBlockHash().ToString());
+        }
+        if (blockundo.vtxundo.size() + 1 != block.vtx.size()) {
+            return error("%s: undo data of block %s does not match the block",
+                         __func__, pindex->GetBlockHash().ToString());
+        }
+
+        const int nOverwrittenHeight = GetBIP30OverwrittenHeight(pindex);
+        for (size_t i = 0; i < block.vtx.size(); ++i) {
+            const CTransaction &tx = *block.vtx[i];
+            const TxId &txid = tx.GetId();
+            for (size_t j = 0; j < tx.vout.size(); ++j) {
+                // Mirror AddCoins(): provably unspendable outputs never enter
+                // the UTXO set.
+                if (tx.vout[j].scriptPubKey.IsUnspendable()) {
+                    continue;
+                }
+                if (nOverwrittenHeight && tx.IsCoinBase()) {
+                    ApplyCoin(stats, COutPoint(txid, j),
+                              Coin(tx.vout[j], nOverwrittenHeight, true),
+                              false);
+                }
+                ApplyCoin(stats, COutPoint(txid, j),
+                          Coin(tx.vout[j], pindex->nHeight, tx.IsCoinBase()),
+                          true);
+            }
+
+            if (i == 0) {
+                continue;
+            }
+            const CTxUndo &txundo = blockundo.vtxundo[i - 1];
+            if (txundo.vprevout.size() != tx.vin.size()) {
+                return error("%s: undo data of block %s does not match the "
+                             "block",
+                             __func__, pindex->GetBlockHash().ToString());
+            }
+            for (size_t j = 0; j < tx.vin.size(); ++j) {
+                ApplyCoin(stats, tx.vin[j].prevout, txundo.vprevout[j], false);
+            }
+        }
+    }
+
+    return m_db->WriteStats(pindex->GetBlockHash(), stats);
+}
+
+BaseIndex::DB &CoinStatsIndex::GetDB() const {
+    return *m_db;
+}
+
+bool CoinStatsIndex::LookUpStats(const CBlockIndex *pindex,
+                                 IndexedCoinsStats &stats) const {
+    return m_db->ReadStats(pindex->GetBlockHash(), stats);
+}
@@ -0,0 +1,86 @@
+// Copyright (c) 2026 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once
+
+#include <amount.h>
+#include <ec_multiset.h>
+#include <index/base.h>
+#include <serialize.h>
+
+#include <cstdint>
+#include <memory>
+
+class Coin;
+class COutPoint;
+
+/** Statistics about the UTXO set as of a given block, see CoinStatsIndex. */
+struct IndexedCoinsStats {
+    //! The number of unspent transaction outputs
+    uint64_t nTransactionOutputs{0};
+    //! A database-independent metric for the UTXO set size, see
+    //! gettxoutsetinfo
+    uint64_t nBogoSize{0};
+    //! The total amount of all unspent transaction outputs
+    Amount nTotalAmount{Amount::zero()};
+    //! The number of unspent transaction outputs carrying tokens
+    uint64_t nTokenOutputs{0};
+    //! The number of unspent transaction outputs carrying an NFT
+    uint64_t nNFTOutputs{0};
+    //! The multiset of all unspent transaction outputs, see
+    //! CoinStatsIndex::AddCoin()
+    ECMultiSet multiset;
+
+    SERIALIZE_METHODS(IndexedCoinsStats, obj) {
+        READWRITE(obj.nTransactionOutputs, obj.nBogoSize, obj.nTotalAmount,
+                  obj.nTokenOutputs, obj.nNFTOutputs, obj.multiset);
+    }
+};
+
+/**
+ * CoinStatsIndex maintains statistics about the UTXO set, including an
+ * ECMultiSet commitment to it, as of every block of the chain. The statistics
+ * of a block are derived from those of its parent, the block itself and its
+ * undo data, so they are available for any height without scanning the UTXO
+ * set.
+ *
+ * Entries are keyed by block hash rather than height, so those of a
+ * disconnected block remain valid and nothing needs to be rewound on a reorg.
+ */
+class CoinStatsIndex final : public BaseIndex {
+protected:
+    class DB;
+
+private:
+    const std::unique_ptr<DB> m_db;
+
+protected:
+    bool WriteBlock(const CBlock &block, const CBlockIndex *pindex) override;
+
+    BaseIndex::DB &GetDB() const override;
+
+public:
+    /// Constructs the index, which becomes available to be queried.
+    explicit CoinStatsIndex(size_t n_cache_size, bool f_memory = false,
+                            bool f_wipe = false);
+
+    // Destructor is declared because this class contains a unique_ptr to an
+    // incomplete type.
+    virtual ~CoinStatsIndex() override;
+
+    /// Look up the statistics of the UTXO set as of the given block.
+    /// Returns false if the block is not indexed (yet).
+    bool LookUpStats(const CBlockIndex *pindex,
+                     IndexedCoinsStats &stats) const;
+
+    /// Add a coin to (or, with fAdd false, remove it from) stats. The
+    /// multiset element of a coin is its outpoint, followed by its height
+    /// times two plus its coinbase flag as a 32-bit little endian integer,
+    /// followed by its output in network serialization.
+    static void ApplyCoin(IndexedCoinsStats &stats, const COutPoint &outpoint,
+                          const Coin &coin, bool fAdd);
+};
+
+/// The global UTXO set statistics index. May be null.
+extern std::unique_ptr<CoinStatsIndex> g_coin_stats_index;
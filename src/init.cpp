@@ -28,6 +28,7 @@
 #include <hash.h>
 #include <httprpc.h>
 #include <httpserver.h>
+#include <index/coinstatsindex.h>
 #include <index/txindex.h>
 #include <interfaces/chain.h>
 #include <key.h>
@@ -38,6 +39,7 @@
 #include <net_processing.h>
 #include <netbase.h>
 #include <node/blockstorage.h>
+#include <node/utxosnapshot.h>
 #include <policy/mempool.h>
 #include <policy/policy.h>
 #include <rpc/blockchain.h>
@@ -209,6 +211,9 @@ void Interrupt() {
     if (g_txindex) {
         g_txindex->Interrupt();
     }
+    if (g_coin_stats_index) {
+        g_coin_stats_index->Interrupt();
+    }
 }
 
 void Shutdown(NodeContext &node) {
@@ -240,12 +245,18 @@ void Shutdown(NodeContext &node) {
     if (peerLogic) {
         UnregisterValidationInterface(peerLogic.get());
     }
+    if (g_block_template_tracker) {
+        UnregisterValidationInterface(g_block_template_tracker.get());
+    }
     if (g_connman) {
         g_connman->Stop();
     }
     if (g_txindex) {
         g_txindex->Stop();
     }
+    if (g_coin_stats_index) {
+        g_coin_stats_index->Stop();
+    }
 
     StopTorControl();
 
@@ -264,9 +275,11 @@ void Shutdown(NodeContext &node) {
     // After the threads that potentially access these pointers have been
     // stopped, destruct and reset all to nullptr.
     peerLogic.reset();
+    g_block_template_tracker.reset();
     g_connman.reset();
     g_banman.reset();
     g_txindex.reset();
+    g_coin_stats_index.reset();
 
     if (::g_mempool.IsLoaded() &&
         gArgs.GetArg("-persistmempool", DEFAULT_PERSIST_MEMPOOL)) {
@@ -450,6 +463,12 @@ void SetupServerArgs() {
     gArgs.AddArg("-check-abla", strprintf("Whether to run extra ABLA (adaptive blocksize limit algorithm) checks at "
                                           "startup. (default: %i)", DEFAULT_ABLA_SLOW_CHECKS),
                  ArgsManager::ALLOW_BOOL, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-coinstatsindex",
+                 strprintf("Maintain statistics about the UTXO set as of every "
+                           "block, used by the gettxoutsetinfo rpc call "
+                           "(default: %d)",
+                           DEFAULT_COINSTATSINDEX),
+                 ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-conf=<file>",
                  strprintf("Specify configuration file. Relative paths will be "
                            "prefixed by datadir location. (default: %s)",
@@ -457,6 +476,14 @@ void SetupServerArgs() {
                  ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-datadir=<dir>", "Specify data directory", ArgsManager::ALLOW_ANY,
                  OptionsCategory::OPTIONS);
+    gArgs.AddArg("-dbbackgroundflush",
+                 strprintf("Write the UTXO set to disk in a background thread "
+                           "when flushing the coins cache, so that validation "
+                           "does not wait for the write to complete. This can "
+                           "briefly double the memory used by the coins cache "
+                           "(default: %d)",
+                           DEFAULT_DB_BACKGROUND_FLUSH),
+                 ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg(
         "-dbbatchsize=<n>",
         strprintf("Maximum database write batch size in bytes (default: %u)",
@@ -520,6 +547,24 @@ void SetupServerArgs() {
     gArgs.AddArg("-loadblock=<file>",
                  "Imports blocks from external blk000??.dat file on startup",
                  ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-loadutxosnapshot=<file>",
+                 "Load the UTXO set from a snapshot file written by "
+                 "dumptxoutset on startup, if the chainstate is empty (e.g. "
+                 "with -reindex-chainstate). -loadutxosnapshothash is "
+                 "required. If the base block of the snapshot has not been "
+                 "validated, -loadutxosnapshotblock and -prune are required "
+                 "as well, and the blocks up to it are assumed to be valid",
+                 ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-loadutxosnapshothash=<hex>",
+                 "The ECMultiSet hash, as reported by dumptxoutset and "
+                 "gettxoutsetinfo on a trusted node, that a UTXO snapshot "
+                 "loaded with -loadutxosnapshot must have",
+                 ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-loadutxosnapshotblock=<hex>",
+                 "The hash, as reported by dumptxoutset on a trusted node, "
+                 "of the block that a UTXO snapshot loaded with "
+                 "-loadutxosnapshot must be as of",
+                 ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-maxmempool=<n>", strprintf("Keep the transaction memory pool below <n> "
                  "megabytes (default: %u, testnet: %u, testnet4: %u, scalenet: %u, chipnet: %u)",
                  DEFAULT_MAX_MEMPOOL_SIZE_PER_MB * defaultChainParams->GetConsensus().nDefaultConsensusBlockSize / ONE_MEGABYTE,
@@ -533,6 +578,11 @@ void SetupServerArgs() {
                            "memory (default: %u)",
                            DEFAULT_MAX_ORPHAN_TRANSACTIONS),
                  ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-maxorphantxsize=<n>",
+                 strprintf("Keep at most <n> megabytes of unconnectable "
+                           "transactions in memory (default: %u)",
+                           DEFAULT_MAX_ORPHAN_TRANSACTIONS_SIZE),
+                 ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-mempoolexpiry=<n>",
                  strprintf("Do not keep transactions in the mempool longer "
                            "than <n> hours (default: %u)",
@@ -551,6 +601,13 @@ void SetupServerArgs() {
             defaultChainParams->GetConsensus().nMinimumChainWork.GetHex(),
             testnetChainParams->GetConsensus().nMinimumChainWork.GetHex()),
         ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-mmapblockfiles",
+                 strprintf("Read blocks and undo data through memory mappings "
+                           "of the block files instead of reading the files. "
+                           "Has no effect on Windows and 32-bit systems "
+                           "(default: %d)",
+                           DEFAULT_MMAP_BLOCK_FILES),
+                 ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg(
         "-expire",
         strprintf(
@@ -567,6 +624,13 @@ void SetupServerArgs() {
                   MAX_ADDITIONAL_SCRIPTCHECK_THREADS + 1,
                   DEFAULT_SCRIPTCHECK_THREADS),
         ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-parallelconnect",
+                 strprintf("Check the input amounts, token rules and sequence "
+                           "locks of a block's transactions in parallel, using "
+                           "as many threads as -par, before applying them to "
+                           "the UTXO set (default: %d)",
+                           DEFAULT_PARALLEL_CONNECT),
+                 ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-parkdeepreorg",
                  strprintf("If connecting a new block would require rewinding "
                            "more than one block from the active chain (i.e., "
@@ -579,11 +643,24 @@ void SetupServerArgs() {
                            "on restart (default: %u)",
                            DEFAULT_PERSIST_MEMPOOL),
                  ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-persistmempoolmetadata",
+                 strprintf("Whether to also record the fee and sigchecks "
+                           "count of every transaction when saving the "
+                           "mempool. Such a file cannot be loaded by older "
+                           "versions of the node (default: %u)",
+                           DEFAULT_PERSIST_MEMPOOL_METADATA),
+                 ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-pid=<file>",
                  strprintf("Specify pid file. Relative paths will be prefixed "
                            "by a net-specific datadir location. (default: %s)",
                            BITCOIN_PID_FILENAME),
                  ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-prefetchblockinputs",
+                 strprintf("Look up the coins spent by a block in parallel, "
+                           "using as many threads as -par, before connecting "
+                           "it (default: %d)",
+                           DEFAULT_PREFETCH_BLOCK_INPUTS),
+                 ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg(
         "-prune=<n>",
         strprintf("Reduce storage requirements by enabling pruning (deleting) "
@@ -606,6 +683,12 @@ void SetupServerArgs() {
         "-reindex",
         "Rebuild chain state and block index from the blk*.dat files on disk",
         ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-reindexthreads=<n>",
+                 strprintf("Set the number of threads scanning block files "
+                           "during -reindex (up to %d, 0 = number of cores, "
+                           "default: %d)",
+                           MAX_REINDEX_THREADS, DEFAULT_REINDEX_THREADS),
+                 ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
 #ifndef WIN32
     gArgs.AddArg(
         "-sysperms",
@@ -719,6 +802,11 @@ void SetupServerArgs() {
                   "backward by this amount. (default: %u seconds)",
                   DEFAULT_MAX_TIME_ADJUSTMENT),
         ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
+    gArgs.AddArg("-msghandthreads=<n>",
+                 strprintf("Number of threads to process peer messages with, each serving a share of the peers "
+                           "(1 to %d, default: %d)",
+                           MAX_MSGHANDLER_THREADS, DEFAULT_MSGHANDLER_THREADS),
+                 ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
     gArgs.AddArg("-onion=<ip:port>",
                  strprintf("Use separate SOCKS5 proxy to reach peers via Tor onion services (default: %s)", "-proxy"),
                  ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
@@ -750,6 +838,10 @@ void SetupServerArgs() {
     gArgs.AddArg("-seednode=<ip>",
                  "Connect to a node to retrieve peer addresses, and disconnect",
                  ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
+    gArgs.AddArg("-socketevents=<mode>",
+                 strprintf("Socket events mode, which must be one of: %s (default: %s)",
+                           GetSupportedSocketEventsModes(), SocketEventsModeToString(DEFAULT_SOCKETEVENTS_MODE)),
+                 ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
     gArgs.AddArg("-timeout=<n>",
                  strprintf("Specify connection timeout in milliseconds "
                            "(minimum: 1, default: %d)",
@@ -1155,6 +1247,20 @@ void SetupServerArgs() {
                            "template_request object given to gbt. (default: %d)", DEFAULT_GBT_CHECK_VALIDITY),
                  ArgsManager::ALLOW_ANY, OptionsCategory::BLOCK_CREATION);
 
+    gArgs.AddArg("-gbtasyncvalidity",
+                 strprintf("Test new block templates for validity in the background after getblocktemplate and/or "
+                           "getblocktemplatelight have returned them, rather than before, if they are to be tested "
+                           "(see -gbtcheckvalidity). A template that fails the test is logged and replaced by the next "
+                           "call. (default: %d)", DEFAULT_GBT_ASYNC_VALIDITY),
+                 ArgsManager::ALLOW_ANY, OptionsCategory::BLOCK_CREATION);
+
+    gArgs.AddArg("-gbtincremental",
+                 strprintf("Keep the transactions of the next block up to date as transactions enter and leave the "
+                           "mempool once getblocktemplate and/or getblocktemplatelight have been called, so that new "
+                           "block templates need not select them from the whole mempool until the block is full. "
+                           "(default: %d)", DEFAULT_GBT_INCREMENTAL),
+                 ArgsManager::ALLOW_ANY, OptionsCategory::BLOCK_CREATION);
+
     gArgs.AddArg("-blockmintxfee=<amt>",
                  strprintf("Set lowest fee rate (in %s/kB) for transactions to "
                            "be included in block creation. (default: %s)",
@@ -1624,11 +1730,15 @@ bool AppInitParameterInteraction(Config &config) {
                 strprintf("Error creating index directory: %s", e.what()));
     }
 
-    // if using block pruning, then disallow txindex
+    // if using block pruning, then disallow txindex and coinstatsindex
     if (gArgs.GetArg("-prune", 0)) {
         if (gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX)) {
             return InitError(_("Prune mode is incompatible with -txindex."));
         }
+        if (gArgs.GetBoolArg("-coinstatsindex", DEFAULT_COINSTATSINDEX)) {
+            return InitError(
+                _("Prune mode is incompatible with -coinstatsindex."));
+        }
     }
 
     // -bind and -whitebind can't be set when not listening
@@ -1708,6 +1818,13 @@ bool AppInitParameterInteraction(Config &config) {
     fCheckBlockIndex = gArgs.GetBoolArg("-checkblockindex",
                                         chainparams.DefaultConsistencyChecks());
     fCheckBlockReads = gArgs.GetBoolArg("-checkblockreads", chainparams.DefaultConsistencyChecks());
+    // Mapping the block files takes more address space than 32-bit systems
+    // have to spare.
+    fMapBlockFiles = gArgs.GetBoolArg("-mmapblockfiles", DEFAULT_MMAP_BLOCK_FILES) && sizeof(void *) >= 8;
+    fPrefetchBlockInputs = gArgs.GetBoolArg("-prefetchblockinputs",
+                                            DEFAULT_PREFETCH_BLOCK_INPUTS);
+    fParallelConnect =
+        gArgs.GetBoolArg("-parallelconnect", DEFAULT_PARALLEL_CONNECT);
     fCheckpointsEnabled =
         gArgs.GetBoolArg("-checkpoints", DEFAULT_CHECKPOINTS_ENABLED);
     if (fCheckpointsEnabled) {
@@ -2270,6 +2387,12 @@ bool AppInitMain(Config &config, RPCServer &rpcServer,
         gArgs.GetBoolArg("-enablebip61", DEFAULT_ENABLE_BIP61), gArgs.GetBoolArg("-feefilter", DEFAULT_FEEFILTER)));
     RegisterValidationInterface(peerLogic.get());
 
+    if (gArgs.GetBoolArg("-gbtincremental", DEFAULT_GBT_INCREMENTAL)) {
+        assert(!g_block_template_tracker);
+        g_block_template_tracker = std::make_unique<BlockTemplateTracker>(config, ::g_mempool);
+        RegisterValidationInterface(g_block_template_tracker.get());
+    }
+
     // sanitize comments per BIP-0014, format user agent and check total size
     std::vector<std::string> uacomments;
     for (const std::string &cmt : gArgs.GetArgs("-uacomment")) {
@@ -2552,7 +2675,9 @@ bool AppInitMain(Config &config, RPCServer &rpcServer,
                 // useful block tree into mapBlockIndex!
 
                 pcoinsdbview.reset(new CCoinsViewDB(
-                    nCoinDBCache, false, fReset || fReindexChainState));
+                    nCoinDBCache, false, fReset || fReindexChainState,
+                    gArgs.GetBoolArg("-dbbackgroundflush",
+                                     DEFAULT_DB_BACKGROUND_FLUSH)));
                 pcoinscatcher.reset(
                     new CCoinsViewErrorCatcher(pcoinsdbview.get()));
 
@@ -2574,11 +2699,54 @@ bool AppInitMain(Config &config, RPCServer &rpcServer,
                     break;
                 }
 
+                // Populate an empty chainstate from a UTXO snapshot, if
+                // requested.
+                bool fLoadedSnapshot = false;
+                if (gArgs.IsArgSet("-loadutxosnapshot")) {
+                    if (!pcoinsdbview->GetBestBlock().IsNull()) {
+                        LogPrintf("Not loading a UTXO snapshot, the "
+                                  "chainstate is not empty\n");
+                    } else {
+                        const fs::path path = AbsPathForConfigVal(
+                            gArgs.GetArg("-loadutxosnapshot", ""));
+                        const std::string strHash =
+                            gArgs.GetArg("-loadutxosnapshothash", "");
+                        if (strHash.size() != 64 || !IsHex(strHash)) {
+                            return InitError(
+                                _("-loadutxosnapshot requires "
+                                  "-loadutxosnapshothash to be set to the "
+                                  "ECMultiSet hash of the snapshot."));
+                        }
+                        const uint256 hashExpected = uint256S(strHash);
+                        const std::string strBlock =
+                            gArgs.GetArg("-loadutxosnapshotblock", "");
+                        if (!strBlock.empty() &&
+                            (strBlock.size() != 64 || !IsHex(strBlock))) {
+                            return InitError(
+                                _("-loadutxosnapshotblock must be the hash "
+                                  "of the base block of the snapshot."));
+                        }
+                        const BlockHash hashBaseExpected(uint256S(strBlock));
+                        if (!LoadUTXOSnapshot(path, *pcoinsdbview, config,
+                                              hashExpected,
+                                              hashBaseExpected)) {
+                            return InitError(strprintf(
+                                _("Unable to load UTXO snapshot %s, see "
+                                  "debug.log for details. Restart with "
+                                  "-reindex-chainstate to rebuild the "
+                                  "chainstate."),
+                                path.string()));
+                        }
+                        fLoadedSnapshot = true;
+                    }
+                }
+
                 // The on-disk coinsdb is now in a good state, create the cache
                 pcoinsTip.reset(new CCoinsViewCache(pcoinscatcher.get()));
 
-                bool is_coinsview_empty = fReset || fReindexChainState ||
-                                          pcoinsTip->GetBestBlock().IsNull();
+                bool is_coinsview_empty =
+                    pcoinsTip->GetBestBlock().IsNull() ||
+                    ((fReset || fReindexChainState) && !fLoadedSnapshot);
                 if (!is_coinsview_empty) {
                     // LoadChainTip sets ::ChainActive() based on pcoinsTip's
                     // best block
@@ -2675,6 +2843,13 @@ bool AppInitMain(Config &config, RPCServer &rpcServer,
         g_txindex->Start();
     }
 
+    if (gArgs.GetBoolArg("-coinstatsindex", DEFAULT_COINSTATSINDEX)) {
+        g_coin_stats_index =
+            std::make_unique<CoinStatsIndex>(/* cache size */ 0, false,
+                                             fReindex);
+        g_coin_stats_index->Start();
+    }
+
     // Step 9: load wallet
     for (const auto &client : node.chain_clients) {
         if (!client->load(chainparams)) {
@@ -2794,6 +2969,22 @@ bool AppInitMain(Config &config, RPCServer &rpcServer,
     connOptions.nMaxOutboundLimit = nMaxOutboundLimit;
     connOptions.m_peer_connect_timeout = peer_connect_timeout;
 
+    const int64_t nMessageHandlerThreads = gArgs.GetArg("-msghandthreads", DEFAULT_MSGHANDLER_THREADS);
+    if (nMessageHandlerThreads < 1 || nMessageHandlerThreads > MAX_MSGHANDLER_THREADS) {
+        return InitError(strprintf(_("Invalid -msghandthreads (%d), must be between 1 and %d"), nMessageHandlerThreads,
+                                   MAX_MSGHANDLER_THREADS));
+    }
+    connOptions.nMessageHandlerThreads = nMessageHandlerThreads;
+
+    const std::string strSocketEventsMode =
+        gArgs.GetArg("-socketevents", SocketEventsModeToString(DEFAULT_SOCKETEVENTS_MODE));
+    if (const auto mode = SocketEventsModeFromString(strSocketEventsMode)) {
+        connOptions.socketEventsMode = *mode;
+    } else {
+        return InitError(strprintf(_("Invalid -socketevents ('%s') specified. Only these modes are supported: %s"),
+                                   strSocketEventsMode, GetSupportedSocketEventsModes()));
+    }
+
     for (const std::string &bind_arg : gArgs.GetArgs("-bind")) {
         CService bind_addr;
         const size_t index = bind_arg.rfind('=');
@@ -45,6 +45,8 @@
 uint64_t nLastBlockTx = 0;
 uint64_t nLastBlockSize = 0;
 
+std::unique_ptr<BlockTemplateTracker> g_block_template_tracker;
+
 int64_t UpdateTime(CBlockHeader *pblock, const Consensus::Params &params,
                    const CBlockIndex *pindexPrev) {
     int64_t nOldTime = pblock->nTime;
@@ -179,7 +181,38 @@ BlockAssembler::CreateNewBlock(const CScript &scriptPubKeyIn, double timeLimitSe
         nAddTxsTimeLimit = nTimeStart + static_cast<int64_t>(addTxsFrac * timeLimitSecs * 1e6);
     }
 
-    addTxs(nAddTxsTimeLimit);
+    // Use the transactions tracked for the next block if they were selected with the same options for this tip,
+    // otherwise select them from the whole mempool and have them tracked from now on.
+    BlockTemplateTracker *const tracker =
+        !overrideOptions && g_block_template_tracker && &g_block_template_tracker->GetMemPool() == &mempool
+            ? g_block_template_tracker.get()
+            : nullptr;
+    const BlockTemplateTracker::Context trackerContext{pindexPrev, nMaxGeneratedBlockSize,
+                                                       nMaxGeneratedBlockSigChecks, blockMinFeeRate,
+                                                       nLockTimeCutoff};
+    std::vector<CTxMemPool::txiter> trackedTxs;
+    bool fUseTracked = tracker && tracker->GetTxs(trackerContext, trackedTxs);
+    if (fUseTracked) {
+        for (const CTxMemPool::txiter &iter : trackedTxs) {
+            // The tracked transactions fit in the block together, so any of them that are left do as well. Should
+            // they not, select the transactions from scratch rather than create an invalid block.
+            if (!TestTx(iter->GetTxSize(), iter->GetSigChecks())) {
+                LogPrintf("%s: the tracked transactions do not fit in the block, selecting them from the mempool\n",
+                          __func__);
+                pblocktemplate->entries.erase(pblocktemplate->entries.begin() + 1, pblocktemplate->entries.end());
+                resetBlock();
+                fUseTracked = false;
+                break;
+            }
+            AddToBlock(iter);
+        }
+    }
+    if (!fUseTracked) {
+        const bool fComplete = addTxs(nAddTxsTimeLimit);
+        if (tracker) {
+            tracker->Sync(trackerContext, pblocktemplate->entries, fComplete, fSkippedCheckTx);
+        }
+    }
 
     const int64_t nTime0 = GetTimeMicros();
 
@@ -315,7 +348,7 @@ bool BlockAssembler::CheckTx(const CTransaction &tx) const {
  *                         until all tx's in mempool are added, whichever is
  *                         smaller).
  */
-void BlockAssembler::addTxs(int64_t nLimitTimePoint) {
+bool BlockAssembler::addTxs(int64_t nLimitTimePoint) {
     using EntryPtrHasher = StdHashWrapper<const CTxMemPoolEntry *>;
     using ParentCountMap = std::unordered_map<const CTxMemPoolEntry *, size_t, EntryPtrHasher>;
     using ChildSet = std::unordered_set<const CTxMemPoolEntry *, EntryPtrHasher>;
@@ -363,9 +396,16 @@ void BlockAssembler::addTxs(int64_t nLimitTimePoint) {
     // being present in the block, but where a parent has now been added.
     std::queue<CTxMemPool::txiter> backlog;
 
+    // Whether every transaction that qualifies has been added so far
+    bool fComplete = true;
+    fSkippedCheckTx = false;
+
     CTxMemPool::txiter iter;
     auto mi = mempool.mapTx.get<modified_feerate>().begin();
-    while (!TimedOut() && (!backlog.empty() || mi != mempool.mapTx.get<modified_feerate>().end())) {
+    while (!backlog.empty() || mi != mempool.mapTx.get<modified_feerate>().end()) {
+        if (TimedOut()) {
+            return false;
+        }
 
         // Get a new or old transaction in mapTx to evaluate.
         bool isFromBacklog = false;
@@ -378,6 +418,8 @@ void BlockAssembler::addTxs(int64_t nLimitTimePoint) {
         }
 
         if (iter->GetModifiedFeeRate() < blockMinFeeRate) {
+            // A child from the backlog may pay less than transactions that are still to come.
+            fComplete = fComplete && !isFromBacklog;
             break;
         }
 
@@ -393,6 +435,7 @@ void BlockAssembler::addTxs(int64_t nLimitTimePoint) {
 
         // Check whether the tx will exceed the block limits.
         if (!TestTx(iter->GetTxSize(), iter->GetSigChecks())) {
+            fComplete = false;
             ++nConsecutiveFailed;
             if (nConsecutiveFailed > MAX_CONSECUTIVE_FAILURES && nBlockSize > nMaxGeneratedBlockSize - 1000) {
                 // Give up if we're close to full and haven't succeeded in a while.
@@ -403,6 +446,7 @@ void BlockAssembler::addTxs(int64_t nLimitTimePoint) {
 
         // Test transaction finality (locktime)
         if (!CheckTx(iter->GetTx())) {
+            fSkippedCheckTx = true;
             continue;
         }
 
@@ -430,6 +474,233 @@ void BlockAssembler::addTxs(int64_t nLimitTimePoint) {
             }
         }
     }
+    return fComplete;
+}
+
+bool BlockTemplateTracker::Context::operator==(const Context &other) const {
+    return pindexPrev == other.pindexPrev && nMaxGeneratedBlockSize == other.nMaxGeneratedBlockSize &&
+           nMaxGeneratedBlockSigChecks == other.nMaxGeneratedBlockSigChecks &&
+           blockMinFeeRate == other.blockMinFeeRate && nLockTimeCutoff == other.nLockTimeCutoff;
+}
+
+BlockTemplateTracker::BlockTemplateTracker(const Config &_config, const CTxMemPool &_mempool)
+    : config(_config), mempool(_mempool) {}
+
+void BlockTemplateTracker::ClearTracked() {
+    context.pindexPrev = nullptr;
+    fSynced = false;
+    mapTracked.clear();
+}
+
+void BlockTemplateTracker::EraseTracked(const TxId &txid) {
+    const auto it = mapTracked.find(txid);
+    if (it == mapTracked.end()) {
+        return;
+    }
+    nBlockSize -= it->second.nSize;
+    nBlockSigChecks -= it->second.nSigChecks;
+    mapTracked.erase(it);
+}
+
+BlockTemplateTracker::Context BlockTemplateTracker::GetContext(const CBlockIndex *pindexPrev) const {
+    static_assert(STANDARD_LOCKTIME_VERIFY_FLAGS & LOCKTIME_MEDIAN_TIME_PAST,
+                  "the lock time cutoff must only depend on pindexPrev");
+    BlockAssembler assembler(config, mempool);
+    assembler.readOptions(DefaultOptions(config, pindexPrev));
+    return Context{pindexPrev, assembler.nMaxGeneratedBlockSize, assembler.nMaxGeneratedBlockSigChecks,
+                   assembler.blockMinFeeRate, pindexPrev->GetMedianTimePast()};
+}
+
+bool BlockTemplateTracker::IsSyncedTo(const CBlockIndex *pindexPrev) const {
+    LOCK(cs);
+    return pindexPrev && context.pindexPrev == pindexPrev;
+}
+
+bool BlockTemplateTracker::GetTxs(const Context &_context, std::vector<CTxMemPool::txiter> &txs) const {
+    AssertLockHeld(mempool.cs);
+    LOCK(cs);
+    if (!context.pindexPrev || context != _context) {
+        return false;
+    }
+
+    // Transactions that left the mempool after they were last notified to us are gone, along with their
+    // descendants. Leave out any descendants that were added since as well, so that parents come first.
+    std::vector<std::pair<uint64_t, CTxMemPool::txiter>> candidates;
+    candidates.reserve(mapTracked.size());
+    for (const auto &[txid, tracked] : mapTracked) {
+        if (const auto iter = mempool.GetIter(txid)) {
+            candidates.emplace_back(tracked.nSequence, *iter);
+        }
+    }
+    std::sort(candidates.begin(), candidates.end(),
+              [](const auto &a, const auto &b) { return a.first < b.first; });
+
+    txs.clear();
+    txs.reserve(candidates.size());
+    CTxMemPool::setEntries setTxs;
+    for (const auto &candidate : candidates) {
+        const CTxMemPool::txiter &iter = candidate.second;
+        const CTxMemPool::Links &parents = mempool.GetMemPoolParents(iter);
+        if (std::all_of(parents.begin(), parents.end(),
+                        [&setTxs](const CTxMemPool::txiter &parent) { return setTxs.count(parent) > 0; })) {
+            setTxs.insert(iter);
+            txs.push_back(iter);
+        }
+    }
+    return true;
+}
+
+void BlockTemplateTracker::Sync(const Context &_context, const std::vector<CBlockTemplateEntry> &entries,
+                                bool fComplete, bool _fSkippedCheckTx) {
+    AssertLockHeld(mempool.cs);
+    LOCK(cs);
+    ClearTracked();
+    if (!fComplete) {
+        return;
+    }
+
+    // Reserve space for the coinbase, as BlockAssembler::resetBlock() does.
+    nBlockSize = 1000;
+    nBlockSigChecks = 100;
+    mapTracked.reserve(entries.size());
+    for (const CBlockTemplateEntry &entry : entries) {
+        if (!entry.tx) {
+            // The dummy coinbase
+            continue;
+        }
+        const auto iter = mempool.GetIter(entry.tx->GetId());
+        assert(iter);
+        const uint64_t nSize = (*iter)->GetTxSize();
+        mapTracked.emplace(entry.tx->GetId(), TrackedTx{nSize, entry.sigChecks, nNextSequence++});
+        nBlockSize += nSize;
+        nBlockSigChecks += entry.sigChecks;
+    }
+    context = _context;
+    fSkippedCheckTx = _fSkippedCheckTx;
+    fSynced = true;
+}
+
+void BlockTemplateTracker::MarkOutOfDate() {
+    LOCK(cs);
+    ClearTracked();
+}
+
+void BlockTemplateTracker::BlockConnected(const std::shared_ptr<const CBlock> &block, const CBlockIndex *pindex,
+                                          const std::vector<CTransactionRef> &txnConflicted) {
+    if (!fSynced) {
+        return;
+    }
+    // The limits for the next block only depend on the chain up to pindex, so neither cs_main nor the mempool lock
+    // is needed to carry the selection over.
+    const Context nextContext = GetContext(pindex);
+    LOCK(cs);
+    if (!context.pindexPrev || context.pindexPrev == pindex) {
+        // Out of date, or already selected for the new tip, e.g. by getblocktemplate before we were notified.
+        return;
+    }
+    if (context.pindexPrev != pindex->pprev || fSkippedCheckTx) {
+        ClearTracked();
+        return;
+    }
+    for (const CTransactionRef &ptx : block->vtx) {
+        EraseTracked(ptx->GetId());
+    }
+    for (const CTransactionRef &ptx : txnConflicted) {
+        EraseTracked(ptx->GetId());
+    }
+    if (nextContext.blockMinFeeRate != context.blockMinFeeRate ||
+        nBlockSize >= nextContext.nMaxGeneratedBlockSize ||
+        nBlockSigChecks >= nextContext.nMaxGeneratedBlockSigChecks) {
+        ClearTracked();
+        return;
+    }
+    context = nextContext;
+}
+
+void BlockTemplateTracker::UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *, bool) {
+    LOCK(cs);
+    if (context.pindexPrev == pindexNew) {
+        // Carried over by BlockConnected(), or already selected for the new tip.
+        return;
+    }
+    // The next block template selects the transactions for the new tip from scratch. Doing so here would hold
+    // cs_main on the validation interface thread for every new tip, whether or not a template is requested.
+    ClearTracked();
+}
+
+void BlockTemplateTracker::TransactionAddedToMempool(const CTransactionRef &ptx) {
+    if (!fSynced) {
+        // Nothing to keep up to date: the next Sync() selects this transaction, if it qualifies, from the mempool.
+        return;
+    }
+    LOCK2(mempool.cs, cs);
+    if (!context.pindexPrev || mapTracked.count(ptx->GetId())) {
+        return;
+    }
+    const auto iter = mempool.GetIter(ptx->GetId());
+    if (!iter) {
+        // Left the mempool already
+        return;
+    }
+
+    // Apply the criteria of BlockAssembler::addTxs().
+    if ((*iter)->GetModifiedFeeRate() < context.blockMinFeeRate) {
+        return;
+    }
+    for (const CTxMemPool::txiter &parent : mempool.GetMemPoolParents(*iter)) {
+        if (!mapTracked.count(parent->GetTx().GetId())) {
+            return;
+        }
+    }
+    CValidationState state;
+    if (!ContextualCheckTransaction(config.GetChainParams().GetConsensus(), *ptx, state,
+                                    context.pindexPrev->nHeight + 1, context.nLockTimeCutoff,
+                                    context.pindexPrev->GetMedianTimePast())) {
+        fSkippedCheckTx = true;
+        return;
+    }
+
+    const uint64_t nSize = (*iter)->GetTxSize();
+    const int64_t nSigChecks = (*iter)->GetSigChecks();
+    if (nBlockSize + nSize >= context.nMaxGeneratedBlockSize ||
+        nBlockSigChecks + nSigChecks >= context.nMaxGeneratedBlockSigChecks) {
+        // The block is full, and the selection depends on the feerates from now on.
+        ClearTracked();
+        return;
+    }
+    mapTracked.emplace(ptx->GetId(), TrackedTx{nSize, nSigChecks, nNextSequence++});
+    nBlockSize += nSize;
+    nBlockSigChecks += nSigChecks;
+}
+
+void BlockTemplateTracker::TransactionRemovedFromMempool(const CTransactionRef &ptx) {
+    LOCK(cs);
+    EraseTracked(ptx->GetId());
+}
+
+void TestBlockValidityAsync(const Config &config, std::shared_ptr<const CBlock> pblock, const CBlockIndex *pindexPrev,
+                            std::function<void(const CValidationState &state)> onInvalid) {
+    CallFunctionInValidationInterfaceQueue([&config, pblock = std::move(pblock), pindexPrev,
+                                            onInvalid = std::move(onInvalid)] {
+        const int64_t nTimeStart = GetTimeMicros();
+        CValidationState state;
+        {
+            LOCK(cs_main);
+            CBlockIndex *const tip = ::ChainActive().Tip();
+            if (tip != pindexPrev) {
+                return;
+            }
+            if (TestBlockValidity(state, config.GetChainParams(), *pblock, tip,
+                                  BlockValidationOptions(config).withCheckPoW(false).withCheckMerkleRoot(false))) {
+                LogPrint(BCLog::BENCH, "TestBlockValidityAsync(): %u txs: %.2fms\n", pblock->vtx.size(),
+                         0.001 * (GetTimeMicros() - nTimeStart));
+                return;
+            }
+        }
+        LogPrintf("ERROR: %s: block template %s is invalid: %s\n", __func__, pblock->GetHash().ToString(),
+                  FormatStateMessage(state));
+        onInvalid(state);
+    });
 }
 
 static
@@ -7,19 +7,27 @@
 #pragma once
 
 #include <primitives/block.h>
+#include <sync.h>
 #include <txmempool.h>
+#include <util/saltedhashers.h>
+#include <validationinterface.h>
 
 #include <boost/multi_index/ordered_index.hpp>
 #include <boost/multi_index_container.hpp>
 
+#include <atomic>
 #include <cstdint>
+#include <functional>
 #include <memory>
 #include <optional>
+#include <unordered_map>
+#include <vector>
 
 class CBlockIndex;
 class CChainParams;
 class Config;
 class CScript;
+class CValidationState;
 
 namespace Consensus {
 struct Params;
@@ -46,6 +54,8 @@ struct CBlockTemplate {
 
 /** Generate a new block, without valid proof-of-work */
 class BlockAssembler {
+    friend class BlockTemplateTracker;
+
 public:
     struct Options {
         Options();
@@ -77,6 +87,9 @@ private:
     int64_t nLockTimeCutoff{};
     int64_t nMedianTimePast{};
 
+    // Whether addTxs() left out a transaction that failed CheckTx()
+    bool fSkippedCheckTx{};
+
     const Config &config;
     const CTxMemPool &mempool;
     const CChainParams &chainparams;
@@ -128,8 +141,10 @@ private:
     // Methods for how to add transactions to a block.
     /**
      * Add transactions from the mempool based on individual tx feerate.
+     * Returns true if every transaction that qualifies was added, i.e. none
+     * was left out for not fitting and the time limit was not reached.
      */
-    void addTxs(int64_t nLimitTimePoint)
+    bool addTxs(int64_t nLimitTimePoint)
         EXCLUSIVE_LOCKS_REQUIRED(mempool.cs);
 
     // helper functions for addTxs()
@@ -140,6 +155,122 @@ private:
     bool CheckTx(const CTransaction &tx) const;
 };
 
+/**
+ * The transactions of the next block, kept up to date as transactions enter
+ * and leave the mempool, so that CreateNewBlock() need not select them from
+ * the whole mempool again for every block template.
+ *
+ * CreateNewBlock() hands it the transactions it selected from scratch for a
+ * tip. From then on, every transaction added to the mempool that qualifies for
+ * the block, whose in-mempool parents are in the block and that fits in it is
+ * added as well, and transactions that leave the mempool are dropped. As long
+ * as no transaction was left out for not fitting, this is the same selection
+ * CreateNewBlock() would make from scratch, which it then uses instead. A
+ * transaction that does not fit or a change in the fee deltas makes it out of
+ * date, until the next CreateNewBlock() selects from scratch again.
+ *
+ * When a block is connected on top of the tracked tip, the selection carries
+ * over to the new tip without the transactions of the block and those that
+ * conflict with it: every transaction left qualified before and still does,
+ * as long as the limits of the block still hold them all and none was left
+ * out for failing the contextual checks, which may pass on the new tip. Any
+ * other new tip makes the tracker out of date.
+ *
+ * Notifications are processed asynchronously, so the tracked transactions may
+ * lag behind the mempool. Those that left it are filtered out when they are
+ * handed to CreateNewBlock().
+ */
+class BlockTemplateTracker final : public CValidationInterface {
+public:
+    /** What the selection of the transactions depends on besides the mempool. */
+    struct Context {
+        const CBlockIndex *pindexPrev{};
+        uint64_t nMaxGeneratedBlockSize{};
+        uint64_t nMaxGeneratedBlockSigChecks{};
+        CFeeRate blockMinFeeRate;
+        int64_t nLockTimeCutoff{};
+
+        bool operator==(const Context &other) const;
+        bool operator!=(const Context &other) const { return !(*this == other); }
+    };
+
+    /// Invariant: `_config` and `_mempool` must outlive this instance.
+    BlockTemplateTracker(const Config &_config, const CTxMemPool &_mempool);
+
+    const CTxMemPool &GetMemPool() const { return mempool; }
+
+    /** Whether the tracked transactions are up to date and were selected for a block on `pindexPrev`. */
+    bool IsSyncedTo(const CBlockIndex *pindexPrev) const LOCKS_EXCLUDED(cs);
+
+    /**
+     * Get the tracked transactions that are still in the mempool, parents first, if they were selected with
+     * `context`. Returns false if they were not or are out of date.
+     */
+    bool GetTxs(const Context &context, std::vector<CTxMemPool::txiter> &txs) const
+        EXCLUSIVE_LOCKS_REQUIRED(mempool.cs) LOCKS_EXCLUDED(cs);
+
+    /**
+     * Track the transactions (other than the coinbase) of `entries`, which were selected from the mempool with
+     * `context`. `fComplete` says whether all transactions that qualify were selected, `fSkippedCheckTx` whether
+     * any was left out for failing the contextual checks.
+     */
+    void Sync(const Context &context, const std::vector<CBlockTemplateEntry> &entries, bool fComplete,
+              bool fSkippedCheckTx) EXCLUSIVE_LOCKS_REQUIRED(mempool.cs) LOCKS_EXCLUDED(cs);
+
+    /** Mark the tracked transactions out of date, e.g. because fee deltas changed. */
+    void MarkOutOfDate() LOCKS_EXCLUDED(cs);
+
+protected:
+    void BlockConnected(const std::shared_ptr<const CBlock> &block, const CBlockIndex *pindex,
+                        const std::vector<CTransactionRef> &txnConflicted) override;
+    void UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload) override;
+    void TransactionAddedToMempool(const CTransactionRef &ptx) override;
+    void TransactionRemovedFromMempool(const CTransactionRef &ptx) override;
+
+private:
+    /** The resources a tracked transaction takes in the block, and the order in which it was tracked. */
+    struct TrackedTx {
+        uint64_t nSize;
+        int64_t nSigChecks;
+        uint64_t nSequence;
+    };
+
+    void ClearTracked() EXCLUSIVE_LOCKS_REQUIRED(cs);
+    void EraseTracked(const TxId &txid) EXCLUSIVE_LOCKS_REQUIRED(cs);
+    /** The context CreateNewBlock() selects the transactions of a block on `pindexPrev` with. */
+    Context GetContext(const CBlockIndex *pindexPrev) const;
+
+    const Config &config;
+    const CTxMemPool &mempool;
+
+    mutable Mutex cs;
+    //! The selection context of the tracked transactions, whose pindexPrev is nullptr if they are out of date
+    Context context GUARDED_BY(cs);
+    //! Whether context.pindexPrev is set, readable without taking cs
+    std::atomic<bool> fSynced{false};
+    //! Whether a transaction that qualified otherwise failed the contextual checks since the last Sync()
+    bool fSkippedCheckTx GUARDED_BY(cs){};
+    std::unordered_map<TxId, TrackedTx, SaltedTxIdHasher> mapTracked GUARDED_BY(cs);
+    //! The size and sigchecks of the block, including those reserved for the coinbase
+    uint64_t nBlockSize GUARDED_BY(cs){};
+    uint64_t nBlockSigChecks GUARDED_BY(cs){};
+    //! The nSequence of the next tracked transaction, which keeps parents before their children
+    uint64_t nNextSequence GUARDED_BY(cs){};
+};
+
+/**
+ * Tracks the transactions of the next block for CreateNewBlock() on g_mempool if not nullptr (see -gbtincremental).
+ */
+extern std::unique_ptr<BlockTemplateTracker> g_block_template_tracker;
+
+/**
+ * Test the validity of a block template built on `pindexPrev` asynchronously, on the validation interface queue, and
+ * call `onInvalid` there with the reason if it is not valid. Nothing is tested if `pindexPrev` is no longer the tip by
+ * then, since the template is stale anyway.
+ */
+void TestBlockValidityAsync(const Config &config, std::shared_ptr<const CBlock> pblock, const CBlockIndex *pindexPrev,
+                            std::function<void(const CValidationState &state)> onInvalid);
+
 /** Modify the extranonce in a block */
 void IncrementExtraNonce(CBlock *pblock, const CBlockIndex *pindexPrev, const Config &config,
                          unsigned int &nExtraNonce);
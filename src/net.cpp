@@ -33,13 +33,19 @@
 #include <cstring>
 #else
 #include <fcntl.h>
+#include <sys/uio.h>
 #endif
 
 #ifdef USE_POLL
 #include <poll.h>
 #endif
 
+#ifdef USE_EPOLL
+#include <sys/epoll.h>
+#endif
+
 #include <algorithm>
+#include <array>
 #include <cmath>
 #include <limits>
 #include <optional>
@@ -81,6 +87,23 @@ enum BindFlags {
 // The sleep time needs to be small to avoid new sockets stalling
 static const uint64_t SELECT_TIMEOUT_MILLISECONDS = 50;
 
+// Maximum number of events returned by one epoll_wait() call. Any further
+// events are returned by the next call.
+static constexpr int EPOLL_MAX_EVENTS = 256;
+// The epoll event data of peer sockets is their NodeId, which is never
+// negative. Listening sockets and the wakeup pipe are told apart by setting
+// the highest bit.
+static constexpr uint64_t EPOLL_TAG_LISTEN = uint64_t(1) << 63;
+static constexpr uint64_t EPOLL_TAG_WAKEUP = std::numeric_limits<uint64_t>::max();
+
+// Maximum number of buffers (message headers and payloads) handed to the
+// socket by one call. Windows sends one buffer at a time.
+#ifdef WIN32
+static constexpr size_t MAX_SEND_BUFFERS = 1;
+#else
+static constexpr size_t MAX_SEND_BUFFERS = 64;
+#endif
+
 const static std::string NET_MESSAGE_TYPE_OTHER = "*other*";
 
 // SHA256("netgroup")[0:8]
@@ -89,6 +112,46 @@ static const uint64_t RANDOMIZER_ID_NETGROUP = 0x6c0edd8036ef4036ULL;
 static const uint64_t RANDOMIZER_ID_LOCALHOSTNONCE = 0xd93e69e2bbfa5735ULL;
 // SHA256("addrcache")[0:8]
 static const uint64_t RANDOMIZER_ID_ADDRCACHE = 0x1cf2e4ddd306dda9ULL;
+std::optional<SocketEventsMode> SocketEventsModeFromString(const std::string &str) {
+#ifdef USE_EPOLL
+    if (str == "epoll") {
+        return SocketEventsMode::EPoll;
+    }
+#endif
+#ifdef USE_POLL
+    if (str == "poll") {
+        return SocketEventsMode::Poll;
+    }
+#else
+    if (str == "select") {
+        return SocketEventsMode::Select;
+    }
+#endif
+    return std::nullopt;
+}
+
+std::string SocketEventsModeToString(SocketEventsMode mode) {
+    switch (mode) {
+        case SocketEventsMode::Select:
+            return "select";
+        case SocketEventsMode::Poll:
+            return "poll";
+        case SocketEventsMode::EPoll:
+            return "epoll";
+    }
+    assert(false);
+}
+
+std::string GetSupportedSocketEventsModes() {
+#if defined(USE_EPOLL)
+    return "epoll, poll";
+#elif defined(USE_POLL)
+    return "poll";
+#else
+    return "select";
+#endif
+}
+
 //
 // Global state variables
 //
@@ -583,6 +646,64 @@ static bool IsOversizedMessage(const Config &config, const CNetMessage &msg) {
     return msg.hdr.IsOversized(config);
 }
 
+CSharedNetMsgPayload::CSharedNetMsgPayload(std::vector<uint8_t> &&dataIn)
+    : data(std::move(dataIn)), hash(Hash(data)) {}
+
+RecvBufferPool::Buffer RecvBufferPool::Acquire(size_t nSize) {
+    if (nSize < MIN_POOLED_SIZE) {
+        return {};
+    }
+
+    LOCK(cs);
+    auto it = buffers.lower_bound(nSize);
+    if (it == buffers.end() || it->first / 2 > nSize) {
+        return {};
+    }
+    Buffer buf = std::move(it->second);
+    nPooledBytes -= it->first;
+    buffers.erase(it);
+    return buf;
+}
+
+void RecvBufferPool::Release(Buffer &&buf) {
+    const size_t nCapacity = buf.capacity();
+    if (nCapacity < MIN_POOLED_SIZE) {
+        return;
+    }
+
+    buf.clear();
+    LOCK(cs);
+    if (buffers.size() >= MAX_POOLED_BUFFERS ||
+        nPooledBytes + nCapacity > MAX_POOLED_BYTES) {
+        return;
+    }
+    buffers.emplace(nCapacity, std::move(buf));
+    nPooledBytes += nCapacity;
+}
+
+size_t RecvBufferPool::GetPooledBuffers() const {
+    LOCK(cs);
+    return buffers.size();
+}
+
+size_t RecvBufferPool::GetPooledBytes() const {
+    LOCK(cs);
+    return nPooledBytes;
+}
+
+RecvBufferPool &GetRecvBufferPool() {
+    static RecvBufferPool pool;
+    return pool;
+}
+
+Span<char> CNode::GetRecvMsgWindow() {
+    if (vRecvMsg.empty() || !vRecvMsg.back().in_data ||
+        vRecvMsg.back().complete()) {
+        return {};
+    }
+    return vRecvMsg.back().GetDataWindow();
+}
+
 bool CNode::ReceiveMsgBytes(const Config &config, const char *pch,
                             uint32_t nBytes, bool &complete) {
     complete = false;
@@ -695,26 +816,48 @@ int CNetMessage::readHeader(const Config &config, const char *pch,
     // switch state to reading message data
     in_data = true;
 
+    // Read the payload into a pooled buffer
+    RecvBufferPool::Buffer buf = GetRecvBufferPool().Acquire(hdr.nMessageSize);
+    vRecv.SwapBuffer(buf);
+
     return nCopy;
 }
 
-int CNetMessage::readData(const char *pch, uint32_t nBytes) {
-    unsigned int nRemaining = hdr.nMessageSize - nDataPos;
-    unsigned int nCopy = std::min(nRemaining, nBytes);
+CNetMessage::~CNetMessage() {
+    RecvBufferPool::Buffer buf;
+    vRecv.SwapBuffer(buf);
+    GetRecvBufferPool().Release(std::move(buf));
+}
 
-    if (vRecv.size() < nDataPos + nCopy) {
+void CNetMessage::ReserveData(uint32_t nBytes) {
+    if (vRecv.size() < nDataPos + nBytes) {
         // Allocate up to 256 KiB ahead, but never more than the total message
         // size.
-        vRecv.resize(std::min(hdr.nMessageSize, nDataPos + nCopy + 256 * 1024));
+        vRecv.resize(std::min(hdr.nMessageSize, nDataPos + nBytes + 256 * 1024));
     }
+}
+
+int CNetMessage::readData(const char *pch, uint32_t nBytes) {
+    unsigned int nRemaining = hdr.nMessageSize - nDataPos;
+    unsigned int nCopy = std::min(nRemaining, nBytes);
+
+    ReserveData(nCopy);
 
     hasher.Write({UInt8Cast(pch), nCopy});
-    memcpy(&vRecv[nDataPos], pch, nCopy);
+    // The bytes may have been received into GetDataWindow() already
+    if (pch != &vRecv[nDataPos]) {
+        memcpy(&vRecv[nDataPos], pch, nCopy);
+    }
     nDataPos += nCopy;
 
     return nCopy;
 }
 
+Span<char> CNetMessage::GetDataWindow() {
+    ReserveData(std::min<uint32_t>(hdr.nMessageSize - nDataPos, 256 * 1024));
+    return {&vRecv[nDataPos], vRecv.size() - nDataPos};
+}
+
 const uint256 &CNetMessage::GetMessageHash() const {
     assert(complete());
     if (data_hash.IsNull()) {
@@ -726,7 +869,6 @@ const uint256 &CNetMessage::GetMessageHash() const {
 size_t CConnman::SocketSendData(CNode *pnode) const
     EXCLUSIVE_LOCKS_REQUIRED(pnode->cs_vSend) {
     size_t nSentSize = 0;
-    size_t nMsgCount = 0;
     // Note that on win32 the send() function takes and returns 32-bit int lengths, even on a 64-bit build, whereas on
     // Unix it takes and returns a ssize_t. We abstract these differences away here, in order to have this code support
     // >2GiB msg sizes even on win32.
@@ -738,26 +880,56 @@ size_t CConnman::SocketSendData(CNode *pnode) const
     static_assert(std::numeric_limits<size_t>::max() >= static_cast<USendSizeT>(std::numeric_limits<SendSizeT>::max()),
                   "SendSizeT's maximum value must fit into a size_t");
 
-    for (const auto &data : pnode->vSendMsg) {
-        assert(data.size() > pnode->nSendOffset);
-        SendSizeT nBytes = 0;
+    while (!pnode->vSendMsg.empty()) {
+        // Gather the unsent parts of the queued messages, so that they are
+        // handed to the socket in one call, without copying them together.
+        std::array<Span<const uint8_t>, MAX_SEND_BUFFERS> buffers;
+        size_t nBuffers = 0;
+        size_t nToSend = 0;
+        size_t nSkip = pnode->nSendOffset;
+        for (const auto &msg : pnode->vSendMsg) {
+            for (const Span<const uint8_t> buffer : {Span<const uint8_t>{msg.header}, msg.GetPayload()}) {
+                if (nBuffers == buffers.size()) {
+                    break;
+                }
+                if (nSkip >= buffer.size()) {
+                    nSkip -= buffer.size();
+                    continue;
+                }
+                buffers[nBuffers++] = buffer.subspan(nSkip);
+                nToSend += buffer.size() - nSkip;
+                nSkip = 0;
+            }
+            if (nBuffers == buffers.size()) {
+                break;
+            }
+        }
+        assert(nBuffers > 0);
 
+        SendSizeT nBytes = 0;
         {
             LOCK(pnode->cs_hSocket);
             if (pnode->hSocket == INVALID_SOCKET) {
                 break;
             }
 
+#ifdef WIN32
             // Ensure we don't overflow SendSizeT (2GiB on win32). If the message exceeds SendSizeT on win32, we will
             // just send it in two parts.
-            const SendSizeT bytesToSend = std::min<size_t>(data.size() - pnode->nSendOffset,
-                                                           std::numeric_limits<SendSizeT>::max());
-
-            nBytes = send(pnode->hSocket,
-                          reinterpret_cast<const char *>(data.data()) +
-                              pnode->nSendOffset,
-                          bytesToSend,
+            nToSend = std::min<size_t>(nToSend, std::numeric_limits<SendSizeT>::max());
+            nBytes = send(pnode->hSocket, reinterpret_cast<const char *>(buffers[0].data()), nToSend,
                           MSG_NOSIGNAL | MSG_DONTWAIT);
+#else
+            std::array<iovec, MAX_SEND_BUFFERS> iov;
+            for (size_t i = 0; i < nBuffers; ++i) {
+                iov[i].iov_base = const_cast<uint8_t *>(buffers[i].data());
+                iov[i].iov_len = buffers[i].size();
+            }
+            msghdr hdr{};
+            hdr.msg_iov = iov.data();
+            hdr.msg_iovlen = nBuffers;
+            nBytes = sendmsg(pnode->hSocket, &hdr, MSG_NOSIGNAL | MSG_DONTWAIT);
+#endif
         }
 
         if (nBytes == 0) {
@@ -780,21 +952,24 @@ size_t CConnman::SocketSendData(CNode *pnode) const
         assert(nBytes > 0);
         pnode->nLastSend = GetSystemTimeInSeconds();
         pnode->nSendBytes += nBytes;
-        pnode->nSendOffset += nBytes;
         nSentSize += nBytes;
-        if (pnode->nSendOffset != data.size()) {
-            // could not send full message; stop sending more
-            break;
-        }
 
-        pnode->nSendOffset = 0;
-        pnode->nSendSize -= data.size();
+        // Drop the messages that were sent completely
+        pnode->nSendOffset += nBytes;
+        while (!pnode->vSendMsg.empty() &&
+               pnode->nSendOffset >= pnode->vSendMsg.front().size()) {
+            const size_t nMsgSize = pnode->vSendMsg.front().size();
+            pnode->nSendOffset -= nMsgSize;
+            pnode->nSendSize -= nMsgSize;
+            pnode->vSendMsg.pop_front();
+        }
         pnode->fPauseSend = pnode->nSendSize > nSendBufferMaxSize;
-        nMsgCount++;
-    }
 
-    pnode->vSendMsg.erase(pnode->vSendMsg.begin(),
-                          pnode->vSendMsg.begin() + nMsgCount);
+        if (USendSizeT(nBytes) != nToSend) {
+            // could not send everything; stop sending more
+            break;
+        }
+    }
 
     if (pnode->vSendMsg.empty()) {
         assert(pnode->nSendOffset == 0);
@@ -1113,6 +1288,7 @@ void CConnman::AcceptConnection(const ListenSocket &hListenSocket) {
 
     {
         LOCK(cs_vNodes);
+        RegisterSocketEvents(pnode);
         vNodes.push_back(pnode);
     }
 }
@@ -1164,6 +1340,7 @@ void CConnman::DisconnectNodes() {
                 // remove from vNodes
                 vNodes.erase(remove(vNodes.begin(), vNodes.end(), pnode),
                              vNodes.end());
+                mapEpollNodes.erase(pnode->GetId());
 
                 // release outbound grant (if any)
                 pnode->grantOutbound.Release();
@@ -1254,6 +1431,12 @@ bool CConnman::GenerateSelectSet(std::set<SOCKET> &recv_set, std::set<SOCKET> &s
         recv_set.insert(hListenSocket.socket);
     }
 
+#ifndef WIN32
+    if (wakeupPipe[0] != -1) {
+        recv_set.insert(wakeupPipe[0]);
+    }
+#endif
+
     {
         LOCK(cs_vNodes);
         for (CNode *pnode : vNodes) {
@@ -1413,13 +1596,185 @@ void CConnman::SocketEvents(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_s
 }
 #endif
 
+void CConnman::SocketEventsEpoll(std::set<SOCKET> &recv_set) {
+#ifdef USE_EPOLL
+    std::array<epoll_event, EPOLL_MAX_EVENTS> events;
+    const int timeout = fSocketWorkPending ? 0 : SELECT_TIMEOUT_MILLISECONDS;
+    const int nEvents = epoll_wait(epollfd, events.data(), events.size(), timeout);
+
+    if (interruptNet) {
+        return;
+    }
+
+    if (nEvents < 0) {
+        if (errno != EINTR) {
+            LogPrintf("socket epoll_wait error %s\n", NetworkErrorString(errno));
+            interruptNet.sleep_for(std::chrono::milliseconds(SELECT_TIMEOUT_MILLISECONDS));
+        }
+        return;
+    }
+
+    LOCK(cs_vNodes);
+    for (int i = 0; i < nEvents; ++i) {
+        const uint64_t tag = events[i].data.u64;
+        if (tag == EPOLL_TAG_WAKEUP) {
+            DrainWakeupPipe();
+        } else if (tag & EPOLL_TAG_LISTEN) {
+            recv_set.insert(vhListenSocket.at(tag & ~EPOLL_TAG_LISTEN).socket);
+        } else {
+            auto it = mapEpollNodes.find(NodeId(tag));
+            if (it == mapEpollNodes.end()) {
+                // Stale event of a peer that was disconnected already
+                continue;
+            }
+            CNode *pnode = it->second;
+            if (events[i].events & EPOLLIN) {
+                pnode->fHasRecvData = true;
+            }
+            if (events[i].events & EPOLLOUT) {
+                pnode->fCanSendData = true;
+            }
+            if (events[i].events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP)) {
+                pnode->fHasSocketError = true;
+            }
+        }
+    }
+#else
+    // -socketevents=epoll is rejected on platforms without epoll
+    assert(false);
+#endif
+}
+
+void CConnman::RegisterSocketEvents(CNode *pnode) {
+#ifdef USE_EPOLL
+    if (epollfd == -1) {
+        return;
+    }
+
+    LOCK(pnode->cs_hSocket);
+    if (pnode->hSocket == INVALID_SOCKET) {
+        return;
+    }
+
+    // The socket stays registered for both directions until it is closed.
+    // Being edge-triggered, epoll only reports when the socket becomes
+    // readable or writable, and the socket handler remembers that in the
+    // CNode until it has read everything or filled the send buffer.
+    epoll_event event{};
+    event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    event.data.u64 = uint64_t(pnode->GetId());
+    if (epoll_ctl(epollfd, EPOLL_CTL_ADD, pnode->hSocket, &event) != 0) {
+        LogPrintf("socket epoll_ctl error %s, dropping peer=%d\n", NetworkErrorString(errno), pnode->GetId());
+        pnode->fDisconnect = true;
+        return;
+    }
+    mapEpollNodes.emplace(pnode->GetId(), pnode);
+#endif
+}
+
+bool CConnman::InitSocketEvents() {
+#ifndef WIN32
+    // The pipe is kept until destruction, as other threads may still call
+    // WakeSocketHandler() after Stop().
+    if (wakeupPipe[0] == -1 && pipe(wakeupPipe) != 0) {
+        LogPrintf("Failed to create the socket handler wakeup pipe: %s\n", NetworkErrorString(errno));
+        wakeupPipe[0] = wakeupPipe[1] = -1;
+        return false;
+    }
+    for (int fd : wakeupPipe) {
+        if (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK) == -1 ||
+            fcntl(fd, F_SETFD, FD_CLOEXEC) == -1) {
+            LogPrintf("Failed to set up the socket handler wakeup pipe: %s\n", NetworkErrorString(errno));
+            return false;
+        }
+    }
+#endif
+
+#ifdef USE_EPOLL
+    if (socketEventsMode == SocketEventsMode::EPoll) {
+        epollfd = epoll_create1(EPOLL_CLOEXEC);
+        if (epollfd == -1) {
+            LogPrintf("Failed to create epoll instance: %s\n", NetworkErrorString(errno));
+            return false;
+        }
+
+        // Listening sockets and the wakeup pipe are level-triggered, as the
+        // socket handler accepts at most one connection per listening socket
+        // and iteration.
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.u64 = EPOLL_TAG_WAKEUP;
+        if (epoll_ctl(epollfd, EPOLL_CTL_ADD, wakeupPipe[0], &event) != 0) {
+            LogPrintf("socket epoll_ctl error %s\n", NetworkErrorString(errno));
+            return false;
+        }
+        for (size_t i = 0; i < vhListenSocket.size(); ++i) {
+            event.data.u64 = EPOLL_TAG_LISTEN | i;
+            if (epoll_ctl(epollfd, EPOLL_CTL_ADD, vhListenSocket[i].socket, &event) != 0) {
+                LogPrintf("socket epoll_ctl error %s\n", NetworkErrorString(errno));
+                return false;
+            }
+        }
+    }
+#endif
+
+    LogPrintf("Using %s for socket events\n", SocketEventsModeToString(socketEventsMode));
+    return true;
+}
+
+void CConnman::ShutdownSocketEvents() {
+    LOCK(cs_vNodes);
+    mapEpollNodes.clear();
+#ifdef USE_EPOLL
+    if (epollfd != -1) {
+        close(epollfd);
+        epollfd = -1;
+    }
+#endif
+}
+
+void CConnman::DrainWakeupPipe() {
+#ifndef WIN32
+    char buf[128];
+    while (read(wakeupPipe[0], buf, sizeof(buf)) > 0) {
+    }
+#endif
+}
+
+void CConnman::WakeSocketHandler() {
+#ifndef WIN32
+    if (wakeupPipe[1] == -1 || !wakeupSocketHandlerNeeded.exchange(false)) {
+        return;
+    }
+    const char byte = 0;
+    // Nothing to do if this fails because the pipe is full, the socket
+    // handler has yet to read the earlier wakeups.
+    [[maybe_unused]] const auto nWritten = write(wakeupPipe[1], &byte, 1);
+#endif
+}
+
 void CConnman::SocketHandler()
 {
     std::set<SOCKET> recv_set, send_set, error_set;
-    SocketEvents(recv_set, send_set, error_set);
+    if (socketEventsMode == SocketEventsMode::EPoll) {
+        SocketEventsEpoll(recv_set);
+    } else {
+        SocketEvents(recv_set, send_set, error_set);
+    }
 
     if (interruptNet) return;
 
+#ifndef WIN32
+    if (wakeupPipe[0] != -1 && recv_set.count(wakeupPipe[0]) > 0) {
+        DrainWakeupPipe();
+    }
+#endif
+
+    // From here on, anything that makes a peer socket worth servicing again
+    // (see WakeSocketHandler()) must interrupt the next wait for events, as
+    // that may come too late to be seen below.
+    wakeupSocketHandlerNeeded = true;
+
     //
     // Accept new connections
     //
@@ -1440,41 +1795,65 @@ void CConnman::SocketHandler()
             pnode->AddRef();
         }
     }
+    fSocketWorkPending = false;
     for (CNode *pnode : vNodesCopy) {
         if (interruptNet) {
             return;
         }
 
-        //
-        // Receive
-        //
-        bool recvSet = false;
-        bool sendSet = false;
-        bool errorSet = false;
-        {
+        if (socketEventsMode != SocketEventsMode::EPoll) {
             LOCK(pnode->cs_hSocket);
             if (pnode->hSocket == INVALID_SOCKET) {
                 continue;
             }
-            recvSet = recv_set.count(pnode->hSocket) > 0;
-            sendSet = send_set.count(pnode->hSocket) > 0;
-            errorSet = error_set.count(pnode->hSocket) > 0;
+            pnode->fHasRecvData = recv_set.count(pnode->hSocket) > 0;
+            pnode->fCanSendData = send_set.count(pnode->hSocket) > 0;
+            pnode->fHasSocketError = error_set.count(pnode->hSocket) > 0;
         }
-        if (recvSet || errorSet) {
+
+        // Same policy as in GenerateSelectSet(): drain the send buffer before
+        // receiving more, and do not receive while the process queue is full.
+        // Socket errors are always looked at.
+        bool fPendingSend;
+        {
+            LOCK(pnode->cs_vSend);
+            fPendingSend = !pnode->vSendMsg.empty();
+        }
+        const bool recvSet = pnode->fHasSocketError ||
+                             (pnode->fHasRecvData && !pnode->fPauseRecv && !fPendingSend);
+        const bool sendSet = pnode->fCanSendData && fPendingSend;
+
+        //
+        // Receive
+        //
+        if (recvSet) {
             // typical socket buffer is 8K-64K
             char pchBuf[0x10000];
+            // Receive the rest of a large payload straight into the message
+            // buffer. Headers and small messages go through pchBuf, so that
+            // several of them can be read at once.
+            Span<char> buf = pnode->GetRecvMsgWindow();
+            if (buf.size() < sizeof(pchBuf)) {
+                buf = pchBuf;
+            }
             int32_t nBytes = 0;
             {
                 LOCK(pnode->cs_hSocket);
                 if (pnode->hSocket == INVALID_SOCKET) {
                     continue;
                 }
-                nBytes =
-                    recv(pnode->hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
+                nBytes = recv(pnode->hSocket, buf.data(), buf.size(),
+                              MSG_DONTWAIT);
             }
             if (nBytes > 0) {
+                if (size_t(nBytes) < buf.size()) {
+                    // Read all there was. Edge-triggered epoll reports the
+                    // next data to arrive.
+                    pnode->fHasRecvData = false;
+                }
                 bool notify = false;
-                if (!pnode->ReceiveMsgBytes(*config, pchBuf, nBytes, notify)) {
+                if (!pnode->ReceiveMsgBytes(*config, buf.data(), nBytes,
+                                            notify)) {
                     pnode->CloseSocketDisconnect();
                 }
                 RecordBytesRecv(nBytes);
@@ -1497,7 +1876,7 @@ void CConnman::SocketHandler()
                         pnode->fPauseRecv =
                             pnode->nProcessQueueSize > nReceiveFloodSize;
                     }
-                    WakeMessageHandler();
+                    WakeMessageHandler(*pnode);
                 }
             } else if (nBytes == 0) {
                 // socket closed gracefully
@@ -1515,6 +1894,9 @@ void CConnman::SocketHandler()
                                   NetworkErrorString(nErr));
                     }
                     pnode->CloseSocketDisconnect();
+                } else if (nErr == WSAEWOULDBLOCK) {
+                    pnode->fHasRecvData = false;
+                    pnode->fHasSocketError = false;
                 }
             }
         }
@@ -1528,9 +1910,21 @@ void CConnman::SocketHandler()
             if (nBytes) {
                 RecordBytesSent(nBytes);
             }
+            fPendingSend = !pnode->vSendMsg.empty();
+            if (fPendingSend) {
+                // The rest did not fit into the socket's send buffer.
+                // Edge-triggered epoll reports when there is space again.
+                pnode->fCanSendData = false;
+            }
         }
 
         InactivityCheck(pnode);
+
+        if (!pnode->fDisconnect &&
+            (pnode->fHasSocketError || (pnode->fHasRecvData && !pnode->fPauseRecv && !fPendingSend) ||
+             (pnode->fCanSendData && fPendingSend))) {
+            fSocketWorkPending = true;
+        }
     }
     {
         LOCK(cs_vNodes);
@@ -1549,11 +1943,26 @@ void CConnman::ThreadSocketHandler() {
 }
 
 void CConnman::WakeMessageHandler() {
+    for (MessageHandlerShard &shard : msgHandlerShards) {
+        {
+            LOCK(shard.mutexMsgProc);
+            shard.fMsgProcWake = true;
+        }
+        shard.condMsgProc.notify_one();
+    }
+}
+
+void CConnman::WakeMessageHandler(const CNode &node) {
+    MessageHandlerShard &shard = msgHandlerShards[GetMessageHandlerShard(node)];
     {
-        std::lock_guard<std::mutex> lock(mutexMsgProc);
-        fMsgProcWake = true;
+        LOCK(shard.mutexMsgProc);
+        shard.fMsgProcWake = true;
     }
-    condMsgProc.notify_one();
+    shard.condMsgProc.notify_one();
+}
+
+int CConnman::GetMessageHandlerShard(const CNode &node) const {
+    return node.GetId() % nMessageHandlerThreads;
 }
 
 void CConnman::ThreadDNSAddressSeed() {
@@ -2013,18 +2422,21 @@ void CConnman::OpenNetworkConnection(const CAddress &addrConnect,
     m_msgproc->InitializeNode(*config, pnode);
     {
         LOCK(cs_vNodes);
+        RegisterSocketEvents(pnode);
         vNodes.push_back(pnode);
     }
 }
 
-void CConnman::ThreadMessageHandler() {
+void CConnman::ThreadMessageHandler(int shard) {
+    MessageHandlerShard &self = msgHandlerShards[shard];
     while (!flagInterruptMsgProc) {
         std::vector<CNode *> vNodesCopy;
         {
             LOCK(cs_vNodes);
-            vNodesCopy = vNodes;
-            for (CNode *pnode : vNodesCopy) {
-                pnode->AddRef();
+            for (CNode *pnode : vNodes) {
+                if (GetMessageHandlerShard(*pnode) == shard) {
+                    vNodesCopy.push_back(pnode->AddRef());
+                }
             }
         }
 
@@ -2101,7 +2513,7 @@ void CConnman::ThreadMessageHandler() {
             }
         }
 
-        WAIT_LOCK(mutexMsgProc, lock);
+        WAIT_LOCK(self.mutexMsgProc, lock);
         if (nSleepUntil > 0us) {
             auto const delta = (nSleepUntil + 1us /* overshoot by 1 usec */) - GetTime<std::chrono::microseconds>();
             auto const nSleepFor = std::clamp(delta, 0us, baseInterval); // clamp to [0, 100msec]
@@ -2110,10 +2522,10 @@ void CConnman::ThreadMessageHandler() {
                          __func__, nSleepFor.count() / 1e3, *shortenedIntervalDueToNodeId);
             }
             if (nSleepFor > 0us) {
-                condMsgProc.wait_for(lock, nSleepFor, [this] { return fMsgProcWake; });
+                self.condMsgProc.wait_for(lock, nSleepFor, [&self] { return self.fMsgProcWake; });
             }
         }
-        fMsgProcWake = false;
+        self.fMsgProcWake = false;
     }
 }
 
@@ -2339,6 +2751,15 @@ bool CConnman::Start(CScheduler &scheduler, const Options &connOptions) {
         return false;
     }
 
+    if (!InitSocketEvents()) {
+        if (clientInterface) {
+            clientInterface->ThreadSafeMessageBox(
+                _("Failed to set up the network event loop."),
+                "", CClientUIInterface::MSG_ERROR);
+        }
+        return false;
+    }
+
     for (const auto &strDest : connOptions.vSeedNodes) {
         AddOneShot(strDest);
     }
@@ -2383,9 +2804,9 @@ bool CConnman::Start(CScheduler &scheduler, const Options &connOptions) {
     interruptNet.reset();
     flagInterruptMsgProc = false;
 
-    {
-        LOCK(mutexMsgProc);
-        fMsgProcWake = false;
+    for (MessageHandlerShard &shard : msgHandlerShards) {
+        LOCK(shard.mutexMsgProc);
+        shard.fMsgProcWake = false;
     }
 
     // Send and receive from sockets, accept connections
@@ -2416,7 +2837,14 @@ bool CConnman::Start(CScheduler &scheduler, const Options &connOptions) {
     }
 
     // Process messages
-    threadMessageHandler = std::thread(util::TraceThread, "msghand", [this] { ThreadMessageHandler(); });
+    for (int i = 0; i < nMessageHandlerThreads; ++i) {
+        const std::string name = nMessageHandlerThreads == 1 ? "msghand" : strprintf("msghand.%d", i);
+        msgHandlerShards[i].thread =
+            std::thread([this, i, name] { util::TraceThread(name.c_str(), [this, i] { ThreadMessageHandler(i); }); });
+    }
+    if (nMessageHandlerThreads > 1) {
+        LogPrintf("Using %d message handler threads\n", nMessageHandlerThreads);
+    }
 
     // Dump network addresses
     scheduler.scheduleEvery(
@@ -2443,11 +2871,14 @@ public:
 } instance_of_cnetcleanup;
 
 void CConnman::Interrupt() {
-    {
-        std::lock_guard<std::mutex> lock(mutexMsgProc);
-        flagInterruptMsgProc = true;
+    flagInterruptMsgProc = true;
+    for (MessageHandlerShard &shard : msgHandlerShards) {
+        {
+            LOCK(shard.mutexMsgProc);
+            shard.fMsgProcWake = true;
+        }
+        shard.condMsgProc.notify_all();
     }
-    condMsgProc.notify_all();
 
     interruptNet();
     InterruptSocks5(true);
@@ -2466,8 +2897,10 @@ void CConnman::Interrupt() {
 }
 
 void CConnman::Stop() {
-    if (threadMessageHandler.joinable()) {
-        threadMessageHandler.join();
+    for (MessageHandlerShard &shard : msgHandlerShards) {
+        if (shard.thread.joinable()) {
+            shard.thread.join();
+        }
     }
     if (threadOpenConnections.joinable()) {
         threadOpenConnections.join();
@@ -2509,6 +2942,7 @@ void CConnman::Stop() {
     }
     vNodes.clear();
     vNodesDisconnected.clear();
+    ShutdownSocketEvents();
     vhListenSocket.clear();
     semOutbound.reset();
     semAddnode.reset();
@@ -2527,6 +2961,13 @@ void CConnman::DeleteNode(CNode *pnode) {
 CConnman::~CConnman() {
     Interrupt();
     Stop();
+#ifndef WIN32
+    for (int fd : wakeupPipe) {
+        if (fd != -1) {
+            close(fd);
+        }
+    }
+#endif
     *deleted = true; // guard againse use-after-free in case our periodic lambda is triggered again
 }
 
@@ -2844,18 +3285,24 @@ bool CConnman::NodeFullyConnected(const CNode *pnode) {
 }
 
 void CConnman::PushMessage(CNode *pnode, CSerializedNetMsg &&msg) {
-    size_t nMessageSize = msg.data.size();
+    size_t nMessageSize = msg.GetPayload().size();
     size_t nTotalSize = nMessageSize + CMessageHeader::HEADER_SIZE;
     LogPrint(BCLog::NET, "sending %s (%d bytes) peer=%d\n", SanitizeString(msg.m_type.c_str()), nMessageSize,
              pnode->GetId());
 
-    std::vector<uint8_t> serializedHeader;
-    serializedHeader.reserve(CMessageHeader::HEADER_SIZE);
-    uint256 hash = Hash(Span{msg.data}.first(nMessageSize));
+    CQueuedNetMsg queued;
+    queued.header.reserve(CMessageHeader::HEADER_SIZE);
     CMessageHeader hdr(config->GetChainParams().NetMagic(), msg.m_type.c_str(), nMessageSize);
-    memcpy(hdr.pchChecksum, hash.begin(), CMessageHeader::CHECKSUM_SIZE);
+    if (msg.shared_data) {
+        memcpy(hdr.pchChecksum, msg.shared_data->hash.begin(), CMessageHeader::CHECKSUM_SIZE);
+    } else {
+        uint256 hash = Hash(Span{msg.data}.first(nMessageSize));
+        memcpy(hdr.pchChecksum, hash.begin(), CMessageHeader::CHECKSUM_SIZE);
+    }
 
-    CVectorWriter{SER_NETWORK, INIT_PROTO_VERSION, serializedHeader, 0, hdr};
+    CVectorWriter{SER_NETWORK, INIT_PROTO_VERSION, queued.header, 0, hdr};
+    queued.data = std::move(msg.data);
+    queued.shared_data = std::move(msg.shared_data);
 
     size_t nBytesSent = 0;
     {
@@ -2869,14 +3316,16 @@ void CConnman::PushMessage(CNode *pnode, CSerializedNetMsg &&msg) {
         if (pnode->nSendSize > nSendBufferMaxSize) {
             pnode->fPauseSend = true;
         }
-        pnode->vSendMsg.push_back(std::move(serializedHeader));
-        if (nMessageSize) {
-            pnode->vSendMsg.push_back(std::move(msg.data));
-        }
+        pnode->vSendMsg.push_back(std::move(queued));
 
         // If write queue empty, attempt "optimistic write"
         if (optimisticSend == true) {
             nBytesSent = SocketSendData(pnode);
+            // Whatever did not fit into the socket's send buffer is up to the
+            // socket handler now, which may be waiting without knowing of it.
+            if (!pnode->vSendMsg.empty()) {
+                WakeSocketHandler();
+            }
         }
     }
     if (nBytesSent) {
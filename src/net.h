@@ -21,11 +21,14 @@
 #include <netaddress.h>
 #include <protocol.h>
 #include <random.h>
+#include <span.h>
 #include <streams.h>
 #include <sync.h>
 #include <threadinterrupt.h>
 #include <uint256.h>
 
+#include <algorithm>
+#include <array>
 #include <atomic>
 #include <chrono>
 #include <condition_variable>
@@ -33,7 +36,9 @@
 #include <deque>
 #include <map>
 #include <memory>
+#include <optional>
 #include <thread>
+#include <unordered_map>
 
 #ifndef WIN32
 #include <arpa/inet.h>
@@ -103,6 +108,30 @@ static const int64_t DEFAULT_PEER_CONNECT_TIMEOUT = 60;
 static const bool DEFAULT_FORCEDNSSEED = false;
 static const size_t DEFAULT_MAXRECEIVEBUFFER = 5 * 1000;
 static const size_t DEFAULT_MAXSENDBUFFER = 1 * 1000;
+/** Default for -msghandthreads, the number of message handler threads. */
+static const int DEFAULT_MSGHANDLER_THREADS = 1;
+/** Maximum number of message handler threads. */
+static const int MAX_MSGHANDLER_THREADS = 16;
+
+/** How the socket handler thread waits for socket events (-socketevents). */
+enum class SocketEventsMode {
+    Select,
+    Poll,
+    EPoll,
+};
+#if defined(USE_EPOLL)
+static constexpr SocketEventsMode DEFAULT_SOCKETEVENTS_MODE = SocketEventsMode::EPoll;
+#elif defined(USE_POLL)
+static constexpr SocketEventsMode DEFAULT_SOCKETEVENTS_MODE = SocketEventsMode::Poll;
+#else
+static constexpr SocketEventsMode DEFAULT_SOCKETEVENTS_MODE = SocketEventsMode::Select;
+#endif
+
+/** Parse a -socketevents value. Returns std::nullopt if the mode is unknown or unsupported on this platform. */
+std::optional<SocketEventsMode> SocketEventsModeFromString(const std::string &str);
+std::string SocketEventsModeToString(SocketEventsMode mode);
+/** Comma separated list of the -socketevents modes supported on this platform. */
+std::string GetSupportedSocketEventsModes();
 
 struct AddedNodeInfo {
     std::string strAddedNode;
@@ -114,6 +143,21 @@ struct AddedNodeInfo {
 struct CNodeStats;
 class CClientUIInterface;
 
+/**
+ * Serialized message payload that can be queued for many peers at once
+ * without copying it. It is immutable, so that its checksum is only computed
+ * once.
+ */
+struct CSharedNetMsgPayload {
+    explicit CSharedNetMsgPayload(std::vector<uint8_t> &&dataIn);
+
+    const std::vector<uint8_t> data;
+    //! Hash of data, which the message checksum is taken from.
+    const uint256 hash;
+};
+
+using CSharedNetMsgPayloadRef = std::shared_ptr<const CSharedNetMsgPayload>;
+
 struct CSerializedNetMsg {
     CSerializedNetMsg() = default;
     CSerializedNetMsg(CSerializedNetMsg &&) = default;
@@ -123,7 +167,32 @@ struct CSerializedNetMsg {
     CSerializedNetMsg &operator=(const CSerializedNetMsg &) = delete;
 
     std::vector<uint8_t> data;
+    //! Payload shared with other messages, sent instead of data if set.
+    CSharedNetMsgPayloadRef shared_data;
     std::string m_type;
+
+    Span<const uint8_t> GetPayload() const {
+        if (shared_data) {
+            return shared_data->data;
+        }
+        return data;
+    }
+};
+
+/** A message queued for sending to a peer. */
+struct CQueuedNetMsg {
+    std::vector<uint8_t> header;
+    std::vector<uint8_t> data;
+    CSharedNetMsgPayloadRef shared_data;
+
+    Span<const uint8_t> GetPayload() const {
+        if (shared_data) {
+            return shared_data->data;
+        }
+        return data;
+    }
+
+    size_t size() const { return header.size() + GetPayload().size(); }
 };
 
 class NetEventsInterface;
@@ -151,6 +220,8 @@ public:
         uint64_t nMaxOutboundTimeframe = 0;
         uint64_t nMaxOutboundLimit = 0;
         int64_t m_peer_connect_timeout = DEFAULT_PEER_CONNECT_TIMEOUT;
+        SocketEventsMode socketEventsMode = DEFAULT_SOCKETEVENTS_MODE;
+        int nMessageHandlerThreads = DEFAULT_MSGHANDLER_THREADS;
         std::vector<std::string> vSeedNodes;
         std::vector<NetWhitelistPermissions> vWhitelistedRange;
         std::vector<NetWhitebindPermissions> vWhiteBinds;
@@ -177,6 +248,8 @@ public:
         nSendBufferMaxSize = connOptions.nSendBufferMaxSize;
         nReceiveFloodSize = connOptions.nReceiveFloodSize;
         m_peer_connect_timeout = connOptions.m_peer_connect_timeout;
+        socketEventsMode = connOptions.socketEventsMode;
+        nMessageHandlerThreads = std::clamp(connOptions.nMessageHandlerThreads, 1, MAX_MSGHANDLER_THREADS);
         {
             LOCK(cs_totalBytesSent);
             nMaxOutboundTimeframe = connOptions.nMaxOutboundTimeframe;
@@ -343,7 +416,15 @@ public:
 
     unsigned int GetReceiveFloodSize() const;
 
+    /** Wake up all message handler threads. */
     void WakeMessageHandler();
+    /** Wake up the message handler thread that processes this peer. */
+    void WakeMessageHandler(const CNode &node);
+    /**
+     * Interrupt the socket handler thread's wait for socket events, e.g.
+     * because a peer has new data to send or may receive again.
+     */
+    void WakeSocketHandler();
 
     /**
      * Attempts to obfuscate tx time through exponentially distributed emitting.
@@ -378,13 +459,36 @@ private:
     void AddOneShot(const std::string &strDest);
     void ProcessOneShot();
     void ThreadOpenConnections(std::vector<std::string> connect);
-    void ThreadMessageHandler();
+    /**
+     * Process the messages of the peers in one message handler shard.
+     *
+     * Peers are assigned to the nMessageHandlerThreads shards by their id, so
+     * every peer is always processed by the same thread. Locking contract for
+     * NetEventsInterface: ProcessMessages() and SendMessages() run concurrently
+     * for peers of different shards, but never for the same peer. CNode state
+     * only accessed by a peer's own message processing (documented as
+     * "Owned-by: msghand thread") thus needs no lock. State that processing a
+     * peer may read or write for other peers or globally must be guarded by
+     * cs_main, g_cs_orphans or a lock of its own.
+     */
+    void ThreadMessageHandler(int shard);
+    int GetMessageHandlerShard(const CNode &node) const;
     void AcceptConnection(const ListenSocket &hListenSocket);
     void DisconnectNodes();
     void NotifyNumConnectionsChanged();
     void InactivityCheck(CNode *pnode);
     bool GenerateSelectSet(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set);
     void SocketEvents(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set);
+    /**
+     * Wait for events on the epoll instance. Readiness of peer sockets is
+     * recorded in their CNode, ready listening sockets are added to recv_set.
+     */
+    void SocketEventsEpoll(std::set<SOCKET> &recv_set);
+    bool InitSocketEvents();
+    void ShutdownSocketEvents();
+    /** Add a new peer's socket to the epoll instance, if one is used. */
+    void RegisterSocketEvents(CNode *pnode) EXCLUSIVE_LOCKS_REQUIRED(cs_vNodes);
+    void DrainWakeupPipe();
     void SocketHandler();
     void ThreadSocketHandler();
     void ThreadDNSAddressSeed();
@@ -500,11 +604,48 @@ private:
     /** SipHasher seeds for deterministic randomness */
     const uint64_t nSeed0, nSeed1;
 
-    /** flag for waking the message processor. */
-    bool fMsgProcWake;
+    /**
+     * A message handler thread, and the means to wake it up. There are always
+     * MAX_MSGHANDLER_THREADS of these, so that they may be woken up at any
+     * time, but only the first nMessageHandlerThreads are used.
+     */
+    struct MessageHandlerShard {
+        /** flag for waking the message processor. */
+        bool fMsgProcWake GUARDED_BY(mutexMsgProc){false};
+        std::condition_variable condMsgProc;
+        Mutex mutexMsgProc;
+        std::thread thread;
+    };
+    std::array<MessageHandlerShard, MAX_MSGHANDLER_THREADS> msgHandlerShards;
+    int nMessageHandlerThreads{DEFAULT_MSGHANDLER_THREADS};
+
+    SocketEventsMode socketEventsMode{DEFAULT_SOCKETEVENTS_MODE};
+    /** epoll instance holding all listening and peer sockets, or -1. */
+    int epollfd{-1};
+    /**
+     * Pipe whose read end is watched by the socket handler along with the
+     * sockets, so that WakeSocketHandler() can interrupt its wait.
+     */
+    int wakeupPipe[2]{-1, -1};
+    /**
+     * Set by the socket handler thread once it is about to wait again, cleared
+     * by the first WakeSocketHandler() call after that.
+     */
+    std::atomic<bool> wakeupSocketHandlerNeeded{false};
+    /**
+     * Peers whose sockets are registered with the epoll instance, by the id
+     * stored in their epoll events. Events are not looked up by CNode pointer,
+     * as a socket can stay registered (and report events) after it was closed
+     * and its CNode deleted if a child process inherited it.
+     */
+    std::unordered_map<NodeId, CNode *> mapEpollNodes GUARDED_BY(cs_vNodes);
+    /**
+     * Whether some peer socket was left with data to read or space to send
+     * into, so the next wait for events must not block. Only used by the
+     * socket handler thread.
+     */
+    bool fSocketWorkPending{false};
 
-    std::condition_variable condMsgProc;
-    Mutex mutexMsgProc;
     std::atomic<bool> flagInterruptMsgProc{false};
 
     CThreadInterrupt interruptNet;
@@ -513,7 +654,6 @@ private:
     std::thread threadSocketHandler;
     std::thread threadOpenAddedConnections;
     std::thread threadOpenConnections;
-    std::thread threadMessageHandler;
 
     /**
      * Flag for deciding to connect to an extra outbound peer, in excess of
@@ -653,11 +793,57 @@ struct CNodeStats {
     uint64_t m_addr_rate_limited = 0;
 };
 
+/**
+ * Pool of message payload buffers, shared by all peers.
+ *
+ * The payload of a received message is read into a buffer taken from the pool,
+ * which is handed back once the message has been processed. Large messages
+ * such as blocks thus reuse memory that is already allocated and mapped in,
+ * instead of allocating (and zeroing) it again for every message. Small
+ * messages are cheaper to allocate than to pool and bypass it.
+ */
+class RecvBufferPool {
+public:
+    using Buffer = CDataStream::vector_type;
+
+    //! Messages smaller than this do not use the pool.
+    static constexpr size_t MIN_POOLED_SIZE = 1024;
+    //! At most this many buffers are kept.
+    static constexpr size_t MAX_POOLED_BUFFERS = 256;
+    //! At most this much memory is kept in buffers.
+    static constexpr size_t MAX_POOLED_BYTES = 64 * 1024 * 1024;
+
+    /**
+     * Take an empty buffer for a message of nSize bytes. Returns the smallest
+     * pooled buffer with room for it, if that is not more than twice as large
+     * as needed, or a new buffer otherwise.
+     */
+    Buffer Acquire(size_t nSize);
+
+    /** Hand a buffer back, or free it if the pool is full. */
+    void Release(Buffer &&buf);
+
+    size_t GetPooledBuffers() const;
+    size_t GetPooledBytes() const;
+
+private:
+    mutable Mutex cs;
+    //! Pooled buffers by capacity.
+    std::multimap<size_t, Buffer> buffers GUARDED_BY(cs);
+    size_t nPooledBytes GUARDED_BY(cs){0};
+};
+
+/** The pool the payloads of all received messages are read into. */
+RecvBufferPool &GetRecvBufferPool();
+
 class CNetMessage {
 private:
     mutable CHash256 hasher;
     mutable uint256 data_hash;
 
+    //! Make room in vRecv for at least nBytes more bytes of payload.
+    void ReserveData(uint32_t nBytes);
+
 public:
     // Parsing header (false) or data (true)
     bool in_data;
@@ -686,6 +872,8 @@ public:
         nTime = 0;
     }
 
+    ~CNetMessage();
+
     bool complete() const {
         if (!in_data) {
             return false;
@@ -703,6 +891,12 @@ public:
 
     int readHeader(const Config &config, const char *pch, uint32_t nBytes);
     int readData(const char *pch, uint32_t nBytes);
+
+    /**
+     * Part of vRecv the next payload bytes can be received into directly.
+     * Bytes written there are then passed to readData() without another copy.
+     */
+    Span<char> GetDataWindow();
 };
 
 /** Information about a peer */
@@ -718,7 +912,7 @@ public:
     // Offset inside the first vSendMsg already sent.
     size_t nSendOffset{0};
     uint64_t nSendBytes GUARDED_BY(cs_vSend){0};
-    std::deque<std::vector<uint8_t>> vSendMsg GUARDED_BY(cs_vSend);
+    std::deque<CQueuedNetMsg> vSendMsg GUARDED_BY(cs_vSend);
     mutable RecursiveMutex cs_vSend;
     RecursiveMutex cs_hSocket;
     RecursiveMutex cs_vRecv;
@@ -772,10 +966,11 @@ public:
 
     /**
      *  Number of addresses that can be processed from this peer. Start at 1 to
-     *  permit self-announcement. Owned-by: msghand thread, hence no locks.
+     *  permit self-announcement. Owned-by: the peer's msghand thread, hence
+     *  no locks.
      */
     double m_addr_token_bucket{1.0};
-    /** When m_addr_token_bucket was last updated. Owned-by: msghand thread. */
+    /** When m_addr_token_bucket was last updated. Owned-by: the peer's msghand thread. */
     std::chrono::microseconds m_addr_token_timestamp{GetTime<std::chrono::microseconds>()};
     /** Total number of addresses that were dropped due to rate limiting. */
     std::atomic<uint64_t> m_addr_rate_limited{0};
@@ -801,6 +996,14 @@ public:
     std::atomic_bool fPauseRecv{false};
     std::atomic_bool fPauseSend{false};
 
+    // Socket readiness as last seen by the socket handler thread, which is the
+    // only one to access these. With select and poll they are refreshed on
+    // every iteration. With epoll they are set by edge-triggered events and
+    // cleared once recv() or send() would block.
+    bool fHasRecvData{false};
+    bool fCanSendData{false};
+    bool fHasSocketError{false};
+
     // We selected peer as (compact blocks) high-bandwidth peer (BIP152)
     std::atomic_bool m_bip152_highbandwidth_to{false};
     // Peer selected us as (compact blocks) high-bandwidth peer (BIP152)
@@ -824,8 +1027,11 @@ public:
     std::atomic<int> nStartingHeight{-1};
 
     // flood relay
-    std::vector<CAddress> vAddrToSend;
-    CRollingBloomFilter addrKnown;
+    // Addresses are pushed by the message handler threads of other peers
+    // too, see RelayAddress().
+    Mutex cs_addrSend;
+    std::vector<CAddress> vAddrToSend GUARDED_BY(cs_addrSend);
+    CRollingBloomFilter addrKnown GUARDED_BY(cs_addrSend);
     bool fGetAddr{false};
     std::chrono::microseconds m_next_addr_send GUARDED_BY(cs_sendProcessing){0};
     std::chrono::microseconds m_next_local_addr_send GUARDED_BY(cs_sendProcessing){0};
@@ -914,6 +1120,13 @@ public:
     bool ReceiveMsgBytes(const Config &config, const char *pch, uint32_t nBytes,
                          bool &complete);
 
+    /**
+     * Buffer the payload of the message being received can be read into from
+     * the socket, before passing it to ReceiveMsgBytes(). Empty when no
+     * payload is being received. Only used by the socket thread.
+     */
+    Span<char> GetRecvMsgWindow();
+
     void SetRecvVersion(int nVersionIn) { nRecvVersion = nVersionIn; }
     int GetRecvVersion() const { return nRecvVersion; }
     void SetSendVersion(int nVersionIn);
@@ -931,6 +1144,7 @@ public:
     void Release() { nRefCount--; }
 
     void AddAddressKnown(const CAddress &_addr) {
+        LOCK(cs_addrSend);
         addrKnown.insert(_addr.GetKey());
     }
 
@@ -940,6 +1154,7 @@ public:
         // because they require ADDRv2 (BIP155) encoding.
         const bool addr_format_supported = m_wants_addrv2 || _addr.IsAddrV1Compatible();
 
+        LOCK(cs_addrSend);
         // Known checking here is only to save space from duplicates.
         // SendMessages will filter it again for knowns that were added
         // after addresses were pushed.
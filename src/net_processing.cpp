@@ -16,6 +16,7 @@
 #include <chain.h>
 #include <chainparams.h>
 #include <config.h>
+#include <consensus/consensus.h>
 #include <consensus/validation.h>
 #include <dsproof/dsproof.h>
 #include <dsproof/storage.h>
@@ -112,19 +113,23 @@ static constexpr auto NONPREF_PEER_TX_DELAY = std::chrono::seconds{2};
 static constexpr auto OVERLOADED_PEER_TX_DELAY = std::chrono::seconds{2};
 /** How long to wait before downloading a transaction from an additional peer. */
 static constexpr auto GETDATA_TX_INTERVAL = std::chrono::seconds{60}; // 1 minute
+/** Maximum number of TX messages queued back to back by a peer that are added to the mempool together. */
+static constexpr size_t MAX_TX_MESSAGES_BATCH = 100;
 /**
  * Limit to avoid sending big packets. Not used in processing incoming GETDATA
  * for compatibility.
  */
 static const unsigned int MAX_GETDATA_SZ = 1000;
 
-/// How many non standard orphan do we consider from a node before ignoring it.
-static constexpr uint32_t MAX_NON_STANDARD_ORPHAN_PER_NODE = 5;
+/// How many orphans are picked at random when one must be evicted. The
+/// largest of them is evicted.
+static constexpr int ORPHAN_EVICTION_CANDIDATES = 4;
 
 namespace internal {
 RecursiveMutex g_cs_orphans;
 MapOrphanTransactions mapOrphanTransactions GUARDED_BY(g_cs_orphans);
 MapOrphanTransactionsByPrev mapOrphanTransactionsByPrev GUARDED_BY(g_cs_orphans);
+size_t nOrphanTransactionsUsage GUARDED_BY(g_cs_orphans) = 0;
 }
 
 /**
@@ -957,11 +962,13 @@ bool internal::AddOrphanTx(const CTransactionRef &tx, NodeId peer)
     for (const CTxIn &txin : tx->vin) {
         mapOrphanTransactionsByPrev[txin.prevout].insert(ret.first);
     }
+    nOrphanTransactionsUsage += ret.first->second.nUsage;
 
     AddToCompactExtraTransactions(tx);
 
-    LogPrint(BCLog::MEMPOOL, "stored orphan tx %s (mapsz %u outsz %u)\n",
-             txid.ToString(), mapOrphanTransactions.size(), mapOrphanTransactionsByPrev.size());
+    LogPrint(BCLog::MEMPOOL, "stored orphan tx %s (mapsz %u outsz %u usage %u)\n",
+             txid.ToString(), mapOrphanTransactions.size(), mapOrphanTransactionsByPrev.size(),
+             nOrphanTransactionsUsage);
     return true;
 }
 
@@ -985,6 +992,7 @@ static int EraseOrphanTx(const TxId &id) EXCLUSIVE_LOCKS_REQUIRED(internal::g_cs
                 internal::mapOrphanTransactionsByPrev.erase(itPrev);
             }
         }
+        internal::nOrphanTransactionsUsage -= it->second.nUsage;
         internal::mapOrphanTransactions.erase(it);
         return 1;
     }();
@@ -1007,7 +1015,7 @@ void internal::EraseOrphansFor(NodeId peer) {
     }
 }
 
-unsigned int internal::LimitOrphanTxSize(unsigned int nMaxOrphans) {
+unsigned int internal::LimitOrphanTxSize(unsigned int nMaxOrphans, size_t nMaxOrphansUsage) {
     LOCK(g_cs_orphans);
 
     unsigned int nEvicted = 0;
@@ -1037,22 +1045,104 @@ unsigned int internal::LimitOrphanTxSize(unsigned int nMaxOrphans) {
         }
     }
     FastRandomContext rng;
-    while (mapOrphanTransactions.size() > nMaxOrphans) {
-        // Evict a random orphan:
-        TxId randomTxId{TxId::Uninitialized};
-        static_assert (sizeof(uint256) == sizeof(randomTxId),
-                       "Assumption here is that TxId and uint256 are byte-wise identical types");
-        rng.rand256(randomTxId); // generate random bytes in-place
-        auto it = mapOrphanTransactions.lower_bound(randomTxId);
-        if (it == mapOrphanTransactions.end()) {
-            it = mapOrphanTransactions.begin();
-        }
-        EraseOrphanTx(it->first);
+    while (mapOrphanTransactions.size() > nMaxOrphans || nOrphanTransactionsUsage > nMaxOrphansUsage) {
+        // Evict the largest of a few random orphans. Their fees are unknown
+        // while their inputs are missing, so the memory they use is what they
+        // cost us: evicting large orphans first frees the limit for more of
+        // the small ones, which an attacker has to send many more of to fill
+        // it. A peer can make its own orphans likelier to be evicted by making
+        // them larger, but it cannot choose which of the others go.
+        auto victim = mapOrphanTransactions.end();
+        for (int i = 0; i < ORPHAN_EVICTION_CANDIDATES; ++i) {
+            TxId randomTxId{TxId::Uninitialized};
+            static_assert (sizeof(uint256) == sizeof(randomTxId),
+                           "Assumption here is that TxId and uint256 are byte-wise identical types");
+            rng.rand256(randomTxId); // generate random bytes in-place
+            auto it = mapOrphanTransactions.lower_bound(randomTxId);
+            if (it == mapOrphanTransactions.end()) {
+                it = mapOrphanTransactions.begin();
+            }
+            if (victim == mapOrphanTransactions.end() || it->second.nUsage > victim->second.nUsage) {
+                victim = it;
+            }
+        }
+        EraseOrphanTx(victim->first);
         ++nEvicted;
     }
     return nEvicted;
 }
 
+std::vector<internal::OrphanAcceptResult> internal::AcceptOrphans(const Config &config,
+                                                                 std::set<TxId> &orphan_work_set) {
+    AssertLockHeld(cs_main);
+    AssertLockHeld(g_cs_orphans);
+
+    std::vector<OrphanAcceptResult> ret;
+    std::unordered_map<NodeId, uint32_t> rejectCountPerNode;
+    std::set<TxId> setGathered;
+    while (!orphan_work_set.empty() && ret.size() < MAX_ORPHANS_PER_PASS) {
+        // Gather orphans of the work set and the orphans descending from them,
+        // so that a chain of orphans is added in one batch once its missing
+        // parent arrived. AcceptToMemoryPoolBatch() puts parents before their
+        // children. Orphans that do not fit in the batch go back to the work
+        // set.
+        const size_t nMaxBatch = std::min(MAX_ORPHAN_BATCH_SIZE, MAX_ORPHANS_PER_PASS - ret.size());
+        std::vector<CTransactionRef> txs;
+        std::vector<NodeId> peers;
+        std::vector<TxId> stage(orphan_work_set.rbegin(), orphan_work_set.rend());
+        orphan_work_set.clear();
+        while (!stage.empty()) {
+            const TxId orphanId = stage.back();
+            stage.pop_back();
+            if (txs.size() >= nMaxBatch) {
+                orphan_work_set.insert(orphanId);
+                continue;
+            }
+            const auto orphan_it = mapOrphanTransactions.find(orphanId);
+            if (orphan_it == mapOrphanTransactions.end() || setGathered.count(orphanId)) {
+                continue;
+            }
+            // Skip the orphans of peers that sent too many invalid ones in this
+            // pass. They stay in the orphan pool.
+            const NodeId fromPeer = orphan_it->second.fromPeer;
+            if (const auto it = rejectCountPerNode.find(fromPeer);
+                it != rejectCountPerNode.end() && it->second > MAX_NON_STANDARD_ORPHAN_PER_NODE) {
+                continue;
+            }
+            setGathered.insert(orphanId);
+            txs.push_back(orphan_it->second.tx);
+            peers.push_back(fromPeer);
+            // The outpoints spent by orphans are ordered by txid first, so those
+            // of this orphan's outputs are next to each other.
+            for (auto it_by_prev = mapOrphanTransactionsByPrev.lower_bound(COutPoint(orphanId, 0));
+                 it_by_prev != mapOrphanTransactionsByPrev.end() && it_by_prev->first.GetTxId() == orphanId;
+                 ++it_by_prev) {
+                for (const auto &elem : it_by_prev->second) {
+                    stage.push_back(elem->first);
+                }
+            }
+        }
+        if (txs.empty()) {
+            break;
+        }
+
+        std::vector<MemPoolAcceptResult> results =
+            AcceptToMemoryPoolBatch(config, g_mempool, txs, {} /* acceptTimes */,
+                                    false /* bypass_limits */, Amount::zero() /* nAbsurdFee */);
+
+        for (size_t i = 0; i < txs.size(); ++i) {
+            if (results[i].fAccepted || !results[i].fMissingInputs) {
+                EraseOrphanTx(txs[i]->GetId());
+            }
+            if (!results[i].fAccepted && !results[i].fMissingInputs && results[i].state.IsInvalid()) {
+                ++rejectCountPerNode[peers[i]];
+            }
+            ret.push_back({std::move(txs[i]), peers[i], std::move(results[i])});
+        }
+    }
+    return ret;
+}
+
 /**
  * Mark a misbehaving peer to be discouraged depending upon the value of `-banscore`.
  */
@@ -1201,9 +1291,44 @@ void PeerLogicValidation::BlockConnected(
 static RecursiveMutex cs_most_recent_block;
 static std::shared_ptr<const CBlock>
     most_recent_block GUARDED_BY(cs_most_recent_block);
-static std::shared_ptr<const CBlockHeaderAndShortTxIDs>
-    most_recent_compact_block GUARDED_BY(cs_most_recent_block);
 static uint256 most_recent_block_hash GUARDED_BY(cs_most_recent_block);
+// Payloads of the messages announcing or serving the most recent block,
+// serialized once and shared by all peers. The block itself is only
+// serialized when first requested.
+static CSharedNetMsgPayloadRef
+    most_recent_compact_block_payload GUARDED_BY(cs_most_recent_block);
+static CSharedNetMsgPayloadRef
+    most_recent_headers_payload GUARDED_BY(cs_most_recent_block);
+static CSharedNetMsgPayloadRef
+    most_recent_block_payload GUARDED_BY(cs_most_recent_block);
+
+/**
+ * Get the block message payload of pblock, if it is still the most recent
+ * block, serializing it if no peer has asked for it before.
+ */
+static CSharedNetMsgPayloadRef
+GetMostRecentBlockPayload(const std::shared_ptr<const CBlock> &pblock)
+    LOCKS_EXCLUDED(cs_most_recent_block) {
+    {
+        LOCK(cs_most_recent_block);
+        if (most_recent_block != pblock) {
+            return nullptr;
+        }
+        if (most_recent_block_payload) {
+            return most_recent_block_payload;
+        }
+    }
+    // Serialize without holding cs_most_recent_block, which validation takes
+    // to announce new blocks. Peers served by other message handler threads
+    // may race us here, the first payload is kept.
+    CSharedNetMsgPayloadRef payload =
+        CNetMsgMaker(PROTOCOL_VERSION).MakePayload(*pblock);
+    LOCK(cs_most_recent_block);
+    if (most_recent_block == pblock && !most_recent_block_payload) {
+        most_recent_block_payload = payload;
+    }
+    return payload;
+}
 
 /**
  * Maintain state about the best-seen block and fast-announce a compact block
@@ -1211,8 +1336,7 @@ static uint256 most_recent_block_hash GUARDED_BY(cs_most_recent_block);
  */
 void PeerLogicValidation::NewPoWValidBlock(
     const CBlockIndex *pindex, const std::shared_ptr<const CBlock> &pblock) {
-    std::shared_ptr<const CBlockHeaderAndShortTxIDs> pcmpctblock =
-        std::make_shared<const CBlockHeaderAndShortTxIDs>(*pblock);
+    const CBlockHeaderAndShortTxIDs cmpctblock(*pblock);
     const CNetMsgMaker msgMaker(PROTOCOL_VERSION);
 
     LOCK(cs_main);
@@ -1224,19 +1348,24 @@ void PeerLogicValidation::NewPoWValidBlock(
     nHighestFastAnnounce = pindex->nHeight;
 
     uint256 hashBlock(pblock->GetHash());
+    CSharedNetMsgPayloadRef cmpctblockPayload =
+        msgMaker.MakePayload(cmpctblock);
+    CSharedNetMsgPayloadRef headersPayload =
+        msgMaker.MakePayload(std::vector<CBlock>{pblock->GetBlockHeader()});
 
     {
         LOCK(cs_most_recent_block);
         most_recent_block_hash = hashBlock;
         most_recent_block = pblock;
-        most_recent_compact_block = pcmpctblock;
+        most_recent_compact_block_payload = cmpctblockPayload;
+        most_recent_headers_payload = std::move(headersPayload);
+        most_recent_block_payload.reset();
     }
 
-    connman->ForEachNode([this, &pcmpctblock, pindex, &msgMaker,
+    connman->ForEachNode([this, &cmpctblockPayload, pindex, &msgMaker,
                           &hashBlock](CNode *pnode) {
         AssertLockHeld(cs_main);
 
-        // TODO: Avoid the repeated-serialization here
         if (pnode->nVersion < INVALID_CB_NO_BAN_VERSION || pnode->fDisconnect) {
             return;
         }
@@ -1249,8 +1378,7 @@ void PeerLogicValidation::NewPoWValidBlock(
             LogPrint(BCLog::NET, "%s sending header-and-ids %s to peer=%d\n",
                      "PeerLogicValidation::NewPoWValidBlock",
                      hashBlock.ToString(), pnode->GetId());
-            connman->PushMessage(
-                pnode, msgMaker.Make(NetMsgType::CMPCTBLOCK, *pcmpctblock));
+            connman->PushMessage(pnode, msgMaker.MakeShared(NetMsgType::CMPCTBLOCK, cmpctblockPayload));
             state.pindexBestHeaderSent = pindex;
         }
     });
@@ -1444,11 +1572,11 @@ static void ProcessGetBlockData(const Config &config, CNode *pfrom,
 
     bool send = false;
     std::shared_ptr<const CBlock> a_recent_block;
-    std::shared_ptr<const CBlockHeaderAndShortTxIDs> a_recent_compact_block;
+    CSharedNetMsgPayloadRef a_recent_compact_block_payload;
     {
         LOCK(cs_most_recent_block);
         a_recent_block = most_recent_block;
-        a_recent_compact_block = most_recent_compact_block;
+        a_recent_compact_block_payload = most_recent_compact_block_payload;
     }
 
     bool need_activate_chain = false;
@@ -1476,162 +1604,207 @@ static void ProcessGetBlockData(const Config &config, CNode *pfrom,
         }
     }
 
-    LOCK(cs_main);
-    const CBlockIndex *pindex = LookupBlockIndex(hash);
-    if (pindex) {
-        send = BlockRequestAllowed(pindex, consensusParams);
-        if (!send) {
+    const CBlockIndex *pindex;
+    // Whether to answer a MSG_CMPCT_BLOCK request with a compact block
+    bool send_cmpct_block = false;
+    // The tip to announce after the block, if the peer is to be told to
+    // continue with getblocks
+    BlockHash hashContinueTip;
+    {
+        LOCK(cs_main);
+        pindex = LookupBlockIndex(hash);
+        if (pindex) {
+            send = BlockRequestAllowed(pindex, consensusParams);
+            if (!send) {
+                LogPrint(BCLog::NET,
+                         "%s: ignoring request from peer=%i for old "
+                         "block that isn't in the main chain\n",
+                         __func__, pfrom->GetId());
+            }
+        }
+        // Disconnect node in case we have reached the outbound limit for
+        // serving historical blocks.
+        // Never disconnect whitelisted nodes.
+        if (send && connman->OutboundTargetReached(true) &&
+            (((pindexBestHeader != nullptr) &&
+              (pindexBestHeader->GetBlockTime() - pindex->GetBlockTime() >
+               HISTORICAL_BLOCK_AGE)) ||
+             inv.type == MSG_FILTERED_BLOCK) &&
+            !pfrom->HasPermission(PF_NOBAN)) {
+            LogPrint(BCLog::NET,
+                     "historical block serving limit reached, disconnect "
+                     "peer=%d\n",
+                     pfrom->GetId());
+
+            // disconnect node
+            pfrom->fDisconnect = true;
+            send = false;
+        }
+        // Avoid leaking prune-height by never sending blocks below the
+        // NODE_NETWORK_LIMITED threshold.
+        // Add two blocks buffer extension for possible races
+        if (send && !pfrom->HasPermission(PF_NOBAN) &&
+            ((((pfrom->GetLocalServices() & NODE_NETWORK_LIMITED) ==
+               NODE_NETWORK_LIMITED) &&
+              ((pfrom->GetLocalServices() & NODE_NETWORK) != NODE_NETWORK) &&
+              (::ChainActive().Tip()->nHeight - pindex->nHeight >
+               (int)NODE_NETWORK_LIMITED_MIN_BLOCKS + 2)))) {
             LogPrint(BCLog::NET,
-                     "%s: ignoring request from peer=%i for old "
-                     "block that isn't in the main chain\n",
-                     __func__, pfrom->GetId());
+                     "Ignore block request below NODE_NETWORK_LIMITED "
+                     "threshold from peer=%d\n",
+                     pfrom->GetId());
+
+            // disconnect node and prevent it from stalling (would otherwise
+            // wait for the missing block)
+            pfrom->fDisconnect = true;
+            send = false;
+        }
+        // Pruned nodes may have deleted the block, so check whether it's
+        // available before trying to send.
+        send = send && pindex->nStatus.hasData();
+        if (send) {
+            // If a peer is asking for old blocks, we're almost guaranteed they
+            // won't have a useful mempool to match against a compact block,
+            // and we don't feel like constructing the object for them, so
+            // instead we respond with the full, non-compact block.
+            send_cmpct_block = inv.type == MSG_CMPCT_BLOCK &&
+                               CanDirectFetch(consensusParams) &&
+                               pindex->nHeight >= ::ChainActive().Height() -
+                                                      MAX_CMPCTBLOCK_DEPTH;
+            if (hash == pfrom->hashContinue) {
+                hashContinueTip = ::ChainActive().Tip()->GetBlockHash();
+            }
         }
+    } // release cs_main, the block is read from disk and sent without it
+    if (!send) {
+        return;
     }
-    const CNetMsgMaker msgMaker(pfrom->GetSendVersion());
-    // Disconnect node in case we have reached the outbound limit for serving
-    // historical blocks.
-    // Never disconnect whitelisted nodes.
-    if (send && connman->OutboundTargetReached(true) &&
-        (((pindexBestHeader != nullptr) &&
-          (pindexBestHeader->GetBlockTime() - pindex->GetBlockTime() >
-           HISTORICAL_BLOCK_AGE)) ||
-         inv.type == MSG_FILTERED_BLOCK) &&
-        !pfrom->HasPermission(PF_NOBAN)) {
-        LogPrint(BCLog::NET,
-                 "historical block serving limit reached, disconnect peer=%d\n",
-                 pfrom->GetId());
 
-        // disconnect node
-        pfrom->fDisconnect = true;
-        send = false;
-    }
-    // Avoid leaking prune-height by never sending blocks below the
-    // NODE_NETWORK_LIMITED threshold.
-    // Add two blocks buffer extension for possible races
-    if (send && !pfrom->HasPermission(PF_NOBAN) &&
-        ((((pfrom->GetLocalServices() & NODE_NETWORK_LIMITED) ==
-           NODE_NETWORK_LIMITED) &&
-          ((pfrom->GetLocalServices() & NODE_NETWORK) != NODE_NETWORK) &&
-          (::ChainActive().Tip()->nHeight - pindex->nHeight >
-           (int)NODE_NETWORK_LIMITED_MIN_BLOCKS + 2)))) {
-        LogPrint(BCLog::NET,
-                 "Ignore block request below NODE_NETWORK_LIMITED "
-                 "threshold from peer=%d\n",
-                 pfrom->GetId());
+    const CNetMsgMaker msgMaker(pfrom->GetSendVersion());
+    std::shared_ptr<const CBlock> pblock;
+    if (a_recent_block && a_recent_block->GetHash() == pindex->GetBlockHash()) {
+        pblock = a_recent_block;
+    }
 
-        // disconnect node and prevent it from stalling (would otherwise wait
-        // for the missing block)
+    // A block that was pruned after the checks above cannot be read anymore.
+    // Disconnect the peer then, so that it does not wait for the block.
+    auto block_read_failed = [&pfrom, &pindex] {
+        LogPrint(BCLog::NET, "cannot load block %s from disk, disconnect peer=%d\n",
+                 pindex->GetBlockHash().ToString(), pfrom->GetId());
         pfrom->fDisconnect = true;
-        send = false;
-    }
-    // Pruned nodes may have deleted the block, so check whether it's available
-    // before trying to send.
-    if (send && pindex->nStatus.hasData()) {
-        std::shared_ptr<const CBlock> pblock;
-        if (a_recent_block &&
-            a_recent_block->GetHash() == pindex->GetBlockHash()) {
-            pblock = a_recent_block;
-        }
+    };
 
-        auto make_raw_block_message = [&pblock, &pindex, &config, &msgMaker] {
-            CSerializedNetMsg msg;
-            if (pblock) {
-                // pblock points to the recent block already in memory, so just use it rather than reading from disk
-                msg = msgMaker.Make(NetMsgType::BLOCK, *pblock);
+    auto make_raw_block_message = [&pblock, &pindex, &config, &msgMaker]() -> std::optional<CSerializedNetMsg> {
+        CSerializedNetMsg msg;
+        if (pblock) {
+            // pblock points to the recent block already in memory, so just use it rather than reading from disk.
+            // Unless a newer block arrived meanwhile, it is serialized only once for all peers.
+            if (auto payload = GetMostRecentBlockPayload(pblock)) {
+                msg = CNetMsgMaker::MakeShared(NetMsgType::BLOCK, std::move(payload));
             } else {
-                // read the raw block data from disk and send it directly to network
-                msg.m_type = NetMsgType::BLOCK;
-                if (!ReadRawBlockFromDisk(msg.data, pindex, config.GetChainParams(), SER_NETWORK, msgMaker.nVersion)) {
-                    assert(!"cannot load raw block data from disk");
-                }
+                msg = msgMaker.Make(NetMsgType::BLOCK, *pblock);
             }
-            return msg;
-        };
-
-        if (inv.type == MSG_BLOCK) {
-            connman->PushMessage(pfrom, make_raw_block_message());
         } else {
-            auto ensure_pblock = [&pblock, &pindex, &consensusParams]() -> const CBlock & {
-                // Read block from disk if not already in memory and deserialize to transform it to
-                // MerkleBlock or CompactBlock
+            // read the raw block data from disk and send it directly to network
+            msg.m_type = NetMsgType::BLOCK;
+            if (!ReadRawBlockFromDisk(msg.data, pindex, config.GetChainParams(), SER_NETWORK, msgMaker.nVersion)) {
+                return std::nullopt;
+            }
+        }
+        return msg;
+    };
+    auto ensure_pblock = [&pblock, &pindex, &consensusParams]() -> bool {
+        // Read block from disk if not already in memory and deserialize to transform it to
+        // MerkleBlock or CompactBlock
+        if (!pblock) {
+            std::shared_ptr<CBlock> pblockRead = std::make_shared<CBlock>();
+            if (!ReadBlockFromDisk(*pblockRead, pindex, consensusParams)) {
+                return false;
+            }
+            pblock = pblockRead;
+        }
+        return true;
+    };
+
+    if (inv.type == MSG_BLOCK ||
+        (inv.type == MSG_CMPCT_BLOCK && !send_cmpct_block)) {
+        auto msg = make_raw_block_message();
+        if (!msg) {
+            block_read_failed();
+            return;
+        }
+        connman->PushMessage(pfrom, std::move(*msg));
+    } else if (inv.type == MSG_FILTERED_BLOCK) {
+        bool sendMerkleBlock = false;
+        CMerkleBlock merkleBlock;
+        {
+            WAIT_LOCK(pfrom->cs_filter, lock);
+            if (pfrom->pfilter) {
                 if (!pblock) {
-                    std::shared_ptr<CBlock> pblockRead = std::make_shared<CBlock>();
-                    if (!ReadBlockFromDisk(*pblockRead, pindex, consensusParams)) {
-                        assert(!"cannot load block from disk");
-                    }
-                    pblock = pblockRead;
-                }
-                return *pblock;
-            };
-            if (inv.type == MSG_FILTERED_BLOCK) {
-                bool sendMerkleBlock = false;
-                CMerkleBlock merkleBlock;
-                {
-                    WAIT_LOCK(pfrom->cs_filter, lock);
-                    if (pfrom->pfilter) {
-                        if (!pblock) {
-                            // read into pblock now with pfrom->cs_filter not held
-                            REVERSE_LOCK(lock);
-                            ensure_pblock();
-                        }
-                        // relocked; check again (in case in future code another thread clears pfilter)
-                        if (pfrom->pfilter) {
-                            sendMerkleBlock = true;
-                            merkleBlock = CMerkleBlock(*pblock, *pfrom->pfilter);
-                        }
+                    // read into pblock now with pfrom->cs_filter not held
+                    REVERSE_LOCK(lock);
+                    if (!ensure_pblock()) {
+                        block_read_failed();
+                        return;
                     }
                 }
-                if (sendMerkleBlock) {
-                    connman->PushMessage(
-                        pfrom, msgMaker.Make(NetMsgType::MERKLEBLOCK, merkleBlock));
-                    // CMerkleBlock just contains hashes, so also push any
-                    // transactions in the block the client did not see. This avoids
-                    // hurting performance by pointlessly requiring a round-trip.
-                    // Note that there is currently no way for a node to request any
-                    // single transactions we didn't send here - they must either
-                    // disconnect and retry or request the full block. Thus, the
-                    // protocol spec specified allows for us to provide duplicate
-                    // txn here, however we MUST always provide at least what the
-                    // remote peer needs.
-                    for (const auto &pair : merkleBlock.vMatchedTxn) {
-                        connman->PushMessage(
-                            pfrom, msgMaker.Make(NetMsgType::TX,
-                                                *pblock->vtx[pair.first]));
-                    }
-                }
-                // else
-                // no response
-            } else if (inv.type == MSG_CMPCT_BLOCK) {
-                // If a peer is asking for old blocks, we're almost guaranteed they
-                // won't have a useful mempool to match against a compact block, and
-                // we don't feel like constructing the object for them, so instead
-                // we respond with the full, non-compact block.
-                int nSendFlags = 0;
-                if (CanDirectFetch(consensusParams) &&
-                    pindex->nHeight >=
-                        ::ChainActive().Height() - MAX_CMPCTBLOCK_DEPTH) {
-                    CBlockHeaderAndShortTxIDs cmpctblock(ensure_pblock());
-                    connman->PushMessage(
-                        pfrom, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK,
-                                            cmpctblock));
-                } else {
-                    connman->PushMessage(pfrom, make_raw_block_message());
+                // relocked; check again (in case in future code another thread clears pfilter)
+                if (pfrom->pfilter) {
+                    sendMerkleBlock = true;
+                    merkleBlock = CMerkleBlock(*pblock, *pfrom->pfilter);
                 }
             }
         }
-
-        // Trigger the peer node to send a getblocks request for the next batch
-        // of inventory.
-        if (hash == pfrom->hashContinue) {
-            // Bypass PushInventory, this must send even if redundant, and we
-            // want it right after the last block so they don't wait for other
-            // stuff first.
-            std::vector<CInv> vInv;
-            vInv.emplace_back(
-                MSG_BLOCK, ::ChainActive().Tip()->GetBlockHash());
-            connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::INV, vInv));
-            pfrom->hashContinue = BlockHash();
+        if (sendMerkleBlock) {
+            connman->PushMessage(
+                pfrom, msgMaker.Make(NetMsgType::MERKLEBLOCK, merkleBlock));
+            // CMerkleBlock just contains hashes, so also push any
+            // transactions in the block the client did not see. This avoids
+            // hurting performance by pointlessly requiring a round-trip.
+            // Note that there is currently no way for a node to request any
+            // single transactions we didn't send here - they must either
+            // disconnect and retry or request the full block. Thus, the
+            // protocol spec specified allows for us to provide duplicate
+            // txn here, however we MUST always provide at least what the
+            // remote peer needs.
+            for (const auto &pair : merkleBlock.vMatchedTxn) {
+                connman->PushMessage(
+                    pfrom, msgMaker.Make(NetMsgType::TX,
+                                        *pblock->vtx[pair.first]));
+            }
         }
+        // else
+        // no response
+    } else if (inv.type == MSG_CMPCT_BLOCK) {
+        if (pblock && a_recent_compact_block_payload) {
+            // pblock is the recent block, whose compact block is serialized
+            // already
+            connman->PushMessage(
+                pfrom, CNetMsgMaker::MakeShared(NetMsgType::CMPCTBLOCK,
+                                                a_recent_compact_block_payload));
+        } else {
+            if (!ensure_pblock()) {
+                block_read_failed();
+                return;
+            }
+            int nSendFlags = 0;
+            CBlockHeaderAndShortTxIDs cmpctblock(*pblock);
+            connman->PushMessage(
+                pfrom, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK,
+                                    cmpctblock));
+        }
+    }
+
+    // Trigger the peer node to send a getblocks request for the next batch
+    // of inventory.
+    if (!hashContinueTip.IsNull()) {
+        // Bypass PushInventory, this must send even if redundant, and we
+        // want it right after the last block so they don't wait for other
+        // stuff first.
+        std::vector<CInv> vInv;
+        vInv.emplace_back(MSG_BLOCK, hashContinueTip);
+        connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::INV, vInv));
+        pfrom->hashContinue = BlockHash();
     }
 }
 
@@ -2071,55 +2244,22 @@ static void ProcessOrphanTx(const Config &config, CConnman *connman,
     AssertLockHeld(cs_main);
     AssertLockHeld(internal::g_cs_orphans);
 
-    std::unordered_map<NodeId, uint32_t> rejectCountPerNode;
-
-    bool done = false;
-    while (!done && !orphan_work_set.empty()) {
-        const TxId orphanId = *orphan_work_set.begin();
-        orphan_work_set.erase(orphan_work_set.begin());
-
-        const auto orphan_it = internal::mapOrphanTransactions.find(orphanId);
-        if (orphan_it == internal::mapOrphanTransactions.end()) {
-            continue;
-        }
-
-        const CTransactionRef porphanTx = orphan_it->second.tx;
-        const CTransaction &orphanTx = *porphanTx;
-        const NodeId fromPeer = orphan_it->second.fromPeer;
-        bool fMissingInputs2 = false;
-        // Use a dummy CValidationState so someone can't setup nodes to counter-DoS based on orphan
-        // resolution (that is, feeding people an invalid transaction based on LegitTxX in order to get
-        // anyone relaying LegitTxX banned)
-        CValidationState stateDummy;
-
-
-        if (const auto it = rejectCountPerNode.find(fromPeer);
-            it != rejectCountPerNode.end() && it->second > MAX_NON_STANDARD_ORPHAN_PER_NODE) {
-            continue;
-        }
-        if (AcceptToMemoryPool(config, g_mempool, stateDummy, porphanTx, &fMissingInputs2,
-                               false /* bypass_limits */, Amount::zero() /* nAbsurdFee */)) {
+    // The states of the orphans are only used to punish the peers that sent
+    // them, so someone can't setup nodes to counter-DoS based on orphan
+    // resolution (that is, feeding people an invalid transaction based on
+    // LegitTxX in order to get anyone relaying LegitTxX banned)
+    for (const internal::OrphanAcceptResult &orphan : internal::AcceptOrphans(config, orphan_work_set)) {
+        const TxId &orphanId = orphan.tx->GetId();
+        const CValidationState &stateDummy = orphan.result.state;
+        if (orphan.result.fAccepted) {
             LogPrint(BCLog::MEMPOOL, "   accepted orphan tx %s\n", orphanId.ToString());
-            RelayTransaction(orphanTx, connman);
-            for (size_t i = 0; i < orphanTx.vout.size(); ++i) {
-                auto it_by_prev = internal::mapOrphanTransactionsByPrev.find(COutPoint(orphanId, i));
-                if (it_by_prev != internal::mapOrphanTransactionsByPrev.end()) {
-                    for (const auto &elem : it_by_prev->second) {
-                        orphan_work_set.insert(elem->first);
-                    }
-                }
-            }
-            EraseOrphanTx(orphanId);
-            done = true;
-        } else if (!fMissingInputs2) {
+            RelayTransaction(*orphan.tx, connman);
+        } else if (!orphan.result.fMissingInputs) {
             int nDos = 0;
-            if (stateDummy.IsInvalid(nDos)) {
-                rejectCountPerNode[fromPeer]++;
-                if (nDos > 0) {
-                    // Punish peer that gave us an invalid orphan tx
-                    Misbehaving(fromPeer, nDos);
-                    LogPrint(BCLog::MEMPOOL, "   invalid orphan tx %s\n", orphanId.ToString());
-                }
+            if (stateDummy.IsInvalid(nDos) && nDos > 0) {
+                // Punish peer that gave us an invalid orphan tx
+                Misbehaving(orphan.fromPeer, nDos);
+                LogPrint(BCLog::MEMPOOL, "   invalid orphan tx %s\n", orphanId.ToString());
             }
             // Has inputs but not accepted to mempool
             // Probably non-standard or insufficient fee
@@ -2128,11 +2268,9 @@ static void ProcessOrphanTx(const Config &config, CConnman *connman,
                 assert(recentRejects);
                 recentRejects->insert(orphanId);
             }
-            EraseOrphanTx(orphanId);
-            done = true;
         }
-        g_mempool.check(pcoinsTip.get());
     }
+    g_mempool.check(pcoinsTip.get());
 }
 
 /** Register with TxRequestTracker that an INV has been received from a peer. The announcement parameters are decided
@@ -2162,6 +2300,235 @@ static void AddTxAnnouncement(TxRequestTracker &txrequest, const CNode& node, co
     txrequest.ReceivedInv(nodeid, txid, preferred, current_time + delay);
 }
 
+/**
+ * Act on the outcome of adding a transaction received from pfrom to the
+ * mempool: relay it and queue the orphans that spend it if it was accepted,
+ * keep it as an orphan if it misses inputs, and remember, report and punish
+ * it otherwise. `result` is left at its default when the transaction was not
+ * tried because we already have it. Returns whether it was accepted.
+ */
+static bool ProcessTxResult(CNode *pfrom, const CTransactionRef &ptx,
+                            const MemPoolAcceptResult &result,
+                            CConnman *connman, bool enable_bip61,
+                            TxRequestTracker &txrequest)
+    EXCLUSIVE_LOCKS_REQUIRED(cs_main, internal::g_cs_orphans) {
+    const CTransaction &tx = *ptx;
+    const TxId &txid = tx.GetId();
+    const CInv inv(MSG_TX, txid);
+    const CValidationState &state = result.state;
+    const CNetMsgMaker msgMaker(pfrom->GetSendVersion());
+
+    if (result.fAccepted) {
+        g_mempool.check(pcoinsTip.get());
+        // As this version of the transaction was acceptable, we can forget about any
+        // requests for it.
+        txrequest.ForgetTxId(tx.GetId());
+        RelayTransaction(tx, connman);
+        for (size_t i = 0; i < tx.vout.size(); ++i) {
+            auto it_by_prev = internal::mapOrphanTransactionsByPrev.find(COutPoint(txid, i));
+            if (it_by_prev != internal::mapOrphanTransactionsByPrev.end()) {
+                for (const auto &elem : it_by_prev->second) {
+                    pfrom->orphan_work_set.insert(elem->first);
+                }
+            }
+        }
+
+        pfrom->nLastTXTime = GetTime();
+
+        LogPrint(BCLog::MEMPOOL,
+                 "AcceptToMemoryPool: peer=%d: accepted %s "
+                 "(poolsz %u txn, %u kB)\n",
+                 pfrom->GetId(), tx.GetId().ToString(), g_mempool.size(),
+                 g_mempool.DynamicMemoryUsage() / 1000);
+    } else if (result.fMissingInputs) {
+        // It may be the case that the orphans parents have all been
+        // rejected.
+        bool fRejectedParents = false;
+        for (const CTxIn &txin : tx.vin) {
+            if (recentRejects->contains(txin.prevout.GetTxId())) {
+                fRejectedParents = true;
+                break;
+            }
+        }
+        if (!fRejectedParents) {
+            const auto current_time = GetTime<std::chrono::microseconds>();
+
+            for (const CTxIn &txin : tx.vin) {
+                // FIXME: MSG_TX should use a TxHash, not a TxId.
+                const TxId _txid = txin.prevout.GetTxId();
+                CInv _inv(MSG_TX, _txid);
+                pfrom->AddInventoryKnown(_inv);
+                if (!AlreadyHave(_inv)) {
+                    AddTxAnnouncement(txrequest, *pfrom, _txid, current_time);
+                }
+            }
+            internal::AddOrphanTx(ptx, pfrom->GetId());
+
+            // Once added to the orphan pool, a tx is considered AlreadyHave, and we shouldn't request it anymore.
+            txrequest.ForgetTxId(tx.GetId());
+
+            // DoS prevention: do not allow mapOrphanTransactions to grow
+            // unbounded
+            unsigned int nMaxOrphanTx = (unsigned int)std::max(
+                int64_t(0), gArgs.GetArg("-maxorphantx",
+                                         DEFAULT_MAX_ORPHAN_TRANSACTIONS));
+            size_t nMaxOrphanTxUsage = std::max<int64_t>(
+                0, gArgs.GetArg("-maxorphantxsize", DEFAULT_MAX_ORPHAN_TRANSACTIONS_SIZE)) * ONE_MEGABYTE;
+            unsigned int nEvicted = internal::LimitOrphanTxSize(nMaxOrphanTx, nMaxOrphanTxUsage);
+            if (nEvicted > 0) {
+                LogPrint(BCLog::MEMPOOL,
+                         "mapOrphan overflow, removed %u tx\n", nEvicted);
+            }
+        } else {
+            LogPrint(BCLog::MEMPOOL,
+                     "not keeping orphan with rejected parents %s\n",
+                     tx.GetId().ToString());
+            // We will continue to reject this tx since it has rejected
+            // parents so avoid re-requesting it from other peers.
+            recentRejects->insert(tx.GetId());
+            txrequest.ForgetTxId(tx.GetId());
+        }
+    } else {
+        if (!state.CorruptionPossible()) {
+            assert(recentRejects);
+            recentRejects->insert(tx.GetId());
+            txrequest.ForgetTxId(tx.GetId());
+            if (RecursiveDynamicUsage(*ptx) < 100000) {
+                AddToCompactExtraTransactions(ptx);
+            }
+        }
+
+        if (pfrom->HasPermission(PF_FORCERELAY)) {
+            // Always relay transactions received from whitelisted peers,
+            // even if they were already in the mempool or rejected from it
+            // due to policy, allowing the node to function as a gateway for
+            // nodes hidden behind it.
+            //
+            // Never relay transactions that we would assign a non-zero DoS
+            // score for, as we expect peers to do the same with us in that
+            // case.
+            int nDoS = 0;
+            if (!state.IsInvalid(nDoS) || nDoS == 0) {
+                LogPrintf("Force relaying tx %s from whitelisted peer=%d\n",
+                          tx.GetId().ToString(), pfrom->GetId());
+                RelayTransaction(tx, connman);
+            } else {
+                LogPrintf("Not relaying invalid transaction %s from "
+                          "whitelisted peer=%d (%s)\n",
+                          tx.GetId().ToString(), pfrom->GetId(),
+                          FormatStateMessage(state));
+            }
+        }
+    }
+
+    // If a tx has been detected by recentRejects, we will have reached
+    // this point and the tx will have been ignored. Because we haven't run
+    // the tx through AcceptToMemoryPool, we won't have computed a DoS
+    // score for it or determined exactly why we consider it invalid.
+    //
+    // This means we won't penalize any peer subsequently relaying a DoSy
+    // tx (even if we penalized the first peer who gave it to us) because
+    // we have to account for recentRejects showing false positives. In
+    // other words, we shouldn't penalize a peer if we aren't *sure* they
+    // submitted a DoSy tx.
+    //
+    // Note that recentRejects doesn't just record DoSy or invalid
+    // transactions, but any tx not accepted by the mempool, which may be
+    // due to node policy (vs. consensus). So we can't blanket penalize a
+    // peer simply for relaying a tx that our recentRejects has caught,
+    // regardless of false positives.
+
+    int nDoS = 0;
+    if (state.IsInvalid(nDoS)) {
+        LogPrint(BCLog::MEMPOOLREJ,
+                 "%s from peer=%d was not accepted: %s\n",
+                 tx.GetHash().ToString(), pfrom->GetId(),
+                 FormatStateMessage(state));
+        // Never send AcceptToMemoryPool's internal codes over P2P.
+        if (enable_bip61 && state.GetRejectCode() > 0 &&
+            state.GetRejectCode() < REJECT_INTERNAL) {
+            connman->PushMessage(
+                pfrom, msgMaker.Make(NetMsgType::REJECT, std::string(NetMsgType::TX),
+                                     uint8_t(state.GetRejectCode()),
+                                     state.GetRejectReason().substr(
+                                         0, MAX_REJECT_MESSAGE_LENGTH),
+                                     inv.hash));
+        }
+        if (nDoS > 0) {
+            Misbehaving(pfrom, nDoS, state.GetRejectReason());
+        }
+    }
+    return result.fAccepted;
+}
+
+/**
+ * Process TX messages that pfrom queued back to back like ProcessMessage()
+ * does one at a time, except that the new transactions are added to the
+ * mempool by a single AcceptToMemoryPoolBatch() call. Their scripts are thus
+ * verified in parallel, and children sent before their parents are accepted
+ * rather than stored as orphans.
+ */
+static void ProcessTxMessages(const Config &config, CNode *pfrom,
+                              std::list<CNetMessage> &msgs, CConnman *connman,
+                              bool enable_bip61, TxRequestTracker &txrequest) {
+    std::vector<CTransactionRef> txs;
+    txs.reserve(msgs.size());
+    for (CNetMessage &msg : msgs) {
+        msg.SetVersion(pfrom->GetRecvVersion());
+        LogPrint(BCLog::NET, "received: %s (%u bytes) peer=%d\n",
+                 NetMsgType::TX, msg.vRecv.size(), pfrom->GetId());
+        try {
+            CTransactionRef ptx;
+            msg.vRecv >> ptx;
+            pfrom->AddInventoryKnown(CInv(MSG_TX, ptx->GetId()));
+            txs.push_back(std::move(ptx));
+        } catch (const std::exception &e) {
+            if (enable_bip61) {
+                connman->PushMessage(pfrom, CNetMsgMaker(INIT_PROTO_VERSION)
+                                                .Make(NetMsgType::REJECT, std::string(NetMsgType::TX), REJECT_MALFORMED,
+                                                      std::string("error parsing message")));
+            }
+            LogPrint(BCLog::NET, "%s(%s, %u bytes): Exception '%s' (%s) caught\n", __func__, NetMsgType::TX,
+                     msg.hdr.nMessageSize, e.what(), typeid(e).name());
+        }
+    }
+
+    LOCK2(cs_main, internal::g_cs_orphans);
+
+    // Only try the transactions we don't have yet, and each of them once. The
+    // others keep a default result, as in ProcessMessage().
+    static constexpr size_t NOT_TRIED = std::numeric_limits<size_t>::max();
+    std::vector<size_t> batchIndex(txs.size(), NOT_TRIED);
+    std::vector<CTransactionRef> batch;
+    std::set<TxId> batchIds;
+    for (size_t i = 0; i < txs.size(); ++i) {
+        const TxId &txid = txs[i]->GetId();
+        txrequest.ReceivedResponse(pfrom->GetId(), txid);
+        if (!AlreadyHave(CInv(MSG_TX, txid)) && batchIds.insert(txid).second) {
+            batchIndex[i] = batch.size();
+            batch.push_back(txs[i]);
+        }
+    }
+
+    const std::vector<MemPoolAcceptResult> results =
+        AcceptToMemoryPoolBatch(config, g_mempool, batch, {} /* acceptTimes */,
+                                false /* bypass_limits */,
+                                Amount::zero() /* nAbsurdFee */);
+
+    bool fAnyAccepted = false;
+    for (size_t i = 0; i < txs.size(); ++i) {
+        const MemPoolAcceptResult result = batchIndex[i] == NOT_TRIED
+                                               ? MemPoolAcceptResult()
+                                               : results[batchIndex[i]];
+        fAnyAccepted |= ProcessTxResult(pfrom, txs[i], result, connman,
+                                        enable_bip61, txrequest);
+    }
+    if (fAnyAccepted) {
+        // Process any orphan transactions that depended on these
+        ProcessOrphanTx(config, connman, pfrom->orphan_work_set);
+    }
+}
+
 // Called from PrcoessMessage(), calls ProcessNewBlock() but also does some additional node accounting.
 static void ProcessBlockFromNode(const Config &config, CNode *pfrom, const std::shared_ptr<const CBlock> &pblock,
                                  bool force_processing) {
@@ -3040,163 +3407,23 @@ static bool ProcessMessage(const Config &config, CNode *pfrom,
 
         CTransactionRef ptx;
         vRecv >> ptx;
-        const CTransaction &tx = *ptx;
-        const TxId &txid = tx.GetId();
-
-        const CInv inv(MSG_TX, txid);
+        const CInv inv(MSG_TX, ptx->GetId());
         pfrom->AddInventoryKnown(inv);
 
         LOCK2(cs_main, internal::g_cs_orphans);
 
-        bool fMissingInputs = false;
-        CValidationState state;
-
-        txrequest.ReceivedResponse(pfrom->GetId(), txid);
-
-        if (!AlreadyHave(inv) &&
-            AcceptToMemoryPool(config, g_mempool, state, ptx, &fMissingInputs,
-                               false /* bypass_limits */,
-                               Amount::zero() /* nAbsurdFee */)) {
-            g_mempool.check(pcoinsTip.get());
-            // As this version of the transaction was acceptable, we can forget about any
-            // requests for it.
-            txrequest.ForgetTxId(tx.GetId());
-            RelayTransaction(tx, connman);
-            for (size_t i = 0; i < tx.vout.size(); ++i) {
-                auto it_by_prev = internal::mapOrphanTransactionsByPrev.find(COutPoint(txid, i));
-                if (it_by_prev != internal::mapOrphanTransactionsByPrev.end()) {
-                    for (const auto &elem : it_by_prev->second) {
-                        pfrom->orphan_work_set.insert(elem->first);
-                    }
-                }
-            }
-
-            pfrom->nLastTXTime = GetTime();
-
-            LogPrint(BCLog::MEMPOOL,
-                     "AcceptToMemoryPool: peer=%d: accepted %s "
-                     "(poolsz %u txn, %u kB)\n",
-                     pfrom->GetId(), tx.GetId().ToString(), g_mempool.size(),
-                     g_mempool.DynamicMemoryUsage() / 1000);
+        txrequest.ReceivedResponse(pfrom->GetId(), ptx->GetId());
 
+        MemPoolAcceptResult result;
+        if (!AlreadyHave(inv)) {
+            result.fAccepted = AcceptToMemoryPool(
+                config, g_mempool, result.state, ptx, &result.fMissingInputs,
+                false /* bypass_limits */, Amount::zero() /* nAbsurdFee */);
+        }
+        if (ProcessTxResult(pfrom, ptx, result, connman, enable_bip61,
+                            txrequest)) {
             // Recursively process any orphan transactions that depended on this one
             ProcessOrphanTx(config, connman, pfrom->orphan_work_set);
-
-        } else if (fMissingInputs) {
-            // It may be the case that the orphans parents have all been
-            // rejected.
-            bool fRejectedParents = false;
-            for (const CTxIn &txin : tx.vin) {
-                if (recentRejects->contains(txin.prevout.GetTxId())) {
-                    fRejectedParents = true;
-                    break;
-                }
-            }
-            if (!fRejectedParents) {
-                const auto current_time = GetTime<std::chrono::microseconds>();
-
-                for (const CTxIn &txin : tx.vin) {
-                    // FIXME: MSG_TX should use a TxHash, not a TxId.
-                    const TxId _txid = txin.prevout.GetTxId();
-                    CInv _inv(MSG_TX, _txid);
-                    pfrom->AddInventoryKnown(_inv);
-                    if (!AlreadyHave(_inv)) {
-                        AddTxAnnouncement(txrequest, *pfrom, _txid, current_time);
-                    }
-                }
-                internal::AddOrphanTx(ptx, pfrom->GetId());
-
-                // Once added to the orphan pool, a tx is considered AlreadyHave, and we shouldn't request it anymore.
-                txrequest.ForgetTxId(tx.GetId());
-
-                // DoS prevention: do not allow mapOrphanTransactions to grow
-                // unbounded
-                unsigned int nMaxOrphanTx = (unsigned int)std::max(
-                    int64_t(0), gArgs.GetArg("-maxorphantx",
-                                             DEFAULT_MAX_ORPHAN_TRANSACTIONS));
-                unsigned int nEvicted = internal::LimitOrphanTxSize(nMaxOrphanTx);
-                if (nEvicted > 0) {
-                    LogPrint(BCLog::MEMPOOL,
-                             "mapOrphan overflow, removed %u tx\n", nEvicted);
-                }
-            } else {
-                LogPrint(BCLog::MEMPOOL,
-                         "not keeping orphan with rejected parents %s\n",
-                         tx.GetId().ToString());
-                // We will continue to reject this tx since it has rejected
-                // parents so avoid re-requesting it from other peers.
-                recentRejects->insert(tx.GetId());
-                txrequest.ForgetTxId(tx.GetId());
-            }
-        } else {
-            if (!state.CorruptionPossible()) {
-                assert(recentRejects);
-                recentRejects->insert(tx.GetId());
-                txrequest.ForgetTxId(tx.GetId());
-                if (RecursiveDynamicUsage(*ptx) < 100000) {
-                    AddToCompactExtraTransactions(ptx);
-                }
-            }
-
-            if (pfrom->HasPermission(PF_FORCERELAY)) {
-                // Always relay transactions received from whitelisted peers,
-                // even if they were already in the mempool or rejected from it
-                // due to policy, allowing the node to function as a gateway for
-                // nodes hidden behind it.
-                //
-                // Never relay transactions that we would assign a non-zero DoS
-                // score for, as we expect peers to do the same with us in that
-                // case.
-                int nDoS = 0;
-                if (!state.IsInvalid(nDoS) || nDoS == 0) {
-                    LogPrintf("Force relaying tx %s from whitelisted peer=%d\n",
-                              tx.GetId().ToString(), pfrom->GetId());
-                    RelayTransaction(tx, connman);
-                } else {
-                    LogPrintf("Not relaying invalid transaction %s from "
-                              "whitelisted peer=%d (%s)\n",
-                              tx.GetId().ToString(), pfrom->GetId(),
-                              FormatStateMessage(state));
-                }
-            }
-        }
-
-        // If a tx has been detected by recentRejects, we will have reached
-        // this point and the tx will have been ignored. Because we haven't run
-        // the tx through AcceptToMemoryPool, we won't have computed a DoS
-        // score for it or determined exactly why we consider it invalid.
-        //
-        // This means we won't penalize any peer subsequently relaying a DoSy
-        // tx (even if we penalized the first peer who gave it to us) because
-        // we have to account for recentRejects showing false positives. In
-        // other words, we shouldn't penalize a peer if we aren't *sure* they
-        // submitted a DoSy tx.
-        //
-        // Note that recentRejects doesn't just record DoSy or invalid
-        // transactions, but any tx not accepted by the mempool, which may be
-        // due to node policy (vs. consensus). So we can't blanket penalize a
-        // peer simply for relaying a tx that our recentRejects has caught,
-        // regardless of false positives.
-
-        int nDoS = 0;
-        if (state.IsInvalid(nDoS)) {
-            LogPrint(BCLog::MEMPOOLREJ,
-                     "%s from peer=%d was not accepted: %s\n",
-                     tx.GetHash().ToString(), pfrom->GetId(),
-                     FormatStateMessage(state));
-            // Never send AcceptToMemoryPool's internal codes over P2P.
-            if (enable_bip61 && state.GetRejectCode() > 0 &&
-                state.GetRejectCode() < REJECT_INTERNAL) {
-                connman->PushMessage(
-                    pfrom, msgMaker.Make(NetMsgType::REJECT, msg_type,
-                                         uint8_t(state.GetRejectCode()),
-                                         state.GetRejectReason().substr(
-                                             0, MAX_REJECT_MESSAGE_LENGTH),
-                                         inv.hash));
-            }
-            if (nDoS > 0) {
-                Misbehaving(pfrom, nDoS, state.GetRejectReason());
-            }
         }
         return true;
     }
@@ -3671,7 +3898,7 @@ static bool ProcessMessage(const Config &config, CNode *pfrom,
         }
         pfrom->fSentAddr = true;
 
-        pfrom->vAddrToSend.clear();
+        WITH_LOCK(pfrom->cs_addrSend, pfrom->vAddrToSend.clear());
         std::vector<CAddress> vAddr;
         if (pfrom->HasPermission(PF_ADDR)) {
             vAddr = connman->GetAddresses(MAX_ADDR_TO_SEND, MAX_PCT_ADDR_TO_SEND);
@@ -3987,6 +4214,30 @@ bool PeerLogicValidation::SendRejectsAndCheckIfShouldDiscourage(CNode *pnode,
     return false;
 }
 
+/**
+ * Whether msg is a well-formed TX message that ProcessTxMessages() can process
+ * together with the other TX messages pfrom queued around it. Anything that
+ * needs the per-message handling of ProcessMessages() and ProcessMessage()
+ * ends the run.
+ */
+static bool CanBatchTxMessage(const Config &config, const CNode *pfrom,
+                              const CNetMessage &msg) {
+    if (!pfrom->fSuccessfullyConnected ||
+        (!g_relay_txes && !pfrom->HasPermission(PF_RELAY)) ||
+        gArgs.IsArgSet("-dropmessagestest")) {
+        return false;
+    }
+    if (memcmp(std::begin(msg.hdr.pchMessageStart),
+               std::begin(config.GetChainParams().NetMagic()),
+               CMessageHeader::MESSAGE_START_SIZE) != 0 ||
+        !msg.hdr.IsValid(config) || msg.hdr.GetCommand() != NetMsgType::TX) {
+        return false;
+    }
+    const uint256 &hash = msg.GetMessageHash();
+    return std::memcmp(hash.data(), msg.hdr.pchChecksum,
+                       CMessageHeader::CHECKSUM_SIZE) == 0;
+}
+
 bool PeerLogicValidation::ProcessMessages(const Config &config, CNode *pfrom,
                                           std::atomic<bool> &interruptMsgProc) {
     const CChainParams &chainparams = config.GetChainParams();
@@ -4033,14 +4284,32 @@ bool PeerLogicValidation::ProcessMessages(const Config &config, CNode *pfrom,
         if (pfrom->vProcessMsg.empty()) {
             return false;
         }
-        // Just take one message
+        // Just take one message, or a run of TX messages that are added to
+        // the mempool together
         msgs.splice(msgs.begin(), pfrom->vProcessMsg,
                     pfrom->vProcessMsg.begin());
         pfrom->nProcessQueueSize -=
             msgs.front().vRecv.size() + CMessageHeader::HEADER_SIZE;
+        if (CanBatchTxMessage(config, pfrom, msgs.front())) {
+            while (msgs.size() < MAX_TX_MESSAGES_BATCH &&
+                   !pfrom->vProcessMsg.empty() &&
+                   CanBatchTxMessage(config, pfrom,
+                                     pfrom->vProcessMsg.front())) {
+                msgs.splice(msgs.end(), pfrom->vProcessMsg,
+                            pfrom->vProcessMsg.begin());
+                pfrom->nProcessQueueSize -=
+                    msgs.back().vRecv.size() + CMessageHeader::HEADER_SIZE;
+            }
+        }
+        const bool fWasPaused = pfrom->fPauseRecv;
         pfrom->fPauseRecv =
             pfrom->nProcessQueueSize > connman->GetReceiveFloodSize();
         fMoreWork = !pfrom->vProcessMsg.empty();
+        if (fWasPaused && !pfrom->fPauseRecv) {
+            // Data may be waiting in the socket already, which the socket
+            // handler is not told about again
+            connman->WakeSocketHandler();
+        }
     }
     CNetMessage &msg(msgs.front());
 
@@ -4093,8 +4362,15 @@ bool PeerLogicValidation::ProcessMessages(const Config &config, CNode *pfrom,
     // Process message
     bool fRet = false;
     try {
-        fRet = ProcessMessage(config, pfrom, msg_type, vRecv, msg.nTime,
-                              connman, interruptMsgProc, m_enable_bip61, m_txrequest);
+        if (msgs.size() > 1) {
+            ProcessTxMessages(config, pfrom, msgs, connman, m_enable_bip61,
+                              m_txrequest);
+            fRet = true;
+        } else {
+            fRet = ProcessMessage(config, pfrom, msg_type, vRecv, msg.nTime,
+                                  connman, interruptMsgProc, m_enable_bip61,
+                                  m_txrequest);
+        }
         if (interruptMsgProc) {
             return false;
         }
@@ -4407,7 +4683,6 @@ bool PeerLogicValidation::SendMessages(const Config &config, CNode *pto,
     if (pto->m_next_addr_send < current_time) {
         pto->m_next_addr_send = PoissonNextSend(current_time, AVG_ADDRESS_BROADCAST_INTERVAL);
         std::vector<CAddress> vAddr;
-        vAddr.reserve(pto->vAddrToSend.size());
 
         const char *msg_type;
         int make_flags;
@@ -4419,25 +4694,28 @@ bool PeerLogicValidation::SendMessages(const Config &config, CNode *pto,
             make_flags = 0;
         }
 
-        for (const CAddress &addr : pto->vAddrToSend) {
-            if (!pto->addrKnown.contains(addr.GetKey())) {
-                pto->addrKnown.insert(addr.GetKey());
-                vAddr.push_back(addr);
-                // receiver rejects addr messages larger than MAX_ADDR_TO_SEND
-                if (vAddr.size() >= MAX_ADDR_TO_SEND) {
-                    connman->PushMessage(pto, msgMaker.Make(make_flags, msg_type, vAddr));
-                    vAddr.clear();
+        {
+            LOCK(pto->cs_addrSend);
+            vAddr.reserve(pto->vAddrToSend.size());
+            for (const CAddress &addr : pto->vAddrToSend) {
+                if (!pto->addrKnown.contains(addr.GetKey())) {
+                    pto->addrKnown.insert(addr.GetKey());
+                    vAddr.push_back(addr);
                 }
             }
-        }
-        pto->vAddrToSend.clear();
-        if (!vAddr.empty()) {
-            connman->PushMessage(pto, msgMaker.Make(make_flags, msg_type, vAddr));
+            pto->vAddrToSend.clear();
+
+            // we only send the big addr message once
+            if (pto->vAddrToSend.capacity() > 40) {
+                pto->vAddrToSend.shrink_to_fit();
+            }
         }
 
-        // we only send the big addr message once
-        if (pto->vAddrToSend.capacity() > 40) {
-            pto->vAddrToSend.shrink_to_fit();
+        // receiver rejects addr messages larger than MAX_ADDR_TO_SEND
+        for (size_t i = 0; i < vAddr.size(); i += MAX_ADDR_TO_SEND) {
+            const auto first = vAddr.begin() + i;
+            const auto last = vAddr.begin() + std::min(vAddr.size(), i + MAX_ADDR_TO_SEND);
+            connman->PushMessage(pto, msgMaker.Make(make_flags, msg_type, std::vector<CAddress>(first, last)));
         }
     }
 
@@ -4579,20 +4857,18 @@ bool PeerLogicValidation::SendMessages(const Config &config, CNode *pto,
 
                 int nSendFlags = 0;
 
-                bool fGotBlockFromCache = false;
+                CSharedNetMsgPayloadRef cmpctblockPayload;
                 {
                     LOCK(cs_most_recent_block);
                     if (most_recent_block_hash == pBestIndex->GetBlockHash()) {
-                        CBlockHeaderAndShortTxIDs cmpctblock(
-                            *most_recent_block);
-                        connman->PushMessage(
-                            pto,
-                            msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK,
-                                          cmpctblock));
-                        fGotBlockFromCache = true;
+                        cmpctblockPayload = most_recent_compact_block_payload;
                     }
                 }
-                if (!fGotBlockFromCache) {
+                if (cmpctblockPayload) {
+                    connman->PushMessage(
+                        pto, CNetMsgMaker::MakeShared(NetMsgType::CMPCTBLOCK,
+                                                      std::move(cmpctblockPayload)));
+                } else {
                     CBlock block;
                     bool ret =
                         ReadBlockFromDisk(block, pBestIndex, consensusParams);
@@ -4616,8 +4892,21 @@ bool PeerLogicValidation::SendMessages(const Config &config, CNode *pto,
                              __func__, vHeaders.front().GetHash().ToString(),
                              pto->GetId());
                 }
-                connman->PushMessage(
-                    pto, msgMaker.Make(NetMsgType::HEADERS, vHeaders));
+                CSharedNetMsgPayloadRef headersPayload;
+                if (vHeaders.size() == 1) {
+                    LOCK(cs_most_recent_block);
+                    if (most_recent_block_hash == pBestIndex->GetBlockHash()) {
+                        headersPayload = most_recent_headers_payload;
+                    }
+                }
+                if (headersPayload) {
+                    connman->PushMessage(
+                        pto, CNetMsgMaker::MakeShared(NetMsgType::HEADERS,
+                                                      std::move(headersPayload)));
+                } else {
+                    connman->PushMessage(
+                        pto, msgMaker.Make(NetMsgType::HEADERS, vHeaders));
+                }
                 state.pindexBestHeaderSent = pBestIndex;
             } else {
                 fRevertToInv = true;
@@ -4986,6 +5275,7 @@ bool PeerLogicValidation::SendMessages(const Config &config, CNode *pto,
         if (nNow > pto->nextSendTimeFeeFilter) {
             static CFeeRate default_feerate =
                 CFeeRate(DEFAULT_MIN_RELAY_TX_FEE_PER_KB);
+            // Shared by all message handler threads, guarded by cs_main
             static FeeFilterRounder filterRounder(default_feerate);
             Amount filterToSend = filterRounder.round(currentFilter);
             filterToSend = std::max(filterToSend, ::minRelayTxFee.GetFeePerK());
@@ -39,6 +39,11 @@ class Config;
  * memory.
  */
 static const unsigned int DEFAULT_MAX_ORPHAN_TRANSACTIONS = 100;
+/**
+ * Default for -maxorphantxsize, maximum megabytes of memory used by orphan
+ * transactions.
+ */
+static const unsigned int DEFAULT_MAX_ORPHAN_TRANSACTIONS_SIZE = 20;
 /**
  * Default number of orphan+recently-replaced txn to keep around for block
  * reconstruction.
@@ -4,12 +4,18 @@
 
 #pragma once
 
+#include <core_memusage.h>
 #include <net_nodeid.h>
 #include <primitives/transaction.h>
 #include <sync.h>
+#include <validation.h>
 
+#include <cstddef>
+#include <cstdint>
+#include <limits>
 #include <map>
 #include <set>
+#include <vector>
 
 // `internal` namespace exposed *FOR TESTS ONLY*
 // This namespace is for exposed internals not intended for public usage.
@@ -22,9 +28,11 @@ struct COrphanTx {
     const CTransactionRef tx;
     const NodeId fromPeer;
     const int64_t nTimeExpire;
+    //! Memory used by tx, counted against -maxorphantxsize
+    const size_t nUsage;
 
     COrphanTx(const CTransactionRef &tx_, NodeId peer, int64_t expire)
-        : tx(tx_), fromPeer(peer), nTimeExpire(expire) {}
+        : tx(tx_), fromPeer(peer), nTimeExpire(expire), nUsage(RecursiveDynamicUsage(tx_)) {}
 };
 
 extern RecursiveMutex g_cs_orphans;
@@ -41,12 +49,48 @@ struct IterTxidLess {
 using MapOrphanTransactionsByPrev = std::map<COutPoint, std::set<MapOrphanTransactions::iterator, IterTxidLess>>;
 //! Lookup by coin spent: every txin.prevout for every tx in mapOrphanTransactions has an entry in this map
 extern MapOrphanTransactionsByPrev mapOrphanTransactionsByPrev GUARDED_BY(g_cs_orphans);
+//! Sum of COrphanTx::nUsage over mapOrphanTransactions
+extern size_t nOrphanTransactionsUsage GUARDED_BY(g_cs_orphans);
 
-// Below are the 3 functions that manipulate mapOrphanTransactions and
+//! An orphan that AcceptOrphans() tried to add to the mempool.
+struct OrphanAcceptResult {
+    CTransactionRef tx;
+    NodeId fromPeer;
+    MemPoolAcceptResult result;
+};
+
+// Below are the 4 functions that manipulate mapOrphanTransactions and
 // mapOrphanTransactionsByPrev (implemented in net_processing.cpp).
 bool AddOrphanTx(const CTransactionRef &tx, NodeId peer) EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans);
 void EraseOrphansFor(NodeId peer);
-unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans);
+/**
+ * Evict expired orphans, then evict orphans until there are at most
+ * nMaxOrphans of them using at most nMaxOrphansUsage bytes, each time the
+ * largest of a few picked at random. Returns the number of orphans evicted to
+ * meet the limits.
+ */
+unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans,
+                               size_t nMaxOrphansUsage = std::numeric_limits<size_t>::max());
+//! The maximum number of orphans AcceptOrphans() tries to add at once
+static constexpr size_t MAX_ORPHAN_BATCH_SIZE = 25;
+//! The maximum number of orphans AcceptOrphans() tries to add in one call
+static constexpr size_t MAX_ORPHANS_PER_PASS = 100;
+//! The number of invalid orphans of a peer after which AcceptOrphans() skips
+//! its other orphans for the rest of the call
+static constexpr uint32_t MAX_NON_STANDARD_ORPHAN_PER_NODE = 5;
+
+/**
+ * Try to add the orphans of orphan_work_set, some of whose missing parents
+ * just arrived, to the mempool, together with the orphans that descend from
+ * them, in AcceptToMemoryPoolBatch() calls of up to MAX_ORPHAN_BATCH_SIZE
+ * orphans. Those that were accepted or turned out to be invalid leave the
+ * orphan pool; those still missing inputs stay in it. Orphans of peers with
+ * more than MAX_NON_STANDARD_ORPHAN_PER_NODE invalid ones are skipped. Stops
+ * after MAX_ORPHANS_PER_PASS orphans, leaving the rest in orphan_work_set for
+ * the next call. Returns the results.
+ */
+std::vector<OrphanAcceptResult> AcceptOrphans(const Config &config, std::set<TxId> &orphan_work_set)
+    EXCLUSIVE_LOCKS_REQUIRED(cs_main, g_cs_orphans);
 
 // This function is used for testing the stale tip eviction logic, see
 // denialofservice_tests.cpp.
@@ -28,5 +28,26 @@ public:
         return Make(0, std::move(msg_type), std::forward<Args>(args)...);
     }
 
+    /**
+     * Serialize a payload once, to be sent to several peers with
+     * MakeShared().
+     */
+    template <typename... Args>
+    CSharedNetMsgPayloadRef MakePayload(Args &&... args) const {
+        std::vector<uint8_t> data;
+        CVectorWriter{SER_NETWORK, nVersion, data, 0,
+                      std::forward<Args>(args)...};
+        return std::make_shared<const CSharedNetMsgPayload>(std::move(data));
+    }
+
+    /** Make a message sending a payload shared with other messages. */
+    static CSerializedNetMsg MakeShared(std::string msg_type,
+                                        CSharedNetMsgPayloadRef payload) {
+        CSerializedNetMsg msg;
+        msg.m_type = std::move(msg_type);
+        msg.shared_data = std::move(payload);
+        return msg;
+    }
+
     const int nVersion;
 };
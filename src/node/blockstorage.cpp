@@ -10,6 +10,7 @@
 #include <clientversion.h>
 #include <config.h>
 #include <consensus/validation.h>
+#include <crypto/common.h>
 #include <dsproof/dsproof.h>
 #include <flatfile.h>
 #include <fs.h>
@@ -23,12 +24,17 @@
 #include <util/time.h>
 #include <validation.h>
 
+#include <algorithm>
+#include <map>
+#include <memory>
+
 std::atomic_bool fImporting(false);
 std::atomic_bool fReindex(false);
 bool fHavePruned GUARDED_BY(cs_main) = false;
 bool fPruneMode = false;
 uint64_t nPruneTarget = 0;
 bool fCheckBlockReads = false;
+bool fMapBlockFiles = false;
 
 RecursiveMutex cs_LastBlockFile;
 std::vector<CBlockFileInfo> vinfoBlockFile GUARDED_BY(cs_LastBlockFile);
@@ -50,6 +56,103 @@ static FILE *OpenUndoFile(const FlatFilePos &pos, bool fReadOnly = false);
 static FlatFileSeq BlockFileSeq();
 static FlatFileSeq UndoFileSeq();
 
+namespace {
+/**
+ * The memory mappings of the block and undo files that are read with
+ * -mmapblockfiles. At most MAX_MAPPED_BLOCK_FILES files are kept mapped, the
+ * least recently used one is unmapped to make room for another one. Readers
+ * hold on to the mapping they use, so it is only unmapped once they are done.
+ */
+class BlockFileMappings {
+    struct Entry {
+        std::shared_ptr<const MappedFlatFile> file;
+        uint64_t nLastUse;
+    };
+
+    Mutex cs;
+    //! By file number and whether it is an undo file
+    std::map<std::pair<int, bool>, Entry> entries GUARDED_BY(cs);
+    uint64_t nUses GUARDED_BY(cs){0};
+
+public:
+    /**
+     * Get a mapping of the first nMinSize bytes of block or undo file nFile,
+     * mapping the file again if it grew since it was last mapped. Returns
+     * nullptr if the file cannot be mapped or is too small.
+     */
+    std::shared_ptr<const MappedFlatFile> Get(int nFile, bool fUndo,
+                                              size_t nMinSize) {
+        LOCK(cs);
+        const auto key = std::make_pair(nFile, fUndo);
+        auto it = entries.find(key);
+        if (it == entries.end() ||
+            it->second.file->GetData().size() < nMinSize) {
+            const FlatFilePos pos(nFile, 0);
+            auto file = fUndo ? UndoFileSeq().Map(pos) : BlockFileSeq().Map(pos);
+            if (!file) {
+                return nullptr;
+            }
+            if (it == entries.end()) {
+                if (entries.size() >= MAX_MAPPED_BLOCK_FILES) {
+                    entries.erase(std::min_element(
+                        entries.begin(), entries.end(),
+                        [](const auto &a, const auto &b) {
+                            return a.second.nLastUse < b.second.nLastUse;
+                        }));
+                }
+                it = entries.emplace(key, Entry{}).first;
+            }
+            it->second.file = std::move(file);
+        }
+        it->second.nLastUse = ++nUses;
+        if (it->second.file->GetData().size() < nMinSize) {
+            return nullptr;
+        }
+        return it->second.file;
+    }
+
+    /** Unmap the block and undo files nFile, which may have been truncated. */
+    void Forget(int nFile) {
+        LOCK(cs);
+        entries.erase(std::make_pair(nFile, false));
+        entries.erase(std::make_pair(nFile, true));
+    }
+};
+
+BlockFileMappings g_block_file_mappings;
+} // namespace
+
+/**
+ * Find the record of a block or undo file at pos in the mapping of its file,
+ * with -mmapblockfiles. A record is preceded by the disk magic and its size,
+ * and followed by nTrailer more bytes. Returns false if the file cannot be
+ * mapped or the record is not within it, in which case the caller reads the
+ * file instead. Otherwise, record is valid for as long as file is held.
+ */
+static bool GetMappedRecord(const FlatFilePos &pos, bool fUndo,
+                            size_t nTrailer,
+                            std::shared_ptr<const MappedFlatFile> &file,
+                            Span<const uint8_t> &record) {
+    const size_t nHeaderSize = CMessageHeader::MESSAGE_START_SIZE + 4;
+    if (!fMapBlockFiles || pos.IsNull() || pos.nPos < nHeaderSize) {
+        return false;
+    }
+    file = g_block_file_mappings.Get(pos.nFile, fUndo, pos.nPos);
+    if (!file) {
+        return false;
+    }
+    const size_t nSize = ReadLE32(file->GetData().data() + pos.nPos - 4);
+    const size_t nEnd = size_t(pos.nPos) + nSize + nTrailer;
+    if (file->GetData().size() < nEnd) {
+        file = g_block_file_mappings.Get(pos.nFile, fUndo, nEnd);
+        if (!file) {
+            return false;
+        }
+    }
+    record = file->GetData().subspan(pos.nPos, nSize);
+    return true;
+}
+
 bool IsBlockPruned(const CBlockIndex *pblockindex) EXCLUSIVE_LOCKS_REQUIRED(cs_main) {
     return fHavePruned && !pblockindex->nStatus.hasData() && pblockindex->nTx > 0;
 }
@@ -145,6 +248,29 @@ bool UndoReadFromDisk(CBlockUndo &blockundo, const CBlockIndex *pindex) {
         return error("%s: no undo data available", __func__);
     }
 
+    std::shared_ptr<const MappedFlatFile> file;
+    Span<const uint8_t> record;
+    if (GetMappedRecord(pos, true, uint256::size(), file, record)) {
+        CHashWriter hasher(SER_GETHASH, PROTOCOL_VERSION);
+        hasher << pindex->pprev->GetBlockHash();
+        hasher.write(reinterpret_cast<const char *>(record.data()),
+                     record.size());
+        try {
+            GenericVectorReader<Span<const uint8_t>>(SER_DISK, CLIENT_VERSION,
+                                                     record, 0) >>
+                blockundo;
+        } catch (const std::exception &e) {
+            return error("%s: Deserialize or I/O error - %s", __func__,
+                         e.what());
+        }
+        const uint256 hashChecksum = hasher.GetHash();
+        if (!std::equal(hashChecksum.begin(), hashChecksum.end(),
+                        record.end())) {
+            return error("%s: Checksum mismatch", __func__);
+        }
+        return true;
+    }
+
     // Open history file to read
     CAutoFile filein(OpenUndoFile(pos, true), SER_DISK, CLIENT_VERSION);
     if (filein.IsNull()) {
@@ -179,6 +305,12 @@ void FlushBlockFile(bool fFinalize = false) {
     FlatFilePos undo_pos_old(nLastBlockFile,
                              vinfoBlockFile[nLastBlockFile].nUndoSize);
 
+    if (fFinalize) {
+        // Finalizing truncates the files, so their mappings may extend beyond
+        // their end.
+        g_block_file_mappings.Forget(nLastBlockFile);
+    }
+
     bool status = true;
     status &= BlockFileSeq().Flush(block_pos_old, fFinalize);
     status &= UndoFileSeq().Flush(undo_pos_old, fFinalize);
@@ -202,6 +334,7 @@ uint64_t CalculateCurrentUsage() {
 void UnlinkPrunedFiles(const std::set<int> &setFilesToPrune) {
     for (const int i : setFilesToPrune) {
         FlatFilePos pos(i, 0);
+        g_block_file_mappings.Forget(i);
         fs::remove(BlockFileSeq().FileName(pos));
         fs::remove(UndoFileSeq().FileName(pos));
         LogPrintf("Prune: %s deleted blk/rev (%05u)\n", __func__, i);
@@ -225,7 +358,7 @@ static FILE *OpenUndoFile(const FlatFilePos &pos, bool fReadOnly) {
     return UndoFileSeq().Open(pos, fReadOnly);
 }
 
-static fs::path GetBlockPosFilename(const FlatFilePos &pos) {
+fs::path GetBlockPosFilename(const FlatFilePos &pos) {
     return BlockFileSeq().FileName(pos);
 }
 
@@ -359,19 +492,33 @@ bool ReadBlockFromDisk(CBlock &block, const FlatFilePos &pos,
                        const Consensus::Params &params) {
     block.SetNull();
 
-    // Open history file to read
-    CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull()) {
-        return error("ReadBlockFromDisk: OpenBlockFile failed for %s",
-                     pos.ToString());
-    }
+    std::shared_ptr<const MappedFlatFile> file;
+    Span<const uint8_t> record;
+    if (GetMappedRecord(pos, false, 0, file, record)) {
+        // Deserialize the block straight from the mapping
+        try {
+            GenericVectorReader<Span<const uint8_t>>(SER_DISK, CLIENT_VERSION,
+                                                     record, 0) >>
+                block;
+        } catch (const std::exception &e) {
+            return error("%s: Deserialize or I/O error - %s at %s", __func__,
+                         e.what(), pos.ToString());
+        }
+    } else {
+        // Open history file to read
+        CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
+        if (filein.IsNull()) {
+            return error("ReadBlockFromDisk: OpenBlockFile failed for %s",
+                         pos.ToString());
+        }
 
-    // Read block
-    try {
-        filein >> block;
-    } catch (const std::exception &e) {
-        return error("%s: Deserialize or I/O error - %s at %s", __func__,
-                     e.what(), pos.ToString());
+        // Read block
+        try {
+            filein >> block;
+        } catch (const std::exception &e) {
+            return error("%s: Deserialize or I/O error - %s at %s", __func__,
+                         e.what(), pos.ToString());
+        }
     }
 
     // Check the header
@@ -469,23 +616,51 @@ std::optional<uint64_t> ReadBlockSizeFromDisk(const CBlockIndex *pindex, const C
     return blockSize;
 }
 
+/**
+ * Copy the raw block data from the mapping of its file, with -mmapblockfiles.
+ * Returns false if it cannot be found there, in which case the caller reads
+ * the file instead.
+ */
+static bool ReadMappedRawBlock(std::vector<uint8_t> &rawBlock, const FlatFilePos &blockPos,
+                               const CChainParams &chainParams) {
+    std::shared_ptr<const MappedFlatFile> file;
+    Span<const uint8_t> record;
+    if (!GetMappedRecord(blockPos, false, 0, file, record)) {
+        return false;
+    }
+    // verify disk magic to validate block position inside the file, and check the block size for sanity, like
+    // ReadBlockSizeCommon()
+    const uint8_t *magic = record.data() - CMessageHeader::MESSAGE_START_SIZE - 4;
+    if (!std::equal(chainParams.DiskMagic().begin(), chainParams.DiskMagic().end(), magic) ||
+        record.size() < BLOCK_HEADER_SIZE || record.size() > MAX_CONSENSUS_BLOCK_SIZE) {
+        return false;
+    }
+    rawBlock.assign(record.begin(), record.end());
+    return true;
+}
+
 bool ReadRawBlockFromDisk(std::vector<uint8_t> &rawBlock, const CBlockIndex *pindex,
                           const CChainParams &chainParams, int nType, int nVersion) {
-    uint64_t blockSize;
     FlatFilePos blockPos;
-    auto optFile = ReadBlockSizeCommon(blockSize, pindex, chainParams, &blockPos);
-    if (!optFile) {
-        // error message already generated by ReadBlockSizeCommon() above
-        return false;
-    }
+    if (fMapBlockFiles) {
+        blockPos = WITH_LOCK(cs_main, return pindex->GetBlockPos());
+    }
+    if (!fMapBlockFiles || !ReadMappedRawBlock(rawBlock, blockPos, chainParams)) {
+        uint64_t blockSize;
+        auto optFile = ReadBlockSizeCommon(blockSize, pindex, chainParams, &blockPos);
+        if (!optFile) {
+            // error message already generated by ReadBlockSizeCommon() above
+            return false;
+        }
 
-    try {
-        // populate data
-        rawBlock.resize(blockSize);
-        *optFile >> Span{rawBlock};
-    } catch (const std::exception &e) {
-        return error("%s: failed to read block data from disk for %s. Original exception: %s",
-                     __func__, blockPos.ToString(), e.what());
+        try {
+            // populate data
+            rawBlock.resize(blockSize);
+            *optFile >> Span{rawBlock};
+        } catch (const std::exception &e) {
+            return error("%s: failed to read block data from disk for %s. Original exception: %s",
+                         __func__, blockPos.ToString(), e.what());
+        }
     }
 
     if (fCheckBlockReads) {
@@ -569,23 +744,7 @@ void ThreadImport(const Config &config, std::vector<fs::path> vImportFiles) {
 
         // -reindex
         if (fReindex) {
-            int nFile = 0;
-            while (true) {
-                FlatFilePos pos(nFile, 0);
-                if (!fs::exists(GetBlockPosFilename(pos))) {
-                    // No block files left to reindex
-                    break;
-                }
-                FILE *file = OpenBlockFile(pos, true);
-                if (!file) {
-                    // This error is logged in OpenBlockFile
-                    break;
-                }
-                LogPrintf("Reindexing block file blk%05u.dat...\n",
-                          (unsigned int)nFile);
-                LoadExternalBlockFile(config, file, &pos);
-                nFile++;
-            }
+            ReindexBlockFiles(config);
             pblocktree->WriteReindexing(false);
             fReindex = false;
             LogPrintf("Reindexing finished\n");
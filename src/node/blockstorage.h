@@ -36,6 +36,10 @@ static constexpr unsigned int BLOCKFILE_CHUNK_SIZE = 0x1000000; // 16 MiB
 static constexpr unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
 /** The maximum size of a blk?????.dat file (since 0.8) */
 static constexpr unsigned int MAX_BLOCKFILE_SIZE = 0x8000000; // 128 MiB
+/** Default for -mmapblockfiles */
+static constexpr bool DEFAULT_MMAP_BLOCK_FILES = false;
+/** The maximum number of block and undo files kept mapped with -mmapblockfiles */
+static constexpr size_t MAX_MAPPED_BLOCK_FILES = 64;
 
 /** External lock; lives in validation.cpp; used for some of the variables and functions below. */
 extern RecursiveMutex cs_main;
@@ -50,6 +54,8 @@ extern bool fPruneMode;
 /** Number of MiB of block files that we're trying to stay below. */
 extern uint64_t nPruneTarget;
 extern bool fCheckBlockReads;
+/** True if blocks and undo data are read through memory mappings of their files (-mmapblockfiles). */
+extern bool fMapBlockFiles;
 extern RecursiveMutex cs_LastBlockFile;
 extern std::vector<CBlockFileInfo> vinfoBlockFile GUARDED_BY(cs_LastBlockFile);
 extern int nLastBlockFile GUARDED_BY(cs_LastBlockFile);
@@ -67,6 +73,9 @@ void CleanupBlockRevFiles();
  */
 FILE *OpenBlockFile(const FlatFilePos &pos, bool fReadOnly = false);
 
+/** Translation to a filesystem path. */
+fs::path GetBlockPosFilename(const FlatFilePos &pos);
+
 /** Get block file info entry for one block file */
 CBlockFileInfo *GetBlockFileInfo(size_t n);
 
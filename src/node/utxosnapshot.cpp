@@ -0,0 +1,437 @@
+// Copyright (c) 2026 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <node/utxosnapshot.h>
+
+#include <chain.h>
+#include <chainparams.h>
+#include <checkqueue.h>
+#include <clientversion.h>
+#include <coins.h>
+#include <config.h>
+#include <consensus/validation.h>
+#include <hash.h>
+#include <index/coinstatsindex.h>
+#include <logging.h>
+#include <node/blockstorage.h>
+#include <shutdown.h>
+#include <streams.h>
+#include <txdb.h>
+#include <util/system.h>
+#include <validation.h>
+
+#include <algorithm>
+#include <cassert>
+#include <exception>
+
+namespace {
+
+/** A chunk of a snapshot file, as it is being written or read. */
+struct SnapshotChunk {
+    SnapshotCoins coins;
+    std::vector<uint8_t> payload;
+    uint256 checksum;
+    IndexedCoinsStats stats;
+};
+
+/**
+ * Serialize the coins of a chunk into its payload, checksum the latter and
+ * compute the statistics of the coins.
+ */
+class SnapshotEncodeCheck {
+    SnapshotChunk *chunk;
+
+public:
+    SnapshotEncodeCheck() : chunk(nullptr) {}
+    explicit SnapshotEncodeCheck(SnapshotChunk *chunkIn) : chunk(chunkIn) {}
+
+    bool operator()() {
+        CVectorWriter writer(SER_DISK, CLIENT_VERSION, chunk->payload, 0);
+        for (const auto &[outpoint, coin] : chunk->coins) {
+            writer << outpoint << coin;
+            CoinStatsIndex::ApplyCoin(chunk->stats, outpoint, coin, true);
+        }
+        chunk->checksum = Hash(chunk->payload);
+        return true;
+    }
+};
+
+/**
+ * Verify the checksum of the payload of a chunk, deserialize its coins and
+ * compute their statistics. The number of coins must already be set.
+ */
+class SnapshotDecodeCheck {
+    SnapshotChunk *chunk;
+
+public:
+    SnapshotDecodeCheck() : chunk(nullptr) {}
+    explicit SnapshotDecodeCheck(SnapshotChunk *chunkIn) : chunk(chunkIn) {}
+
+    bool operator()() {
+        if (Hash(chunk->payload) != chunk->checksum) {
+            return error("UTXO snapshot chunk checksum mismatch");
+        }
+        try {
+            VectorReader reader(SER_DISK, CLIENT_VERSION, chunk->payload, 0);
+            for (auto &[outpoint, coin] : chunk->coins) {
+                reader >> outpoint >> coin;
+                if (coin.IsSpent()) {
+                    return error("UTXO snapshot contains a spent coin");
+                }
+                CoinStatsIndex::ApplyCoin(chunk->stats, outpoint, coin, true);
+            }
+            if (!reader.empty()) {
+                return error("UTXO snapshot chunk has trailing data");
+            }
+        } catch (const std::exception &e) {
+            return error("UTXO snapshot chunk is malformed: %s", e.what());
+        }
+        return true;
+    }
+};
+
+/**
+ * Runs checks on all cores for the duration of a snapshot dump or load. The
+ * calling thread helps while it waits for them.
+ */
+template <typename T> class SnapshotWorkers {
+    CCheckQueue<T> queue{1};
+
+public:
+    SnapshotWorkers() {
+        queue.StartWorkerThreads(std::max(GetNumCores(), 1) - 1, "snapshot");
+    }
+    ~SnapshotWorkers() { queue.StopWorkerThreads(); }
+
+    //! The number of chunks to process at once
+    static size_t WindowSize() {
+        return 2 * size_t(std::max(GetNumCores(), 1));
+    }
+
+    //! Run one check on each of chunks, and return whether all succeeded.
+    bool Run(std::vector<SnapshotChunk> &chunks) {
+        std::vector<T> checks;
+        checks.reserve(chunks.size());
+        for (SnapshotChunk &chunk : chunks) {
+            checks.emplace_back(&chunk);
+        }
+        CCheckQueueControl<T> control(&queue);
+        control.Add(checks);
+        return control.Wait();
+    }
+};
+
+void AddStats(IndexedCoinsStats &stats, const IndexedCoinsStats &other) {
+    stats.nTransactionOutputs += other.nTransactionOutputs;
+    stats.nBogoSize += other.nBogoSize;
+    stats.nTotalAmount += other.nTotalAmount;
+    stats.nTokenOutputs += other.nTokenOutputs;
+    stats.nNFTOutputs += other.nNFTOutputs;
+    stats.multiset.Combine(other.multiset);
+}
+
+} // namespace
+
+bool WriteUTXOSnapshot(CAutoFile &file, CCoinsViewCursor &cursor,
+                       const CBlockIndex &base, const CChainParams &params,
+                       SnapshotMetadata &metadata) {
+    assert(cursor.GetBestBlock() == base.GetBlockHash());
+    metadata.hashBase = base.GetBlockHash();
+    metadata.nHeight = base.nHeight;
+    metadata.nCoins = 0;
+    {
+        LOCK(cs_main);
+        metadata.nChainTx = base.nChainTx;
+        metadata.vBlocks.assign(base.nHeight, SnapshotBlock());
+        for (const CBlockIndex *pindex = &base; pindex->pprev;
+             pindex = pindex->pprev) {
+            SnapshotBlock &block = metadata.vBlocks[pindex->nHeight - 1];
+            block.header = pindex->GetBlockHeader();
+            block.ablaState = pindex->GetAblaStateOpt();
+        }
+    }
+
+    SnapshotWorkers<SnapshotEncodeCheck> workers;
+    IndexedCoinsStats stats;
+    try {
+        file << SNAPSHOT_MAGIC << SNAPSHOT_VERSION << params.DiskMagic()
+             << metadata.hashBase << int32_t(metadata.nHeight)
+             << metadata.nChainTx << metadata.vBlocks
+             << SerializeHash(metadata.vBlocks);
+
+        std::vector<SnapshotChunk> chunks;
+        while (cursor.Valid()) {
+            if (ShutdownRequested()) {
+                return error("%s: interrupted", __func__);
+            }
+
+            // Read a window of chunks from the cursor, serialize them in
+            // parallel and write them out in order.
+            chunks.clear();
+            while (cursor.Valid() && chunks.size() < workers.WindowSize()) {
+                SnapshotChunk &chunk = chunks.emplace_back();
+                chunk.coins.reserve(SNAPSHOT_CHUNK_COINS);
+                while (cursor.Valid() &&
+                       chunk.coins.size() < SNAPSHOT_CHUNK_COINS) {
+                    auto &[outpoint, coin] = chunk.coins.emplace_back();
+                    if (!cursor.GetKey(outpoint) || !cursor.GetValue(coin)) {
+                        return error("%s: unable to read value", __func__);
+                    }
+                    cursor.Next();
+                }
+            }
+            workers.Run(chunks);
+
+            for (const SnapshotChunk &chunk : chunks) {
+                file << uint32_t(chunk.coins.size()) << chunk.payload
+                     << chunk.checksum;
+                AddStats(stats, chunk.stats);
+            }
+            metadata.nCoins = stats.nTransactionOutputs;
+            LogPrintf("Wrote %u coins to UTXO snapshot\n", metadata.nCoins);
+        }
+
+        metadata.hashMultiSet = stats.multiset.GetHash();
+        file << uint32_t(0) << metadata.nCoins << metadata.hashMultiSet;
+    } catch (const std::exception &e) {
+        return error("%s: failed to write UTXO snapshot: %s", __func__,
+                     e.what());
+    }
+    return true;
+}
+
+bool ReadUTXOSnapshotHeader(CAutoFile &file, const CChainParams &params,
+                            SnapshotMetadata &metadata) {
+    try {
+        std::array<uint8_t, SNAPSHOT_MAGIC.size()> magic;
+        uint16_t nVersion;
+        CMessageHeader::MessageMagic diskMagic;
+        int32_t nHeight;
+        file >> magic >> nVersion >> diskMagic;
+        if (magic != SNAPSHOT_MAGIC) {
+            return error("%s: not a UTXO snapshot", __func__);
+        }
+        if (nVersion != SNAPSHOT_VERSION) {
+            return error("%s: unsupported UTXO snapshot version %u", __func__,
+                         nVersion);
+        }
+        if (diskMagic != params.DiskMagic()) {
+            return error("%s: UTXO snapshot is of another network", __func__);
+        }
+
+        uint256 checksum;
+        file >> metadata.hashBase >> nHeight >> metadata.nChainTx >>
+            metadata.vBlocks >> checksum;
+        metadata.nHeight = nHeight;
+        if (nHeight < 0 || metadata.vBlocks.size() != size_t(nHeight)) {
+            return error("%s: UTXO snapshot has %u blocks, expected %d",
+                         __func__, metadata.vBlocks.size(), nHeight);
+        }
+        if (SerializeHash(metadata.vBlocks) != checksum) {
+            return error("%s: UTXO snapshot blocks checksum mismatch",
+                         __func__);
+        }
+        BlockHash hashPrev = params.GetConsensus().hashGenesisBlock;
+        for (const SnapshotBlock &block : metadata.vBlocks) {
+            if (block.header.hashPrevBlock != hashPrev) {
+                return error("%s: UTXO snapshot blocks do not form a chain",
+                             __func__);
+            }
+            hashPrev = block.header.GetHash();
+        }
+        if (hashPrev != metadata.hashBase) {
+            return error("%s: UTXO snapshot blocks do not lead to its base "
+                         "block",
+                         __func__);
+        }
+    } catch (const std::exception &e) {
+        return error("%s: failed to read UTXO snapshot: %s", __func__,
+                     e.what());
+    }
+    return true;
+}
+
+bool ReadUTXOSnapshotCoins(
+    CAutoFile &file, SnapshotMetadata &metadata,
+    const std::function<bool(SnapshotCoins &coins)> &consume) {
+    SnapshotWorkers<SnapshotDecodeCheck> workers;
+    IndexedCoinsStats stats;
+    try {
+        std::vector<SnapshotChunk> chunks;
+        bool fDone = false;
+        while (!fDone) {
+            if (ShutdownRequested()) {
+                return error("%s: interrupted", __func__);
+            }
+
+            // Read a window of chunks, verify and deserialize them in parallel
+            // and hand them over in order.
+            chunks.clear();
+            while (!fDone && chunks.size() < workers.WindowSize()) {
+                uint32_t nCoins;
+                file >> nCoins;
+                if (nCoins == 0) {
+                    fDone = true;
+                    break;
+                }
+                if (nCoins > SNAPSHOT_CHUNK_COINS) {
+                    return error("%s: oversized UTXO snapshot chunk", __func__);
+                }
+                SnapshotChunk &chunk = chunks.emplace_back();
+                chunk.coins.resize(nCoins);
+                file >> chunk.payload >> chunk.checksum;
+            }
+            if (!workers.Run(chunks)) {
+                return error("%s: invalid UTXO snapshot chunk", __func__);
+            }
+
+            for (SnapshotChunk &chunk : chunks) {
+                if (!consume(chunk.coins)) {
+                    return false;
+                }
+                AddStats(stats, chunk.stats);
+            }
+            LogPrintf("Read %u coins from UTXO snapshot\n",
+                      stats.nTransactionOutputs);
+        }
+
+        file >> metadata.nCoins >> metadata.hashMultiSet;
+    } catch (const std::exception &e) {
+        return error("%s: failed to read UTXO snapshot: %s", __func__,
+                     e.what());
+    }
+
+    if (stats.nTransactionOutputs != metadata.nCoins) {
+        return error("%s: UTXO snapshot has %u coins, expected %u", __func__,
+                     stats.nTransactionOutputs, metadata.nCoins);
+    }
+    if (stats.multiset.GetHash() != metadata.hashMultiSet) {
+        return error("%s: UTXO snapshot has ECMultiSet hash %s, expected %s",
+                     __func__, stats.multiset.GetHash().GetHex(),
+                     metadata.hashMultiSet.GetHex());
+    }
+    return true;
+}
+
+bool LoadUTXOSnapshot(const fs::path &path, CCoinsViewDB &view,
+                      const Config &config, const uint256 &hashExpected,
+                      const BlockHash &hashBaseExpected) {
+    AssertLockHeld(cs_main);
+    const CChainParams &params = config.GetChainParams();
+
+    if (!view.GetBestBlock().IsNull() || !view.GetHeadBlocks().empty()) {
+        return error("%s: the chainstate is not empty", __func__);
+    }
+    // The trailer of a snapshot only proves that the file is consistent with
+    // itself, so its hash must be committed to by a trusted source.
+    if (hashExpected.IsNull()) {
+        return error("%s: no expected ECMultiSet hash for the UTXO snapshot",
+                     __func__);
+    }
+
+    SnapshotMetadata metadata;
+    const auto OpenSnapshot = [&]() {
+        CAutoFile file(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+        if (file.IsNull()) {
+            error("%s: failed to open %s", __func__, path.string());
+        } else if (!ReadUTXOSnapshotHeader(file, params, metadata)) {
+            file.fclose();
+        }
+        return file;
+    };
+
+    // Verify the whole file before writing anything, so that the chainstate
+    // never contains coins of an invalid snapshot.
+    bool fAssumeBase;
+    {
+        CAutoFile file = OpenSnapshot();
+        if (file.IsNull()) {
+            return false;
+        }
+
+        if (!hashBaseExpected.IsNull() &&
+            metadata.hashBase != hashBaseExpected) {
+            return error("%s: UTXO snapshot is as of block %s, expected %s",
+                         __func__, metadata.hashBase.ToString(),
+                         hashBaseExpected.ToString());
+        }
+        const CBlockIndex *pindex = LookupBlockIndex(metadata.hashBase);
+        if (pindex && pindex->nHeight != metadata.nHeight) {
+            return error("%s: the base block %s of the UTXO snapshot is at "
+                         "height %d, not %d",
+                         __func__, metadata.hashBase.ToString(),
+                         pindex->nHeight, metadata.nHeight);
+        }
+        // Only the expected base block hash vouches for the headers and ABLA
+        // states of a chain that has not been validated, and the blocks that
+        // were never downloaded cannot be served.
+        fAssumeBase = !pindex || !pindex->IsValid(BlockValidity::SCRIPTS) ||
+                      !pindex->nStatus.hasData();
+        if (fAssumeBase && hashBaseExpected.IsNull()) {
+            return error("%s: the base block %s of the UTXO snapshot has not "
+                         "been validated, and no expected base block was "
+                         "given",
+                         __func__, metadata.hashBase.ToString());
+        }
+        if (fAssumeBase && !fPruneMode) {
+            return error("%s: the base block %s of the UTXO snapshot has not "
+                         "been validated, which requires pruning",
+                         __func__, metadata.hashBase.ToString());
+        }
+
+        LogPrintf("Verifying UTXO snapshot %s of block %s (%d)\n",
+                  path.string(), metadata.hashBase.ToString(),
+                  metadata.nHeight);
+        if (!ReadUTXOSnapshotCoins(file, metadata,
+                                   [](SnapshotCoins &) { return true; })) {
+            return false;
+        }
+        if (metadata.hashMultiSet != hashExpected) {
+            return error("%s: UTXO snapshot has ECMultiSet hash %s, expected "
+                         "%s",
+                         __func__, metadata.hashMultiSet.GetHex(),
+                         hashExpected.GetHex());
+        }
+    }
+
+    if (fAssumeBase) {
+        LogPrintf("Accepting the %u blocks up to the base block of the UTXO "
+                  "snapshot\n",
+                  metadata.vBlocks.size());
+        CValidationState state;
+        if (!AssumeSnapshotChain(config, metadata.vBlocks, metadata.nChainTx,
+                                 state)) {
+            return error("%s: invalid UTXO snapshot chain: %s", __func__,
+                         FormatStateMessage(state));
+        }
+    }
+
+    LogPrintf("Loading %u coins from UTXO snapshot with ECMultiSet hash %s\n",
+              metadata.nCoins, metadata.hashMultiSet.GetHex());
+    const BlockHash hashBase = metadata.hashBase;
+    CAutoFile file = OpenSnapshot();
+    if (file.IsNull()) {
+        return false;
+    }
+    if (metadata.hashBase != hashBase) {
+        return error("%s: UTXO snapshot changed while it was loaded", __func__);
+    }
+    if (!ReadUTXOSnapshotCoins(file, metadata,
+                               [&](SnapshotCoins &coins) {
+                                   return view.WriteSnapshotCoins(
+                                       coins, hashBase, false);
+                               }) ||
+        metadata.hashMultiSet != hashExpected) {
+        // The file changed since it was verified, or could not be written.
+        // Do not leave a partial UTXO set behind for ReplayBlocks() to adopt.
+        error("%s: failed to load UTXO snapshot, erasing the coins written "
+              "so far",
+              __func__);
+        if (!view.EraseSnapshotCoins()) {
+            error("%s: failed to erase the UTXO snapshot coins", __func__);
+        }
+        return false;
+    }
+    return view.WriteSnapshotCoins({}, hashBase, true);
+}
@@ -0,0 +1,136 @@
+// Copyright (c) 2026 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once
+
+#include <consensus/abla.h>
+#include <fs.h>
+#include <primitives/block.h>
+#include <primitives/blockhash.h>
+#include <serialize.h>
+#include <sync.h>
+#include <uint256.h>
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <utility>
+#include <vector>
+
+class CAutoFile;
+class CBlockIndex;
+class CChainParams;
+class CCoinsViewCursor;
+class CCoinsViewDB;
+class Coin;
+class Config;
+class COutPoint;
+
+extern RecursiveMutex cs_main;
+
+/**
+ * A UTXO snapshot file holds the UTXO set as of a block. It consists of
+ *
+ * - a header: SNAPSHOT_MAGIC, SNAPSHOT_VERSION, the disk magic of the network,
+ *   the hash and the height of the block;
+ * - the blocks of the chain up to the block: the number of transactions up to
+ *   and including the block, the header and ABLA state of every block after
+ *   the genesis block, and the double SHA256 of the latter;
+ * - chunks of up to SNAPSHOT_CHUNK_COINS coins: the number of coins, the
+ *   outpoints and coins serialized as in the coins database, and the double
+ *   SHA256 of the latter;
+ * - an empty chunk, which is just a zero number of coins;
+ * - a trailer: the total number of coins and the hash of their ECMultiSet,
+ *   which equals the ecmultiset_hash reported by gettxoutsetinfo (see
+ *   CoinStatsIndex::ApplyCoin()).
+ *
+ * The chunks are serialized, checksummed and hashed into the multiset in
+ * parallel, both when writing and when reading the file.
+ */
+static constexpr std::array<uint8_t, 5> SNAPSHOT_MAGIC = {
+    {'u', 't', 'x', 'o', 0xff}};
+static constexpr uint16_t SNAPSHOT_VERSION = 1;
+//! The maximum number of coins in a chunk of a snapshot file
+static constexpr uint32_t SNAPSHOT_CHUNK_COINS = 1 << 14;
+
+//! The outpoints and coins of a chunk of a snapshot file
+using SnapshotCoins = std::vector<std::pair<COutPoint, Coin>>;
+
+/**
+ * A block of the chain up to the base block of a snapshot file. It lets a node
+ * that has not seen the chain load the snapshot (see AssumeSnapshotChain()).
+ */
+struct SnapshotBlock {
+    CBlockHeader header;
+    //! The ABLA state of the block, if upgrade 10 had activated by then
+    std::optional<abla::State> ablaState;
+
+    SERIALIZE_METHODS(SnapshotBlock, obj) {
+        READWRITE(obj.header, obj.ablaState);
+    }
+};
+
+/** What a snapshot file says about its contents. */
+struct SnapshotMetadata {
+    //! The block the UTXO set is as of
+    BlockHash hashBase;
+    int nHeight{-1};
+    //! The number of transactions up to and including that block
+    uint64_t nChainTx{0};
+    //! The blocks from height 1 up to and including that block
+    std::vector<SnapshotBlock> vBlocks;
+    //! The number of coins in the file
+    uint64_t nCoins{0};
+    //! The ECMultiSet hash of the coins in the file
+    uint256 hashMultiSet;
+};
+
+/**
+ * Write a snapshot of the coins of cursor, which are the UTXO set as of block
+ * base, to file. Fills in metadata. Returns false on failure, or if shutdown
+ * was requested.
+ */
+bool WriteUTXOSnapshot(CAutoFile &file, CCoinsViewCursor &cursor,
+                       const CBlockIndex &base, const CChainParams &params,
+                       SnapshotMetadata &metadata) LOCKS_EXCLUDED(cs_main);
+
+/**
+ * Read the header and the blocks of a snapshot file into metadata. Returns
+ * false if the file is not a snapshot of this network, or if the blocks are
+ * corrupt or do not lead from the genesis block to the base block.
+ */
+bool ReadUTXOSnapshotHeader(CAutoFile &file, const CChainParams &params,
+                            SnapshotMetadata &metadata);
+
+/**
+ * Read the coins of a snapshot file whose header has been read into metadata,
+ * and fill in the rest of it. Every chunk is passed to consume, in the order
+ * of the file, after its checksum has been verified. Returns false if any
+ * checksum, the number of coins or the ECMultiSet hash in the trailer does not
+ * match, if consume returns false or if shutdown was requested.
+ */
+bool ReadUTXOSnapshotCoins(
+    CAutoFile &file, SnapshotMetadata &metadata,
+    const std::function<bool(SnapshotCoins &coins)> &consume);
+
+/**
+ * Load the snapshot file at path into view, which must be empty. The ECMultiSet
+ * hash of the snapshot must equal hashExpected, which must not be null, and
+ * its base block must equal hashBaseExpected unless the latter is null.
+ *
+ * If the base block has not been fully validated, e.g. on a node that has not
+ * seen the chain yet, hashBaseExpected is required and the node must be
+ * pruning. The headers of the blocks up to the base block are then accepted
+ * from the snapshot, and the blocks that were never downloaded are assumed to
+ * be valid and treated as pruned (see AssumeSnapshotChain()).
+ *
+ * The whole file is verified before anything is written. If loading fails
+ * afterwards, the coins written so far are erased again; an interrupted load
+ * is completed by ReplayBlocks().
+ */
+bool LoadUTXOSnapshot(const fs::path &path, CCoinsViewDB &view,
+                      const Config &config, const uint256 &hashExpected,
+                      const BlockHash &hashBaseExpected)
+    EXCLUSIVE_LOCKS_REQUIRED(cs_main);
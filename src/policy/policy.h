@@ -37,6 +37,17 @@ static constexpr Amount DEFAULT_BLOCK_MIN_TX_FEE_PER_KB(1000 * SATOSHI);
  * TestBlockValidity() on the generated block template.
  */
 static constexpr bool DEFAULT_GBT_CHECK_VALIDITY = true;
+/**
+ * Default for -gbtasyncvalidity, which determines whether the validity of
+ * a new block template is tested after getblocktemplate has returned it.
+ */
+static constexpr bool DEFAULT_GBT_ASYNC_VALIDITY = false;
+/**
+ * Default for -gbtincremental, which determines whether the transactions of
+ * the next block are tracked as the mempool changes, rather than selected
+ * from the whole mempool for every block template.
+ */
+static constexpr bool DEFAULT_GBT_INCREMENTAL = true;
 /**
  * Default for -allowunconnectedmining, which determines whether we ensure
  * that the node is connected to at least 1 peer for getblocktemplate[light]
@@ -10,15 +10,18 @@
 #include <chain.h>
 #include <chainparams.h>
 #include <checkpoints.h>
+#include <clientversion.h>
 #include <coins.h>
 #include <config.h>
 #include <consensus/abla.h>
 #include <consensus/validation.h>
 #include <core_io.h>
 #include <hash.h>
+#include <index/coinstatsindex.h>
 #include <index/txindex.h>
 #include <key_io.h>
 #include <node/blockstorage.h>
+#include <node/utxosnapshot.h>
 #include <policy/policy.h>
 #include <primitives/transaction.h>
 #include <rpc/mining.h>
@@ -478,6 +481,10 @@ static std::string EntryDescriptionString() {
            CURRENCY_UNIT +
            "\n"
            "    }\n"
+           "    \"ancestorcount\" : n,    (numeric) number of in-mempool "
+           "ancestor transactions (including this one)\n"
+           "    \"ancestorsize\" : n,     (numeric) size of in-mempool "
+           "ancestors (including this one)\n"
            "    \"depends\" : [           (array) unconfirmed transactions "
            "used as inputs for this transaction\n"
            "        \"transactionid\",    (string) parent transaction id\n"
@@ -488,29 +495,25 @@ static std::string EntryDescriptionString() {
            "       ... ]\n";
 }
 
-static UniValue::Object entryToJSON(const CTxMemPool &pool, const CTxMemPoolEntry &e)
-    EXCLUSIVE_LOCKS_REQUIRED(pool.cs) {
-    AssertLockHeld(pool.cs);
-
+static UniValue::Object entryToJSON(const CTxMemPool::Snapshot::Entry &e) {
     UniValue::Object info;
-    info.reserve(5);
+    info.reserve(7);
 
     UniValue::Object fees;
     fees.reserve(2);
-    fees.emplace_back("base", ValueFromAmount(e.GetFee()));
-    fees.emplace_back("modified", ValueFromAmount(e.GetModifiedFee()));
+    fees.emplace_back("base", ValueFromAmount(e.fee));
+    fees.emplace_back("modified", ValueFromAmount(e.modifiedFee));
 
     info.emplace_back("fees", std::move(fees));
-    info.emplace_back("size", e.GetTxSize());
-    info.emplace_back("time", e.GetTime());
+    info.emplace_back("size", e.size);
+    info.emplace_back("time", e.time);
 
-    const CTransaction &tx = e.GetTx();
+    info.emplace_back("ancestorcount", e.ancestors.count);
+    info.emplace_back("ancestorsize", e.ancestors.size);
 
     std::set<std::string> setDepends;
-    for (const CTxIn &txin : tx.vin) {
-        if (pool.exists(txin.prevout.GetTxId())) {
-            setDepends.insert(txin.prevout.GetTxId().ToString());
-        }
+    for (const TxId &parent : e.parents) {
+        setDepends.insert(parent.ToString());
     }
     UniValue::Array depends;
     depends.reserve(setDepends.size());
@@ -520,35 +523,37 @@ static UniValue::Object entryToJSON(const CTxMemPool &pool, const CTxMemPoolEntr
     info.emplace_back("depends", std::move(depends));
 
     UniValue::Array spent;
-    const CTxMemPool::txiter &it = pool.mapTx.find(tx.GetId());
-    const CTxMemPool::setEntries &setChildren = pool.GetMemPoolChildren(it);
-    spent.reserve(setChildren.size());
-    for (CTxMemPool::txiter childiter : setChildren) {
-        spent.emplace_back(childiter->GetTx().GetId().ToString());
+    spent.reserve(e.children.size());
+    for (const TxId &child : e.children) {
+        spent.emplace_back(child.ToString());
     }
     info.emplace_back("spentby", std::move(spent));
 
     return info;
 }
 
+static UniValue::Object entryToJSON(const CTxMemPool &pool, const CTxMemPoolEntry &e)
+    EXCLUSIVE_LOCKS_REQUIRED(pool.cs) {
+    AssertLockHeld(pool.cs);
+    return entryToJSON(pool.GetSnapshotEntry(pool.mapTx.iterator_to(e), true /* fWithLinks */));
+}
+
 UniValue MempoolToJSON(const CTxMemPool &pool, bool verbose) {
+    // Formatting happens on a snapshot, without holding pool.cs.
+    const std::shared_ptr<const CTxMemPool::Snapshot> snapshot = pool.GetSnapshot(verbose /* fWithLinks */);
     if (verbose) {
         UniValue::Object ret;
-        LOCK(pool.cs);
-        ret.reserve(pool.mapTx.size());
-        for (const CTxMemPoolEntry &e : pool.mapTx) {
-            const uint256 &txid = e.GetTx().GetId();
-            ret.emplace_back(txid.ToString(), entryToJSON(pool, e));
+        ret.reserve(snapshot->entries.size());
+        for (const CTxMemPool::Snapshot::Entry &e : snapshot->entries) {
+            ret.emplace_back(e.txid.ToString(), entryToJSON(e));
         }
         return ret;
     }
 
-    std::vector<uint256> vtxids;
-    pool.queryHashes(vtxids);
     UniValue::Array ret;
-    ret.reserve(vtxids.size());
-    for (const uint256 &txid : vtxids) {
-        ret.emplace_back(txid.ToString());
+    ret.reserve(snapshot->entries.size());
+    for (const CTxMemPool::Snapshot::Entry &e : snapshot->entries) {
+        ret.emplace_back(e.txid.ToString());
     }
     return ret;
 }
@@ -1106,10 +1111,12 @@ struct CCoinsStats {
     uint256 hashSerialized;
     uint64_t nDiskSize;
     Amount nTotalAmount;
+    uint64_t nTokenOutputs;
+    uint64_t nNFTOutputs;
 
     CCoinsStats()
         : nHeight(0), nTransactions(0), nTransactionOutputs(0), nBogoSize(0),
-          nDiskSize(0), nTotalAmount() {}
+          nDiskSize(0), nTotalAmount(), nTokenOutputs(0), nNFTOutputs(0) {}
 };
 
 static void ApplyStats(CCoinsStats &stats, CHashWriter &ss, const uint256 &hash,
@@ -1126,6 +1133,10 @@ static void ApplyStats(CCoinsStats &stats, CHashWriter &ss, const uint256 &hash,
                           VarIntMode::NONNEGATIVE_SIGNED);
         stats.nTransactionOutputs++;
         stats.nTotalAmount += output.second.GetTxOut().nValue;
+        if (const auto &tokenData = output.second.GetTxOut().tokenDataPtr) {
+            stats.nTokenOutputs++;
+            stats.nNFTOutputs += tokenData->HasNFT();
+        }
         stats.nBogoSize +=
             32 /* txid */ + 4 /* vout index */ + 4 /* height + coinbase */ +
             8 /* amount */ + 2 /* scriptPubKey len */ +
@@ -1239,49 +1250,238 @@ static UniValue pruneblockchain(const Config &config,
 
 static UniValue gettxoutsetinfo(const Config &config,
                                 const JSONRPCRequest &request) {
-    if (request.fHelp || request.params.size() != 0) {
+    if (request.fHelp || request.params.size() > 2) {
         throw std::runtime_error(
             RPCHelpMan{"gettxoutsetinfo",
                 "\nReturns statistics about the unspent transaction output set.\n"
-                "Note this call may take some time.\n",
-                {}}
+                "Note this call may take some time without -coinstatsindex.\n"
+                "When using coinstatsindex, the statistics that need a scan of the "
+                "whole UTXO set are null, and the ECMultiSet hash is returned instead "
+                "of the serialized hash.\n",
+                {
+                    {"hash_or_height", RPCArg::Type::NUM, /* opt */ true, /* default_val */ "the current best block", "The block hash or height of the target block (requires -coinstatsindex)", "", {"", "string or numeric"}},
+                    {"use_index", RPCArg::Type::BOOL, /* opt */ true, /* default_val */ "true", "Use coinstatsindex, if available."},
+                }}
                 .ToString() +
             "\nResult:\n"
             "{\n"
-            "  \"height\":n,     (numeric) The current block height (index)\n"
-            "  \"bestblock\": \"hex\",   (string) the best block hash hex\n"
-            "  \"transactions\": n,      (numeric) The number of transactions\n"
+            "  \"height\":n,     (numeric) The block height (index) of the "
+            "statistics\n"
+            "  \"bestblock\": \"hex\",   (string) The hash of the block of the "
+            "statistics\n"
+            "  \"transactions\": n,      (numeric) The number of transactions "
+            "(null when using coinstatsindex)\n"
             "  \"txouts\": n,            (numeric) The number of output "
             "transactions\n"
             "  \"bogosize\": n,          (numeric) A database-independent "
             "metric for UTXO set size\n"
-            "  \"hash_serialized\": \"hash\",   (string) The serialized hash\n"
+            "  \"hash_serialized\": \"hash\",   (string) The serialized hash "
+            "(null when using coinstatsindex)\n"
+            "  \"ecmultiset_hash\": \"hash\",   (string) The ECMultiSet hash "
+            "of the UTXO set (only available with coinstatsindex)\n"
             "  \"disk_size\": n,         (numeric) The estimated size of the "
-            "chainstate on disk\n"
-            "  \"total_amount\": x.xxx          (numeric) The total amount\n"
+            "chainstate on disk (when using coinstatsindex, null unless the "
+            "statistics are of the current best block)\n"
+            "  \"total_amount\": x.xxx,  (numeric) The total amount\n"
+            "  \"token_txouts\": n,      (numeric) The number of outputs "
+            "carrying tokens\n"
+            "  \"nft_txouts\": n         (numeric) The number of outputs "
+            "carrying an NFT\n"
             "}\n"
             "\nExamples:\n" +
             HelpExampleCli("gettxoutsetinfo", "") +
+            HelpExampleCli("gettxoutsetinfo", "1000") +
+            HelpExampleCli("gettxoutsetinfo",
+                           "'\"00000000c937983704a73af28acdec37b049d214adbda81d"
+                           "7e2a3dd146f6ed09\"'") +
             HelpExampleRpc("gettxoutsetinfo", ""));
     }
 
-    CCoinsStats stats;
-    FlushStateToDisk();
-    NodeContext& node = EnsureAnyNodeContext(request.context);
-    if (!GetUTXOStats(pcoinsdbview.get(), stats, node.rpc_interruption_point)) {
-        throw JSONRPCError(RPC_INTERNAL_ERROR, "Unable to read UTXO set");
-    }
+    const bool use_index =
+        request.params[1].isNull() ? true : request.params[1].get_bool();
+    CoinStatsIndex *const index =
+        use_index ? g_coin_stats_index.get() : nullptr;
 
     UniValue::Object ret;
-    ret.reserve(8);
-    ret.emplace_back("height", stats.nHeight);
-    ret.emplace_back("bestblock", stats.hashBlock.GetHex());
-    ret.emplace_back("transactions", stats.nTransactions);
+    if (!index) {
+        if (!request.params[0].isNull()) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER,
+                               "Querying specific block heights requires "
+                               "coinstatsindex");
+        }
+
+        CCoinsStats stats;
+        FlushStateToDisk();
+        NodeContext& node = EnsureAnyNodeContext(request.context);
+        if (!GetUTXOStats(pcoinsdbview.get(), stats,
+                          node.rpc_interruption_point)) {
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "Unable to read UTXO set");
+        }
+
+        ret.reserve(10);
+        ret.emplace_back("height", stats.nHeight);
+        ret.emplace_back("bestblock", stats.hashBlock.GetHex());
+        ret.emplace_back("transactions", stats.nTransactions);
+        ret.emplace_back("txouts", stats.nTransactionOutputs);
+        ret.emplace_back("bogosize", stats.nBogoSize);
+        ret.emplace_back("hash_serialized", stats.hashSerialized.GetHex());
+        ret.emplace_back("disk_size", stats.nDiskSize);
+        ret.emplace_back("total_amount", ValueFromAmount(stats.nTotalAmount));
+        ret.emplace_back("token_txouts", stats.nTokenOutputs);
+        ret.emplace_back("nft_txouts", stats.nNFTOutputs);
+        return ret;
+    }
+
+    // Make sure the index has seen the blocks of the current chain.
+    index->BlockUntilSyncedToCurrentChain();
+
+    const CBlockIndex *pindex;
+    bool is_tip;
+    {
+        LOCK(cs_main);
+        if (request.params[0].isNull()) {
+            pindex = ::ChainActive().Tip();
+        } else if (request.params[0].isNum()) {
+            const int height = request.params[0].get_int();
+            const int current_tip = ::ChainActive().Height();
+            if (height < 0) {
+                throw JSONRPCError(
+                    RPC_INVALID_PARAMETER,
+                    strprintf("Target block height %d is negative", height));
+            }
+            if (height > current_tip) {
+                throw JSONRPCError(
+                    RPC_INVALID_PARAMETER,
+                    strprintf("Target block height %d after current tip %d",
+                              height, current_tip));
+            }
+            pindex = ::ChainActive()[height];
+        } else {
+            const BlockHash hash(
+                ParseHashV(request.params[0], "hash_or_height"));
+            pindex = LookupBlockIndex(hash);
+            if (!pindex) {
+                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY,
+                                   "Block not found");
+            }
+        }
+        is_tip = pindex == ::ChainActive().Tip();
+    }
+    assert(pindex != nullptr);
+
+    IndexedCoinsStats stats;
+    if (!index->LookUpStats(pindex, stats)) {
+        throw JSONRPCError(RPC_INTERNAL_ERROR,
+                           strprintf("Unable to read UTXO set statistics of "
+                                     "block %s, coinstatsindex may not be "
+                                     "synced yet",
+                                     pindex->GetBlockHash().GetHex()));
+    }
+
+    ret.reserve(11);
+    ret.emplace_back("height", pindex->nHeight);
+    ret.emplace_back("bestblock", pindex->GetBlockHash().GetHex());
+    // Not tracked by the index, they would need a scan of the UTXO set
+    ret.emplace_back("transactions", UniValue());
     ret.emplace_back("txouts", stats.nTransactionOutputs);
     ret.emplace_back("bogosize", stats.nBogoSize);
-    ret.emplace_back("hash_serialized", stats.hashSerialized.GetHex());
-    ret.emplace_back("disk_size", stats.nDiskSize);
+    ret.emplace_back("hash_serialized", UniValue());
+    ret.emplace_back("ecmultiset_hash", stats.multiset.GetHash().GetHex());
+    // Only the current chainstate is on disk
+    if (is_tip) {
+        ret.emplace_back("disk_size", uint64_t(pcoinsdbview->EstimateSize()));
+    } else {
+        ret.emplace_back("disk_size", UniValue());
+    }
     ret.emplace_back("total_amount", ValueFromAmount(stats.nTotalAmount));
+    ret.emplace_back("token_txouts", stats.nTokenOutputs);
+    ret.emplace_back("nft_txouts", stats.nNFTOutputs);
+    return ret;
+}
+
+static UniValue dumptxoutset(const Config &config,
+                             const JSONRPCRequest &request) {
+    if (request.fHelp || request.params.size() != 1) {
+        throw std::runtime_error(
+            RPCHelpMan{"dumptxoutset",
+                "\nWrite the unspent transaction output set as of the current "
+                "best block to a snapshot file, which -loadutxosnapshot can "
+                "load into the chainstate of another node.\n",
+                {
+                    {"path", RPCArg::Type::STR, /* opt */ false, /* default_val */ "", "The path of the snapshot file. Relative paths are relative to the data directory."},
+                }}
+                .ToString() +
+            "\nResult:\n"
+            "{\n"
+            "  \"coins_written\": n,      (numeric) The number of coins "
+            "written to the snapshot\n"
+            "  \"base_hash\": \"hex\",     (string) The hash of the block "
+            "the snapshot is as of\n"
+            "  \"base_height\": n,        (numeric) The height of that "
+            "block\n"
+            "  \"path\": \"path\",         (string) The absolute path of "
+            "the snapshot file\n"
+            "  \"ecmultiset_hash\": \"hash\",   (string) The ECMultiSet "
+            "hash of the UTXO set, see gettxoutsetinfo\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("dumptxoutset", "\"utxo.dat\"") +
+            HelpExampleRpc("dumptxoutset", "\"utxo.dat\""));
+    }
+
+    const fs::path path = AbsPathForConfigVal(request.params[0].get_str());
+    // Write to a temporary file first, so that an interrupted dump never
+    // leaves a truncated snapshot behind.
+    const fs::path temppath = path.string() + ".incomplete";
+    if (fs::exists(path)) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER,
+                           path.string() + " already exists. If you are sure "
+                                           "this is what you want, move it "
+                                           "out of the way first");
+    }
+
+    CAutoFile file(fsbridge::fopen(temppath, "wb"), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER,
+                           "Unable to open " + temppath.string() +
+                               " for writing");
+    }
+
+    std::unique_ptr<CCoinsViewCursor> pcursor;
+    const CBlockIndex *tip;
+    {
+        // Flush and open the cursor at once, so that the database snapshot
+        // the cursor iterates over is consistent with the tip.
+        LOCK(cs_main);
+        FlushStateToDisk();
+        pcursor.reset(pcoinsdbview->Cursor(true /* snapshot */));
+        tip = LookupBlockIndex(pcursor->GetBestBlock());
+        assert(tip != nullptr);
+    }
+
+    SnapshotMetadata metadata;
+    if (!WriteUTXOSnapshot(file, *pcursor, *tip, config.GetChainParams(),
+                           metadata) ||
+        !FileCommit(file.Get())) {
+        file.fclose();
+        fs::remove(temppath);
+        throw JSONRPCError(RPC_MISC_ERROR, "Unable to write UTXO snapshot");
+    }
+    file.fclose();
+    if (!RenameOver(temppath, path)) {
+        fs::remove(temppath);
+        throw JSONRPCError(RPC_MISC_ERROR, "Unable to rename " +
+                                               temppath.string() + " to " +
+                                               path.string());
+    }
+
+    UniValue::Object ret;
+    ret.reserve(5);
+    ret.emplace_back("coins_written", metadata.nCoins);
+    ret.emplace_back("base_hash", metadata.hashBase.GetHex());
+    ret.emplace_back("base_height", metadata.nHeight);
+    ret.emplace_back("path", path.string());
+    ret.emplace_back("ecmultiset_hash", metadata.hashMultiSet.GetHex());
     return ret;
 }
 
@@ -1628,6 +1828,9 @@ static UniValue getchaintips(const Config &config,
 }
 
 UniValue::Object MempoolInfoToJSON(const Config &config, const CTxMemPool &pool) {
+    // All of these are O(1), so they are read under a single lock rather than
+    // from a snapshot, which would copy the whole pool after every change.
+    LOCK(pool.cs);
     UniValue::Object ret;
     ret.reserve(7);
     ret.emplace_back("loaded", pool.IsLoaded());
@@ -2925,6 +3128,7 @@ static UniValue fillmempool(const Config &config, const JSONRPCRequest &request)
 static const ContextFreeRPCCommand commands[] = {
     //  category            name                      actor (function)        argNames
     //  ------------------- ------------------------  ----------------------  ----------
+    { "blockchain",         "dumptxoutset",           dumptxoutset,           {"path"} },
     { "blockchain",         "finalizeblock",          finalizeblock,          {"blockhash"} },
     { "blockchain",         "getbestblockhash",       getbestblockhash,       {} },
     { "blockchain",         "getblock",               getblock,               {"blockhash","verbosity|verbose"} },
@@ -2943,7 +3147,7 @@ static const ContextFreeRPCCommand commands[] = {
     { "blockchain",         "getmempoolinfo",         getmempoolinfo,         {} },
     { "blockchain",         "getrawmempool",          getrawmempool,          {"verbose"} },
     { "blockchain",         "gettxout",               gettxout,               {"txid","n","include_mempool"} },
-    { "blockchain",         "gettxoutsetinfo",        gettxoutsetinfo,        {} },
+    { "blockchain",         "gettxoutsetinfo",        gettxoutsetinfo,        {"hash_or_height","use_index"} },
     { "blockchain",         "invalidateblock",        invalidateblock,        {"blockhash"} },
     { "blockchain",         "parkblock",              parkblock,              {"blockhash"} },
     { "blockchain",         "preciousblock",          preciousblock,          {"blockhash"} },
@@ -116,6 +116,8 @@ static const CRPCConvertParam vRPCConvertParams[] = {
     {"gettxout", 1, "n"},
     {"gettxout", 2, "include_mempool"},
     {"gettxoutproof", 0, "txids"},
+    {"gettxoutsetinfo", 0, "hash_or_height"},
+    {"gettxoutsetinfo", 1, "use_index"},
     {"lockunspent", 0, "unlock"},
     {"lockunspent", 1, "transactions"},
     {"importprivkey", 2, "rescan"},
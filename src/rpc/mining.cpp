@@ -35,6 +35,7 @@
 
 #include <univalue.h>
 
+#include <atomic>
 #include <cmath>
 #include <cstdint>
 #include <cstring>
@@ -312,6 +313,10 @@ static UniValue prioritisetransaction(const Config &config,
     }
 
     g_mempool.PrioritiseTransaction(txid, nAmount);
+    if (g_block_template_tracker) {
+        // The selection of the transactions of the next block depends on the fee deltas.
+        g_block_template_tracker->MarkOutOfDate();
+    }
     return true;
 }
 
@@ -517,10 +522,19 @@ static UniValue getblocktemplatecommon(bool fLight, const Config &config, const
     static std::unique_ptr<CBlockTemplate> pblocktemplate;
     static std::unique_ptr<LightResult> plightresult; // fLight mode only, cached result associated with pblocktemplate
     static bool fIgnoreCache = false;
+    // Set if pblocktemplate is found invalid by the asynchronous validity test (-gbtasyncvalidity)
+    static std::shared_ptr<std::atomic<bool>> pfTemplateInvalid;
+    if (pfTemplateInvalid && *pfTemplateInvalid) {
+        fIgnoreCache = true;
+    }
     bool fNewTip = (pindexPrev && pindexPrev != ::ChainActive().Tip());
+    // Rebuilding the block template is cheap if the transactions of the next block are tracked, so don't throttle it,
+    // unless every template is tested for validity, which holds cs_main whether or not it is done asynchronously.
+    const bool fTracked = !checkValidity && g_block_template_tracker &&
+                          g_block_template_tracker->IsSyncedTo(::ChainActive().Tip());
     if (pindexPrev != ::ChainActive().Tip() || fIgnoreCache || ignoreCacheOverride ||
         (g_mempool.GetTransactionsUpdated() != nTransactionsUpdatedLast &&
-         GetTime() - nStart > 5)) {
+         (fTracked || GetTime() - nStart > 5))) {
         // Clear pindexPrev so future calls make a new block, despite any
         // failures from here on
         pindexPrev = nullptr;
@@ -545,16 +559,25 @@ static UniValue getblocktemplatecommon(bool fLight, const Config &config, const
             timeLimitSecs = maxGBTTimeSecs;
         }
 
-        // Create new block
+        // Create new block, and test its validity after returning it if so configured
+        const bool fAsyncValidity =
+            checkValidity && gArgs.GetBoolArg("-gbtasyncvalidity", DEFAULT_GBT_ASYNC_VALIDITY);
         CScript scriptDummy = CScript() << OP_TRUE;
         const CBlockIndex *pindexMinedTip{};
-        pblocktemplate =
-            BlockAssembler(config, g_mempool).CreateNewBlock(scriptDummy, timeLimitSecs, checkValidity, &pindexMinedTip);
+        pblocktemplate = BlockAssembler(config, g_mempool).CreateNewBlock(scriptDummy, timeLimitSecs,
+                                                                          checkValidity && !fAsyncValidity,
+                                                                          &pindexMinedTip);
         plightresult.reset();
         if (!pblocktemplate) {
             throw JSONRPCError(RPC_OUT_OF_MEMORY, "Out of memory");
         }
         assert(pindexMinedTip == pindexPrevNew); // sanity check
+        pfTemplateInvalid.reset();
+        if (fAsyncValidity) {
+            pfTemplateInvalid = std::make_shared<std::atomic<bool>>(false);
+            TestBlockValidityAsync(config, std::make_shared<const CBlock>(pblocktemplate->block), pindexPrevNew,
+                                   [pfInvalid = pfTemplateInvalid](const CValidationState &) { *pfInvalid = true; });
+        }
 
         // Need to update only after we know CreateNewBlock succeeded
         pindexPrev = pindexPrevNew;
@@ -376,6 +376,15 @@ public:
             return vch.erase(first, last);
     }
 
+    /**
+     * Exchange the underlying buffer with vchIn and read the new contents from
+     * the start. Lets a caller recycle an allocation for another stream.
+     */
+    void SwapBuffer(vector_type &vchIn) {
+        vch.swap(vchIn);
+        nReadPos = 0;
+    }
+
     inline void Compact() {
         vch.erase(vch.begin(), vch.begin() + nReadPos);
         nReadPos = 0;
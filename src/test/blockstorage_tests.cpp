@@ -0,0 +1,97 @@
+// Copyright (c) 2026 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <node/blockstorage.h>
+
+#include <chain.h>
+#include <chainparams.h>
+#include <clientversion.h>
+#include <primitives/block.h>
+#include <streams.h>
+#include <undo.h>
+#include <validation.h>
+#include <version.h>
+
+#include <test/setup_common.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <vector>
+
+namespace {
+
+//! The serialization of an object, to compare objects without operator==.
+template <typename T> std::vector<uint8_t> Serialize(const T &obj) {
+    std::vector<uint8_t> data;
+    CVectorWriter(SER_DISK, CLIENT_VERSION, data, 0, obj);
+    return data;
+}
+
+struct MapBlockFilesSetup : public TestChain100Setup {
+    ~MapBlockFilesSetup() { fMapBlockFiles = false; }
+};
+
+} // namespace
+
+BOOST_FIXTURE_TEST_SUITE(blockstorage_tests, MapBlockFilesSetup)
+
+BOOST_AUTO_TEST_CASE(mapped_block_reads) {
+    const CChainParams &params = Params();
+    std::vector<const CBlockIndex *> vpindex;
+    {
+        LOCK(cs_main);
+        for (const CBlockIndex *pindex = ::ChainActive().Tip(); pindex;
+             pindex = pindex->pprev) {
+            vpindex.push_back(pindex);
+        }
+    }
+
+    for (const CBlockIndex *pindex : vpindex) {
+        // Blocks, undo data and raw blocks read through the mappings of the
+        // block files are the same as those read from the files.
+        fMapBlockFiles = false;
+        CBlock block;
+        BOOST_REQUIRE(ReadBlockFromDisk(block, pindex, params.GetConsensus()));
+        std::vector<uint8_t> rawBlock;
+        BOOST_REQUIRE(ReadRawBlockFromDisk(rawBlock, pindex, params,
+                                           SER_NETWORK, PROTOCOL_VERSION));
+        CBlockUndo blockundo;
+        const bool fUndo = pindex->pprev != nullptr;
+        if (fUndo) {
+            BOOST_REQUIRE(UndoReadFromDisk(blockundo, pindex));
+        }
+
+        fMapBlockFiles = true;
+        CBlock blockMapped;
+        BOOST_CHECK(
+            ReadBlockFromDisk(blockMapped, pindex, params.GetConsensus()));
+        BOOST_CHECK(blockMapped.GetHash() == pindex->GetBlockHash());
+        BOOST_CHECK(Serialize(blockMapped) == Serialize(block));
+        std::vector<uint8_t> rawBlockMapped;
+        BOOST_CHECK(ReadRawBlockFromDisk(rawBlockMapped, pindex, params,
+                                         SER_NETWORK, PROTOCOL_VERSION));
+        BOOST_CHECK(rawBlockMapped == rawBlock);
+        BOOST_CHECK(rawBlockMapped == Serialize(block));
+        if (fUndo) {
+            CBlockUndo blockundoMapped;
+            BOOST_CHECK(UndoReadFromDisk(blockundoMapped, pindex));
+            BOOST_CHECK(Serialize(blockundoMapped) == Serialize(blockundo));
+        }
+    }
+
+    // Blocks written after the files were mapped can be read through the
+    // mappings as well.
+    fMapBlockFiles = true;
+    const CBlock block = CreateAndProcessBlock({}, CScript() << OP_TRUE);
+    const CBlockIndex *tip = WITH_LOCK(cs_main, return ::ChainActive().Tip());
+    BOOST_REQUIRE(tip->GetBlockHash() == block.GetHash());
+    CBlock blockMapped;
+    BOOST_CHECK(ReadBlockFromDisk(blockMapped, tip, params.GetConsensus()));
+    BOOST_CHECK(Serialize(blockMapped) == Serialize(block));
+    CBlockUndo blockundo;
+    BOOST_CHECK(UndoReadFromDisk(blockundo, tip));
+    BOOST_CHECK(blockundo.vtxundo.empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
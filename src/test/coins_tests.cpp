@@ -9,6 +9,7 @@
 #include <consensus/validation.h>
 #include <script/standard.h>
 #include <streams.h>
+#include <txdb.h>
 #include <undo.h>
 #include <util/strencodings.h>
 #include <validation.h>
@@ -625,7 +626,8 @@ void GetCoinMapEntry(const CCoinsMap &map, Amount &value, char &flags) {
 }
 
 void WriteCoinViewEntry(CCoinsView &view, const Amount value, char flags) {
-    CCoinsMap map;
+    CCoinsMapMemoryResource resource;
+    CCoinsMap map{0, CCoinsMap::hasher{}, CCoinsMap::key_equal{}, &resource};
     InsertCoinMapEntry(map, value, flags);
     BOOST_CHECK(view.BatchWrite(map, BlockHash()));
 }
@@ -813,6 +815,36 @@ BOOST_AUTO_TEST_CASE(coin_add) {
     CheckAddCoin(VALUE2, VALUE3, VALUE3, DIRTY | FRESH, DIRTY | FRESH, true);
 }
 
+static void CheckEmplaceFetchedCoin(Amount cache_value, Amount expected_value,
+                                    char cache_flags, char expected_flags) {
+    SingleEntryCacheTest test(ABSENT, cache_value, cache_flags);
+    CTxOut output;
+    output.nValue = VALUE3;
+    test.cache.EmplaceFetchedCoin(OUTPOINT, Coin(std::move(output), 1, false));
+    test.cache.SelfTest();
+
+    Amount result_value;
+    char result_flags;
+    GetCoinMapEntry(test.cache.map(), result_value, result_flags);
+    BOOST_CHECK_EQUAL(result_value, expected_value);
+    BOOST_CHECK_EQUAL(result_flags, expected_flags);
+}
+
+BOOST_AUTO_TEST_CASE(coin_emplace_fetched) {
+    /**
+     * Check EmplaceFetchedCoin behavior: a prefetched coin only ever fills an
+     * absent entry, as a clean entry, and leaves existing entries untouched.
+     *
+     *                      Cache   Result  Cache        Result
+     *                      Value   Value   Flags        Flags
+     */
+    CheckEmplaceFetchedCoin(ABSENT, VALUE3, NO_ENTRY, 0);
+    for (const char flags : FLAGS) {
+        CheckEmplaceFetchedCoin(PRUNED, PRUNED, flags, flags);
+        CheckEmplaceFetchedCoin(VALUE2, VALUE2, flags, flags);
+    }
+}
+
 void CheckWriteCoin(Amount parent_value, Amount child_value,
                     Amount expected_value, char parent_flags, char child_flags,
                     char expected_flags) {
@@ -912,4 +944,68 @@ BOOST_AUTO_TEST_CASE(coin_write) {
     }
 }
 
+
+BOOST_AUTO_TEST_CASE(coins_db_background_write) {
+    // Apply the same flushes to a database written synchronously and one
+    // written in the background, and check they always look the same.
+    CCoinsViewDB syncdb(1 << 20, true, true, false);
+    CCoinsViewDB asyncdb(1 << 20, true, true, true);
+    std::vector<COutPoint> outpoints;
+
+    for (int round = 0; round < 10; ++round) {
+        CCoinsViewCache synccache(&syncdb), asynccache(&asyncdb);
+        for (int i = 0; i < 200; ++i) {
+            if (!outpoints.empty() && InsecureRandBool()) {
+                const COutPoint &outpoint =
+                    outpoints[InsecureRandRange(outpoints.size())];
+                synccache.SpendCoin(outpoint);
+                asynccache.SpendCoin(outpoint);
+                continue;
+            }
+            outpoints.emplace_back(TxId(InsecureRand256()), 0);
+            const Coin coin(CTxOut(int64_t(InsecureRandRange(1000) + 1) *
+                                       SATOSHI,
+                                   CScript() << OP_TRUE),
+                            round, false);
+            synccache.AddCoin(outpoints.back(), coin, false);
+            asynccache.AddCoin(outpoints.back(), coin, false);
+        }
+        const BlockHash hashBlock(InsecureRand256());
+        synccache.SetBestBlock(hashBlock);
+        asynccache.SetBestBlock(hashBlock);
+        BOOST_CHECK(synccache.Flush());
+        BOOST_CHECK(asynccache.Flush());
+
+        // Whether or not the write is complete yet, the flushed state is
+        // visible.
+        BOOST_CHECK(asyncdb.GetBestBlock() == hashBlock);
+        for (const COutPoint &outpoint : outpoints) {
+            Coin coin1, coin2;
+            BOOST_CHECK_EQUAL(syncdb.GetCoin(outpoint, coin1),
+                              asyncdb.GetCoin(outpoint, coin2));
+            BOOST_CHECK(coin1 == coin2);
+            BOOST_CHECK_EQUAL(syncdb.HaveCoin(outpoint),
+                              asyncdb.HaveCoin(outpoint));
+        }
+    }
+
+    // Once the write is complete, the database is consistent with the last
+    // flush.
+    BOOST_CHECK(asyncdb.WaitForPendingWrite());
+    BOOST_CHECK(asyncdb.GetHeadBlocks().empty());
+    BOOST_CHECK(asyncdb.GetBestBlock() == syncdb.GetBestBlock());
+    std::unique_ptr<CCoinsViewCursor> cursor1(syncdb.Cursor());
+    std::unique_ptr<CCoinsViewCursor> cursor2(asyncdb.Cursor());
+    for (; cursor1->Valid(); cursor1->Next(), cursor2->Next()) {
+        BOOST_REQUIRE(cursor2->Valid());
+        COutPoint key1, key2;
+        Coin coin1, coin2;
+        BOOST_CHECK(cursor1->GetKey(key1) && cursor2->GetKey(key2));
+        BOOST_CHECK(key1 == key2);
+        BOOST_CHECK(cursor1->GetValue(coin1) && cursor2->GetValue(coin2));
+        BOOST_CHECK(coin1 == coin2);
+    }
+    BOOST_CHECK(!cursor2->Valid());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,154 @@
+// Copyright (c) 2026 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <index/coinstatsindex.h>
+
+#include <config.h>
+#include <consensus/validation.h>
+#include <script/sighashtype.h>
+#include <script/interpreter.h>
+#include <txdb.h>
+#include <txmempool.h>
+#include <util/time.h>
+#include <validation.h>
+
+#include <test/setup_common.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <memory>
+
+namespace {
+
+//! Compute the statistics of the current UTXO set by scanning it.
+IndexedCoinsStats ScanStats() {
+    FlushStateToDisk();
+    IndexedCoinsStats stats;
+    std::unique_ptr<CCoinsViewCursor> cursor(pcoinsdbview->Cursor());
+    for (; cursor->Valid(); cursor->Next()) {
+        COutPoint outpoint;
+        Coin coin;
+        BOOST_REQUIRE(cursor->GetKey(outpoint) && cursor->GetValue(coin));
+        CoinStatsIndex::ApplyCoin(stats, outpoint, coin, true);
+    }
+    return stats;
+}
+
+void CheckStats(const IndexedCoinsStats &stats,
+                const IndexedCoinsStats &expected) {
+    BOOST_CHECK(stats.multiset == expected.multiset);
+    BOOST_CHECK_EQUAL(stats.nTransactionOutputs, expected.nTransactionOutputs);
+    BOOST_CHECK_EQUAL(stats.nBogoSize, expected.nBogoSize);
+    BOOST_CHECK_EQUAL(stats.nTotalAmount, expected.nTotalAmount);
+    BOOST_CHECK_EQUAL(stats.nTokenOutputs, expected.nTokenOutputs);
+    BOOST_CHECK_EQUAL(stats.nNFTOutputs, expected.nNFTOutputs);
+}
+
+IndexedCoinsStats TipStats(const CoinStatsIndex &index) {
+    BOOST_CHECK(
+        const_cast<CoinStatsIndex &>(index).BlockUntilSyncedToCurrentChain());
+    IndexedCoinsStats stats;
+    BOOST_CHECK(index.LookUpStats(
+        WITH_LOCK(cs_main, return ::ChainActive().Tip()), stats));
+    return stats;
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(coinstatsindex_tests)
+
+BOOST_FIXTURE_TEST_CASE(coinstatsindex_initial_sync, TestChain100Setup) {
+    CoinStatsIndex index(1 << 20, true);
+
+    // Nothing is indexed before the index is started.
+    IndexedCoinsStats stats;
+    const CBlockIndex *tip = WITH_LOCK(cs_main, return ::ChainActive().Tip());
+    BOOST_CHECK(!index.LookUpStats(tip, stats));
+    BOOST_CHECK(!index.BlockUntilSyncedToCurrentChain());
+
+    index.Start();
+
+    // Allow the index to catch up with the block index.
+    constexpr int64_t timeout_ms = 10 * 1000;
+    int64_t time_start = GetTimeMillis();
+    while (!index.BlockUntilSyncedToCurrentChain()) {
+        BOOST_REQUIRE(time_start + timeout_ms > GetTimeMillis());
+        MilliSleep(100);
+    }
+
+    const IndexedCoinsStats statsBefore = TipStats(index);
+    CheckStats(statsBefore, ScanStats());
+    BOOST_CHECK_EQUAL(statsBefore.nTransactionOutputs, 100U);
+
+    // The genesis block has no spendable outputs.
+    BOOST_CHECK(index.LookUpStats(
+        WITH_LOCK(cs_main, return ::ChainActive().Genesis()), stats));
+    BOOST_CHECK(stats.multiset.IsEmpty());
+    BOOST_CHECK_EQUAL(stats.nTransactionOutputs, 0U);
+
+    // Spend a coinbase to a regular and a provably unspendable output.
+    const CScript scriptPubKey = CScript()
+                                 << ToByteVector(coinbaseKey.GetPubKey())
+                                 << OP_CHECKSIG;
+    CMutableTransaction spend;
+    spend.nVersion = 1;
+    spend.vin.resize(1);
+    spend.vin[0].prevout = COutPoint(m_coinbase_txns[0]->GetId(), 0);
+    spend.vout.resize(2);
+    spend.vout[0].nValue = 11 * CENT;
+    spend.vout[0].scriptPubKey = scriptPubKey;
+    spend.vout[1].nValue = Amount::zero();
+    spend.vout[1].scriptPubKey = CScript() << OP_RETURN;
+    std::vector<uint8_t> vchSig;
+    const uint256 hash =
+        SignatureHash(scriptPubKey,
+                      ScriptExecutionContext{0, m_coinbase_txns[0]->vout[0],
+                                             spend},
+                      SigHashType().withFork(), nullptr,
+                      STANDARD_SCRIPT_VERIFY_FLAGS)
+            .signatureHash;
+    BOOST_CHECK(coinbaseKey.SignECDSA(hash, vchSig));
+    vchSig.push_back(uint8_t(SIGHASH_ALL | SIGHASH_FORKID));
+    spend.vin[0].scriptSig << vchSig;
+
+    const CBlock block = CreateAndProcessBlock({spend}, scriptPubKey);
+    BOOST_CHECK(WITH_LOCK(cs_main, return ::ChainActive().Tip())
+                    ->GetBlockHash() == block.GetHash());
+
+    // The block adds a coinbase and the spend's first output, and spends a
+    // coinbase.
+    const IndexedCoinsStats statsSpend = TipStats(index);
+    CheckStats(statsSpend, ScanStats());
+    BOOST_CHECK_EQUAL(statsSpend.nTransactionOutputs, 101U);
+
+    // The statistics of earlier blocks stay available.
+    BOOST_CHECK(index.LookUpStats(tip, stats));
+    CheckStats(stats, statsBefore);
+
+    // Replace the block with two others. The statistics of the new chain
+    // build on those of the fork point.
+    {
+        CValidationState state;
+        CBlockIndex *pindex = WITH_LOCK(cs_main, return ::ChainActive().Tip());
+        BOOST_CHECK(InvalidateBlock(GetConfig(), state, pindex));
+    }
+    // The spend went back to the mempool, keep it out of the new blocks.
+    g_mempool.clear();
+    const CScript scriptOther = CScript() << OP_TRUE;
+    CreateAndProcessBlock({}, scriptOther);
+    CreateAndProcessBlock({}, scriptOther);
+    BOOST_CHECK_EQUAL(WITH_LOCK(cs_main, return ::ChainActive().Height()),
+                      tip->nHeight + 2);
+    CheckStats(TipStats(index), ScanStats());
+
+    // shutdown sequence (c.f. Shutdown() in init.cpp)
+    index.Stop();
+
+    scheduler.stop();
+    schedulerThread.join();
+
+    // Rest of shutdown sequence and destructors happen in ~TestingSetup()
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -10,14 +10,17 @@
 #include <chainparams.h>
 #include <config.h>
 #include <crypto/siphash.h>
+#include <hash.h>
 #include <keystore.h>
 #include <net.h>
 #include <net_processing.h>
 #include <net_processing_internal.h> // for internal namespace
+#include <netmessagemaker.h>
 #include <policy/policy.h>
 #include <pow.h>
 #include <script/sign.h>
 #include <serialize.h>
+#include <streams.h>
 #include <util/system.h>
 #include <validation.h>
 
@@ -51,6 +54,25 @@ static CService ip(uint32_t i) {
 
 static NodeId id = 0;
 
+/** A received message as the socket handler queues it for processing. */
+static CNetMessage MakeReceivedMessage(const Config &config,
+                                       const CSerializedNetMsg &msg) {
+    const auto &magic = config.GetChainParams().NetMagic();
+    const uint256 hash = Hash(msg.data);
+    CMessageHeader hdr(magic, msg.m_type.c_str(), msg.data.size());
+    memcpy(hdr.pchChecksum, hash.begin(), CMessageHeader::CHECKSUM_SIZE);
+    std::vector<uint8_t> header;
+    CVectorWriter{SER_NETWORK, INIT_PROTO_VERSION, header, 0, hdr};
+
+    CNetMessage received(magic, SER_NETWORK, INIT_PROTO_VERSION);
+    BOOST_CHECK_EQUAL(received.readHeader(config, reinterpret_cast<const char *>(header.data()), header.size()),
+                      int(header.size()));
+    BOOST_CHECK_EQUAL(received.readData(reinterpret_cast<const char *>(msg.data.data()), msg.data.size()),
+                      int(msg.data.size()));
+    BOOST_CHECK(received.complete());
+    return received;
+}
+
 BOOST_FIXTURE_TEST_SUITE(denialofservice_tests, TestingSetup)
 
 // Test eviction of an outbound peer whose chain never advances
@@ -487,6 +509,14 @@ static void CheckMapOrphanTxByPrevSanity() {
             BOOST_CHECK(it2->second.count(it) == 1); // count here only works with non-const `it`
         }
     }
+
+    // the memory used by the orphans must be accounted for
+    size_t usage = 0;
+    for (const auto & [txid, orphantx] : m) {
+        BOOST_CHECK_EQUAL(orphantx.nUsage, RecursiveDynamicUsage(orphantx.tx));
+        usage += orphantx.nUsage;
+    }
+    BOOST_CHECK_EQUAL(internal::nOrphanTransactionsUsage, usage);
 }
 
 BOOST_AUTO_TEST_CASE(DoS_mapOrphans) {
@@ -576,9 +606,209 @@ BOOST_AUTO_TEST_CASE(DoS_mapOrphans) {
     internal::LimitOrphanTxSize(10);
     BOOST_CHECK(internal::mapOrphanTransactions.size() <= 10);
     CheckMapOrphanTxByPrevSanity();
+    // ... and its memory limit:
+    const size_t halfUsage = internal::nOrphanTransactionsUsage / 2;
+    BOOST_CHECK(internal::LimitOrphanTxSize(10, halfUsage) > 0);
+    BOOST_CHECK(internal::nOrphanTransactionsUsage <= halfUsage);
+    CheckMapOrphanTxByPrevSanity();
     internal::LimitOrphanTxSize(0);
     BOOST_CHECK(internal::mapOrphanTransactions.empty());
+    BOOST_CHECK_EQUAL(internal::nOrphanTransactionsUsage, 0U);
+    CheckMapOrphanTxByPrevSanity();
+}
+
+BOOST_AUTO_TEST_CASE(DoS_mapOrphans_evict_large) {
+    const auto makeOrphan = [](size_t scriptSigSize) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(TxId(InsecureRand256()), 0);
+        tx.vin[0].scriptSig << std::vector<uint8_t>(scriptSigSize, 0xff);
+        tx.vout.resize(1);
+        tx.vout[0].nValue = 1 * CENT;
+        tx.vout[0].scriptPubKey = GetScriptForDestination(CKeyID(uint160()));
+        return MakeTransactionRef(tx);
+    };
+    const CTransactionRef large = makeOrphan(50000);
+
+    // Evict one of a large orphan and 9 small ones, many times over. A random
+    // orphan would be the large one about 10% of the time, the largest of the
+    // candidates is about 30% of the time.
+    LOCK(internal::g_cs_orphans);
+    const int nRounds = 500;
+    int nLargeEvicted = 0;
+    for (int round = 0; round < nRounds; round++) {
+        BOOST_CHECK(internal::AddOrphanTx(large, 0));
+        for (int i = 0; i < 9; i++) {
+            BOOST_CHECK(internal::AddOrphanTx(makeOrphan(100), 0));
+        }
+        BOOST_CHECK_EQUAL(internal::LimitOrphanTxSize(9), 1U);
+        nLargeEvicted += !internal::mapOrphanTransactions.count(large->GetId());
+        internal::LimitOrphanTxSize(0);
+    }
+    BOOST_CHECK_GT(nLargeEvicted, nRounds / 5);
+    BOOST_CHECK(internal::mapOrphanTransactions.empty());
+}
+
+BOOST_AUTO_TEST_CASE(DoS_AcceptOrphans) {
+    // A chain of orphans, the first of which spends an unknown output.
+    std::vector<CTransactionRef> chain;
+    for (int i = 0; i < 10; i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = chain.empty() ? COutPoint(TxId(InsecureRand256()), 0)
+                                          : COutPoint(chain.back()->GetId(), 0);
+        // Padded so that the transactions are not too small to be standard.
+        tx.vin[0].scriptSig << std::vector<uint8_t>(100, 0xff);
+        tx.vout.resize(1);
+        tx.vout[0].nValue = 1 * CENT;
+        tx.vout[0].scriptPubKey = GetScriptForDestination(CKeyID(uint160()));
+        chain.push_back(MakeTransactionRef(tx));
+
+        LOCK(internal::g_cs_orphans);
+        BOOST_CHECK(internal::AddOrphanTx(chain.back(), 0));
+    }
+
+    // The whole chain is tried at once, starting from its first orphan, and
+    // stays in the orphan pool as that one is still missing its input.
+    {
+        LOCK2(cs_main, internal::g_cs_orphans);
+        std::set<TxId> orphan_work_set{chain.front()->GetId()};
+        const std::vector<internal::OrphanAcceptResult> results =
+            internal::AcceptOrphans(GetConfig(), orphan_work_set);
+        BOOST_CHECK(orphan_work_set.empty());
+        BOOST_CHECK_EQUAL(results.size(), chain.size());
+        for (const internal::OrphanAcceptResult &orphan : results) {
+            BOOST_CHECK(!orphan.result.fAccepted);
+            BOOST_CHECK(orphan.result.fMissingInputs);
+            BOOST_CHECK_EQUAL(orphan.fromPeer, 0);
+        }
+        BOOST_CHECK_EQUAL(internal::mapOrphanTransactions.size(), chain.size());
+    }
     CheckMapOrphanTxByPrevSanity();
+
+    internal::EraseOrphansFor(0);
+    LOCK(internal::g_cs_orphans);
+    BOOST_CHECK(internal::mapOrphanTransactions.empty());
+}
+
+BOOST_AUTO_TEST_CASE(DoS_AcceptOrphans_limits) {
+    // A long chain of orphans from peer 0, and invalid orphans from peer 1.
+    const auto makeOrphan = [](const COutPoint &prevout, const Amount value, NodeId peer) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = prevout;
+        tx.vin[0].scriptSig << std::vector<uint8_t>(100, 0xff);
+        tx.vout.resize(1);
+        tx.vout[0].nValue = value;
+        tx.vout[0].scriptPubKey = GetScriptForDestination(CKeyID(uint160()));
+        const CTransactionRef ptx = MakeTransactionRef(tx);
+        LOCK(internal::g_cs_orphans);
+        BOOST_CHECK(internal::AddOrphanTx(ptx, peer));
+        return ptx;
+    };
+    std::vector<CTransactionRef> chain;
+    for (size_t i = 0; i < internal::MAX_ORPHANS_PER_PASS + 10; i++) {
+        chain.push_back(makeOrphan(chain.empty() ? COutPoint(TxId(InsecureRand256()), 0)
+                                                 : COutPoint(chain.back()->GetId(), 0),
+                                   1 * CENT, 0));
+    }
+    std::set<TxId> invalid;
+    for (size_t i = 0; i < internal::MAX_ORPHAN_BATCH_SIZE + 5; i++) {
+        invalid.insert(makeOrphan(COutPoint(TxId(InsecureRand256()), 0), MAX_MONEY + SATOSHI, 1)->GetId());
+    }
+
+    LOCK2(cs_main, internal::g_cs_orphans);
+
+    // Only MAX_ORPHANS_PER_PASS orphans are tried in a call, the rest are left
+    // for the next one.
+    std::set<TxId> orphan_work_set{chain.front()->GetId()};
+    BOOST_CHECK_EQUAL(internal::AcceptOrphans(GetConfig(), orphan_work_set).size(),
+                      internal::MAX_ORPHANS_PER_PASS);
+    BOOST_CHECK_EQUAL(orphan_work_set.size(), 1U);
+    BOOST_CHECK_EQUAL(internal::AcceptOrphans(GetConfig(), orphan_work_set).size(), 10U);
+    BOOST_CHECK(orphan_work_set.empty());
+    BOOST_CHECK_EQUAL(internal::mapOrphanTransactions.size(), chain.size() + invalid.size());
+
+    // Once a peer sent more than MAX_NON_STANDARD_ORPHAN_PER_NODE invalid
+    // orphans in a call, its other orphans are skipped and stay in the pool.
+    orphan_work_set = invalid;
+    const std::vector<internal::OrphanAcceptResult> results = internal::AcceptOrphans(GetConfig(), orphan_work_set);
+    BOOST_CHECK_EQUAL(results.size(), internal::MAX_ORPHAN_BATCH_SIZE);
+    for (const internal::OrphanAcceptResult &orphan : results) {
+        BOOST_CHECK(!orphan.result.fAccepted);
+        BOOST_CHECK(!orphan.result.fMissingInputs);
+        BOOST_CHECK(orphan.result.state.IsInvalid());
+        BOOST_CHECK(!internal::mapOrphanTransactions.count(orphan.tx->GetId()));
+    }
+    BOOST_CHECK(orphan_work_set.empty());
+    BOOST_CHECK_EQUAL(internal::mapOrphanTransactions.size(), chain.size() + 5);
+    CheckMapOrphanTxByPrevSanity();
+
+    internal::EraseOrphansFor(0);
+    internal::EraseOrphansFor(1);
+    BOOST_CHECK(internal::mapOrphanTransactions.empty());
+}
+
+BOOST_AUTO_TEST_CASE(DoS_ProcessTxMessages) {
+    const Config &config = GetConfig();
+    std::atomic<bool> interruptDummy(false);
+
+    auto connman = std::make_unique<CConnman>(config, 0x1337, 0x1337);
+    auto peerLogic = std::make_unique<PeerLogicValidation>(
+        connman.get(), nullptr, scheduler, false, true);
+
+    CNode dummyNode(id++, NODE_NETWORK, 0, INVALID_SOCKET, CAddress(ip(0xa0b0c001), NODE_NONE), 0, 0,
+                    CAddress(), "", true);
+    dummyNode.SetSendVersion(PROTOCOL_VERSION);
+    peerLogic->InitializeNode(config, &dummyNode);
+    dummyNode.nVersion = 1;
+    dummyNode.fSuccessfullyConnected = true;
+
+    // A chain of orphans sent as TX messages back to back, followed by a PING.
+    const CNetMsgMaker msgMaker(INIT_PROTO_VERSION);
+    std::vector<CTransactionRef> chain;
+    {
+        LOCK(dummyNode.cs_vProcessMsg);
+        for (int i = 0; i < 10; i++) {
+            CMutableTransaction tx;
+            tx.vin.resize(1);
+            tx.vin[0].prevout = chain.empty() ? COutPoint(TxId(InsecureRand256()), 0)
+                                              : COutPoint(chain.back()->GetId(), 0);
+            tx.vin[0].scriptSig << std::vector<uint8_t>(100, 0xff);
+            tx.vout.resize(1);
+            tx.vout[0].nValue = 1 * CENT;
+            tx.vout[0].scriptPubKey = GetScriptForDestination(CKeyID(uint160()));
+            chain.push_back(MakeTransactionRef(tx));
+            dummyNode.vProcessMsg.push_back(MakeReceivedMessage(config, msgMaker.Make(NetMsgType::TX, *chain.back())));
+        }
+        dummyNode.vProcessMsg.push_back(MakeReceivedMessage(config, msgMaker.Make(NetMsgType::PING, uint64_t(1))));
+        for (const CNetMessage &msg : dummyNode.vProcessMsg) {
+            dummyNode.nProcessQueueSize += msg.vRecv.size() + CMessageHeader::HEADER_SIZE;
+        }
+    }
+
+    // The TX messages are processed together, the PING is left for later.
+    BOOST_CHECK(peerLogic->ProcessMessages(config, &dummyNode, interruptDummy));
+    {
+        LOCK(dummyNode.cs_vProcessMsg);
+        BOOST_CHECK_EQUAL(dummyNode.vProcessMsg.size(), 1U);
+        BOOST_CHECK_EQUAL(dummyNode.vProcessMsg.front().hdr.GetCommand(), NetMsgType::PING);
+        BOOST_CHECK_EQUAL(dummyNode.nProcessQueueSize,
+                          dummyNode.vProcessMsg.front().vRecv.size() + CMessageHeader::HEADER_SIZE);
+    }
+    {
+        LOCK(internal::g_cs_orphans);
+        BOOST_CHECK_EQUAL(internal::mapOrphanTransactions.size(), chain.size());
+        for (const CTransactionRef &tx : chain) {
+            BOOST_CHECK(internal::mapOrphanTransactions.count(tx->GetId()));
+        }
+    }
+    CheckMapOrphanTxByPrevSanity();
+
+    bool dummy;
+    peerLogic->FinalizeNode(config, dummyNode.GetId(), dummy);
+    LOCK(internal::g_cs_orphans);
+    BOOST_CHECK(internal::mapOrphanTransactions.empty());
 }
 
 BOOST_AUTO_TEST_SUITE_END()
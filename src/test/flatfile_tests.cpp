@@ -131,4 +131,41 @@ BOOST_AUTO_TEST_CASE(flatfile_flush) {
     BOOST_CHECK_EQUAL(fs::file_size(seq.FileName(FlatFilePos(0, 1))), 1);
 }
 
+BOOST_AUTO_TEST_CASE(flatfile_map) {
+    auto data_dir = SetDataDir("flatfile_test");
+    FlatFileSeq seq(data_dir, "a", 100);
+
+    // Missing and empty files are not mapped.
+    BOOST_CHECK(!seq.Map(FlatFilePos(0, 0)));
+    fclose(seq.Open(FlatFilePos(0, 0)));
+    BOOST_CHECK(!seq.Map(FlatFilePos(0, 0)));
+
+    const std::string data = "this is a test";
+    {
+        CAutoFile file(seq.Open(FlatFilePos(0, 0)), SER_DISK, CLIENT_VERSION);
+        file << data;
+    }
+
+    const auto mapped = seq.Map(FlatFilePos(0, 5));
+#ifdef WIN32
+    BOOST_CHECK(!mapped);
+#else
+    BOOST_REQUIRE(mapped);
+    BOOST_CHECK_EQUAL(mapped->GetData().size(), data.size() + 1);
+
+    std::string read;
+    GenericVectorReader<Span<const uint8_t>>(SER_DISK, CLIENT_VERSION,
+                                             mapped->GetData(), 0) >>
+        read;
+    BOOST_CHECK_EQUAL(read, data);
+
+    // Writes within the size of the file are visible through the mapping.
+    {
+        CAutoFile file(seq.Open(FlatFilePos(0, 1)), SER_DISK, CLIENT_VERSION);
+        file << uint8_t('T');
+    }
+    BOOST_CHECK_EQUAL(mapped->GetData()[1], 'T');
+#endif
+}
+
 BOOST_AUTO_TEST_SUITE_END()
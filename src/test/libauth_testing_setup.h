@@ -14,6 +14,7 @@
 #include <string>
 #include <string_view>
 #include <tuple>
+#include <unordered_map>
 
 class CValidationState;
 class ScriptExecutionMetrics;
@@ -38,7 +39,7 @@ public:
             std::string scriptAsm;
             CTransactionRef tx;
             size_t txSize{};
-            CCoinsMap inputCoins;
+            std::unordered_map<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher> inputCoins;
             bool scriptOnly = false; //< If true, this test should *not* test against AcceptToMemoryPool() for the
                                      //< whole txn, but should just evaluate the script for input `inputNum`.
             bool benchmark = false;  //< True if the test description contains the string " benchmark:"
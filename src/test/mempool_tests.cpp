@@ -107,6 +107,66 @@ BOOST_AUTO_TEST_CASE(MempoolRemoveTest) {
     BOOST_CHECK_EQUAL(testPool.size(), 0UL);
 }
 
+BOOST_AUTO_TEST_CASE(MempoolLinksReuseTest) {
+    // The links slots of removed entries are reused without carrying over
+    // their links.
+    TestMemPoolEntryHelper entry;
+    CMutableTransaction txParent;
+    txParent.vin.resize(1);
+    txParent.vin[0].scriptSig = CScript() << OP_11;
+    txParent.vout.resize(2);
+    for (int i = 0; i < 2; i++) {
+        txParent.vout[i].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        txParent.vout[i].nValue = 33000 * SATOSHI;
+    }
+    CMutableTransaction txChild[3];
+    for (int i = 0; i < 3; i++) {
+        txChild[i].vin.resize(1);
+        txChild[i].vin[0].scriptSig = CScript() << OP_11;
+        // The last child double-spends the first.
+        txChild[i].vin[0].prevout = COutPoint(txParent.GetId(), i % 2);
+        txChild[i].vout.resize(1);
+        txChild[i].vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        txChild[i].vout[0].nValue = (11000 + i) * SATOSHI;
+    }
+    CMutableTransaction txGrandChild;
+    txGrandChild.vin.resize(1);
+    txGrandChild.vin[0].scriptSig = CScript() << OP_11;
+    txGrandChild.vin[0].prevout = COutPoint(txChild[0].GetId(), 0);
+    txGrandChild.vout.resize(1);
+    txGrandChild.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txGrandChild.vout[0].nValue = 10000 * SATOSHI;
+
+    CTxMemPool testPool;
+    LOCK2(cs_main, testPool.cs);
+    testPool.addUnchecked(entry.FromTx(txParent));
+    testPool.addUnchecked(entry.FromTx(txChild[0]));
+    testPool.addUnchecked(entry.FromTx(txChild[1]));
+    testPool.addUnchecked(entry.FromTx(txGrandChild));
+    const CTxMemPool::txiter parent = *testPool.GetIter(txParent.GetId());
+    const CTxMemPool::txiter child0 = *testPool.GetIter(txChild[0].GetId());
+    const uint32_t nChild0Slot = child0->GetLinksSlot();
+    const uint32_t nGrandChildSlot =
+        (*testPool.GetIter(txGrandChild.GetId()))->GetLinksSlot();
+    BOOST_CHECK_EQUAL(testPool.GetMemPoolChildren(parent).size(), 2U);
+    BOOST_CHECK_EQUAL(testPool.GetMemPoolChildren(child0).size(), 1U);
+
+    // Removing the first child and its child frees their slots, which the
+    // entries added next take.
+    testPool.removeRecursive(CTransaction(txChild[0]));
+    BOOST_CHECK_EQUAL(testPool.size(), 2U);
+    BOOST_CHECK_EQUAL(testPool.GetMemPoolChildren(parent).size(), 1U);
+    testPool.addUnchecked(entry.FromTx(txChild[2]));
+    const CTxMemPool::txiter child2 = *testPool.GetIter(txChild[2].GetId());
+    BOOST_CHECK(child2->GetLinksSlot() == nChild0Slot ||
+                child2->GetLinksSlot() == nGrandChildSlot);
+    BOOST_CHECK(testPool.GetMemPoolParents(child2) ==
+                CTxMemPool::Links{parent});
+    BOOST_CHECK(testPool.GetMemPoolChildren(child2).empty());
+    BOOST_CHECK_EQUAL(testPool.GetMemPoolChildren(parent).size(), 2U);
+    BOOST_CHECK(testPool.GetMemPoolChildren(parent).back() == child2);
+}
+
 BOOST_AUTO_TEST_CASE(MempoolClearTest) {
     // Test CTxMemPool::clear functionality
 
@@ -522,7 +582,7 @@ struct TestMemPoolWithAncestryChecker : CTxMemPool
             if (!counted.insert(candidate).second) {
                 continue;
             }
-            const setEntries &parents = GetMemPoolParents(candidate);
+            const Links &parents = GetMemPoolParents(candidate);
             if (parents.size() == 0) {
                 setEntries descendants;
                 CalculateDescendants(candidate, descendants);
@@ -756,6 +816,199 @@ BOOST_AUTO_TEST_CASE(MempoolAncestryTests) {
     BOOST_CHECK_EQUAL(descendants, 4ULL);
 }
 
+BOOST_AUTO_TEST_CASE(MempoolAncestorStatsTest) {
+    CTxMemPool pool;
+    LOCK2(cs_main, pool.cs);
+    TestMemPoolEntryHelper entry;
+
+    // Compare the memoized ancestor stats against a walk over the ancestors.
+    const auto checkStats = [&pool](const CTransactionRef &tx) EXCLUSIVE_LOCKS_REQUIRED(pool.cs) {
+        const CTxMemPool::txiter it = *pool.GetIter(tx->GetId());
+        CTxMemPool::setEntries setAncestors;
+        pool.CalculateMemPoolAncestors(*it, setAncestors, false);
+        setAncestors.insert(it);
+        uint64_t size = 0;
+        int64_t sigChecks = 0;
+        for (const CTxMemPool::txiter ancestorit : setAncestors) {
+            size += ancestorit->GetTxSize();
+            sigChecks += ancestorit->GetSigChecks();
+        }
+        const CTxMemPool::AncestorStats stats = pool.GetAncestorStats(it);
+        BOOST_CHECK_EQUAL(stats.count, setAncestors.size());
+        BOOST_CHECK_EQUAL(stats.size, size);
+        BOOST_CHECK_EQUAL(stats.sigChecks, sigChecks);
+        return stats.count;
+    };
+
+    // A long chain, queried from its tip first so that the stats of the whole
+    // chain are computed at once.
+    //
+    // [tx0].0 <- [tx1].0 <- ... <- [tx199]
+    //
+    std::vector<CTransactionRef> chain;
+    Amount v = 100 * COIN;
+    for (size_t i = 0; i < 200; i++) {
+        chain.push_back(make_tx(/* output_values */ {v},
+                                /* inputs */ i > 0 ? std::vector<CTransactionRef>{chain.back()}
+                                                   : std::vector<CTransactionRef>{}));
+        v -= 10 * CENT;
+        pool.addUnchecked(entry.Fee(10000 * SATOSHI).SigChecks(i % 3).FromTx(chain.back()));
+    }
+    BOOST_CHECK_EQUAL(checkStats(chain.back()), 200U);
+    for (size_t i = 0; i < chain.size(); i++) {
+        BOOST_CHECK_EQUAL(checkStats(chain[i]), i + 1);
+    }
+
+    // A diamond hanging off the chain, whose bottom has two parents that
+    // share their ancestors.
+    //
+    // [tx199].0 <- [ta].0 <- [tb].0 -----<------- [td]
+    //                          |                    |
+    //                          \---1 <- [tc].0 --<--/
+    //
+    CTransactionRef ta = make_tx(/* output_values */ {10 * COIN}, /* inputs */ {chain.back()});
+    CTransactionRef tb = make_tx(/* output_values */ {5 * COIN, 3 * COIN}, /* inputs */ {ta});
+    CTransactionRef tc = make_tx(/* output_values */ {2 * COIN}, /* inputs */ {tb},
+                                 /* input_indices */ {1});
+    CTransactionRef td = make_tx(/* output_values */ {6 * COIN}, /* inputs */ {tb, tc},
+                                 /* input_indices */ {0, 0});
+    for (const CTransactionRef &tx : {ta, tb, tc, td}) {
+        pool.addUnchecked(entry.Fee(10000 * SATOSHI).FromTx(tx));
+    }
+    BOOST_CHECK_EQUAL(checkStats(td), 204U);
+    BOOST_CHECK_EQUAL(checkStats(tc), 203U);
+
+    // Confirming the first half of the chain removes it from the ancestors of
+    // everything left.
+    pool.removeForBlock({chain.begin(), chain.begin() + 100});
+    BOOST_CHECK_EQUAL(pool.size(), 104U);
+    BOOST_CHECK_EQUAL(checkStats(td), 104U);
+    for (size_t i = 100; i < chain.size(); i++) {
+        BOOST_CHECK_EQUAL(checkStats(chain[i]), i - 99);
+    }
+    BOOST_CHECK_EQUAL(checkStats(tb), 102U);
+
+    // Removing the middle of the chain leaves its start alone.
+    pool.removeRecursive(*chain[150]);
+    BOOST_CHECK_EQUAL(pool.size(), 50U);
+    BOOST_CHECK_EQUAL(checkStats(chain[149]), 50U);
+    BOOST_CHECK_EQUAL(checkStats(chain[100]), 1U);
+}
+
+BOOST_AUTO_TEST_CASE(MempoolRemoveForBlockTest) {
+    CTxMemPool pool;
+    LOCK2(cs_main, pool.cs);
+    TestMemPoolEntryHelper entry;
+
+    //
+    // [tp].0 <- [tc].0 <- [tg]
+    //   |
+    //   \---1 <- [tx].0 <- [ty]
+    //
+    // [tu]
+    //
+    CTransactionRef tp = make_tx(/* output_values */ {10 * COIN, 10 * COIN});
+    CTransactionRef tc = make_tx(/* output_values */ {9 * COIN}, /* inputs */ {tp});
+    CTransactionRef tg = make_tx(/* output_values */ {8 * COIN}, /* inputs */ {tc});
+    CTransactionRef tx = make_tx(/* output_values */ {9 * COIN}, /* inputs */ {tp}, /* input_indices */ {1});
+    CTransactionRef ty = make_tx(/* output_values */ {8 * COIN}, /* inputs */ {tx});
+    CTransactionRef tu = make_tx(/* output_values */ {7 * COIN});
+    for (const CTransactionRef &t : {tp, tc, tg, tx, ty, tu}) {
+        pool.addUnchecked(entry.Fee(10000 * SATOSHI).FromTx(t));
+    }
+    pool.PrioritiseTransaction(tc->GetId(), 1000 * SATOSHI);
+    pool.PrioritiseTransaction(tx->GetId(), 1000 * SATOSHI);
+    pool.PrioritiseTransaction(tu->GetId(), 1000 * SATOSHI);
+
+    std::vector<std::pair<TxId, MemPoolRemovalReason>> removed;
+    boost::signals2::scoped_connection conn = pool.NotifyEntryRemoved.connect(
+        [&removed](CTransactionRef ptx, MemPoolRemovalReason reason) { removed.emplace_back(ptx->GetId(), reason); });
+
+    // The block confirms tp and tc, along with a transaction that is not in
+    // the mempool and double-spends tx.
+    CTransactionRef txConflict = make_tx(/* output_values */ {5 * COIN}, /* inputs */ {tp}, /* input_indices */ {1});
+    pool.removeForBlock({tp, tc, txConflict});
+
+    // The block transactions go first, parents before children, then the
+    // conflicting ones with their descendants.
+    const std::vector<std::pair<TxId, MemPoolRemovalReason>> expected{
+        {tp->GetId(), MemPoolRemovalReason::BLOCK},
+        {tc->GetId(), MemPoolRemovalReason::BLOCK},
+        {tx->GetId(), MemPoolRemovalReason::CONFLICT},
+        {ty->GetId(), MemPoolRemovalReason::CONFLICT},
+    };
+    BOOST_CHECK(removed == expected);
+    BOOST_CHECK_EQUAL(pool.size(), 2U);
+    const CTxMemPool::txiter itg = *pool.GetIter(tg->GetId());
+    BOOST_CHECK(pool.GetMemPoolParents(itg).empty());
+    BOOST_CHECK(pool.GetMemPoolChildren(itg).empty());
+    BOOST_CHECK(!pool.isSpent(COutPoint(tp->GetId(), 1)));
+
+    // Only the prioritisation of the unrelated transaction is left.
+    BOOST_CHECK_EQUAL(pool.mapDeltas.size(), 1U);
+    BOOST_CHECK_EQUAL(pool.mapDeltas.count(tu->GetId()), 1U);
+}
+
+BOOST_AUTO_TEST_CASE(MempoolSnapshotTest) {
+    CTxMemPool pool;
+    TestMemPoolEntryHelper entry;
+
+    // [tp].0 <- [tc]
+    CTransactionRef tp = make_tx(/* output_values */ {10 * COIN});
+    CTransactionRef tc = make_tx(/* output_values */ {9 * COIN}, /* inputs */ {tp});
+    {
+        LOCK2(cs_main, pool.cs);
+        pool.addUnchecked(entry.Fee(10000 * SATOSHI).Time(1).FromTx(tp));
+    }
+
+    const auto snapshot1 = pool.GetSnapshot();
+    BOOST_CHECK(!snapshot1->fWithLinks);
+    BOOST_CHECK_EQUAL(snapshot1->entries.size(), 1U);
+    BOOST_CHECK_EQUAL(snapshot1->totalTxSize, tp->GetTotalSize());
+    BOOST_CHECK(snapshot1->entries[0].txid == tp->GetId());
+    BOOST_CHECK_EQUAL(snapshot1->entries[0].fee, 10000 * SATOSHI);
+    BOOST_CHECK_EQUAL(snapshot1->entries[0].time, 1);
+
+    // Nothing changed, so the same snapshot is shared.
+    BOOST_CHECK_EQUAL(pool.GetSnapshot(), snapshot1);
+
+    // Adding a transaction makes a new one, in entry id order, while the old
+    // one stays as it was for those still holding it.
+    {
+        LOCK2(cs_main, pool.cs);
+        pool.addUnchecked(entry.Fee(20000 * SATOSHI).Time(2).FromTx(tc));
+    }
+    const auto snapshot2 = pool.GetSnapshot();
+    BOOST_CHECK(snapshot2 != snapshot1);
+    BOOST_CHECK_EQUAL(snapshot1->entries.size(), 1U);
+    BOOST_CHECK_EQUAL(snapshot2->entries.size(), 2U);
+    BOOST_CHECK(snapshot2->entries[0].txid == tp->GetId());
+    BOOST_CHECK(snapshot2->entries[1].txid == tc->GetId());
+    BOOST_CHECK(snapshot2->entries[1].parents.empty());
+
+    // Asking for links takes a new snapshot, which also serves callers that
+    // do not need them.
+    const auto snapshot3 = pool.GetSnapshot(true /* fWithLinks */);
+    BOOST_CHECK(snapshot3 != snapshot2);
+    BOOST_CHECK(snapshot3->fWithLinks);
+    BOOST_CHECK_EQUAL(pool.GetSnapshot(), snapshot3);
+    BOOST_CHECK(snapshot3->entries[0].children == std::vector<TxId>{tc->GetId()});
+    BOOST_CHECK(snapshot3->entries[1].parents == std::vector<TxId>{tp->GetId()});
+    BOOST_CHECK_EQUAL(snapshot3->entries[1].ancestors.count, 2U);
+    BOOST_CHECK_EQUAL(snapshot3->entries[1].ancestors.size, tp->GetTotalSize() + tc->GetTotalSize());
+
+    // Prioritising a transaction in the pool changes its modified fee.
+    pool.PrioritiseTransaction(tc->GetId(), 1000 * SATOSHI);
+    const auto snapshot4 = pool.GetSnapshot();
+    BOOST_CHECK(snapshot4 != snapshot3);
+    BOOST_CHECK_EQUAL(snapshot4->entries[1].fee, 20000 * SATOSHI);
+    BOOST_CHECK_EQUAL(snapshot4->entries[1].modifiedFee, 21000 * SATOSHI);
+
+    pool.clear();
+    BOOST_CHECK(pool.GetSnapshot()->entries.empty());
+    BOOST_CHECK_EQUAL(pool.GetSnapshot()->totalTxSize, 0U);
+}
+
 BOOST_AUTO_TEST_CASE(GetModifiedFeeRateTest) {
     CMutableTransaction tx = CMutableTransaction();
     tx.vin.resize(1);
@@ -13,14 +13,20 @@
 #include <consensus/merkle.h>
 #include <consensus/tx_verify.h>
 #include <consensus/validation.h>
+#include <key.h>
 #include <policy/policy.h>
+#include <pow.h>
 #include <pubkey.h>
+#include <script/interpreter.h>
+#include <script/sighashtype.h>
 #include <script/standard.h>
 #include <txmempool.h>
 #include <uint256.h>
+#include <util/defer.h>
 #include <util/strencodings.h>
 #include <util/system.h>
 #include <validation.h>
+#include <validationinterface.h>
 
 #include <test/setup_common.h>
 
@@ -28,6 +34,7 @@
 
 #include <memory>
 #include <optional>
+#include <set>
 
 BOOST_FIXTURE_TEST_SUITE(miner_tests, TestingSetup)
 
@@ -744,4 +751,197 @@ BOOST_AUTO_TEST_CASE(TestCBlockTemplateEntry) {
     BOOST_CHECK_EQUAL(txEntry.sigChecks, 10);
 }
 
+//! The ids of the transactions of a block template, other than the coinbase.
+static std::set<TxId> TemplateTxIds(const CBlockTemplate &blocktemplate) {
+    std::set<TxId> txids;
+    for (size_t i = 1; i < blocktemplate.block.vtx.size(); ++i) {
+        txids.insert(blocktemplate.block.vtx[i]->GetId());
+    }
+    return txids;
+}
+
+BOOST_FIXTURE_TEST_CASE(BlockTemplateTracker_incremental, TestChain100Setup) {
+    const Config &config = GetConfig();
+    g_block_template_tracker = std::make_unique<BlockTemplateTracker>(config, g_mempool);
+    RegisterValidationInterface(g_block_template_tracker.get());
+    GetMainSignals().RegisterWithMempoolSignals(g_mempool);
+    Defer cleanup([] {
+        GetMainSignals().UnregisterWithMempoolSignals(g_mempool);
+        UnregisterValidationInterface(g_block_template_tracker.get());
+        SyncWithValidationInterfaceQueue();
+        g_block_template_tracker.reset();
+    });
+
+    TestMemPoolEntryHelper entry;
+    // Add a transaction to the mempool, and notify it unless told otherwise.
+    const auto addTx = [&entry](const CMutableTransaction &tx, Amount fee, bool notify = true) {
+        const CTransactionRef ptx = MakeTransactionRef(tx);
+        {
+            LOCK2(cs_main, g_mempool.cs);
+            g_mempool.addUnchecked(entry.Fee(fee).Time(GetTime()).FromTx(ptx));
+        }
+        if (notify) {
+            GetMainSignals().TransactionAddedToMempool(ptx);
+        }
+        return ptx;
+    };
+    // Spend an output of prevTx, padding the scriptSig so that the transaction is not undersized.
+    const auto spend = [](const CTransaction &prevTx, uint32_t n, Amount fee, size_t nOutputs = 1) {
+        CMutableTransaction tx;
+        tx.vin.emplace_back(COutPoint(prevTx.GetId(), n), CScript() << std::vector<uint8_t>(MIN_TX_SIZE_MAGNETIC_ANOMALY, 0));
+        tx.vout.assign(nOutputs, CTxOut((prevTx.vout[n].nValue - fee) / int64_t(nOutputs), CScript() << OP_TRUE));
+        return tx;
+    };
+    // The transactions of a block template, selected incrementally if the tracker is in sync.
+    const auto tracked = [&config] {
+        SyncWithValidationInterfaceQueue();
+        return TemplateTxIds(*BlockAssembler(config, g_mempool).CreateNewBlock(CScript() << OP_TRUE, 0., false));
+    };
+    // The transactions of a block template selected from the whole mempool, which overriding the options does.
+    const auto full = [&config] {
+        return TemplateTxIds(
+            *AssemblerForTest(config, g_mempool).CreateNewBlock(CScript() << OP_TRUE, 0., false));
+    };
+    const auto tip = [] { return WITH_LOCK(cs_main, return ::ChainActive().Tip()); };
+
+    // The first block template is selected from the whole mempool, and the tracker follows it from then on.
+    const CTransactionRef parent = addTx(spend(*m_coinbase_txns[0], 0, 10000 * SATOSHI, 10), 10000 * SATOSHI);
+    BOOST_CHECK(!g_block_template_tracker->IsSyncedTo(tip()));
+    BOOST_CHECK(tracked() == std::set<TxId>{parent->GetId()});
+    BOOST_CHECK(g_block_template_tracker->IsSyncedTo(tip()));
+
+    // Transactions that qualify are added as they enter the mempool, others are not.
+    std::vector<CTransactionRef> children;
+    for (uint32_t n = 0; n < 5; ++n) {
+        children.push_back(addTx(spend(*parent, n, 10000 * SATOSHI), 10000 * SATOSHI));
+    }
+    const CTransactionRef freeTx = addTx(spend(*parent, 5, Amount::zero()), Amount::zero());
+    const CTransactionRef freeChild = addTx(spend(*freeTx, 0, 10000 * SATOSHI), 10000 * SATOSHI);
+    std::set<TxId> expected = tracked();
+    BOOST_CHECK_EQUAL(expected.size(), 6U);
+    BOOST_CHECK(!expected.count(freeTx->GetId()));
+    BOOST_CHECK(!expected.count(freeChild->GetId()));
+    BOOST_CHECK(expected == full());
+    BOOST_CHECK(g_block_template_tracker->IsSyncedTo(tip()));
+
+    // Transactions that have not been notified yet are not selected incrementally.
+    const CTransactionRef unnotified = addTx(spend(*parent, 6, 10000 * SATOSHI), 10000 * SATOSHI, false);
+    BOOST_CHECK(tracked() == expected);
+    expected.insert(unnotified->GetId());
+    BOOST_CHECK(full() == expected);
+    GetMainSignals().TransactionAddedToMempool(unnotified);
+    BOOST_CHECK(tracked() == expected);
+
+    // Transactions that leave the mempool are dropped, along with their descendants.
+    const CTransactionRef grandchild = addTx(spend(*children[0], 0, 10000 * SATOSHI), 10000 * SATOSHI);
+    BOOST_CHECK(tracked().count(grandchild->GetId()));
+    WITH_LOCK(g_mempool.cs, g_mempool.removeRecursive(*children[0]));
+    expected.erase(children[0]->GetId());
+    BOOST_CHECK(tracked() == expected);
+    BOOST_CHECK(full() == expected);
+    BOOST_CHECK(g_block_template_tracker->IsSyncedTo(tip()));
+
+    // Changing fee deltas makes the tracker out of date, until the next block template is selected from the whole
+    // mempool.
+    g_mempool.PrioritiseTransaction(freeTx->GetId(), 10000 * SATOSHI);
+    g_block_template_tracker->MarkOutOfDate();
+    BOOST_CHECK(!g_block_template_tracker->IsSyncedTo(tip()));
+    expected.insert(freeTx->GetId());
+    expected.insert(freeChild->GetId());
+    BOOST_CHECK(tracked() == expected);
+    BOOST_CHECK(full() == expected);
+    BOOST_CHECK(g_block_template_tracker->IsSyncedTo(tip()));
+
+    // A block on top of the tracked tip carries the selection over to the new tip, without the transactions of the
+    // block. The transactions above are not valid, so they must not be mined: start over from an empty mempool.
+    WITH_LOCK(cs_main, g_mempool.clear());
+    g_block_template_tracker->MarkOutOfDate();
+    BOOST_CHECK(tracked().empty());
+    // Spend the first output of prevTx, which pays to coinbaseKey, back to it.
+    const auto signedSpend = [this](const CTransaction &prevTx, Amount fee) {
+        const CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+        CMutableTransaction tx;
+        tx.vin.emplace_back(COutPoint(prevTx.GetId(), 0));
+        tx.vout.emplace_back(prevTx.vout[0].nValue - fee, scriptPubKey);
+        std::vector<uint8_t> vchSig;
+        const uint256 hash = SignatureHash(scriptPubKey, ScriptExecutionContext{0, prevTx.vout[0], tx},
+                                           SigHashType().withFork(), nullptr, STANDARD_SCRIPT_VERIFY_FLAGS)
+                                 .signatureHash;
+        BOOST_CHECK(coinbaseKey.SignECDSA(hash, vchSig));
+        vchSig.push_back(uint8_t(SIGHASH_ALL | SIGHASH_FORKID));
+        tx.vin[0].scriptSig << vchSig;
+        return tx;
+    };
+    const CTransactionRef mined = addTx(signedSpend(*m_coinbase_txns[0], 10000 * SATOSHI), 10000 * SATOSHI);
+    const CTransactionRef kept = addTx(signedSpend(*mined, 10000 * SATOSHI), 10000 * SATOSHI);
+    BOOST_CHECK(tracked() == (std::set<TxId>{mined->GetId(), kept->GetId()}));
+
+    const CBlockIndex *pindexOld = tip();
+    {
+        // Mine only the parent, which leaves its child in the mempool. Selecting from the whole mempool leaves the
+        // tracker alone.
+        std::unique_ptr<CBlockTemplate> pblocktemplate =
+            AssemblerForTest(config, g_mempool).CreateNewBlock(CScript() << OP_TRUE);
+        CBlock &block = pblocktemplate->block;
+        CMutableTransaction coinbase(*block.vtx[0]);
+        coinbase.vout[0].nValue -= 10000 * SATOSHI;
+        block.vtx = {MakeTransactionRef(coinbase), mined};
+        block.hashMerkleRoot = BlockMerkleRoot(block);
+        while (!CheckProofOfWork(block.GetHash(), block.nBits, config.GetChainParams().GetConsensus())) {
+            ++block.nNonce;
+        }
+        BOOST_CHECK(ProcessNewBlock(config, std::make_shared<const CBlock>(block), true, nullptr));
+    }
+    SyncWithValidationInterfaceQueue();
+    BOOST_CHECK(tip() != pindexOld);
+    BOOST_CHECK(!g_block_template_tracker->IsSyncedTo(pindexOld));
+    BOOST_CHECK(g_block_template_tracker->IsSyncedTo(tip()));
+    BOOST_CHECK(tracked() == std::set<TxId>{kept->GetId()});
+    BOOST_CHECK(full() == std::set<TxId>{kept->GetId()});
+
+    // Transactions keep being added for the new tip.
+    const CTransactionRef next = addTx(signedSpend(*kept, 10000 * SATOSHI), 10000 * SATOSHI);
+    BOOST_CHECK(tracked() == (std::set<TxId>{kept->GetId(), next->GetId()}));
+    BOOST_CHECK(full() == tracked());
+
+    // Any other new tip makes the tracker out of date, until the next block template is selected from the whole
+    // mempool, to which disconnecting the block returned its transaction.
+    {
+        CValidationState state;
+        CBlockIndex *const pindexInvalid = WITH_LOCK(cs_main, return ::ChainActive().Tip());
+        BOOST_CHECK(InvalidateBlock(config, state, pindexInvalid));
+    }
+    SyncWithValidationInterfaceQueue();
+    BOOST_CHECK(tip() == pindexOld);
+    BOOST_CHECK(!g_block_template_tracker->IsSyncedTo(tip()));
+    BOOST_CHECK(tracked() == (std::set<TxId>{mined->GetId(), kept->GetId(), next->GetId()}));
+    BOOST_CHECK(g_block_template_tracker->IsSyncedTo(tip()));
+    BOOST_CHECK(full() == tracked());
+}
+
+BOOST_FIXTURE_TEST_CASE(TestBlockValidityAsync_invalid, TestChain100Setup) {
+    const Config &config = GetConfig();
+    const CBlockIndex *tip = WITH_LOCK(cs_main, return ::ChainActive().Tip());
+    const std::unique_ptr<CBlockTemplate> pblocktemplate =
+        BlockAssembler(config, g_mempool).CreateNewBlock(CScript() << OP_TRUE, 0., false);
+    const auto testAsync = [&config](const CBlock &block, const CBlockIndex *pindexPrev) {
+        std::optional<std::string> reason;
+        TestBlockValidityAsync(config, std::make_shared<const CBlock>(block), pindexPrev,
+                               [&reason](const CValidationState &state) { reason = state.GetRejectReason(); });
+        SyncWithValidationInterfaceQueue();
+        return reason;
+    };
+
+    // A valid template passes.
+    BOOST_CHECK(!testAsync(pblocktemplate->block, tip));
+
+    // An invalid one is reported, unless the tip has changed since it was created.
+    CBlock block = pblocktemplate->block;
+    CMutableTransaction coinbase(*block.vtx[0]);
+    coinbase.vout[0].nValue += SATOSHI;
+    block.vtx[0] = MakeTransactionRef(coinbase);
+    BOOST_CHECK(testAsync(block, tip) == std::optional<std::string>("bad-cb-amount"));
+    BOOST_CHECK(!testAsync(block, tip->pprev));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -10,6 +10,7 @@
 #include <config.h>
 #include <hash.h>
 #include <netbase.h>
+#include <netmessagemaker.h>
 #include <serialize.h>
 #include <span.h>
 #include <streams.h>
@@ -745,4 +746,159 @@ BOOST_AUTO_TEST_CASE(ipv4_peer_with_ipv6_addrMe_test) {
     BOOST_CHECK(1);
 }
 
+BOOST_AUTO_TEST_CASE(socket_events_mode) {
+    for (const auto mode : {SocketEventsMode::Select, SocketEventsMode::Poll, SocketEventsMode::EPoll}) {
+        const std::string str = SocketEventsModeToString(mode);
+        const auto parsed = SocketEventsModeFromString(str);
+        // Only the supported modes are parsed, and back to the same mode
+        BOOST_CHECK_EQUAL(bool(parsed), GetSupportedSocketEventsModes().find(str) != std::string::npos);
+        BOOST_CHECK(!parsed || *parsed == mode);
+    }
+    BOOST_CHECK(SocketEventsModeFromString(SocketEventsModeToString(DEFAULT_SOCKETEVENTS_MODE)) ==
+                DEFAULT_SOCKETEVENTS_MODE);
+    BOOST_CHECK(!SocketEventsModeFromString(""));
+    BOOST_CHECK(!SocketEventsModeFromString("EPOLL"));
+    BOOST_CHECK(!SocketEventsModeFromString("kqueue"));
+#ifdef USE_EPOLL
+    BOOST_CHECK(DEFAULT_SOCKETEVENTS_MODE == SocketEventsMode::EPoll);
+    BOOST_CHECK(!SocketEventsModeFromString("select"));
+#endif
+}
+
+BOOST_AUTO_TEST_CASE(recv_buffer_pool) {
+    RecvBufferPool pool;
+
+    // Small messages bypass the pool
+    RecvBufferPool::Buffer buf = pool.Acquire(RecvBufferPool::MIN_POOLED_SIZE - 1);
+    BOOST_CHECK_EQUAL(buf.capacity(), 0U);
+    buf.reserve(RecvBufferPool::MIN_POOLED_SIZE - 1);
+    pool.Release(std::move(buf));
+    BOOST_CHECK_EQUAL(pool.GetPooledBuffers(), 0U);
+
+    // Buffers are handed back empty and reused
+    buf = RecvBufferPool::Buffer(4096, 'x');
+    const char *const data = buf.data();
+    pool.Release(std::move(buf));
+    BOOST_CHECK_EQUAL(pool.GetPooledBuffers(), 1U);
+    BOOST_CHECK_EQUAL(pool.GetPooledBytes(), 4096U);
+    // Not for messages much smaller than the buffer
+    BOOST_CHECK_EQUAL(pool.Acquire(2047).capacity(), 0U);
+    // Nor for messages that do not fit
+    BOOST_CHECK_EQUAL(pool.Acquire(4097).capacity(), 0U);
+    buf = pool.Acquire(2048);
+    BOOST_CHECK(buf.empty());
+    BOOST_CHECK_EQUAL(buf.capacity(), 4096U);
+    BOOST_CHECK(buf.data() == data);
+    BOOST_CHECK_EQUAL(pool.GetPooledBuffers(), 0U);
+    BOOST_CHECK_EQUAL(pool.GetPooledBytes(), 0U);
+
+    // The smallest buffer that fits is used
+    for (const size_t size : {8192, 2048, 4096}) {
+        buf.clear();
+        buf.shrink_to_fit();
+        buf.reserve(size);
+        pool.Release(std::move(buf));
+    }
+    BOOST_CHECK_EQUAL(pool.Acquire(3000).capacity(), 4096U);
+    BOOST_CHECK_EQUAL(pool.Acquire(3000).capacity(), 0U);
+    BOOST_CHECK_EQUAL(pool.Acquire(5000).capacity(), 8192U);
+    BOOST_CHECK_EQUAL(pool.GetPooledBuffers(), 1U);
+
+    // The pool is bounded in bytes
+    buf = RecvBufferPool::Buffer(RecvBufferPool::MAX_POOLED_BYTES);
+    pool.Release(std::move(buf));
+    BOOST_CHECK_EQUAL(pool.GetPooledBuffers(), 1U);
+    BOOST_CHECK_EQUAL(pool.GetPooledBytes(), 2048U);
+
+    // and in number of buffers
+    for (size_t i = 0; i < RecvBufferPool::MAX_POOLED_BUFFERS; ++i) {
+        pool.Release(RecvBufferPool::Buffer(RecvBufferPool::MIN_POOLED_SIZE));
+    }
+    BOOST_CHECK_EQUAL(pool.GetPooledBuffers(), RecvBufferPool::MAX_POOLED_BUFFERS);
+}
+
+BOOST_AUTO_TEST_CASE(cnetmessage_data_window) {
+    const Config &config = GetConfig();
+    const auto &magic = config.GetChainParams().NetMagic();
+
+    std::vector<char> payload(600 * 1024);
+    for (size_t i = 0; i < payload.size(); ++i) {
+        payload[i] = char(i * 7);
+    }
+    const uint256 hash = Hash(payload);
+    CMessageHeader hdr(magic, "block", payload.size());
+    memcpy(hdr.pchChecksum, hash.begin(), CMessageHeader::CHECKSUM_SIZE);
+    std::vector<uint8_t> header;
+    CVectorWriter{SER_NETWORK, INIT_PROTO_VERSION, header, 0, hdr};
+
+    CNetMessage msg(magic, SER_NETWORK, INIT_PROTO_VERSION);
+    const char *const pchHeader = reinterpret_cast<const char *>(header.data());
+    BOOST_CHECK_EQUAL(msg.readHeader(config, pchHeader, header.size()), int(header.size()));
+    BOOST_CHECK(msg.in_data);
+
+    // Receive part of the payload the usual way, the rest into the window
+    const size_t nCopied = 1000;
+    BOOST_CHECK_EQUAL(msg.readData(payload.data(), nCopied), int(nCopied));
+    size_t nPos = nCopied;
+    while (!msg.complete()) {
+        Span<char> window = msg.GetDataWindow();
+        BOOST_CHECK(!window.empty());
+        BOOST_CHECK(window.size() <= payload.size() - nPos);
+        // Only part of the window is filled, as a short read would
+        const size_t nBytes = std::min(window.size(), size_t(100 * 1024));
+        memcpy(window.data(), payload.data() + nPos, nBytes);
+        BOOST_CHECK_EQUAL(msg.readData(window.data(), nBytes), int(nBytes));
+        nPos += nBytes;
+    }
+    BOOST_CHECK_EQUAL(nPos, payload.size());
+    BOOST_CHECK(std::equal(msg.vRecv.begin(), msg.vRecv.end(), payload.begin(), payload.end()));
+    BOOST_CHECK(msg.GetMessageHash() == hash);
+
+    // No window while there is no payload to receive
+    CNode node(0, NODE_NETWORK, 0, INVALID_SOCKET, CAddress(), 0, 0, CAddress(), "", false);
+    BOOST_CHECK(node.GetRecvMsgWindow().empty());
+    bool complete = false;
+    BOOST_CHECK(node.ReceiveMsgBytes(config, pchHeader, header.size(), complete));
+    BOOST_CHECK(!complete);
+    BOOST_CHECK(!node.GetRecvMsgWindow().empty());
+}
+
+BOOST_AUTO_TEST_CASE(shared_payload_messages) {
+    const Config &config = GetConfig();
+    CConnman connman(config, 0x1337, 0x1337);
+    const CNetMsgMaker msgMaker(INIT_PROTO_VERSION);
+    const std::vector<uint8_t> payload(1000, 0x42);
+
+    // Serialized once, with its checksum
+    const CSharedNetMsgPayloadRef shared = msgMaker.MakePayload(payload);
+    const CSerializedNetMsg owned = msgMaker.Make("test", payload);
+    BOOST_CHECK(shared->data == owned.data);
+    BOOST_CHECK(shared->hash == Hash(owned.data));
+
+    // and queued for several peers without copying it
+    std::vector<std::unique_ptr<CNode>> nodes;
+    for (NodeId id = 0; id < 3; ++id) {
+        nodes.push_back(std::make_unique<CNode>(id, NODE_NETWORK, 0, INVALID_SOCKET, CAddress(), 0, 0, CAddress(),
+                                                "", false));
+    }
+    connman.PushMessage(nodes[0].get(), msgMaker.MakeShared("test", shared));
+    connman.PushMessage(nodes[1].get(), msgMaker.MakeShared("test", shared));
+    connman.PushMessage(nodes[2].get(), msgMaker.Make("test", payload));
+    for (const auto &node : nodes) {
+        LOCK(node->cs_vSend);
+        BOOST_CHECK_EQUAL(node->vSendMsg.size(), 1U);
+        BOOST_CHECK_EQUAL(node->nSendSize, CMessageHeader::HEADER_SIZE + shared->data.size());
+    }
+    LOCK2(nodes[0]->cs_vSend, nodes[2]->cs_vSend);
+    const CQueuedNetMsg &sharedMsg = nodes[0]->vSendMsg.front();
+    const CQueuedNetMsg &ownedMsg = nodes[2]->vSendMsg.front();
+    BOOST_CHECK(sharedMsg.shared_data == shared);
+    BOOST_CHECK(sharedMsg.GetPayload().data() == shared->data.data());
+    BOOST_CHECK_EQUAL(shared.use_count(), 3);
+    // The messages are the same on the wire
+    BOOST_CHECK(sharedMsg.header == ownedMsg.header);
+    BOOST_CHECK(std::equal(sharedMsg.GetPayload().begin(), sharedMsg.GetPayload().end(),
+                           ownedMsg.GetPayload().begin(), ownedMsg.GetPayload().end()));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,100 @@
+// Copyright (c) 2022 The Bitcoin Core developers
+// Copyright (c) 2026 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <support/allocators/pool.h>
+
+#include <memusage.h>
+
+#include <test/setup_common.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+BOOST_FIXTURE_TEST_SUITE(pool_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(basic_allocating) {
+    auto resource = PoolResource<8, 8>(1024);
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 1U);
+    BOOST_CHECK_EQUAL(resource.ChunkSizeBytes(), 1024U);
+
+    // first chunk is already allocated
+    void *block = resource.Allocate(8, 8);
+    BOOST_CHECK(block != nullptr);
+
+    // the freed block is reused for the next allocation of the same size
+    resource.Deallocate(block, 8, 8);
+    BOOST_CHECK_EQUAL(resource.Allocate(8, 8), block);
+
+    // 0 bytes takes one entry from the first freelist
+    void *b = resource.Allocate(0, 1);
+    BOOST_CHECK(b != nullptr);
+    resource.Deallocate(b, 0, 1);
+    BOOST_CHECK_EQUAL(resource.Allocate(0, 1), b);
+
+    // larger than MAX_BLOCK_SIZE_BYTES or more strictly aligned blocks
+    // bypass the pool entirely
+    void *big = resource.Allocate(16, 8);
+    void *aligned = resource.Allocate(8, 16);
+    BOOST_CHECK(big != nullptr);
+    BOOST_CHECK(aligned != nullptr);
+    BOOST_CHECK_EQUAL(reinterpret_cast<uintptr_t>(aligned) % 16, 0U);
+    resource.Deallocate(big, 16, 8);
+    resource.Deallocate(aligned, 8, 16);
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 1U);
+
+    // exhausting the first chunk allocates a new one
+    std::vector<void *> blocks;
+    for (size_t i = 0; i < 1024 / 8; ++i) {
+        blocks.push_back(resource.Allocate(8, 8));
+    }
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 2U);
+    for (void *p : blocks) {
+        resource.Deallocate(p, 8, 8);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(memusage_test) {
+    using Map = std::unordered_map<
+        int, int, std::hash<int>, std::equal_to<int>,
+        PoolAllocator<std::pair<const int, int>,
+                      sizeof(std::pair<const int, int>) + sizeof(void *) * 4>>;
+    auto resource = Map::allocator_type::ResourceType(1024);
+
+    {
+        Map map{0, std::hash<int>{}, std::equal_to<int>{}, &resource};
+
+        // Without any elements, the chunk and the bucket array are all that
+        // is in use.
+        const size_t initial = memusage::DynamicUsage(map);
+        BOOST_CHECK(initial >= memusage::MallocUsage(1024));
+
+        for (int i = 0; i < 1000; ++i) {
+            map[i];
+        }
+
+        // The usage is accounted for in whole chunks.
+        BOOST_CHECK(resource.NumAllocatedChunks() > 1);
+        BOOST_CHECK(memusage::DynamicUsage(map) >=
+                    memusage::MallocUsage(resource.ChunkSizeBytes()) *
+                        resource.NumAllocatedChunks());
+        BOOST_CHECK(memusage::DynamicUsage(map) > initial);
+    }
+
+    // Destroying the map returns its nodes to the freelists but keeps the
+    // chunks.
+    const size_t nChunks = resource.NumAllocatedChunks();
+    {
+        Map map{0, std::hash<int>{}, std::equal_to<int>{}, &resource};
+        for (int i = 0; i < 1000; ++i) {
+            map[i];
+        }
+    }
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), nChunks);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
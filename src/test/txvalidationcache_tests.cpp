@@ -4,6 +4,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <chain.h>
+#include <chainparams.h>
 #include <config.h>
 #include <consensus/validation.h>
 #include <key.h>
@@ -94,6 +95,218 @@ BOOST_FIXTURE_TEST_CASE(tx_mempool_block_doublespend, TestChain100Setup) {
     BOOST_CHECK_EQUAL(g_mempool.size(), 0U);
 }
 
+BOOST_FIXTURE_TEST_CASE(tx_block_doublespend_parallel_connect,
+                        TestChain100Setup) {
+    // Same as above, but with the transactions of a block checked in parallel
+    // before they are applied, where a double-spend can only be detected when
+    // applying the second spend.
+    const bool fParallelConnectSaved = fParallelConnect;
+    fParallelConnect = true;
+
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey())
+                                     << OP_CHECKSIG;
+
+    auto makeSpend = [&](const CTransactionRef &prevTx, const Amount value) {
+        CMutableTransaction spend;
+        spend.nVersion = 1;
+        spend.vin.resize(1);
+        spend.vin[0].prevout = COutPoint(prevTx->GetId(), 0);
+        spend.vout.resize(1);
+        spend.vout[0].nValue = value;
+        spend.vout[0].scriptPubKey = scriptPubKey;
+
+        std::vector<uint8_t> vchSig;
+        uint256 hash = SignatureHash(scriptPubKey, ScriptExecutionContext{0, prevTx->vout[0], spend},
+                                     SigHashType().withFork(), nullptr, STANDARD_SCRIPT_VERIFY_FLAGS).signatureHash;
+        BOOST_CHECK(coinbaseKey.SignECDSA(hash, vchSig));
+        vchSig.push_back(uint8_t(SIGHASH_ALL | SIGHASH_FORKID));
+        spend.vin[0].scriptSig << vchSig;
+        return spend;
+    };
+
+    // A spend of the first mature coinbase, a spend of its output in the same
+    // block, and a double-spend of the coinbase.
+    const CMutableTransaction spend = makeSpend(m_coinbase_txns[0], 11 * CENT);
+    const CMutableTransaction child =
+        makeSpend(MakeTransactionRef(spend), 10 * CENT);
+    const CMutableTransaction doubleSpend =
+        makeSpend(m_coinbase_txns[0], 12 * CENT);
+
+    CBlock block =
+        CreateAndProcessBlock({spend, child, doubleSpend}, scriptPubKey);
+    BOOST_CHECK(::ChainActive().Tip()->GetBlockHash() != block.GetHash());
+
+    // Without the double-spend the block is fine.
+    block = CreateAndProcessBlock({spend, child}, scriptPubKey);
+    BOOST_CHECK(::ChainActive().Tip()->GetBlockHash() == block.GetHash());
+
+    // Spending the now spent coin again is not.
+    block = CreateAndProcessBlock(
+        {makeSpend(MakeTransactionRef(spend), 9 * CENT),
+         makeSpend(m_coinbase_txns[1], 9 * CENT)},
+        scriptPubKey);
+    BOOST_CHECK(::ChainActive().Tip()->GetBlockHash() != block.GetHash());
+
+    fParallelConnect = fParallelConnectSaved;
+}
+
+// Spend the first output of prevTx, which pays to key, back to key.
+static CMutableTransaction MakeSpend(const CKey &key,
+                                     const CTransactionRef &prevTx,
+                                     const Amount value) {
+    const CScript scriptPubKey = CScript() << ToByteVector(key.GetPubKey())
+                                           << OP_CHECKSIG;
+    CMutableTransaction spend;
+    spend.nVersion = 1;
+    spend.vin.resize(1);
+    spend.vin[0].prevout = COutPoint(prevTx->GetId(), 0);
+    spend.vout.resize(1);
+    spend.vout[0].nValue = value;
+    spend.vout[0].scriptPubKey = scriptPubKey;
+
+    std::vector<uint8_t> vchSig;
+    uint256 hash = SignatureHash(scriptPubKey, ScriptExecutionContext{0, prevTx->vout[0], spend},
+                                 SigHashType().withFork(), nullptr, STANDARD_SCRIPT_VERIFY_FLAGS).signatureHash;
+    BOOST_CHECK(key.SignECDSA(hash, vchSig));
+    vchSig.push_back(uint8_t(SIGHASH_ALL | SIGHASH_FORKID));
+    spend.vin[0].scriptSig << vchSig;
+    return spend;
+}
+
+BOOST_FIXTURE_TEST_CASE(prevalidate_mempool_transactions, TestChain100Setup) {
+    // Transactions whose scripts were verified in parallel ahead of
+    // AcceptToMemoryPool() have their results in the script execution cache,
+    // and only those that pass.
+    const Config &config = GetConfig();
+
+    // Mature the coinbases spent below.
+    const CScript scriptPubKey = CScript()
+                                 << ToByteVector(coinbaseKey.GetPubKey())
+                                 << OP_CHECKSIG;
+    for (int i = 0; i < 3; i++) {
+        CreateAndProcessBlock({}, scriptPubKey);
+    }
+
+    // A spend of a coinbase, a spend of its output, which can only be checked
+    // against the outputs of the former, and a spend with a bad signature.
+    const CTransactionRef spend = MakeTransactionRef(
+        MakeSpend(coinbaseKey, m_coinbase_txns[0], 11 * CENT));
+    const CTransactionRef child =
+        MakeTransactionRef(MakeSpend(coinbaseKey, spend, 10 * CENT));
+    CMutableTransaction badSpend =
+        MakeSpend(coinbaseKey, m_coinbase_txns[1], 11 * CENT);
+    badSpend.vin[0].scriptSig = CScript() << std::vector<uint8_t>(72, 0x30);
+    const CTransactionRef bad = MakeTransactionRef(badSpend);
+
+    // A transaction with an output that cannot be a coin is left to
+    // AcceptToMemoryPool() to reject.
+    CMutableTransaction nullOutput(*spend);
+    nullOutput.vout[0].SetNull();
+    // The scripts of a transaction that pays too little fee are not even
+    // run, unless the limits are bypassed.
+    const CTransactionRef noFee = MakeTransactionRef(MakeSpend(
+        coinbaseKey, m_coinbase_txns[2], m_coinbase_txns[2]->vout[0].nValue));
+    const CTransactionRef noFeeBypassed = MakeTransactionRef(MakeSpend(
+        coinbaseKey, m_coinbase_txns[3], m_coinbase_txns[3]->vout[0].nValue));
+    PrevalidateMemPoolTransactions(
+        config, g_mempool,
+        {spend, child, bad, MakeTransactionRef(nullOutput), noFee}, false);
+    PrevalidateMemPoolTransactions(config, g_mempool, {noFeeBypassed}, true);
+    // Failures are remembered instead of being checked again, and still left
+    // to acceptance to report.
+    PrevalidateMemPoolTransactions(config, g_mempool, {bad}, false);
+
+    LOCK(cs_main);
+    uint32_t nextBlockFlags;
+    const uint32_t flags = GetMemPoolScriptFlags(
+        config.GetChainParams().GetConsensus(), ::ChainActive().Tip(),
+        &nextBlockFlags);
+    int nSigChecks;
+    for (const CTransactionRef &tx : {spend, child}) {
+        BOOST_CHECK(IsKeyInScriptCache(ScriptCacheKey(*tx, flags), false,
+                                       nSigChecks));
+        BOOST_CHECK_EQUAL(nSigChecks, 1);
+        BOOST_CHECK(IsKeyInScriptCache(ScriptCacheKey(*tx, nextBlockFlags),
+                                       false, nSigChecks));
+        BOOST_CHECK_EQUAL(nSigChecks, 1);
+    }
+    BOOST_CHECK(!IsKeyInScriptCache(ScriptCacheKey(*bad, flags), false,
+                                    nSigChecks));
+    BOOST_CHECK(!IsKeyInScriptCache(ScriptCacheKey(*bad, nextBlockFlags),
+                                    false, nSigChecks));
+    BOOST_CHECK(!IsKeyInScriptCache(ScriptCacheKey(*noFee, flags), false,
+                                    nSigChecks));
+    BOOST_CHECK(IsKeyInScriptCache(ScriptCacheKey(*noFeeBypassed, flags),
+                                   false, nSigChecks));
+
+    // Acceptance itself is unaffected.
+    BOOST_CHECK(ToMemPool(CMutableTransaction(*spend)));
+    BOOST_CHECK(ToMemPool(CMutableTransaction(*child)));
+    BOOST_CHECK(!ToMemPool(badSpend));
+    BOOST_CHECK_EQUAL(g_mempool.size(), 2U);
+}
+
+BOOST_FIXTURE_TEST_CASE(accept_to_memory_pool_batch, TestChain100Setup) {
+    const Config &config = GetConfig();
+
+    // A chain of spends listed children first, a valid spend of a coinbase
+    // that is not mature yet and a spend of an unknown transaction.
+    const CTransactionRef spend = MakeTransactionRef(
+        MakeSpend(coinbaseKey, m_coinbase_txns[0], 11 * CENT));
+    const CTransactionRef child =
+        MakeTransactionRef(MakeSpend(coinbaseKey, spend, 10 * CENT));
+    const CTransactionRef grandchild =
+        MakeTransactionRef(MakeSpend(coinbaseKey, child, 9 * CENT));
+    const CTransactionRef immature = MakeTransactionRef(
+        MakeSpend(coinbaseKey, m_coinbase_txns[1], 11 * CENT));
+    CMutableTransaction orphanSpend =
+        MakeSpend(coinbaseKey, m_coinbase_txns[2], 11 * CENT);
+    orphanSpend.vin[0].prevout = COutPoint(TxId(InsecureRand256()), 0);
+    const CTransactionRef orphan = MakeTransactionRef(orphanSpend);
+
+    const std::vector<CTransactionRef> txs{grandchild, immature, child, orphan,
+                                           spend};
+    const int64_t nNow = GetTime();
+    const std::vector<int64_t> acceptTimes{nNow - 1, nNow - 2, nNow - 3,
+                                           nNow - 4, nNow - 5};
+    const std::vector<MemPoolAcceptResult> results = AcceptToMemoryPoolBatch(
+        config, g_mempool, txs, acceptTimes, false /* bypass_limits */,
+        Amount::zero() /* nAbsurdFee */);
+
+    // The results are in the order of the transactions.
+    BOOST_REQUIRE_EQUAL(results.size(), txs.size());
+    for (const size_t i : {0, 2, 4}) {
+        BOOST_CHECK(results[i].fAccepted);
+        BOOST_CHECK(results[i].state.IsValid());
+        BOOST_CHECK(!results[i].fMissingInputs);
+        BOOST_CHECK(g_mempool.exists(txs[i]->GetId()));
+        BOOST_CHECK_EQUAL(g_mempool.info(txs[i]->GetId()).nTime,
+                          acceptTimes[i]);
+    }
+    BOOST_CHECK(!results[1].fAccepted);
+    BOOST_CHECK_EQUAL(results[1].state.GetRejectReason(),
+                      "bad-txns-premature-spend-of-coinbase");
+    BOOST_CHECK(!results[1].fMissingInputs);
+    BOOST_CHECK(!results[3].fAccepted);
+    BOOST_CHECK(results[3].fMissingInputs);
+    BOOST_CHECK_EQUAL(g_mempool.size(), 3U);
+
+    // Transactions already in the mempool are rejected as such, and an empty
+    // acceptTimes accepts the others with the current time.
+    const CTransactionRef other =
+        MakeTransactionRef(MakeSpend(coinbaseKey, grandchild, 8 * CENT));
+    const std::vector<MemPoolAcceptResult> again = AcceptToMemoryPoolBatch(
+        config, g_mempool, {spend, other}, {}, false /* bypass_limits */,
+        Amount::zero() /* nAbsurdFee */);
+    BOOST_REQUIRE_EQUAL(again.size(), 2U);
+    BOOST_CHECK(!again[0].fAccepted);
+    BOOST_CHECK_EQUAL(again[0].state.GetRejectReason(),
+                      "txn-already-in-mempool");
+    BOOST_CHECK(again[1].fAccepted);
+    BOOST_CHECK(g_mempool.info(other->GetId()).nTime >= nNow);
+    BOOST_CHECK_EQUAL(g_mempool.size(), 4U);
+}
+
 static inline bool
 CheckInputs(const CTransaction &tx, CValidationState &state,
             const CCoinsViewCache &view, bool fScriptChecks,
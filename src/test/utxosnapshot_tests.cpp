@@ -0,0 +1,213 @@
+// Copyright (c) 2026 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <node/utxosnapshot.h>
+
+#include <chainparams.h>
+#include <config.h>
+#include <clientversion.h>
+#include <coins.h>
+#include <index/coinstatsindex.h>
+#include <streams.h>
+#include <txdb.h>
+#include <validation.h>
+
+#include <test/setup_common.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <map>
+#include <memory>
+
+namespace {
+
+//! Read all coins of a coins view.
+std::map<COutPoint, Coin> ReadCoins(const CCoinsView &view) {
+    std::map<COutPoint, Coin> coins;
+    std::unique_ptr<CCoinsViewCursor> cursor(view.Cursor());
+    for (; cursor->Valid(); cursor->Next()) {
+        COutPoint outpoint;
+        Coin coin;
+        BOOST_REQUIRE(cursor->GetKey(outpoint) && cursor->GetValue(coin));
+        coins.emplace(outpoint, std::move(coin));
+    }
+    return coins;
+}
+
+void CheckCoins(const std::map<COutPoint, Coin> &coins,
+                const std::map<COutPoint, Coin> &expected) {
+    BOOST_CHECK_EQUAL(coins.size(), expected.size());
+    for (const auto &[outpoint, coin] : expected) {
+        const auto it = coins.find(outpoint);
+        BOOST_REQUIRE(it != coins.end());
+        BOOST_CHECK(it->second.GetTxOut() == coin.GetTxOut());
+        BOOST_CHECK_EQUAL(it->second.GetHeight(), coin.GetHeight());
+        BOOST_CHECK_EQUAL(it->second.IsCoinBase(), coin.IsCoinBase());
+    }
+}
+
+//! Dump the chainstate to a snapshot file at path.
+SnapshotMetadata DumpSnapshot(const fs::path &path) {
+    FlushStateToDisk();
+    const CBlockIndex *tip = WITH_LOCK(cs_main, return ::ChainActive().Tip());
+    std::unique_ptr<CCoinsViewCursor> cursor(pcoinsdbview->Cursor());
+    CAutoFile file(fsbridge::fopen(path, "wb"), SER_DISK, CLIENT_VERSION);
+    BOOST_REQUIRE(!file.IsNull());
+    SnapshotMetadata metadata;
+    BOOST_REQUIRE(
+        WriteUTXOSnapshot(file, *cursor, *tip, Params(), metadata));
+    return metadata;
+}
+
+//! Read the snapshot file at path. Returns false if it is invalid.
+bool ReadSnapshot(const fs::path &path, SnapshotMetadata &metadata,
+                  std::map<COutPoint, Coin> &coins) {
+    CAutoFile file(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+    BOOST_REQUIRE(!file.IsNull());
+    return ReadUTXOSnapshotHeader(file, Params(), metadata) &&
+           ReadUTXOSnapshotCoins(file, metadata, [&](SnapshotCoins &chunk) {
+               BOOST_CHECK(!chunk.empty());
+               BOOST_CHECK(chunk.size() <= SNAPSHOT_CHUNK_COINS);
+               for (auto &[outpoint, coin] : chunk) {
+                   coins.emplace(outpoint, std::move(coin));
+               }
+               return true;
+           });
+}
+
+} // namespace
+
+BOOST_FIXTURE_TEST_SUITE(utxosnapshot_tests, TestChain100Setup)
+
+BOOST_AUTO_TEST_CASE(snapshot_roundtrip) {
+    const fs::path path = GetDataDir() / "utxo.dat";
+    const SnapshotMetadata dumped = DumpSnapshot(path);
+
+    const std::map<COutPoint, Coin> expected = ReadCoins(*pcoinsdbview);
+    IndexedCoinsStats stats;
+    for (const auto &[outpoint, coin] : expected) {
+        CoinStatsIndex::ApplyCoin(stats, outpoint, coin, true);
+    }
+    const CBlockIndex *tip = WITH_LOCK(cs_main, return ::ChainActive().Tip());
+    BOOST_CHECK(dumped.hashBase == tip->GetBlockHash());
+    BOOST_CHECK_EQUAL(dumped.nHeight, tip->nHeight);
+    BOOST_CHECK_EQUAL(dumped.nCoins, expected.size());
+    BOOST_CHECK(dumped.hashMultiSet == stats.multiset.GetHash());
+    BOOST_CHECK_EQUAL(dumped.nChainTx, tip->nChainTx);
+    BOOST_REQUIRE_EQUAL(dumped.vBlocks.size(), size_t(tip->nHeight));
+    BOOST_CHECK(dumped.vBlocks.back().header.GetHash() == tip->GetBlockHash());
+    BOOST_CHECK(dumped.vBlocks.back().ablaState == tip->GetAblaStateOpt());
+
+    SnapshotMetadata metadata;
+    std::map<COutPoint, Coin> coins;
+    BOOST_CHECK(ReadSnapshot(path, metadata, coins));
+    BOOST_CHECK(metadata.hashBase == dumped.hashBase);
+    BOOST_CHECK_EQUAL(metadata.nHeight, dumped.nHeight);
+    BOOST_CHECK_EQUAL(metadata.nCoins, dumped.nCoins);
+    BOOST_CHECK(metadata.hashMultiSet == dumped.hashMultiSet);
+    BOOST_CHECK_EQUAL(metadata.nChainTx, dumped.nChainTx);
+    BOOST_REQUIRE_EQUAL(metadata.vBlocks.size(), dumped.vBlocks.size());
+    for (size_t i = 0; i < metadata.vBlocks.size(); ++i) {
+        BOOST_CHECK(metadata.vBlocks[i].header.GetHash() ==
+                    dumped.vBlocks[i].header.GetHash());
+        BOOST_CHECK(metadata.vBlocks[i].ablaState == dumped.vBlocks[i].ablaState);
+    }
+    CheckCoins(coins, expected);
+
+    // Snapshots of another network are rejected.
+    {
+        CAutoFile file(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+        BOOST_CHECK(!ReadUTXOSnapshotHeader(
+            file, *CreateChainParams(CBaseChainParams::MAIN), metadata));
+    }
+
+    // Any corruption of the blocks or of the coins is detected.
+    const size_t nSize = fs::file_size(path);
+    for (const size_t nPos : {size_t(100), nSize / 2, nSize - 40}) {
+        FILE *f = fsbridge::fopen(path, "rb+");
+        BOOST_REQUIRE(f != nullptr);
+        BOOST_REQUIRE(fseek(f, nPos, SEEK_SET) == 0);
+        const int c = fgetc(f);
+        BOOST_REQUIRE(fseek(f, nPos, SEEK_SET) == 0);
+        fputc(c ^ 1, f);
+        fclose(f);
+
+        coins.clear();
+        BOOST_CHECK(!ReadSnapshot(path, metadata, coins));
+
+        f = fsbridge::fopen(path, "rb+");
+        BOOST_REQUIRE(fseek(f, nPos, SEEK_SET) == 0);
+        fputc(c, f);
+        fclose(f);
+    }
+    coins.clear();
+    BOOST_CHECK(ReadSnapshot(path, metadata, coins));
+
+    // So is truncation.
+    fs::resize_file(path, nSize - 1);
+    coins.clear();
+    BOOST_CHECK(!ReadSnapshot(path, metadata, coins));
+}
+
+BOOST_AUTO_TEST_CASE(snapshot_load) {
+    const fs::path path = GetDataDir() / "utxo.dat";
+    const SnapshotMetadata dumped = DumpSnapshot(path);
+    const std::map<COutPoint, Coin> expected = ReadCoins(*pcoinsdbview);
+
+    LOCK(cs_main);
+
+    // A snapshot is only loaded if its hash is the expected one, which is
+    // required, and nothing is written otherwise.
+    CCoinsViewDB view(1 << 20, true);
+    uint256 hashWrong = dumped.hashMultiSet;
+    *hashWrong.begin() ^= 1;
+    for (const uint256 &hash : {hashWrong, uint256()}) {
+        BOOST_CHECK(
+            !LoadUTXOSnapshot(path, view, GetConfig(), hash, BlockHash()));
+        BOOST_CHECK(view.GetBestBlock().IsNull());
+        BOOST_CHECK(view.GetHeadBlocks().empty());
+        BOOST_CHECK(ReadCoins(view).empty());
+    }
+
+    // If given, the base block must be the expected one too.
+    BlockHash hashBaseWrong = dumped.hashBase;
+    *hashBaseWrong.begin() ^= 1;
+    BOOST_CHECK(!LoadUTXOSnapshot(path, view, GetConfig(), dumped.hashMultiSet,
+                                  hashBaseWrong));
+    BOOST_CHECK(view.GetBestBlock().IsNull());
+    BOOST_CHECK(ReadCoins(view).empty());
+
+    BOOST_CHECK(LoadUTXOSnapshot(path, view, GetConfig(), dumped.hashMultiSet,
+                                 dumped.hashBase));
+    BOOST_CHECK(view.GetBestBlock() == dumped.hashBase);
+    BOOST_CHECK(view.GetHeadBlocks().empty());
+    CheckCoins(ReadCoins(view), expected);
+
+    // The chainstate must be empty.
+    BOOST_CHECK(!LoadUTXOSnapshot(path, view, GetConfig(), dumped.hashMultiSet,
+                                  BlockHash()));
+
+    // A load that was interrupted leaves the chainstate marked as being in
+    // transition to the base block, for ReplayBlocks() to complete.
+    CCoinsViewDB partial(1 << 20, true);
+    BOOST_CHECK(partial.WriteSnapshotCoins({*expected.begin()},
+                                           dumped.hashBase, false));
+    BOOST_CHECK(partial.GetBestBlock().IsNull());
+    BOOST_REQUIRE_EQUAL(partial.GetHeadBlocks().size(), 2U);
+    BOOST_CHECK(partial.GetHeadBlocks()[0] == dumped.hashBase);
+    BOOST_CHECK(partial.GetHeadBlocks()[1].IsNull());
+    BOOST_CHECK(!LoadUTXOSnapshot(path, partial, GetConfig(),
+                                  dumped.hashMultiSet, BlockHash()));
+
+    // A failed load erases what it wrote.
+    BOOST_CHECK(partial.EraseSnapshotCoins());
+    BOOST_CHECK(partial.GetBestBlock().IsNull());
+    BOOST_CHECK(partial.GetHeadBlocks().empty());
+    BOOST_CHECK(ReadCoins(partial).empty());
+    BOOST_CHECK(LoadUTXOSnapshot(path, partial, GetConfig(),
+                                 dumped.hashMultiSet, BlockHash()));
+    CheckCoins(ReadCoins(partial), expected);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
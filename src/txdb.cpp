@@ -14,6 +14,7 @@
 #include <shutdown.h>
 #include <ui_interface.h>
 #include <util/system.h>
+#include <util/thread.h>
 #include <util/vector.h>
 
 #include <cstdint>
@@ -46,18 +47,61 @@ struct CoinEntry {
 };
 } // namespace
 
-CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe)
-    : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe, true) {}
+CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe,
+                           bool fBackgroundWriteIn)
+    : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe, true),
+      fBackgroundWrite(fBackgroundWriteIn) {
+    if (fBackgroundWrite) {
+        writerThread = std::thread(util::TraceThread, "coinsflush",
+                                   [this] { ThreadWriteCoins(); });
+    }
+}
+
+CCoinsViewDB::~CCoinsViewDB() {
+    if (!writerThread.joinable()) {
+        return;
+    }
+    if (!WaitForPendingWrite()) {
+        LogPrintf("%s: the last coins database write failed\n", __func__);
+    }
+    WITH_LOCK(cs_pending, fStopWriter = true);
+    cond_pending.notify_all();
+    writerThread.join();
+}
+
+bool CCoinsViewDB::GetPendingCoin(const COutPoint &outpoint,
+                                  Coin &coin) const {
+    if (!fHavePending) {
+        return false;
+    }
+    LOCK(cs_pending);
+    if (!pending) {
+        return false;
+    }
+    CCoinsMap::const_iterator it = pending->coins.find(outpoint);
+    if (it == pending->coins.end()) {
+        return false;
+    }
+    coin = it->second.coin;
+    return true;
+}
 
 bool CCoinsViewDB::GetCoin(const COutPoint &outpoint, Coin &coin) const {
+    if (GetPendingCoin(outpoint, coin)) {
+        return !coin.IsSpent();
+    }
     return db.Read(CoinEntry(&outpoint), coin);
 }
 
 bool CCoinsViewDB::HaveCoin(const COutPoint &outpoint) const {
+    Coin coin;
+    if (GetPendingCoin(outpoint, coin)) {
+        return !coin.IsSpent();
+    }
     return db.Exists(CoinEntry(&outpoint));
 }
 
-BlockHash CCoinsViewDB::GetBestBlock() const {
+BlockHash CCoinsViewDB::ReadBestBlock() const {
     BlockHash hashBestChain;
     if (!db.Read(DB_BEST_BLOCK, hashBestChain)) {
         return BlockHash();
@@ -65,6 +109,16 @@ BlockHash CCoinsViewDB::GetBestBlock() const {
     return hashBestChain;
 }
 
+BlockHash CCoinsViewDB::GetBestBlock() const {
+    if (fHavePending) {
+        LOCK(cs_pending);
+        if (pending) {
+            return pending->hashBlock;
+        }
+    }
+    return ReadBestBlock();
+}
+
 std::vector<BlockHash> CCoinsViewDB::GetHeadBlocks() const {
     std::vector<BlockHash> vhashHeadBlocks;
     if (!db.Read(DB_HEAD_BLOCKS, vhashHeadBlocks)) {
@@ -74,6 +128,91 @@ std::vector<BlockHash> CCoinsViewDB::GetHeadBlocks() const {
 }
 
 bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const BlockHash &hashBlock) {
+    if (!fBackgroundWrite) {
+        return WriteCoins(mapCoins, hashBlock, true);
+    }
+
+    assert(!hashBlock.IsNull());
+    if (!WaitForPendingWrite()) {
+        return false;
+    }
+
+    // Only the modified entries are of interest to the database, so there is
+    // no need to hold on to the others.
+    auto next = std::make_unique<PendingWrite>();
+    next->hashBlock = hashBlock;
+    for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();
+         it = mapCoins.erase(it)) {
+        if (it->second.flags & CCoinsCacheEntry::DIRTY) {
+            next->coins.emplace(it->first, std::move(it->second));
+        }
+    }
+    LogPrint(BCLog::COINDB,
+             "Handing %u changed transaction outputs over to the background "
+             "writer...\n",
+             (unsigned int)next->coins.size());
+
+    {
+        LOCK(cs_pending);
+        pending = std::move(next);
+        fHavePending = true;
+    }
+    cond_pending.notify_all();
+    return true;
+}
+
+bool CCoinsViewDB::WaitForPendingWrite() const {
+    WAIT_LOCK(cs_pending, lock);
+    cond_pending.wait(lock, [this]() EXCLUSIVE_LOCKS_REQUIRED(cs_pending) {
+        return !pending || fWriteFailed;
+    });
+    return !fWriteFailed;
+}
+
+void CCoinsViewDB::ThreadWriteCoins() {
+    while (true) {
+        PendingWrite *write;
+        {
+            WAIT_LOCK(cs_pending, lock);
+            cond_pending.wait(lock, [this]() EXCLUSIVE_LOCKS_REQUIRED(
+                                        cs_pending) {
+                return fStopWriter || (pending && !fWriteFailed);
+            });
+            if (fStopWriter) {
+                return;
+            }
+            write = pending.get();
+        }
+
+        bool fOk = false;
+        try {
+            fOk = WriteCoins(write->coins, write->hashBlock, false);
+        } catch (const std::exception &e) {
+            LogPrintf("%s: %s\n", __func__, e.what());
+        }
+
+        if (!fOk) {
+            // Keep serving the coins from memory, and refuse further writes.
+            WITH_LOCK(cs_pending, fWriteFailed = true);
+            cond_pending.notify_all();
+            AbortNode("Failed to write to coin database");
+            continue;
+        }
+
+        // Everything is on disk now, so lookups can go to the database again.
+        // The coins are freed outside of the lock.
+        std::unique_ptr<PendingWrite> done;
+        {
+            LOCK(cs_pending);
+            done = std::move(pending);
+            fHavePending = false;
+        }
+        cond_pending.notify_all();
+    }
+}
+
+bool CCoinsViewDB::WriteCoins(CCoinsMap &mapCoins, const BlockHash &hashBlock,
+                              bool fErase) {
     CDBBatch batch(db);
     size_t count = 0;
     size_t changed = 0;
@@ -82,7 +221,7 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const BlockHash &hashBlock) {
     int crash_simulate = gArgs.GetArg("-dbcrashratio", 0);
     assert(!hashBlock.IsNull());
 
-    BlockHash old_tip = GetBestBlock();
+    BlockHash old_tip = ReadBestBlock();
     if (old_tip.IsNull()) {
         // We may be in the middle of replaying.
         std::vector<BlockHash> old_heads = GetHeadBlocks();
@@ -110,8 +249,12 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const BlockHash &hashBlock) {
             changed++;
         }
         count++;
-        CCoinsMap::iterator itOld = it++;
-        mapCoins.erase(itOld);
+        if (fErase) {
+            CCoinsMap::iterator itOld = it++;
+            mapCoins.erase(itOld);
+        } else {
+            ++it;
+        }
         if (batch.SizeEstimate() > batch_size) {
             LogPrint(BCLog::COINDB, "Writing partial batch of %.2f MiB\n",
                      batch.SizeEstimate() * (1.0 / 1048576.0));
@@ -141,6 +284,45 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const BlockHash &hashBlock) {
     return ret;
 }
 
+bool CCoinsViewDB::WriteSnapshotCoins(
+    const std::vector<std::pair<COutPoint, Coin>> &coins,
+    const BlockHash &hashBase, bool fFinal) {
+    assert(!hashBase.IsNull());
+    CDBBatch batch(db);
+    if (fFinal) {
+        batch.Erase(DB_HEAD_BLOCKS);
+        batch.Write(DB_BEST_BLOCK, hashBase);
+    } else {
+        batch.Write(DB_HEAD_BLOCKS, Vector(hashBase, BlockHash()));
+    }
+    for (const auto &[outpoint, coin] : coins) {
+        batch.Write(CoinEntry(&outpoint), coin);
+    }
+    return db.WriteBatch(batch);
+}
+
+bool CCoinsViewDB::EraseSnapshotCoins() {
+    const size_t batch_size = 1 << 24;
+    std::unique_ptr<CDBIterator> pcursor(db.NewIterator());
+    CDBBatch batch(db);
+    COutPoint outpoint;
+    CoinEntry entry(&outpoint);
+    for (pcursor->Seek(DB_COIN);
+         pcursor->Valid() && pcursor->GetKey(entry) && entry.key == DB_COIN;
+         pcursor->Next()) {
+        batch.Erase(entry);
+        if (batch.SizeEstimate() > batch_size) {
+            if (!db.WriteBatch(batch)) {
+                return false;
+            }
+            batch.Clear();
+        }
+    }
+    batch.Erase(DB_HEAD_BLOCKS);
+    batch.Erase(DB_BEST_BLOCK);
+    return db.WriteBatch(batch, true);
+}
+
 size_t CCoinsViewDB::EstimateSize() const {
     return db.EstimateSize(DB_COIN, char(DB_COIN + 1));
 }
@@ -169,6 +351,9 @@ bool CBlockTreeDB::ReadLastBlockFile(int &nFile) {
 }
 
 CCoinsViewCursor *CCoinsViewDB::Cursor(bool snapshot) const {
+    // The cursor iterates over the database only, so it has to wait for the
+    // coins still being written.
+    WaitForPendingWrite();
     CCoinsViewDBCursor *i = new CCoinsViewDBCursor(
         const_cast<CDBWrapper &>(db).NewIterator(snapshot), GetBestBlock());
     /**
@@ -11,10 +11,14 @@
 #include <dbwrapper.h>
 #include <flatfile.h>
 #include <primitives/block.h>
+#include <sync.h>
 
+#include <atomic>
+#include <condition_variable>
 #include <map>
 #include <memory>
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -32,6 +36,8 @@ static constexpr int MAX_BLOCK_COINSDB_USAGE = 10;
 static const int64_t nDefaultDbCache = 450;
 //! -dbbatchsize default (bytes)
 static const int64_t nDefaultDbBatchSize = 16 << 20;
+//! -dbbackgroundflush default
+static const bool DEFAULT_DB_BACKGROUND_FLUSH = false;
 //! max. -dbcache (MiB)
 static const int64_t nMaxDbCache = sizeof(void *) > 4 ? 16384 : 1024;
 //! min. -dbcache (MiB)
@@ -46,14 +52,27 @@ static const int64_t nMaxTxIndexCache = 1024;
 //! Max memory allocated to coin DB specific cache (MiB)
 static const int64_t nMaxCoinsDBCache = 8;
 
-/** CCoinsView backed by the coin database (chainstate/) */
+/**
+ * CCoinsView backed by the coin database (chainstate/)
+ *
+ * In background write mode, BatchWrite() does not write the coins itself.
+ * It waits for the previous write to complete, takes over the modified
+ * entries of the map and returns, and a dedicated thread then writes them to
+ * the database. Until that write is complete, GetCoin(), HaveCoin() and
+ * GetBestBlock() answer from the entries being written, so the view always
+ * looks as if the last BatchWrite() had completed. Crash consistency is the
+ * same as for a synchronous write: the database is marked as being in the
+ * middle of a transition (see GetHeadBlocks()) until the last batch is
+ * written.
+ */
 class CCoinsViewDB final : public CCoinsView {
 protected:
     CDBWrapper db;
 
 public:
     explicit CCoinsViewDB(size_t nCacheSize, bool fMemory = false,
-                          bool fWipe = false);
+                          bool fWipe = false, bool fBackgroundWrite = false);
+    ~CCoinsViewDB() override;
 
     bool GetCoin(const COutPoint &outpoint, Coin &coin) const override;
     bool HaveCoin(const COutPoint &outpoint) const override;
@@ -66,6 +85,53 @@ public:
     //! Returns whether an error occurred.
     bool Upgrade();
     size_t EstimateSize() const override;
+
+    //! Wait until the coins passed to the last BatchWrite() are on disk.
+    //! Returns false if writing them in the background failed.
+    bool WaitForPendingWrite() const;
+
+    //! Write coins of a UTXO snapshot as of hashBase to an empty database
+    //! (see LoadUTXOSnapshot()). Until this is called with fFinal, the
+    //! database is marked as being in the middle of a transition from
+    //! nothing to hashBase, so an interrupted load is completed by
+    //! ReplayBlocks().
+    bool WriteSnapshotCoins(
+        const std::vector<std::pair<COutPoint, Coin>> &coins,
+        const BlockHash &hashBase, bool fFinal);
+    //! Erase the coins written by an unfinished WriteSnapshotCoins() and the
+    //! transition marker, leaving the database empty again.
+    bool EraseSnapshotCoins();
+
+private:
+    //! A set of coins handed over to the background thread.
+    struct PendingWrite {
+        CCoinsMapMemoryResource resource;
+        CCoinsMap coins{0, SaltedOutpointHasher(), CCoinsMap::key_equal(),
+                        &resource};
+        BlockHash hashBlock;
+    };
+
+    const bool fBackgroundWrite;
+
+    mutable Mutex cs_pending;
+    mutable std::condition_variable cond_pending;
+    //! The coins being written in the background, if any. The background
+    //! thread reads them without holding cs_pending, so they must not be
+    //! modified until it is done with them.
+    std::unique_ptr<PendingWrite> pending GUARDED_BY(cs_pending);
+    //! Fast path for lookups while nothing is being written.
+    std::atomic<bool> fHavePending{false};
+    bool fWriteFailed GUARDED_BY(cs_pending){false};
+    bool fStopWriter GUARDED_BY(cs_pending){false};
+    std::thread writerThread;
+
+    BlockHash ReadBestBlock() const;
+    //! Look up outpoint in the coins being written. Returns false if it is
+    //! not among them.
+    bool GetPendingCoin(const COutPoint &outpoint, Coin &coin) const;
+    bool WriteCoins(CCoinsMap &mapCoins, const BlockHash &hashBlock,
+                    bool fErase);
+    void ThreadWriteCoins();
 };
 
 /** Specialization of CCoinsViewCursor to iterate over a CCoinsViewDB */
@@ -39,6 +39,7 @@
 #include <unordered_map>
 #include <unordered_set>
 #include <utility>
+#include <vector>
 
 CTxMemPoolEntry::CTxMemPoolEntry(const CTransactionRef &_tx, const Amount _nFee,
                                  int64_t _nTime,
@@ -66,7 +67,9 @@ void CTxMemPoolEntry::UpdateLockPoints(const LockPoints &lp) {
 
 void CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntries &setAncestors,
                                            bool fSearchForParents /* = true */) const {
-    setEntries parentHashes;
+    // Ancestors that were just added to setAncestors and whose parents have
+    // yet to be walked. Every ancestor is looked up in setAncestors once.
+    std::vector<txiter> stage;
     const CTransaction &tx = entry.GetTx();
 
     if (fSearchForParents) {
@@ -75,34 +78,138 @@ void CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntr
         // iterate mapTx to find parents.
         for (const CTxIn &in : tx.vin) {
             std::optional<txiter> piter = GetIter(in.prevout.GetTxId());
-            if (!piter) {
-                continue;
+            if (piter && setAncestors.insert(*piter).second) {
+                stage.push_back(*piter);
             }
-            parentHashes.insert(*piter);
         }
     } else {
         // If we're not searching for parents, we require this to be an entry in
         // the mempool already.
         txiter it = mapTx.iterator_to(entry);
-        parentHashes = GetMemPoolParents(it);
+        for (txiter piter : GetMemPoolParents(it)) {
+            if (setAncestors.insert(piter).second) {
+                stage.push_back(piter);
+            }
+        }
     }
 
-    while (!parentHashes.empty()) {
-        txiter stageit = *parentHashes.begin();
-
-        setAncestors.insert(stageit);
-        parentHashes.erase(parentHashes.begin());
+    while (!stage.empty()) {
+        const txiter stageit = stage.back();
+        stage.pop_back();
 
-        const setEntries &setMemPoolParents = GetMemPoolParents(stageit);
-        for (txiter phash : setMemPoolParents) {
+        for (txiter phash : GetMemPoolParents(stageit)) {
             // If this is a new ancestor, add it.
-            if (!algo::contains(setAncestors, phash)) {
-                parentHashes.insert(phash);
+            if (setAncestors.insert(phash).second) {
+                stage.push_back(phash);
             }
         }
     }
 }
 
+auto CTxMemPool::GetAncestorStats(txiter entry) const -> AncestorStats {
+    AssertLockHeld(cs);
+    if (fAncestorStatsStale) {
+        // Release the memory too rather than keep the buckets of the last block.
+        decltype(mapAncestorStats)().swap(mapAncestorStats);
+        fAncestorStatsStale = false;
+    }
+    // Follow single parents up from entry until an entry whose stats are
+    // memoized, or which has to be computed from all of its ancestors.
+    std::vector<txiter> chain;
+    AncestorStats stats;
+    txiter it = entry;
+    for (;;) {
+        if (auto found = mapAncestorStats.find(it->GetLinksSlot()); found != mapAncestorStats.end()) {
+            stats = found->second;
+            break;
+        }
+        const Links &parents = GetMemPoolParents(it);
+        if (parents.size() == 1) {
+            chain.push_back(it);
+            it = *parents.begin();
+            continue;
+        }
+        // No parents, or several whose ancestors may overlap.
+        setEntries setAncestors;
+        if (!parents.empty()) {
+            CalculateMemPoolAncestors(*it, setAncestors, false);
+        }
+        for (txiter ancestorit : setAncestors) {
+            stats.Add(*ancestorit);
+        }
+        stats.Add(*it);
+        mapAncestorStats.emplace(it->GetLinksSlot(), stats);
+        break;
+    }
+    // The ancestors of an entry with a single parent are that parent and its
+    // ancestors, none of which is the entry itself.
+    for (auto chainit = chain.rbegin(); chainit != chain.rend(); ++chainit) {
+        stats.Add(**chainit);
+        mapAncestorStats.emplace((*chainit)->GetLinksSlot(), stats);
+    }
+    return stats;
+}
+
+auto CTxMemPool::GetSnapshotEntry(txiter it, bool fWithLinks) const -> Snapshot::Entry {
+    AssertLockHeld(cs);
+    Snapshot::Entry entry;
+    entry.txid = it->GetTx().GetId();
+    entry.fee = it->GetFee();
+    entry.modifiedFee = it->GetModifiedFee();
+    entry.size = it->GetTxSize();
+    entry.time = it->GetTime();
+    if (fWithLinks) {
+        entry.ancestors = GetAncestorStats(it);
+        const Links &parents = GetMemPoolParents(it);
+        entry.parents.reserve(parents.size());
+        for (txiter parentit : parents) {
+            entry.parents.push_back(parentit->GetTx().GetId());
+        }
+        const Links &children = GetMemPoolChildren(it);
+        entry.children.reserve(children.size());
+        for (txiter childit : children) {
+            entry.children.push_back(childit->GetTx().GetId());
+        }
+    }
+    return entry;
+}
+
+std::shared_ptr<const CTxMemPool::Snapshot> CTxMemPool::GetSnapshot(bool fWithLinks) const {
+    const auto isCurrent = [&](const std::shared_ptr<const Snapshot> &snapshot) {
+        return snapshot && snapshot->nTransactionsUpdated == nTransactionsUpdated &&
+               (snapshot->fWithLinks || !fWithLinks);
+    };
+    std::shared_ptr<const Snapshot> previous = std::atomic_load(&m_snapshot);
+    if (isCurrent(previous)) {
+        return previous;
+    }
+
+    std::shared_ptr<const Snapshot> snapshot;
+    {
+        LOCK(cs);
+        // Another caller may have taken one while we were waiting for cs.
+        snapshot = std::atomic_load(&m_snapshot);
+        if (isCurrent(snapshot)) {
+            return snapshot;
+        }
+
+        auto fresh = std::make_shared<Snapshot>();
+        fresh->nTransactionsUpdated = nTransactionsUpdated;
+        fresh->fWithLinks = fWithLinks;
+        fresh->totalTxSize = totalTxSize;
+        fresh->entries.reserve(mapTx.size());
+        const auto &index = mapTx.get<entry_id>();
+        for (auto it = index.begin(); it != index.end(); ++it) {
+            fresh->entries.push_back(GetSnapshotEntry(mapTx.project<0>(it), fWithLinks));
+        }
+        snapshot = std::move(fresh);
+        previous = std::atomic_exchange(&m_snapshot, snapshot);
+    }
+    // previous, if no other caller still holds it, is freed here rather than
+    // under cs.
+    return snapshot;
+}
+
 void CTxMemPool::UpdateParentsOf(bool add, txiter it) {
     // add or remove this tx as a child of each parent
     for (txiter piter : GetMemPoolParents(it)) {
@@ -110,24 +217,23 @@ void CTxMemPool::UpdateParentsOf(bool add, txiter it) {
     }
 }
 
-void CTxMemPool::UpdateChildrenForRemoval(txiter it) {
-    const setEntries &setMemPoolChildren = GetMemPoolChildren(it);
-    for (txiter updateIt : setMemPoolChildren) {
-        UpdateParent(updateIt, it, false);
-    }
-}
-
 void CTxMemPool::UpdateForRemoveFromMempool(const setEntries &entriesToRemove) {
+    // Sever the links between each transaction being removed and its parents
+    // and children that stay in the mempool. The links among the transactions
+    // being removed go away with them in removeUnchecked(), so a block's worth
+    // of transactions, which are mostly each other's parents and children, is
+    // unlinked without erasing those links one by one.
     for (txiter removeIt : entriesToRemove) {
-        // Note that UpdateParentsOf severs the child links that point to
-        // removeIt in the mapLinks entries for the parents of removeIt.
-        UpdateParentsOf(false, removeIt);
-    }
-    // After updating all the parent links, we can now sever the link between
-    // each transaction being removed and any mempool children (ie, update
-    // setMemPoolParents for each direct child of a transaction being removed).
-    for (txiter removeIt : entriesToRemove) {
-        UpdateChildrenForRemoval(removeIt);
+        for (txiter parentIt : GetMemPoolParents(removeIt)) {
+            if (!algo::contains(entriesToRemove, parentIt)) {
+                UpdateChild(parentIt, removeIt, false);
+            }
+        }
+        for (txiter childIt : GetMemPoolChildren(removeIt)) {
+            if (!algo::contains(entriesToRemove, childIt)) {
+                UpdateParent(childIt, removeIt, false);
+            }
+        }
     }
 }
 
@@ -165,6 +271,16 @@ void CTxMemPool::addUnchecked(CTxMemPoolEntry &&entry) {
     // get a guaranteed unique id (in case tests re-use the same object)
     entry.SetEntryId(nextEntryId++);
 
+    // Give the entry a slot for its links, reusing that of a removed entry if
+    // there is one.
+    if (vFreeLinks.empty()) {
+        entry.SetLinksSlot(vLinks.size());
+        vLinks.emplace_back();
+    } else {
+        entry.SetLinksSlot(vFreeLinks.back());
+        vFreeLinks.pop_back();
+    }
+
     // Update transaction for any feeDelta created by PrioritiseTransaction
     {
         Amount feeDelta = Amount::zero();
@@ -182,8 +298,6 @@ void CTxMemPool::addUnchecked(CTxMemPoolEntry &&entry) {
     // Sanity check: We should always end up inserting at the end of the entry_id index
     assert(&*mapTx.get<entry_id>().rbegin() == &*newit);
 
-    mapLinks.try_emplace(newit);
-
     // Update cachedInnerUsage to include contained transaction's usage.
     // (When we update the entry for in-mempool parents, memory usage will be
     // further updated.)
@@ -199,10 +313,13 @@ void CTxMemPool::addUnchecked(CTxMemPoolEntry &&entry) {
     // guaranteed that a new transaction arriving will not have any children,
     // because such children would be orphans.
 
-    // Update ancestors with information about this tx
-    for (const auto &pit : GetIterSet(setParentTransactions)) {
-        UpdateParent(newit, pit, true);
-    }
+    // Update ancestors with information about this tx. The parents come
+    // sorted by entry id already, and are stored in one allocation of the
+    // exact size.
+    const setEntries setParents = GetIterSet(setParentTransactions);
+    Links &parents = vLinks[newit->GetLinksSlot()].parents;
+    parents.assign(setParents.begin(), setParents.end());
+    cachedInnerUsage += memusage::DynamicUsage(parents);
     UpdateParentsOf(true, newit);
 
     nTransactionsUpdated++;
@@ -222,13 +339,17 @@ void CTxMemPool::removeUnchecked(txiter it, MemPoolRemovalReason reason) {
 
     totalTxSize -= it->GetTxSize();
     cachedInnerUsage -= it->DynamicMemoryUsage();
-    if (const auto linksiter = mapLinks.find(it); linksiter != mapLinks.end()) {
-        cachedInnerUsage -= memusage::DynamicUsage(linksiter->second.parents) +
-                            memusage::DynamicUsage(linksiter->second.children);
-        mapLinks.erase(linksiter);
-    }
+    TxLinks &links = vLinks[it->GetLinksSlot()];
+    cachedInnerUsage -= memusage::DynamicUsage(links.parents) +
+                        memusage::DynamicUsage(links.children);
+    // Release the capacity too, as the next entry to take the slot starts
+    // with none accounted for.
+    links = TxLinks();
+    vFreeLinks.push_back(it->GetLinksSlot());
     mapTx.erase(it);
     nTransactionsUpdated++;
+    // The descendants of the entry lose it as an ancestor.
+    fAncestorStatsStale = true;
 }
 
 // Calculates descendants of entry that are not already in setDescendants, and
@@ -239,22 +360,22 @@ void CTxMemPool::removeUnchecked(txiter it, MemPoolRemovalReason reason) {
 // iterating over those entries.
 void CTxMemPool::CalculateDescendants(txiter entryit,
                                       setEntries &setDescendants) const {
-    setEntries stage;
-    if (!algo::contains(setDescendants, entryit)) {
-        stage.insert(entryit);
+    // Descendants that were just added to setDescendants and whose children
+    // have yet to be walked.
+    std::vector<txiter> stage;
+    if (setDescendants.insert(entryit).second) {
+        stage.push_back(entryit);
     }
     // Traverse down the children of entry, only adding children that are not
     // accounted for in setDescendants already (because those children have
     // either already been walked, or will be walked in this iteration).
     while (!stage.empty()) {
-        txiter it = *stage.begin();
-        setDescendants.insert(it);
-        stage.erase(stage.begin());
-
-        const setEntries &setChildren = GetMemPoolChildren(it);
-        for (txiter childiter : setChildren) {
-            if (!algo::contains(setDescendants, childiter)) {
-                stage.insert(childiter);
+        const txiter it = stage.back();
+        stage.pop_back();
+
+        for (txiter childiter : GetMemPoolChildren(it)) {
+            if (setDescendants.insert(childiter).second) {
+                stage.push_back(childiter);
             }
         }
     }
@@ -290,21 +411,6 @@ void CTxMemPool::removeRecursive(const CTransaction &origTx,
     RemoveStaged(setAllRemoves, reason);
 }
 
-void CTxMemPool::removeConflicts(const CTransaction &tx) {
-    // Remove transactions which depend on inputs of tx, recursively
-    AssertLockHeld(cs);
-    for (const CTxIn &txin : tx.vin) {
-        auto it = mapNextTx.find(txin.prevout);
-        if (it != mapNextTx.end()) {
-            const CTransaction &txConflict = *it->second;
-            if (txConflict != tx) {
-                ClearPrioritisation(txConflict.GetId());
-                removeRecursive(txConflict, MemPoolRemovalReason::CONFLICT);
-            }
-        }
-    }
-}
-
 /**
  * Called when a block is connected. Removes from mempool and updates the miner
  * fee estimator.
@@ -318,34 +424,55 @@ void CTxMemPool::removeForBlock(const std::vector<CTransactionRef> &vtx) {
         return;
     }
 
-    DisconnectedBlockTransactions disconnectpool;
-    disconnectpool.addNoLimit(vtx);
-
-    // iterate in topological order (parents before children)
-    for (const CTransactionRef &tx : reverse_iterate(disconnectpool.GetQueuedTx().get<insertion_order>())) {
+    // Find the block transactions that are in the mempool, and the mempool
+    // transactions that spend the same outputs as the others, in one pass.
+    setEntries stage;
+    std::vector<txiter> conflicts;
+    for (const CTransactionRef &tx : vtx) {
         const txiter it = mapTx.find(tx->GetId());
         if (it != mapTx.end()) {
-            setEntries stage;
             stage.insert(it);
-            RemoveStaged(stage, MemPoolRemovalReason::BLOCK);
-        } else {
-            removeConflicts(*tx);
+            continue;
+        }
+        for (const CTxIn &txin : tx->vin) {
+            const auto nextit = mapNextTx.find(txin.prevout);
+            if (nextit != mapNextTx.end()) {
+                conflicts.push_back(mapTx.find(nextit->second->GetId()));
+            }
+        }
+    }
+
+    // Remove the block transactions all at once. They are removed in the order
+    // of their entry ids, so parents before children.
+    RemoveStaged(stage, MemPoolRemovalReason::BLOCK);
+
+    // Then remove the conflicting transactions, along with their descendants.
+    if (!conflicts.empty()) {
+        setEntries setConflicts;
+        for (const txiter it : conflicts) {
+            ClearPrioritisation(it->GetTx().GetId());
+            CalculateDescendants(it, setConflicts);
+        }
+        RemoveStaged(setConflicts, MemPoolRemovalReason::CONFLICT);
+    }
+
+    // clear prioritisations (mapDeltas); optimized for the common case where
+    // mapDeltas is empty
+    if (!mapDeltas.empty()) {
+        for (const CTransactionRef &tx : vtx) {
+            mapDeltas.erase(tx->GetId());
         }
     }
-    // clear prioritisations (mapDeltas); optmized for the common case where
-    // mapDeltas is empty or much smaller than block.vtx
-    algo::erase_if(mapDeltas, [&disconnectpool](const auto &kv) {
-        return algo::contains(disconnectpool.GetQueuedTx(), kv.first);
-    });
 
     lastRollingFeeUpdate = GetTime();
     blockSinceLastRollingFeeBump = true;
-
-    disconnectpool.clear();
 }
 
 void CTxMemPool::_clear(bool clearDspOrphans /*= true*/) {
-    mapLinks.clear();
+    vLinks.clear();
+    vFreeLinks.clear();
+    decltype(mapAncestorStats)().swap(mapAncestorStats);
+    fAncestorStatsStale = false;
     mapTx.clear();
     mapNextTx.clear();
     totalTxSize = 0;
@@ -399,9 +526,8 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const {
         checkTotal += it->GetTxSize();
         innerUsage += it->DynamicMemoryUsage();
         const CTransaction &tx = it->GetTx();
-        auto linksiter = mapLinks.find(it);
-        assert(linksiter != mapLinks.end());
-        const TxLinks &links = linksiter->second;
+        assert(it->GetLinksSlot() < vLinks.size());
+        const TxLinks &links = vLinks[it->GetLinksSlot()];
         innerUsage += memusage::DynamicUsage(links.parents) +
                       memusage::DynamicUsage(links.children);
         bool fDependsWait = false;
@@ -427,13 +553,26 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const {
             assert(it3->first == &txin.prevout);
             assert(it3->second == &tx);
         }
-        assert(setParentCheck == GetMemPoolParents(it));
+        assert(std::equal(setParentCheck.begin(), setParentCheck.end(),
+                          GetMemPoolParents(it).begin(),
+                          GetMemPoolParents(it).end()));
         // Verify ancestor state is correct.
         setEntries setAncestors;
         CalculateMemPoolAncestors(*it, setAncestors);
         // all ancestors should have entryId < this tx's entryId
-        for (const auto &ancestor : setAncestors)
+        AncestorStats ancestorStats;
+        for (const auto &ancestor : setAncestors) {
             assert(ancestor->GetEntryId() < it->GetEntryId());
+            ancestorStats.Add(*ancestor);
+        }
+        ancestorStats.Add(*it);
+        // memoized ancestor stats should match the walk
+        if (auto found = mapAncestorStats.find(it->GetLinksSlot());
+            !fAncestorStatsStale && found != mapAncestorStats.end()) {
+            assert(found->second.count == ancestorStats.count);
+            assert(found->second.size == ancestorStats.size);
+            assert(found->second.sigChecks == ancestorStats.sigChecks);
+        }
 
         // Check children against mapNextTx
         CTxMemPool::setEntries setChildrenCheck;
@@ -446,7 +585,9 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const {
             assert(childit != mapTx.end());
             setChildrenCheck.insert(childit);
         }
-        assert(setChildrenCheck == GetMemPoolChildren(it));
+        assert(std::equal(setChildrenCheck.begin(), setChildrenCheck.end(),
+                          GetMemPoolChildren(it).begin(),
+                          GetMemPoolChildren(it).end()));
 
         if (fDependsWait) {
             waitingOnDependants.push_back(&(*it));
@@ -480,6 +621,8 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const {
 
     assert(totalTxSize == checkTotal);
     assert(innerUsage == cachedInnerUsage);
+    // Every links slot is either used by an entry or free.
+    assert(vLinks.size() == mapTx.size() + vFreeLinks.size());
 }
 
 bool CTxMemPool::CompareTopologically(const TxId &txida, const TxId &txidb) const {
@@ -650,7 +793,10 @@ size_t CTxMemPool::DynamicMemoryUsage() const {
                mapTx.size() +
            memusage::DynamicUsage(mapNextTx) +
            memusage::DynamicUsage(mapDeltas) +
-           memusage::DynamicUsage(mapLinks) +
+           memusage::DynamicUsage(vLinks) +
+           memusage::DynamicUsage(vFreeLinks) +
+           // An empty mapAncestorStats owns no memory, see GetAncestorStats().
+           (mapAncestorStats.empty() ? 0 : memusage::DynamicUsage(mapAncestorStats)) +
            cachedInnerUsage;
 }
 
@@ -692,40 +838,45 @@ void CTxMemPool::LimitSize(size_t limit, unsigned long age) {
     }
 }
 
-// NB: The pointer type is only used for template overload selection and never dereferenced so this is safe.
-inline constexpr size_t setEntriesIncrementalUsage =
-        memusage::IncrementalDynamicUsage(static_cast<CTxMemPool::setEntries *>(nullptr));
+void CTxMemPool::UpdateLinks(Links &links, txiter link, bool add) {
+    const auto it = std::lower_bound(links.begin(), links.end(), link,
+                                     CompareIteratorByEntryId());
+    const bool fFound = it != links.end() && *it == link;
+    if (add == fFound) {
+        return;
+    }
+    cachedInnerUsage -= memusage::DynamicUsage(links);
+    if (add) {
+        links.insert(it, link);
+    } else if (links.size() == 1) {
+        // Most entries lose their only child when it is mined or evicted.
+        Links().swap(links);
+    } else {
+        links.erase(it);
+    }
+    cachedInnerUsage += memusage::DynamicUsage(links);
+}
 
 void CTxMemPool::UpdateChild(txiter entry, txiter child, bool add) {
-    if (add && mapLinks[entry].children.insert(child).second) {
-        cachedInnerUsage += setEntriesIncrementalUsage;
-    } else if (!add && mapLinks[entry].children.erase(child)) {
-        cachedInnerUsage -= setEntriesIncrementalUsage;
-    }
+    UpdateLinks(vLinks[entry->GetLinksSlot()].children, child, add);
 }
 
 void CTxMemPool::UpdateParent(txiter entry, txiter parent, bool add) {
-    if (add && mapLinks[entry].parents.insert(parent).second) {
-        cachedInnerUsage += setEntriesIncrementalUsage;
-    } else if (!add && mapLinks[entry].parents.erase(parent)) {
-        cachedInnerUsage -= setEntriesIncrementalUsage;
-    }
+    UpdateLinks(vLinks[entry->GetLinksSlot()].parents, parent, add);
 }
 
-const CTxMemPool::setEntries &
+const CTxMemPool::Links &
 CTxMemPool::GetMemPoolParents(txiter entry) const {
     assert(entry != mapTx.end());
-    auto it = mapLinks.find(entry);
-    assert(it != mapLinks.end());
-    return it->second.parents;
+    assert(entry->GetLinksSlot() < vLinks.size());
+    return vLinks[entry->GetLinksSlot()].parents;
 }
 
-const CTxMemPool::setEntries &
+const CTxMemPool::Links &
 CTxMemPool::GetMemPoolChildren(txiter entry) const {
     assert(entry != mapTx.end());
-    auto it = mapLinks.find(entry);
-    assert(it != mapLinks.end());
-    return it->second.children;
+    assert(entry->GetLinksSlot() < vLinks.size());
+    return vLinks[entry->GetLinksSlot()].children;
 }
 
 CTransactionRef CTxMemPool::addDoubleSpendProof(const DoubleSpendProof &proof, const std::optional<txiter> &optIter) {
@@ -1278,6 +1429,12 @@ void DisconnectedBlockTransactions::updateMempoolForReorg(const Config &config,
         // Iterate disconnectpool in reverse, so that we add transactions back to
         // the mempool starting with the earliest transaction that had been
         // previously seen in a block.
+        std::vector<CTransactionRef> txs;
+        std::vector<int64_t> acceptTimes;
+        std::vector<bool> hasFeeDeltas;
+        txs.reserve(queuedTx.size());
+        acceptTimes.reserve(queuedTx.size());
+        hasFeeDeltas.reserve(queuedTx.size());
         for (const CTransactionRef &tx : reverse_iterate(queuedTx.get<insertion_order>())) {
             if (tx->IsCoinBase())
                 continue;
@@ -1290,18 +1447,19 @@ void DisconnectedBlockTransactions::updateMempoolForReorg(const Config &config,
                 g_mempool.mapDeltas[tx->GetId()] = ptxInfo->feeDelta;
                 hasFeeDelta = true;
             }
-            // ignore validation errors in resurrected transactions
-            CValidationState stateDummy;
-            bool ok = AcceptToMemoryPoolWithTime(config, g_mempool, stateDummy, tx,
-                                                 nullptr /* pfMissingInputs */,
-                                                 ptxInfo ? ptxInfo->time : GetTime() /* nAcceptTime */,
-                                                 true /* bypass_limits */,
-                                                 Amount::zero() /* nAbsurdFee */,
-                                                 false /* test_accept */);
-            if (!ok && hasFeeDelta) {
+            txs.push_back(tx);
+            acceptTimes.push_back(ptxInfo ? ptxInfo->time : GetTime());
+            hasFeeDeltas.push_back(hasFeeDelta);
+        }
+        // ignore validation errors in resurrected transactions
+        const std::vector<MemPoolAcceptResult> results =
+            AcceptToMemoryPoolBatch(config, g_mempool, txs, acceptTimes, true /* bypass_limits */,
+                                    Amount::zero() /* nAbsurdFee */);
+        for (size_t i = 0; i < txs.size(); ++i) {
+            if (!results[i].fAccepted && hasFeeDeltas[i]) {
                 // tx not accepted: undo mapDelta insertion from above
                 LOCK(g_mempool.cs);
-                g_mempool.mapDeltas.erase(tx->GetId());
+                g_mempool.mapDeltas.erase(txs[i]->GetId());
             }
         }
     }
@@ -23,6 +23,7 @@
 #include <boost/multi_index_container.hpp>
 #include <boost/signals2/signal.hpp>
 
+#include <atomic>
 #include <map>
 #include <memory>
 #include <optional>
@@ -89,6 +90,8 @@ class CTxMemPoolEntry {
     const int64_t nTime;
     //! keep track of transactions that spend a coinbase
     const bool spendsCoinbase;
+    //! Index of the links of this entry in CTxMemPool::vLinks
+    uint32_t linksSlot = 0;
     //! Total sigchecks
     const int64_t sigChecks;
     //! Used for determining the priority of the transaction for mining in a
@@ -113,6 +116,9 @@ public:
     //! In other words, it may not be mutated for an instance whose storage is in CTxMemPool::mapTx, otherwise mempool
     //! invariants will be violated.
     void SetEntryId(uint64_t eid) { entryId = eid; }
+    uint32_t GetLinksSlot() const { return linksSlot; }
+    //! Like the entry id, this is only set by addUnchecked() before entry insertion into the mempool.
+    void SetLinksSlot(uint32_t slot) { linksSlot = slot; }
 
     const CTransaction &GetTx() const { return *this->tx; }
     CTransactionRef GetSharedTx() const { return this->tx; }
@@ -296,8 +302,10 @@ class CTxMemPool {
 private:
     //! Value n means that n times in 2^32 we check.
     uint32_t nCheckFrequency GUARDED_BY(cs);
-    //! Used by getblocktemplate to trigger CreateNewBlock() invocation
-    unsigned int nTransactionsUpdated;
+    //! Used by getblocktemplate to trigger CreateNewBlock() invocation, and by
+    //! GetSnapshot() to tell whether its cached snapshot is still current.
+    //! Written under cs, but may be read without it.
+    std::atomic<unsigned int> nTransactionsUpdated;
 
     //! sum of all mempool tx's sizes.
     size_t totalTxSize;
@@ -384,12 +392,83 @@ public:
         }
     };
     using setEntries = std::set<txiter, CompareIteratorByEntryId>;
+    //! The in-mempool parents or children of an entry, sorted by entry id like
+    //! setEntries. Most entries have few of them, and a vector stores them in
+    //! one allocation instead of one tree node each.
+    using Links = std::vector<txiter>;
 
-    const setEntries &GetMemPoolParents(txiter entry) const
+    const Links &GetMemPoolParents(txiter entry) const
         EXCLUSIVE_LOCKS_REQUIRED(cs);
-    const setEntries &GetMemPoolChildren(txiter entry) const
+    const Links &GetMemPoolChildren(txiter entry) const
         EXCLUSIVE_LOCKS_REQUIRED(cs);
 
+    //! Totals over a mempool transaction and all of its in-mempool ancestors.
+    struct AncestorStats {
+        uint64_t count = 0;
+        uint64_t size = 0;
+        int64_t sigChecks = 0;
+
+        void Add(const CTxMemPoolEntry &entry) {
+            ++count;
+            size += entry.GetTxSize();
+            sigChecks += entry.GetSigChecks();
+        }
+    };
+
+    /**
+     * Get the totals over `entry` and all of its in-mempool ancestors.
+     *
+     * The result is memoized per entry until a transaction leaves the mempool,
+     * since only that can change the ancestors of the remaining entries. An
+     * entry with a single in-mempool parent takes the totals of that parent
+     * and adds itself, so that along a chain each query costs O(1) once its
+     * parent is known, rather than a walk over the whole chain.
+     */
+    AncestorStats GetAncestorStats(txiter entry) const
+        EXCLUSIVE_LOCKS_REQUIRED(cs);
+
+    /** A read-only copy of the mempool, see GetSnapshot(). */
+    struct Snapshot {
+        struct Entry {
+            TxId txid;
+            Amount fee;
+            Amount modifiedFee;
+            size_t size = 0;
+            int64_t time = 0;
+
+            //! The fields below are only filled in for snapshots taken with
+            //! links.
+            AncestorStats ancestors;
+            //! In-mempool parents and children, in entry id order.
+            std::vector<TxId> parents;
+            std::vector<TxId> children;
+        };
+
+        //! The value of nTransactionsUpdated that this snapshot reflects.
+        unsigned int nTransactionsUpdated = 0;
+        bool fWithLinks = false;
+        //! All entries, in entry id order.
+        std::vector<Entry> entries;
+        uint64_t totalTxSize = 0;
+    };
+
+    /** Copy the fields of a single entry, as GetSnapshot() does. */
+    Snapshot::Entry GetSnapshotEntry(txiter it, bool fWithLinks) const
+        EXCLUSIVE_LOCKS_REQUIRED(cs);
+
+    /**
+     * Get a snapshot of the mempool's entries, for callers that list the whole
+     * pool. If nothing was added, removed or prioritised since the last
+     * snapshot was taken, that snapshot is returned without taking cs.
+     * Otherwise a new one is copied under cs and shared with later callers,
+     * so that polling readers hold cs only for a flat copy, at most once per
+     * change, and never while their results are being formatted.
+     *
+     * The last snapshot is kept until a newer one replaces it.
+     */
+    std::shared_ptr<const Snapshot> GetSnapshot(bool fWithLinks = false) const
+        LOCKS_EXCLUDED(cs);
+
     /**
      * Add a double-spend proof to an existing mempool entry.
      * Returns the CTransactionRef of the mempool entry we added it to.
@@ -490,15 +569,32 @@ private:
     DspDescendants getDspDescendantsForIter(txiter) const EXCLUSIVE_LOCKS_REQUIRED(cs);
 
     struct TxLinks {
-        setEntries parents;
-        setEntries children;
+        Links parents;
+        Links children;
     };
 
-    using txlinksMap = std::map<txiter, TxLinks, CompareIteratorByEntryId>;
-    txlinksMap mapLinks;
+    //! The links of the entries of mapTx, indexed by their links slot, so that
+    //! finding them takes no search. The slots of removed entries are kept in
+    //! vFreeLinks to be reused by the next entries added.
+    std::vector<TxLinks> vLinks;
+    std::vector<uint32_t> vFreeLinks;
+
+    //! The results of GetAncestorStats() by links slot. Only entries that were
+    //! queried, or are ancestors of one that was, are in it.
+    mutable std::unordered_map<uint32_t, AncestorStats> mapAncestorStats GUARDED_BY(cs);
+    //! Set whenever a transaction leaves the mempool, since the ancestors of
+    //! its descendants change. mapAncestorStats is cleared on the next query.
+    mutable bool fAncestorStatsStale GUARDED_BY(cs) = false;
+
+    //! The last snapshot taken by GetSnapshot(). Only accessed through
+    //! std::atomic_load() and std::atomic_store().
+    mutable std::shared_ptr<const Snapshot> m_snapshot;
 
     void UpdateParent(txiter entry, txiter parent, bool add);
     void UpdateChild(txiter entry, txiter child, bool add);
+    //! Add or remove link in links, accounting for the change of capacity in
+    //! cachedInnerUsage.
+    void UpdateLinks(Links &links, txiter link, bool add);
 
 public:
     indirectmap<COutPoint, const CTransaction *> mapNextTx GUARDED_BY(cs);
@@ -537,7 +633,6 @@ public:
     void removeRecursive(
         const CTransaction &tx,
         MemPoolRemovalReason reason = MemPoolRemovalReason::UNKNOWN);
-    void removeConflicts(const CTransaction &tx) EXCLUSIVE_LOCKS_REQUIRED(cs);
     void removeForBlock(const std::vector<CTransactionRef> &vtx);
 
     void clear(bool clearDspOrphans = true);
@@ -603,8 +698,10 @@ public:
      * Try to calculate all in-mempool ancestors of entry.
      *  (these are all calculated including the tx itself)
      * fSearchForParents = whether to search a tx's vin for in-mempool parents,
-     * or look up parents from mapLinks. Must be true for entries not in the
+     * or look up parents from vLinks. Must be true for entries not in the
      * mempool.
+     * Assumes that setAncestors includes all in-mempool ancestors of anything
+     * already in it.
      */
     void CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntries &setAncestors,
                                    bool fSearchForParents = true) const
@@ -684,18 +781,16 @@ public:
 
 private:
     /**
-     * Update parents of `it` to add/remove it as a child transaction (updates mapLinks).
+     * Update parents of `it` to add/remove it as a child transaction (updates vLinks).
      */
     void UpdateParentsOf(bool add, txiter it)
         EXCLUSIVE_LOCKS_REQUIRED(cs);
     /**
      * For each transaction being removed, sever links between parents
-     * and children in mapLinks
+     * and children in vLinks that are not being removed as well
      */
     void UpdateForRemoveFromMempool(const setEntries &entriesToRemove)
         EXCLUSIVE_LOCKS_REQUIRED(cs);
-    /** Sever link between specified transaction and direct children. */
-    void UpdateChildrenForRemoval(txiter entry) EXCLUSIVE_LOCKS_REQUIRED(cs);
 
     /**
      * Before calling removeUnchecked for a given transaction,
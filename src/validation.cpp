@@ -9,6 +9,7 @@
 #include <arith_uint256.h>
 #include <blockindexworkcomparator.h>
 #include <blockvalidity.h>
+#include <bloom.h>
 #include <chainparams.h>
 #include <checkpoints.h>
 #include <checkqueue.h>
@@ -27,6 +28,7 @@
 #include <hash.h>
 #include <index/txindex.h>
 #include <node/blockstorage.h>
+#include <node/utxosnapshot.h>
 #include <policy/fees.h>
 #include <policy/mempool.h>
 #include <policy/policy.h>
@@ -52,18 +54,26 @@
 #include <util/strencodings.h>
 #include <util/string.h>
 #include <util/system.h>
+#include <util/threadnames.h>
 #include <util/time.h>
 #include <validationinterface.h>
 #include <warnings.h>
 
 #include <algorithm>
 #include <atomic>
+#include <condition_variable>
 #include <deque>
+#include <functional>
+#include <future>
 #include <limits>
 #include <list>
+#include <map>
 #include <optional>
+#include <queue>
 #include <string>
 #include <thread>
+#include <unordered_map>
+#include <unordered_set>
 #include <utility>
 
 #define MICRO 0.000001
@@ -196,6 +206,10 @@ public:
         EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
     bool ReplayBlocks(const Consensus::Params &params, CCoinsView *view);
+    bool AssumeSnapshotChain(const Config &config,
+                             const std::vector<SnapshotBlock> &blocks,
+                             uint64_t nChainTx, CValidationState &state)
+        EXCLUSIVE_LOCKS_REQUIRED(cs_main);
     bool LoadGenesisBlock(const CChainParams &chainparams);
 
     void PruneBlockIndexCandidates();
@@ -234,6 +248,8 @@ private:
     void ReceivedBlockTransactions(const CBlock &block, CBlockIndex *pindexNew,
                                    const FlatFilePos &pos)
         EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+    void LinkBlockTransactions(CBlockIndex *pindexNew)
+        EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
     bool RollforwardBlock(const CBlockIndex *pindex, CCoinsViewCache &inputs,
                           const Consensus::Params &params)
@@ -267,6 +283,8 @@ bool fIsBareMultisigStd = DEFAULT_PERMIT_BAREMULTISIG;
 bool fRequireStandard = true;
 bool fCheckBlockIndex = false;
 bool fCheckpointsEnabled = DEFAULT_CHECKPOINTS_ENABLED;
+bool fPrefetchBlockInputs = DEFAULT_PREFETCH_BLOCK_INPUTS;
+bool fParallelConnect = DEFAULT_PARALLEL_CONNECT;
 size_t nCoinCacheUsage = 5000 * 300;
 int64_t nMaxTipAge = DEFAULT_MAX_TIP_AGE;
 
@@ -1185,6 +1203,36 @@ int GetSpendHeight(const CCoinsViewCache &inputs) {
     return pindexPrev->nHeight + 1;
 }
 
+/**
+ * Append one CScriptCheck per input of `tx` to `vChecks`, populating `txdata`
+ * if needed. Unlike CheckInputs() this neither consults nor updates the script
+ * execution cache, so it does not need cs_main and may run concurrently on
+ * other threads as long as `view` is not being modified.
+ */
+static void AppendScriptChecks(const CTransaction &tx,
+                               const CCoinsViewCache &view,
+                               const uint32_t flags, bool sigCacheStore,
+                               PrecomputedTransactionData &txdata,
+                               TxSigCheckLimiter &txLimitSigChecks,
+                               CheckInputsLimiter *pBlockLimitSigChecks,
+                               std::vector<CScriptCheck> &vChecks) {
+    vChecks.reserve(vChecks.size() + tx.vin.size());
+
+    auto contextVec = ScriptExecutionContext::createForAllInputs(tx, view);
+
+    for (size_t i = 0; i < tx.vin.size(); ++i) {
+        assert(!contextVec[i].coin().IsSpent());
+        if ( ! txdata.populated) {
+            txdata.PopulateFromContext(contextVec[i]);
+        }
+
+        // We very carefully only pass in things to CScriptCheck which are
+        // clearly committed to by tx's hash. See the comment in CheckInputs.
+        vChecks.emplace_back(contextVec[i], flags, sigCacheStore, txdata,
+                             &txLimitSigChecks, pBlockLimitSigChecks);
+    }
+}
+
 bool CheckInputs(const CTransaction &tx, CValidationState &state,
                  const CCoinsViewCache &view, bool fScriptChecks,
                  const uint32_t flags, bool sigCacheStore, bool scriptCacheStore,
@@ -1223,6 +1271,14 @@ bool CheckInputs(const CTransaction &tx, CValidationState &state,
         return true;
     }
 
+    // If pvChecks is not null, defer the check execution to the caller.
+    if (pvChecks) {
+        AppendScriptChecks(tx, view, flags, sigCacheStore, txdata,
+                           txLimitSigChecks, pBlockLimitSigChecks, *pvChecks);
+        nSigChecksOut = 0;
+        return true;
+    }
+
     int nSigChecksTotal = 0;
 
     auto contextVec = ScriptExecutionContext::createForAllInputs(tx, view);
@@ -1242,12 +1298,6 @@ bool CheckInputs(const CTransaction &tx, CValidationState &state,
         // Verify signature
         CScriptCheck check(contextVec[i], flags, sigCacheStore, txdata, &txLimitSigChecks, pBlockLimitSigChecks);
 
-        // If pvChecks is not null, defer the check execution to the caller.
-        if (pvChecks) {
-            pvChecks->push_back(std::move(check));
-            continue;
-        }
-
         if (!check()) {
             ScriptError scriptError = check.GetScriptError();
             // Compute flags without the optional standardness flags.
@@ -1289,7 +1339,7 @@ bool CheckInputs(const CTransaction &tx, CValidationState &state,
 
     nSigChecksOut = nSigChecksTotal;
 
-    if (scriptCacheStore && !pvChecks) {
+    if (scriptCacheStore) {
         // We executed all of the provided scripts, and were told to cache the
         // result. Do so now.
         AddKeyInScriptCache(hashCacheEntry, nSigChecksTotal);
@@ -1411,14 +1461,698 @@ DisconnectResult ApplyBlockUndo(CBlockUndo &&blockUndo, const CBlock &block, con
 
 static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
 
+namespace {
+/**
+ * Look up a single outpoint in a coins view on behalf of
+ * PrefetchBlockInputs(). The view must support concurrent GetCoin() calls.
+ * Every check writes to its own caller-owned result slot, so no further
+ * synchronization is needed.
+ */
+class CCoinsPrefetchCheck {
+    const CCoinsView *view;
+    const COutPoint *outpoint;
+    Coin *coin;
+    uint8_t *found;
+
+public:
+    CCoinsPrefetchCheck(const CCoinsView *viewIn, const COutPoint *outpointIn,
+                        Coin *coinIn, uint8_t *foundIn)
+        : view(viewIn), outpoint(outpointIn), coin(coinIn), found(foundIn) {}
+
+    bool operator()() {
+        try {
+            *found = view->GetCoin(*outpoint, *coin);
+        } catch (const std::exception &e) {
+            // Leave it to the serial lookup in ConnectBlock to report this.
+            LogPrint(BCLog::COINDB, "Coin prefetch for %s failed: %s\n",
+                     outpoint->ToString(), e.what());
+            *found = false;
+        }
+        // Never abort the remaining lookups.
+        return true;
+    }
+};
+} // namespace
+
+static CCheckQueue<CCoinsPrefetchCheck> coinprefetchqueue(128);
+static std::atomic<int> nCoinPrefetchThreads{0};
+
+namespace {
+/**
+ * Outcome of checking one transaction of a block against the coins view, as
+ * ConnectBlock() does before applying the transaction to it.
+ */
+struct TxConnectResult {
+    enum class Stage : uint8_t {
+        //! Not checked (yet).
+        UNCHECKED,
+        //! All of the checks below passed.
+        OK,
+        //! Consensus::CheckTxInputs() failed.
+        INPUTS,
+        //! CheckTxTokens() failed.
+        TOKENS,
+        //! The transaction is not BIP68 final.
+        SEQUENCE_LOCKS,
+    };
+
+    Stage stage = Stage::UNCHECKED;
+    //! Filled in by the check that failed, if any.
+    CValidationState state;
+    Amount txfee = Amount::zero();
+
+    //! Whether the script execution cache was consulted for this transaction,
+    //! and what it returned.
+    bool fScriptCacheChecked = false;
+    bool fScriptCacheHit = false;
+    int nCachedSigChecks = 0;
+
+    //! Script checks prepared during the parallel check phase, if any.
+    bool fScriptChecksPrepared = false;
+    std::vector<CScriptCheck> vChecks;
+};
+
+/** Block-wide parameters shared by the checks of all of its transactions. */
+struct TxConnectParams {
+    const CCoinsViewCache *view;
+    const CBlockIndex *pindex;
+    int nLockTimeFlags;
+    uint32_t flags;
+    int64_t firstTokenBlockHeight;
+    bool fCacheResults;
+    CheckInputsLimiter *pBlockLimitSigChecks;
+};
+} // namespace
+
+/**
+ * Run the per-transaction checks of ConnectBlock() which only read the coins
+ * view: input amounts, token rules and BIP68 sequence locks, in that order.
+ * Returns false and records which check failed in `result` on failure.
+ */
+static bool CheckTxForConnect(const CTransaction &tx,
+                              const TxConnectParams &params,
+                              TxConnectResult &result) {
+    const CCoinsViewCache &view = *params.view;
+    const bool isCoinBase = tx.IsCoinBase();
+
+    result.state = CValidationState();
+    result.txfee = Amount::zero();
+    result.fScriptChecksPrepared = false;
+    result.vChecks.clear();
+
+    if (!isCoinBase &&
+        !Consensus::CheckTxInputs(tx, result.state, view,
+                                  params.pindex->nHeight, result.txfee)) {
+        result.stage = TxConnectResult::Stage::INPUTS;
+        return false;
+    }
+
+    // Note: we pass coinbase txn here too, which is what we want, since
+    // coinbase txn should have NO token data post-activation of Upgrade9, and
+    // this function checks that requirement.
+    if (!CheckTxTokens(tx, result.state, view, params.flags,
+                       params.firstTokenBlockHeight)) {
+        result.stage = TxConnectResult::Stage::TOKENS;
+        return false;
+    }
+
+    if (!isCoinBase) {
+        // BIP68 lock checks (as opposed to nLockTime checks) must be in
+        // ConnectBlock because they require the UTXO set.
+        std::vector<int> prevheights(tx.vin.size());
+        for (size_t j = 0; j < tx.vin.size(); j++) {
+            prevheights[j] = view.AccessCoin(tx.vin[j].prevout).GetHeight();
+        }
+
+        if (!SequenceLocks(tx, params.nLockTimeFlags, &prevheights,
+                           *params.pindex)) {
+            result.stage = TxConnectResult::Stage::SEQUENCE_LOCKS;
+            return false;
+        }
+    }
+
+    result.stage = TxConnectResult::Stage::OK;
+    return true;
+}
+
+namespace {
+/**
+ * Check a single transaction of a block on behalf of
+ * CheckBlockTransactionsParallel(), and prepare its script checks if asked to.
+ */
+class CTxConnectCheck {
+    const TxConnectParams *params;
+    const CTransaction *tx;
+    TxConnectResult *result;
+    //! Non-null if the script checks of tx should be prepared too.
+    TxSigCheckLimiter *pTxLimitSigChecks;
+
+public:
+    CTxConnectCheck(const TxConnectParams *paramsIn,
+                    const CTransaction *txIn, TxConnectResult *resultIn,
+                    TxSigCheckLimiter *pTxLimitSigChecksIn)
+        : params(paramsIn), tx(txIn), result(resultIn),
+          pTxLimitSigChecks(pTxLimitSigChecksIn) {}
+
+    bool operator()() {
+        if (!CheckTxForConnect(*tx, *params, *result)) {
+            // The block is invalid, so let the queue skip the remaining
+            // checks. ConnectBlock() redoes any it needs serially.
+            return false;
+        }
+        if (pTxLimitSigChecks) {
+            PrecomputedTransactionData txdata;
+            AppendScriptChecks(*tx, *params->view, params->flags,
+                               params->fCacheResults, txdata,
+                               *pTxLimitSigChecks,
+                               params->pBlockLimitSigChecks, result->vChecks);
+            result->fScriptChecksPrepared = true;
+        }
+        return true;
+    }
+};
+} // namespace
+
+static CCheckQueue<CTxConnectCheck> txconnectqueue(128);
+static std::atomic<int> nTxConnectThreads{0};
+
+namespace {
+/**
+ * Outcome of verifying the input scripts of one transaction on behalf of
+ * PrevalidateMemPoolTransactions().
+ */
+struct MemPoolPrevalidateResult {
+    //! Whether the scripts were run at all.
+    bool fChecked = false;
+    //! Whether all scripts passed with both sets of flags.
+    bool fValid = false;
+    int nSigChecksStandard = 0;
+    int nSigChecksConsensus = 0;
+};
+
+/** Flags and limits shared by the prevalidation of all transactions of a batch. */
+struct MemPoolPrevalidateParams {
+    const CCoinsViewCache *view;
+    uint32_t scriptVerifyFlags;
+    uint32_t nextBlockScriptVerifyFlags;
+    int nSpendHeight;
+    //! Whether to check the fees against the limits below.
+    bool fCheckFees;
+    CFeeRate minRelayFee;
+    CFeeRate mempoolMinFee;
+};
+
+/**
+ * Run the input scripts of `tx` with `flags`, without consulting the script
+ * execution cache. Returns false if any of them fails.
+ */
+bool RunScriptChecks(const CTransaction &tx, const CCoinsViewCache &view,
+                     const uint32_t flags, PrecomputedTransactionData &txdata,
+                     int &nSigChecksOut) {
+    TxSigCheckLimiter txLimitSigChecks;
+    std::vector<CScriptCheck> vChecks;
+    AppendScriptChecks(tx, view, flags, true, txdata, txLimitSigChecks,
+                       nullptr, vChecks);
+    int nSigChecksTotal = 0;
+    for (CScriptCheck &check : vChecks) {
+        if (!check()) {
+            return false;
+        }
+        nSigChecksTotal += check.GetScriptExecutionMetrics().GetSigChecks();
+    }
+    nSigChecksOut = nSigChecksTotal;
+    return true;
+}
+
+/**
+ * Check a single transaction for the mempool on behalf of
+ * PrevalidateMemPoolTransactions(): the context-free and standardness checks
+ * that AcceptToMemoryPool() starts with, the checks of its inputs and of its
+ * fee against the relay and mempool minimum fees, and only then its input
+ * scripts with the standard and with the next block's script flags.
+ */
+class CMemPoolPrevalidateCheck {
+    const MemPoolPrevalidateParams *params;
+    const CTransaction *tx;
+    //! Fee delta from PrioritiseTransaction.
+    Amount feeDelta;
+    MemPoolPrevalidateResult *result;
+
+public:
+    CMemPoolPrevalidateCheck() = default;
+    CMemPoolPrevalidateCheck(const MemPoolPrevalidateParams *paramsIn,
+                             const CTransaction *txIn, const Amount feeDeltaIn,
+                             MemPoolPrevalidateResult *resultIn)
+        : params(paramsIn), tx(txIn), feeDelta(feeDeltaIn), result(resultIn) {}
+
+    bool operator()() {
+        // Whatever fails here is left to AcceptToMemoryPool() to report, so
+        // never abort the checks of the other transactions.
+        CValidationState state;
+        std::string reason;
+        if (!CheckRegularTransaction(*tx, state) ||
+            (fRequireStandard &&
+             !IsStandardTx(*tx, reason, params->scriptVerifyFlags)) ||
+            !params->view->HaveInputs(*tx)) {
+            return true;
+        }
+        Amount nFees = Amount::zero();
+        if (!Consensus::CheckTxInputs(*tx, state, *params->view,
+                                      params->nSpendHeight, nFees)) {
+            return true;
+        }
+        if (params->fCheckFees) {
+            // The virtual size, which the mempool minimum fee applies to, is
+            // at least the size, so these are sure to fail later anyway.
+            const Amount nModifiedFees = nFees + feeDelta;
+            const size_t nSize = tx->GetTotalSize();
+            const Amount mempoolRejectFee = params->mempoolMinFee.GetFee(nSize);
+            if (nModifiedFees < params->minRelayFee.GetFee(nSize) ||
+                (mempoolRejectFee > Amount::zero() &&
+                 nModifiedFees < mempoolRejectFee)) {
+                return true;
+            }
+        }
+        PrecomputedTransactionData txdata;
+        result->fChecked = true;
+        result->fValid =
+            RunScriptChecks(*tx, *params->view, params->scriptVerifyFlags,
+                            txdata, result->nSigChecksStandard) &&
+            RunScriptChecks(*tx, *params->view,
+                            params->nextBlockScriptVerifyFlags, txdata,
+                            result->nSigChecksConsensus);
+        return true;
+    }
+};
+} // namespace
+
+static CCheckQueue<CMemPoolPrevalidateCheck> mempoolcheckqueue(16);
+static std::atomic<int> nMemPoolCheckThreads{0};
+
 void StartScriptCheckWorkerThreads(int threads_num) {
     scriptcheckqueue.StartWorkerThreads(threads_num);
+    coinprefetchqueue.StartWorkerThreads(threads_num, "coinpref");
+    nCoinPrefetchThreads = threads_num;
+    txconnectqueue.StartWorkerThreads(threads_num, "txcheck");
+    nTxConnectThreads = threads_num;
+    mempoolcheckqueue.StartWorkerThreads(threads_num, "mempchk");
+    nMemPoolCheckThreads = threads_num;
 }
 
 void StopScriptCheckWorkerThreads() {
+    nMemPoolCheckThreads = 0;
+    mempoolcheckqueue.StopWorkerThreads();
+    nTxConnectThreads = 0;
+    txconnectqueue.StopWorkerThreads();
+    nCoinPrefetchThreads = 0;
+    coinprefetchqueue.StopWorkerThreads();
     scriptcheckqueue.StopWorkerThreads();
 }
 
+/**
+ * Transactions whose scripts failed prevalidation, by
+ * PrevalidateFailureKey(). Unlike valid results, failures are not kept in the
+ * script execution cache, so without this every attempt to accept one again
+ * would repeat the work.
+ */
+static CRollingBloomFilter &GetPrevalidateFailures()
+    EXCLUSIVE_LOCKS_REQUIRED(cs_main) {
+    static CRollingBloomFilter filter(120000, 0.000001);
+    return filter;
+}
+
+static uint256 PrevalidateFailureKey(const CTransaction &tx,
+                                     const MemPoolPrevalidateParams &params) {
+    return (CHashWriter(SER_GETHASH, 0)
+            << tx.GetHash() << params.scriptVerifyFlags
+            << params.nextBlockScriptVerifyFlags)
+        .GetHash();
+}
+
+void PrevalidateMemPoolTransactions(const Config &config, CTxMemPool &pool,
+                                    const std::vector<CTransactionRef> &txs,
+                                    bool bypass_limits) {
+    // Without worker threads, AcceptToMemoryPool() would just repeat the work
+    // on this thread.
+    if (nMemPoolCheckThreads == 0 || txs.empty()) {
+        return;
+    }
+
+    CCoinsView dummy;
+    CCoinsViewCache view(&dummy);
+    MemPoolPrevalidateParams params;
+    params.view = &view;
+    // The transactions to prevalidate, by index into txs
+    std::vector<size_t> vIndices;
+    vIndices.reserve(txs.size());
+    std::vector<Amount> feeDeltas(txs.size(), Amount::zero());
+    {
+        // Take a snapshot of the coins the transactions spend, from the
+        // UTXO set and the mempool, and of the script flags to check them
+        // with.
+        LOCK2(cs_main, pool.cs);
+        const Consensus::Params &consensusParams =
+            config.GetChainParams().GetConsensus();
+        params.scriptVerifyFlags = GetMemPoolScriptFlags(
+            consensusParams, ::ChainActive().Tip(),
+            &params.nextBlockScriptVerifyFlags);
+        params.nSpendHeight = ::ChainActive().Height() + 1;
+        params.fCheckFees = !bypass_limits;
+        params.minRelayFee = minRelayTxFee;
+        params.mempoolMinFee = pool.GetMinFee(config.GetMaxMemPoolSize());
+
+        CCoinsViewMemPool viewMemPool(pcoinsTip.get(), pool);
+        view.SetBackend(viewMemPool);
+        // Coins pulled into pcoinsTip just for this, which are evicted again
+        // so that AcceptToMemoryPool() can keep track of them.
+        std::vector<COutPoint> coins_to_uncache;
+        for (size_t i = 0; i < txs.size(); ++i) {
+            const CTransaction &tx = *txs[i];
+            if (tx.IsCoinBase() || pool.exists(tx.GetId())) {
+                continue;
+            }
+            // Transactions prevalidated before, whether they passed or
+            // failed, are only checked again for their outputs to be
+            // available to the transactions after them. AcceptToMemoryPool()
+            // reports the failures.
+            int nSigChecksDummy;
+            const bool fCached =
+                GetPrevalidateFailures().contains(
+                    PrevalidateFailureKey(tx, params)) ||
+                (IsKeyInScriptCache(
+                     ScriptCacheKey(tx, params.scriptVerifyFlags), false,
+                     nSigChecksDummy) &&
+                 IsKeyInScriptCache(
+                     ScriptCacheKey(tx, params.nextBlockScriptVerifyFlags),
+                     false, nSigChecksDummy));
+            if (!fCached) {
+                for (const CTxIn &txin : tx.vin) {
+                    if (!pcoinsTip->HaveCoinInCache(txin.prevout)) {
+                        coins_to_uncache.push_back(txin.prevout);
+                    }
+                    view.AccessCoin(txin.prevout);
+                }
+                pool.ApplyDelta(tx.GetId(), feeDeltas[i]);
+                vIndices.push_back(i);
+            }
+            // Let transactions spend the outputs of those before them, so
+            // that chains of them can be checked together. Nothing has been
+            // checked yet, so leave out outputs that cannot be coins, which
+            // AcceptToMemoryPool() rejects anyway.
+            for (size_t j = 0; j < tx.vout.size(); ++j) {
+                if (tx.vout[j].IsNull()) {
+                    continue;
+                }
+                view.AddCoin(COutPoint(tx.GetId(), j),
+                             Coin(tx.vout[j], MEMPOOL_HEIGHT, false), true);
+            }
+        }
+        view.SetBackend(dummy);
+        for (const COutPoint &outpoint : coins_to_uncache) {
+            pcoinsTip->Uncache(outpoint);
+        }
+    }
+
+    // The workers only ever read from the cache of view, which has all the
+    // coins that exist.
+    std::vector<MemPoolPrevalidateResult> results(txs.size());
+    {
+        CCheckQueueControl<CMemPoolPrevalidateCheck> control(
+            &mempoolcheckqueue);
+        std::vector<CMemPoolPrevalidateCheck> vChecks;
+        vChecks.reserve(vIndices.size());
+        for (const size_t i : vIndices) {
+            vChecks.emplace_back(&params, txs[i].get(), feeDeltas[i],
+                                 &results[i]);
+        }
+        control.Add(vChecks);
+        control.Wait();
+    }
+
+    LOCK(cs_main);
+    size_t nValid = 0;
+    for (const size_t i : vIndices) {
+        const MemPoolPrevalidateResult &result = results[i];
+        if (!result.fValid) {
+            if (result.fChecked) {
+                GetPrevalidateFailures().insert(
+                    PrevalidateFailureKey(*txs[i], params));
+            }
+            continue;
+        }
+        // Script validity only depends on the transaction, the outputs it
+        // spends, which its inputs commit to, and the flags. So these results
+        // stay valid whatever happens to the mempool and the chain until the
+        // transactions are submitted.
+        AddKeyInScriptCache(ScriptCacheKey(*txs[i], params.scriptVerifyFlags),
+                            result.nSigChecksStandard);
+        AddKeyInScriptCache(
+            ScriptCacheKey(*txs[i], params.nextBlockScriptVerifyFlags),
+            result.nSigChecksConsensus);
+        ++nValid;
+    }
+    LogPrint(BCLog::MEMPOOL,
+             "Prevalidated the scripts of %u of %u transactions\n", nValid,
+             txs.size());
+}
+
+/**
+ * Order the indices of `txs` so that every transaction comes after those of
+ * `txs` whose outputs it spends, and otherwise in the order of `txs`.
+ */
+static std::vector<size_t>
+SortTopologically(const std::vector<CTransactionRef> &txs) {
+    std::unordered_map<TxId, size_t, SaltedTxIdHasher> mapIndex;
+    mapIndex.reserve(txs.size());
+    for (size_t i = 0; i < txs.size(); ++i) {
+        mapIndex.emplace(txs[i]->GetId(), i);
+    }
+
+    // The transactions of txs that spend the outputs of each, and the number
+    // of transactions of txs each waits for.
+    std::vector<std::vector<size_t>> vChildren(txs.size());
+    std::vector<size_t> vParents(txs.size(), 0);
+    for (size_t i = 0; i < txs.size(); ++i) {
+        std::unordered_set<size_t> setParents;
+        for (const CTxIn &txin : txs[i]->vin) {
+            const auto it = mapIndex.find(txin.prevout.GetTxId());
+            if (it != mapIndex.end() && it->second != i &&
+                setParents.insert(it->second).second) {
+                vChildren[it->second].push_back(i);
+                ++vParents[i];
+            }
+        }
+    }
+
+    std::priority_queue<size_t, std::vector<size_t>, std::greater<size_t>>
+        ready;
+    for (size_t i = 0; i < txs.size(); ++i) {
+        if (vParents[i] == 0) {
+            ready.push(i);
+        }
+    }
+    std::vector<size_t> vOrder;
+    vOrder.reserve(txs.size());
+    while (!ready.empty()) {
+        const size_t i = ready.top();
+        ready.pop();
+        vOrder.push_back(i);
+        for (const size_t child : vChildren[i]) {
+            if (--vParents[child] == 0) {
+                ready.push(child);
+            }
+        }
+    }
+    // Transactions have no cycles, as they would have to commit to the ids
+    // of each other.
+    assert(vOrder.size() == txs.size());
+    return vOrder;
+}
+
+std::vector<MemPoolAcceptResult>
+AcceptToMemoryPoolBatch(const Config &config, CTxMemPool &pool,
+                        const std::vector<CTransactionRef> &txs,
+                        const std::vector<int64_t> &acceptTimes,
+                        bool bypass_limits, const Amount nAbsurdFee) {
+    assert(acceptTimes.empty() || acceptTimes.size() == txs.size());
+    std::vector<MemPoolAcceptResult> results(txs.size());
+    if (txs.empty()) {
+        return results;
+    }
+    const std::vector<size_t> vOrder = SortTopologically(txs);
+    const int64_t nNow = GetTime();
+
+    size_t nAccepted = 0;
+    for (size_t nStart = 0; nStart < vOrder.size();
+         nStart += MEMPOOL_BATCH_SIZE) {
+        const size_t nEnd =
+            std::min(nStart + MEMPOOL_BATCH_SIZE, vOrder.size());
+        std::vector<CTransactionRef> vBatch;
+        vBatch.reserve(nEnd - nStart);
+        for (size_t n = nStart; n < nEnd; ++n) {
+            vBatch.push_back(txs[vOrder[n]]);
+        }
+
+        PrevalidateMemPoolTransactions(config, pool, vBatch, bypass_limits);
+
+        LOCK(cs_main);
+        for (size_t n = nStart; n < nEnd; ++n) {
+            const size_t i = vOrder[n];
+            MemPoolAcceptResult &result = results[i];
+            std::vector<COutPoint> coins_to_uncache;
+            result.fAccepted = AcceptToMemoryPoolWorker(
+                config, pool, result.state, txs[i], &result.fMissingInputs,
+                acceptTimes.empty() ? nNow : acceptTimes[i], bypass_limits,
+                nAbsurdFee, coins_to_uncache, false /* test_accept */);
+            if (result.fAccepted) {
+                ++nAccepted;
+            } else {
+                for (const COutPoint &outpoint : coins_to_uncache) {
+                    pcoinsTip->Uncache(outpoint);
+                }
+            }
+        }
+
+        // After we've (potentially) uncached entries, ensure our coins cache
+        // is still within its size limits
+        CValidationState stateDummy;
+        FlushStateToDisk(config.GetChainParams(), stateDummy,
+                         FlushStateMode::PERIODIC);
+    }
+    LogPrint(BCLog::MEMPOOL, "Accepted %u of a batch of %u transactions\n",
+             nAccepted, txs.size());
+    return results;
+}
+
+/**
+ * Check phase of a parallel ConnectBlock(): run CheckTxForConnect() for all
+ * transactions of `block` concurrently on the transaction check worker
+ * threads, and prepare the script checks of those that miss the script
+ * execution cache.
+ *
+ * Thanks to CTOR, the validity of a spend does not depend on where the
+ * spending transaction sits in the block, so every transaction can be checked
+ * against the view as it is after the block's outputs were added and before
+ * any of its inputs were spent. The only thing this cannot catch is two
+ * transactions spending the same coin, which ConnectBlock() detects when
+ * applying them in order.
+ *
+ * All inputs are first pulled into `view` on this thread, so that the workers
+ * only ever read from its cache and never modify it.
+ */
+static void CheckBlockTransactionsParallel(
+    const CBlock &block, const TxConnectParams &params, bool fScriptChecks,
+    std::vector<TxSigCheckLimiter> &txLimiters,
+    std::vector<TxConnectResult> &results) EXCLUSIVE_LOCKS_REQUIRED(cs_main) {
+    AssertLockHeld(cs_main);
+    assert(results.size() == block.vtx.size());
+
+    for (const auto &ptx : block.vtx) {
+        if (ptx->IsCoinBase()) {
+            continue;
+        }
+        for (const CTxIn &txin : ptx->vin) {
+            params.view->AccessCoin(txin.prevout);
+        }
+    }
+
+    std::vector<CTxConnectCheck> vChecks;
+    vChecks.reserve(block.vtx.size());
+    for (size_t i = 0; i < block.vtx.size(); ++i) {
+        const CTransaction &tx = *block.vtx[i];
+        TxConnectResult &result = results[i];
+        TxSigCheckLimiter *pTxLimitSigChecks = nullptr;
+        if (fScriptChecks && !tx.IsCoinBase()) {
+            // The script execution cache requires cs_main, so it is looked up
+            // here rather than on the workers.
+            result.fScriptCacheChecked = true;
+            result.fScriptCacheHit = IsKeyInScriptCache(
+                ScriptCacheKey(tx, params.flags), !params.fCacheResults,
+                result.nCachedSigChecks);
+            if (!result.fScriptCacheHit) {
+                pTxLimitSigChecks = &txLimiters.at(i - 1);
+            }
+        }
+        vChecks.emplace_back(&params, &tx, &result, pTxLimitSigChecks);
+    }
+
+    CCheckQueueControl<CTxConnectCheck> control(&txconnectqueue);
+    control.Add(vChecks);
+    control.Wait();
+}
+
+/**
+ * Warm `cache` with the coins spent by `block`, looking up every outpoint
+ * missing from it concurrently on the coin prefetch worker threads.
+ *
+ * Thanks to CTOR the complete set of outpoints a block spends is known before
+ * it is connected, so the serial database reads ConnectBlock() would
+ * otherwise do one by one on a cold cache can all be issued up front.
+ * Outpoints created by the block itself are skipped. This is purely an
+ * optimization: ConnectBlock() behaves identically whether or not it ran.
+ */
+static void PrefetchBlockInputs(const CBlock &block, CCoinsViewCache &cache)
+    EXCLUSIVE_LOCKS_REQUIRED(cs_main) {
+    AssertLockHeld(cs_main);
+    if (!fPrefetchBlockInputs || nCoinPrefetchThreads == 0 ||
+        block.vtx.size() < 2) {
+        return;
+    }
+
+    const int64_t nTimeStart = GetTimeMicros();
+
+    std::unordered_set<TxId, SaltedTxIdHasher> blockTxIds;
+    blockTxIds.reserve(block.vtx.size());
+    for (const auto &ptx : block.vtx) {
+        blockTxIds.insert(ptx->GetId());
+    }
+
+    std::vector<COutPoint> outpoints;
+    for (const auto &ptx : block.vtx) {
+        if (ptx->IsCoinBase()) {
+            continue;
+        }
+        for (const CTxIn &txin : ptx->vin) {
+            if (blockTxIds.count(txin.prevout.GetTxId()) ||
+                cache.HaveCoinInCache(txin.prevout)) {
+                continue;
+            }
+            outpoints.push_back(txin.prevout);
+        }
+    }
+    if (outpoints.empty()) {
+        return;
+    }
+
+    // The cache itself is not thread-safe, so the lookups go to its backing
+    // view (the coins database), and the results are inserted afterwards.
+    const CCoinsView *backend = cache.GetBackend();
+    std::vector<Coin> coins(outpoints.size());
+    std::vector<uint8_t> found(outpoints.size(), false);
+    {
+        std::vector<CCoinsPrefetchCheck> vChecks;
+        vChecks.reserve(outpoints.size());
+        for (size_t i = 0; i < outpoints.size(); ++i) {
+            vChecks.emplace_back(backend, &outpoints[i], &coins[i], &found[i]);
+        }
+        CCheckQueueControl<CCoinsPrefetchCheck> control(&coinprefetchqueue);
+        control.Add(vChecks);
+        control.Wait();
+    }
+
+    size_t nFound = 0;
+    for (size_t i = 0; i < outpoints.size(); ++i) {
+        if (found[i]) {
+            cache.EmplaceFetchedCoin(outpoints[i], std::move(coins[i]));
+            ++nFound;
+        }
+    }
+
+    LogPrint(BCLog::BENCH,
+             "  - Prefetch %u/%u inputs: %.2fms\n", nFound, outpoints.size(),
+             (GetTimeMicros() - nTimeStart) * MILLI);
+}
+
 int32_t ComputeBlockVersion(const CBlockIndex *pindexPrev,
                             const Consensus::Params &params) {
     return VERSIONBITS_TOP_BITS;
@@ -1739,7 +2473,6 @@ bool CChainState::ConnectBlock(const CBlock &block, CValidationState &state,
              MILLI * (nTime2 - nTime1), nTimeForks * MICRO,
              nTimeForks * MILLI / nBlocksTotal);
 
-    std::vector<int> prevheights;
     Amount nFees = Amount::zero();
     int nInputs = 0;
 
@@ -1753,6 +2486,16 @@ bool CChainState::ConnectBlock(const CBlock &block, CValidationState &state,
     std::vector<TxSigCheckLimiter> nSigChecksTxLimiters;
     nSigChecksTxLimiters.resize(block.vtx.size() - 1);
 
+    const bool fEnforceSigCheck = flags & SCRIPT_ENFORCE_SIGCHECKS;
+    if (!fEnforceSigCheck) {
+        // Historically, there has been transactions with a very high
+        // sigcheck count, so we need to disable this check for such
+        // transactions.
+        for (auto &txLimiter : nSigChecksTxLimiters) {
+            txLimiter = TxSigCheckLimiter::getDisabled();
+        }
+    }
+
     CBlockUndo blockundo;
     blockundo.vtxundo.resize(block.vtx.size() - 1);
 
@@ -1787,19 +2530,46 @@ bool CChainState::ConnectBlock(const CBlock &block, CValidationState &state,
         firstTokenBlockHeight = std::numeric_limits<int64_t>::max();
     }
 
+    // Don't cache results if we're actually connecting blocks (still consult
+    // the cache, though).
+    const bool fCacheResults = fJustCheck;
+
+    const TxConnectParams txParams{&view,
+                                   pindex,
+                                   nLockTimeFlags,
+                                   flags,
+                                   firstTokenBlockHeight,
+                                   fCacheResults,
+                                   &nSigChecksBlockLimiter};
+    std::vector<TxConnectResult> txResults(block.vtx.size());
+    if (fParallelConnect && nTxConnectThreads > 0 && block.vtx.size() > 2) {
+        CheckBlockTransactionsParallel(block, txParams, fScriptChecks,
+                                       nSigChecksTxLimiters, txResults);
+    }
+
     size_t txIndex = 0;
-    for (const auto &ptx : block.vtx) {
-        const CTransaction &tx = *ptx;
+    for (size_t i = 0; i < block.vtx.size(); ++i) {
+        const CTransaction &tx = *block.vtx[i];
         const bool isCoinBase = tx.IsCoinBase();
         nInputs += tx.vin.size();
 
-        Amount txfee = Amount::zero();
-        if (!isCoinBase && !Consensus::CheckTxInputs(tx, state, view,
-                                                     pindex->nHeight, txfee)) {
+        // A transaction checked in parallel was checked against the view as
+        // it was before any of the block's inputs got spent, so its result
+        // only stands if none of its inputs was spent by a transaction
+        // applied since. Otherwise, or if it was not checked at all, check it
+        // now against the current view.
+        TxConnectResult &result = txResults[i];
+        if (result.stage == TxConnectResult::Stage::UNCHECKED ||
+            (!isCoinBase && !view.HaveInputs(tx))) {
+            CheckTxForConnect(tx, txParams, result);
+        }
+
+        if (result.stage == TxConnectResult::Stage::INPUTS) {
+            state = result.state;
             return error("%s: Consensus::CheckTxInputs: %s, %s", __func__,
                          tx.GetId().ToString(), FormatStateMessage(state));
         }
-        nFees += txfee;
+        nFees += result.txfee;
         if (!MoneyRange(nFees)) {
             return state.DoS(
                 100,
@@ -1809,10 +2579,9 @@ bool CChainState::ConnectBlock(const CBlock &block, CValidationState &state,
         }
 
         // Check token spends are within consensus
-        // Note: we pass coinbase txn here too, which is what we want, since coinbase txn should have NO token data
-        // post-activation of Upgrade9, and this function checks that requirement.
-        if ( ! CheckTxTokens(tx, state, view, flags, firstTokenBlockHeight)) {
+        if (result.stage == TxConnectResult::Stage::TOKENS) {
             // State was filled-in by CheckTxTokens
+            state = result.state;
             return false;
         }
 
@@ -1821,41 +2590,41 @@ bool CChainState::ConnectBlock(const CBlock &block, CValidationState &state,
             continue;
         }
 
-        // Check that transaction is BIP68 final BIP68 lock checks (as
-        // opposed to nLockTime checks) must be in ConnectBlock because they
-        // require the UTXO set.
-        prevheights.resize(tx.vin.size());
-        for (size_t j = 0; j < tx.vin.size(); j++) {
-            prevheights[j] = view.AccessCoin(tx.vin[j].prevout).GetHeight();
-        }
-
-        if (!SequenceLocks(tx, nLockTimeFlags, &prevheights, *pindex)) {
+        // Check that transaction is BIP68 final.
+        if (result.stage == TxConnectResult::Stage::SEQUENCE_LOCKS) {
             return state.DoS(
                 100,
                 error("%s: contains a non-BIP68-final transaction", __func__),
                 REJECT_INVALID, "bad-txns-nonfinal");
         }
-
-        // Don't cache results if we're actually connecting blocks (still
-        // consult the cache, though).
-        bool fCacheResults = fJustCheck;
-
-        const bool fEnforceSigCheck = flags & SCRIPT_ENFORCE_SIGCHECKS;
-        if (!fEnforceSigCheck) {
-            // Historically, there has been transactions with a very high
-            // sigcheck count, so we need to disable this check for such
-            // transactions.
-            nSigChecksTxLimiters[txIndex] = TxSigCheckLimiter::getDisabled();
-        }
+        assert(result.stage == TxConnectResult::Stage::OK);
 
         std::vector<CScriptCheck> vChecks;
-        // nSigChecksRet may be accurate (found in cache) or 0 (checks were
-        // deferred into vChecks).
-        int nSigChecksRet;
-        PrecomputedTransactionData txdata; // starts out unpopulated, will be calculated for us in CheckInputs
-        if (!CheckInputs(tx, state, view, fScriptChecks, flags, fCacheResults,
-                         fCacheResults, txdata, nSigChecksRet, nSigChecksTxLimiters[txIndex],
-                         &nSigChecksBlockLimiter, &vChecks)) {
+        bool fInputsOk = true;
+        if (result.fScriptChecksPrepared) {
+            vChecks = std::move(result.vChecks);
+        } else if (result.fScriptCacheHit) {
+            // Same accounting as CheckInputs() does on a script execution
+            // cache hit.
+            if (!nSigChecksTxLimiters[txIndex].consume_and_check(
+                    result.nCachedSigChecks) ||
+                !nSigChecksBlockLimiter.consume_and_check(
+                    result.nCachedSigChecks)) {
+                fInputsOk = state.Invalid(false, REJECT_NONSTANDARD,
+                                          strprintf("too-many-sigchecks"));
+            }
+        } else {
+            // nSigChecksRet may be accurate (found in cache) or 0 (checks were
+            // deferred into vChecks).
+            int nSigChecksRet;
+            PrecomputedTransactionData txdata; // starts out unpopulated, will be calculated for us in CheckInputs
+            fInputsOk = CheckInputs(tx, state, view, fScriptChecks, flags,
+                                    fCacheResults, fCacheResults, txdata,
+                                    nSigChecksRet,
+                                    nSigChecksTxLimiters[txIndex],
+                                    &nSigChecksBlockLimiter, &vChecks);
+        }
+        if (!fInputsOk) {
             // Parallel CheckInputs shouldn't fail except for this reason, which
             // is banworthy. Use "blk-bad-inputs" to mimic the parallel script
             // check error.
@@ -1869,11 +2638,11 @@ bool CChainState::ConnectBlock(const CBlock &block, CValidationState &state,
 
         control.Add(vChecks);
 
-        // Note: this must execute in the same iteration as CheckTxInputs (not
-        // in a separate loop) in order to detect double spends. However,
-        // this does not prevent double-spending by duplicated transaction
-        // inputs in the same transaction (cf. CVE-2018-17144) -- that check is
-        // done in CheckBlock (CheckRegularTransaction).
+        // Note: this must execute in the same iteration as the HaveInputs
+        // check above (not in a separate loop) in order to detect double
+        // spends. However, this does not prevent double-spending by duplicated
+        // transaction inputs in the same transaction (cf. CVE-2018-17144) --
+        // that check is done in CheckBlock (CheckRegularTransaction).
         SpendCoins(view, tx, blockundo.vtxundo.at(txIndex), pindex->nHeight);
         txIndex++;
     }
@@ -2060,8 +2829,14 @@ static bool FlushStateToDisk(const CChainParams &chainparams,
                     }
                 }
 
-                // Finally remove any pruned files
+                // Finally remove any pruned files. A coins database write
+                // still running in the background may need to be replayed from
+                // these blocks if interrupted, so let it complete first.
                 if (fFlushForPrune) {
+                    if (pcoinsdbview && !pcoinsdbview->WaitForPendingWrite()) {
+                        return AbortNode(state,
+                                         "Failed to write to coin database");
+                    }
                     UnlinkPrunedFiles(setFilesToPrune);
                 }
                 nLastWrite = nNow;
@@ -2473,6 +3248,7 @@ bool CChainState::ConnectTip(const Config &config, CValidationState &state,
     LogPrint(BCLog::BENCH, "  - Load block from disk: %.2fms [%.2fs]\n",
              (nTime2 - nTime1) * MILLI, nTimeReadFromDisk * MICRO);
     {
+        PrefetchBlockInputs(blockConnecting, *pcoinsTip);
         CCoinsViewCache view(pcoinsTip.get());
         bool rv = ConnectBlock(blockConnecting, state, pindexNew, view, params,
                                BlockValidationOptions(config));
@@ -3443,7 +4219,16 @@ void CChainState::ReceivedBlockTransactions(const CBlock &block,
     pindexNew->nStatus = pindexNew->nStatus.withData();
     pindexNew->RaiseValidity(BlockValidity::TRANSACTIONS);
     setDirtyBlockIndex.insert(pindexNew);
+    LinkBlockTransactions(pindexNew);
+}
 
+/**
+ * Count the transactions of pindexNew, whose own transactions have been
+ * received, and of its descendants that were waiting for it, into nChainTx if
+ * those of all of its ancestors have been received as well. Otherwise, have it
+ * wait for its parent.
+ */
+void CChainState::LinkBlockTransactions(CBlockIndex *pindexNew) {
     if (pindexNew->pprev == nullptr || pindexNew->pprev->HaveTxsDownloaded()) {
         // If pindexNew is the genesis block or all parents are
         // BLOCK_VALID_TRANSACTIONS.
@@ -4999,6 +5784,72 @@ bool ReplayBlocks(const Consensus::Params &params, CCoinsView *view) {
     return g_chainstate.ReplayBlocks(params, view);
 }
 
+bool CChainState::AssumeSnapshotChain(const Config &config,
+                                      const std::vector<SnapshotBlock> &blocks,
+                                      uint64_t nChainTx,
+                                      CValidationState &state) {
+    AssertLockHeld(cs_main);
+    const Consensus::Params &params = config.GetChainParams().GetConsensus();
+
+    CBlockIndex *pindexBase = LookupBlockIndex(params.hashGenesisBlock);
+    if (!pindexBase) {
+        return error("%s: genesis block not loaded", __func__);
+    }
+    for (const SnapshotBlock &block : blocks) {
+        if (!AcceptBlockHeader(config, block.header, state, &pindexBase)) {
+            return error("%s: AcceptBlockHeader failed (%s)", __func__,
+                         FormatStateMessage(state));
+        }
+    }
+
+    // The blocks whose transactions were never received are assumed to be
+    // valid, and are treated as pruned from then on.
+    std::vector<CBlockIndex *> vAssumed;
+    for (CBlockIndex *pindex = pindexBase;
+         pindex && !pindex->HaveTxsDownloaded(); pindex = pindex->pprev) {
+        vAssumed.push_back(pindex);
+    }
+    for (auto it = vAssumed.rbegin(); it != vAssumed.rend(); ++it) {
+        CBlockIndex *pindex = *it;
+        if (pindex->nTx == 0) {
+            // Only the total is known, so the base block gets what the
+            // unknown blocks before it do not account for.
+            const uint64_t nPrevChainTx =
+                pindex->pprev ? pindex->pprev->nChainTx : 0;
+            pindex->nTx =
+                pindex == pindexBase && nChainTx > nPrevChainTx + 1
+                    ? std::min<uint64_t>(nChainTx - nPrevChainTx,
+                                         std::numeric_limits<unsigned int>::max())
+                    : 1;
+        }
+        pindex->RaiseValidity(BlockValidity::SCRIPTS);
+        if (!pindex->GetAblaStateOpt() && pindex->nHeight > 0) {
+            pindex->SetAblaStateOpt(blocks[pindex->nHeight - 1].ablaState);
+        }
+        setDirtyBlockIndex.insert(pindex);
+        LinkBlockTransactions(pindex);
+    }
+
+    if (!vAssumed.empty()) {
+        LogPrintf("%s: assumed %u blocks up to %s (%d) to be valid\n",
+                  __func__, vAssumed.size(),
+                  pindexBase->GetBlockHash().ToString(), pindexBase->nHeight);
+        if (!fHavePruned) {
+            pblocktree->WriteFlag("prunedblockfiles", true);
+            fHavePruned = true;
+        }
+    }
+
+    // The snapshot must not be reorganized away from.
+    return FinalizeBlockInternal(config, state, pindexBase);
+}
+
+bool AssumeSnapshotChain(const Config &config,
+                         const std::vector<SnapshotBlock> &blocks,
+                         uint64_t nChainTx, CValidationState &state) {
+    return g_chainstate.AssumeSnapshotChain(config, blocks, nChainTx, state);
+}
+
 // May NOT be used after any connections are up as much of the peer-processing
 // logic assumes a consistent block index state
 void CChainState::UnloadBlockIndex() {
@@ -5098,16 +5949,26 @@ bool LoadGenesisBlock(const CChainParams &chainparams) {
     return g_chainstate.LoadGenesisBlock(chainparams);
 }
 
-void LoadExternalBlockFile(const Config &config, FILE *fileIn,
-                           FlatFilePos *dbp) {
-    // Map of disk positions for blocks with unknown parent (only used for
-    // reindex)
-    static std::multimap<uint256, FlatFilePos> mapBlocksUnknownParent;
-    int64_t nStart = GetTimeMillis();
-
-    const CChainParams &chainparams = config.GetChainParams();
+namespace {
+/** A block found in a block file by ScanBlockFile(). */
+struct ScannedBlock {
+    std::shared_ptr<CBlock> block;
+    BlockHash hash;
+    //! The position of the block in its file
+    unsigned int nPos{0};
+    //! The serialized size of the block
+    unsigned int nSize{0};
+};
+} // namespace
 
-    int nLoaded = 0;
+/**
+ * Find the blocks in a block file, deserialize them and pass them to fn in the
+ * order of the file, until the end of the file, until shutdown is requested or
+ * until fn returns false. Anything that does not look like a block is skipped.
+ * This takes over fileIn and closes it.
+ */
+static void ScanBlockFile(const CChainParams &chainparams, FILE *fileIn,
+                          const std::function<bool(ScannedBlock &&)> &fn) {
     try {
         // This takes over fileIn and calls fclose() on it in the CBufferedFile
         // destructor. Make sure we have at least 2*MAX_TX_SIZE space in there
@@ -5146,102 +6007,18 @@ void LoadExternalBlockFile(const Config &config, FILE *fileIn,
 
             try {
                 // read block
-                uint64_t nBlockPos = blkdat.GetPos();
-                if (dbp) {
-                    dbp->nPos = nBlockPos;
-                }
-                blkdat.SetLimit(nBlockPos + nSize);
-                blkdat.SetPos(nBlockPos);
-                std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
-                CBlock &block = *pblock;
-                blkdat >> block;
+                ScannedBlock scanned;
+                scanned.nPos = blkdat.GetPos();
+                scanned.nSize = nSize;
+                blkdat.SetLimit(scanned.nPos + nSize);
+                blkdat.SetPos(scanned.nPos);
+                scanned.block = std::make_shared<CBlock>();
+                blkdat >> *scanned.block;
                 nRewind = blkdat.GetPos();
 
-                const BlockHash hash = block.GetHash();
-                {
-                    LOCK(cs_main);
-                    // detect out of order blocks, and store them for later
-                    if (hash != chainparams.GetConsensus().hashGenesisBlock &&
-                        !LookupBlockIndex(block.hashPrevBlock)) {
-                        LogPrint(
-                            BCLog::REINDEX,
-                            "%s: Out of order block %s, parent %s not known\n",
-                            __func__, hash.ToString(),
-                            block.hashPrevBlock.ToString());
-                        if (dbp) {
-                            mapBlocksUnknownParent.insert(
-                                std::make_pair(block.hashPrevBlock, *dbp));
-                        }
-                        continue;
-                    }
-
-                    // process in case the block isn't known yet
-                    CBlockIndex *pindex = LookupBlockIndex(hash);
-                    if (!pindex || !pindex->nStatus.hasData()) {
-                        CValidationState state;
-                        if (g_chainstate.AcceptBlock(config, pblock, state,
-                                                     true, dbp, nullptr)) {
-                            nLoaded++;
-                        }
-                        if (state.IsError()) {
-                            break;
-                        }
-                    } else if (hash != chainparams.GetConsensus()
-                                           .hashGenesisBlock &&
-                               pindex->nHeight % 1000 == 0) {
-                        LogPrint(
-                            BCLog::REINDEX,
-                            "Block Import: already had block %s at height %d\n",
-                            hash.ToString(), pindex->nHeight);
-                    }
-                }
-
-                // Activate the genesis block so normal node progress can
-                // continue
-                if (hash == chainparams.GetConsensus().hashGenesisBlock) {
-                    CValidationState state;
-                    if (!ActivateBestChain(config, state)) {
-                        break;
-                    }
-                }
-
-                NotifyHeaderTip();
-
-                // Recursively process earlier encountered successors of this
-                // block
-                std::deque<uint256> queue;
-                queue.push_back(hash);
-                while (!queue.empty()) {
-                    uint256 head = queue.front();
-                    queue.pop_front();
-                    std::pair<std::multimap<uint256, FlatFilePos>::iterator,
-                              std::multimap<uint256, FlatFilePos>::iterator>
-                        range = mapBlocksUnknownParent.equal_range(head);
-                    while (range.first != range.second) {
-                        std::multimap<uint256, FlatFilePos>::iterator it =
-                            range.first;
-                        std::shared_ptr<CBlock> pblockrecursive =
-                            std::make_shared<CBlock>();
-                        if (ReadBlockFromDisk(*pblockrecursive, it->second,
-                                              chainparams.GetConsensus())) {
-                            LogPrint(
-                                BCLog::REINDEX,
-                                "%s: Processing out of order child %s of %s\n",
-                                __func__, pblockrecursive->GetHash().ToString(),
-                                head.ToString());
-                            LOCK(cs_main);
-                            CValidationState dummy;
-                            if (g_chainstate.AcceptBlock(
-                                    config, pblockrecursive, dummy, true,
-                                    &it->second, nullptr)) {
-                                nLoaded++;
-                                queue.push_back(pblockrecursive->GetHash());
-                            }
-                        }
-                        range.first++;
-                        mapBlocksUnknownParent.erase(it);
-                        NotifyHeaderTip();
-                    }
+                scanned.hash = scanned.block->GetHash();
+                if (!fn(std::move(scanned))) {
+                    break;
                 }
             } catch (const std::exception &e) {
                 LogPrintf("%s: Deserialize or I/O error - %s\n", __func__,
@@ -5251,6 +6028,121 @@ void LoadExternalBlockFile(const Config &config, FILE *fileIn,
     } catch (const std::runtime_error &e) {
         AbortNode(std::string("System error: ") + e.what());
     }
+}
+
+// Map of disk positions for blocks with unknown parent (only used for reindex)
+static std::multimap<uint256, FlatFilePos> mapBlocksUnknownParent;
+
+/**
+ * Import a block found by ScanBlockFile() at dbp, if not null, into the block
+ * index, along with any of its descendants that were found before it.
+ * Returns false if the rest of the file should be skipped.
+ */
+static bool ImportScannedBlock(const Config &config,
+                               const ScannedBlock &scanned, FlatFilePos *dbp,
+                               int &nLoaded) {
+    const CChainParams &chainparams = config.GetChainParams();
+    const std::shared_ptr<CBlock> &pblock = scanned.block;
+    const CBlock &block = *pblock;
+    const BlockHash &hash = scanned.hash;
+    {
+        LOCK(cs_main);
+        // detect out of order blocks, and store them for later
+        if (hash != chainparams.GetConsensus().hashGenesisBlock &&
+            !LookupBlockIndex(block.hashPrevBlock)) {
+            LogPrint(BCLog::REINDEX,
+                     "%s: Out of order block %s, parent %s not known\n",
+                     __func__, hash.ToString(),
+                     block.hashPrevBlock.ToString());
+            if (dbp) {
+                mapBlocksUnknownParent.insert(
+                    std::make_pair(block.hashPrevBlock, *dbp));
+            }
+            return true;
+        }
+
+        // process in case the block isn't known yet
+        CBlockIndex *pindex = LookupBlockIndex(hash);
+        if (!pindex || !pindex->nStatus.hasData()) {
+            CValidationState state;
+            if (g_chainstate.AcceptBlock(config, pblock, state, true, dbp,
+                                         nullptr)) {
+                nLoaded++;
+            }
+            if (state.IsError()) {
+                return false;
+            }
+        } else if (hash != chainparams.GetConsensus().hashGenesisBlock &&
+                   pindex->nHeight % 1000 == 0) {
+            LogPrint(BCLog::REINDEX,
+                     "Block Import: already had block %s at height %d\n",
+                     hash.ToString(), pindex->nHeight);
+        }
+    }
+
+    // Activate the genesis block so normal node progress can continue
+    if (hash == chainparams.GetConsensus().hashGenesisBlock) {
+        CValidationState state;
+        if (!ActivateBestChain(config, state)) {
+            return false;
+        }
+    }
+
+    NotifyHeaderTip();
+
+    // Recursively process earlier encountered successors of this block
+    std::deque<uint256> queue;
+    queue.push_back(hash);
+    while (!queue.empty()) {
+        uint256 head = queue.front();
+        queue.pop_front();
+        std::pair<std::multimap<uint256, FlatFilePos>::iterator,
+                  std::multimap<uint256, FlatFilePos>::iterator>
+            range = mapBlocksUnknownParent.equal_range(head);
+        while (range.first != range.second) {
+            std::multimap<uint256, FlatFilePos>::iterator it = range.first;
+            std::shared_ptr<CBlock> pblockrecursive =
+                std::make_shared<CBlock>();
+            if (ReadBlockFromDisk(*pblockrecursive, it->second,
+                                  chainparams.GetConsensus())) {
+                LogPrint(BCLog::REINDEX,
+                         "%s: Processing out of order child %s of %s\n",
+                         __func__, pblockrecursive->GetHash().ToString(),
+                         head.ToString());
+                LOCK(cs_main);
+                CValidationState dummy;
+                if (g_chainstate.AcceptBlock(config, pblockrecursive, dummy,
+                                             true, &it->second, nullptr)) {
+                    nLoaded++;
+                    queue.push_back(pblockrecursive->GetHash());
+                }
+            }
+            range.first++;
+            mapBlocksUnknownParent.erase(it);
+            NotifyHeaderTip();
+        }
+    }
+    return true;
+}
+
+void LoadExternalBlockFile(const Config &config, FILE *fileIn,
+                           FlatFilePos *dbp) {
+    int64_t nStart = GetTimeMillis();
+    int nLoaded = 0;
+    ScanBlockFile(config.GetChainParams(), fileIn,
+                  [&](ScannedBlock &&scanned) {
+                      if (dbp) {
+                          dbp->nPos = scanned.nPos;
+                      }
+                      try {
+                          return ImportScannedBlock(config, scanned, dbp,
+                                                    nLoaded);
+                      } catch (const std::exception &e) {
+                          LogPrintf("%s: Deserialize or I/O error - %s\n",
+                                    __func__, e.what());
+                          return true;
+                      }
+                  });
 
     if (nLoaded > 0) {
         LogPrintf("Loaded %i blocks from external file in %dms\n", nLoaded,
@@ -5258,6 +6150,222 @@ void LoadExternalBlockFile(const Config &config, FILE *fileIn,
     }
 }
 
+namespace {
+/**
+ * Hands the blocks that the threads of ReindexBlockFiles() find in the block
+ * files over to the thread importing them, in the order of the files. The
+ * blocks of the file being imported are passed on as they are found. Those of
+ * later files are held back until it is their file's turn, up to a total
+ * serialized size of MAX_REINDEX_BUFFER_SIZE, beyond which scanning them
+ * waits.
+ */
+class BlockFileReorderBuffer {
+    struct File {
+        std::deque<ScannedBlock> blocks;
+        //! Whether the file exists
+        bool fExists{false};
+        //! Whether all blocks of the file have been added
+        bool fDone{false};
+    };
+
+    Mutex cs;
+    std::condition_variable cond;
+    //! The files being scanned or waiting to be imported
+    std::map<int, File> files GUARDED_BY(cs);
+    //! The file being imported
+    int nImporting GUARDED_BY(cs){0};
+    //! The next file to be scanned
+    int nNextScan GUARDED_BY(cs){0};
+    //! Whether a missing file was found, so no further files are scanned
+    bool fLastFile GUARDED_BY(cs){false};
+    bool fStop GUARDED_BY(cs){false};
+    //! The total serialized size of the blocks in files
+    size_t nBuffered GUARDED_BY(cs){0};
+
+public:
+    //! Get the next file to scan. Returns false if there are none left.
+    bool ClaimFile(int &nFile) LOCKS_EXCLUDED(cs) {
+        LOCK(cs);
+        if (fStop || fLastFile) {
+            return false;
+        }
+        nFile = nNextScan++;
+        return true;
+    }
+
+    //! Start adding the blocks of nFile, which may not exist.
+    void StartFile(int nFile, bool fExists) LOCKS_EXCLUDED(cs) {
+        LOCK(cs);
+        File &file = files[nFile];
+        file.fExists = fExists;
+        file.fDone = !fExists;
+        fLastFile |= !fExists;
+        cond.notify_all();
+    }
+
+    //! Add a block of nFile. Returns false if the import stopped.
+    bool AddBlock(int nFile, ScannedBlock &&block)
+        LOCKS_EXCLUDED(cs) {
+        WAIT_LOCK(cs, lock);
+        // Never hold back the file being imported, and never hold back a block
+        // just because it is large on its own.
+        cond.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(cs) {
+            return fStop || nFile == nImporting || nBuffered == 0 ||
+                   nBuffered + block.nSize <= MAX_REINDEX_BUFFER_SIZE;
+        });
+        if (fStop) {
+            return false;
+        }
+        nBuffered += block.nSize;
+        files[nFile].blocks.push_back(std::move(block));
+        cond.notify_all();
+        return true;
+    }
+
+    //! Mark all blocks of nFile as added.
+    void FinishFile(int nFile) LOCKS_EXCLUDED(cs) {
+        LOCK(cs);
+        files[nFile].fDone = true;
+        cond.notify_all();
+    }
+
+    //! Wait until nFile is being scanned. Returns false if it does not exist
+    //! or if the import stopped.
+    bool WaitForFile(int nFile) LOCKS_EXCLUDED(cs) {
+        WAIT_LOCK(cs, lock);
+        assert(nFile == nImporting);
+        cond.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(cs) {
+            return fStop || files.count(nFile);
+        });
+        return !fStop && files[nFile].fExists;
+    }
+
+    //! Take the next block of nFile, which is being imported. Returns false,
+    //! and moves on to the next file, once all blocks of nFile were taken.
+    bool TakeBlock(int nFile, ScannedBlock &block)
+        LOCKS_EXCLUDED(cs) {
+        WAIT_LOCK(cs, lock);
+        assert(nFile == nImporting);
+        File &file = files[nFile];
+        cond.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(cs) {
+            return fStop || !file.blocks.empty() || file.fDone;
+        });
+        if (fStop || file.blocks.empty()) {
+            files.erase(nFile);
+            nImporting = nFile + 1;
+            cond.notify_all();
+            return false;
+        }
+        block = std::move(file.blocks.front());
+        file.blocks.pop_front();
+        nBuffered -= block.nSize;
+        cond.notify_all();
+        return true;
+    }
+
+    //! Stop scanning and importing.
+    void Stop() LOCKS_EXCLUDED(cs) {
+        LOCK(cs);
+        fStop = true;
+        cond.notify_all();
+    }
+};
+} // namespace
+
+void ReindexBlockFiles(const Config &config) {
+    const CChainParams &chainparams = config.GetChainParams();
+    int nThreads = gArgs.GetArg("-reindexthreads", DEFAULT_REINDEX_THREADS);
+    if (nThreads <= 0) {
+        nThreads = GetNumCores();
+    }
+    nThreads = std::clamp(nThreads, 1, MAX_REINDEX_THREADS);
+
+    if (nThreads == 1) {
+        for (int nFile = 0;; nFile++) {
+            FlatFilePos pos(nFile, 0);
+            if (!fs::exists(GetBlockPosFilename(pos))) {
+                // No block files left to reindex
+                break;
+            }
+            FILE *file = OpenBlockFile(pos, true);
+            if (!file) {
+                // This error is logged in OpenBlockFile
+                break;
+            }
+            LogPrintf("Reindexing block file blk%05u.dat...\n",
+                      (unsigned int)nFile);
+            LoadExternalBlockFile(config, file, &pos);
+        }
+        return;
+    }
+
+    LogPrintf("Reindexing with %d block file scanning threads\n", nThreads);
+    BlockFileReorderBuffer buffer;
+    std::vector<std::thread> threads;
+    for (int i = 0; i < nThreads; i++) {
+        threads.emplace_back([&, i]() {
+            util::ThreadRename(strprintf("reindex.%d", i));
+            int nFile;
+            while (buffer.ClaimFile(nFile)) {
+                FlatFilePos pos(nFile, 0);
+                FILE *file = fs::exists(GetBlockPosFilename(pos))
+                                 ? OpenBlockFile(pos, true)
+                                 : nullptr;
+                buffer.StartFile(nFile, file != nullptr);
+                if (!file) {
+                    break;
+                }
+                ScanBlockFile(chainparams, file, [&](ScannedBlock &&scanned) {
+                    // The checks that do not depend on the chain are the bulk
+                    // of the work of accepting a block, so get them out of
+                    // the way here. If they fail, the importing thread
+                    // repeats them to handle the failure.
+                    CValidationState state;
+                    CheckBlock(*scanned.block, state,
+                               chainparams.GetConsensus(),
+                               BlockValidationOptions(config));
+                    return buffer.AddBlock(nFile, std::move(scanned));
+                });
+                buffer.FinishFile(nFile);
+            }
+        });
+    }
+
+    for (int nFile = 0; buffer.WaitForFile(nFile); nFile++) {
+        LogPrintf("Reindexing block file blk%05u.dat...\n",
+                  (unsigned int)nFile);
+        const int64_t nStart = GetTimeMillis();
+        int nLoaded = 0;
+        bool fSkip = false;
+        FlatFilePos pos(nFile, 0);
+        ScannedBlock scanned;
+        while (buffer.TakeBlock(nFile, scanned)) {
+            if (fSkip || ShutdownRequested()) {
+                continue;
+            }
+            pos.nPos = scanned.nPos;
+            try {
+                fSkip = !ImportScannedBlock(config, scanned, &pos, nLoaded);
+            } catch (const std::exception &e) {
+                LogPrintf("%s: Deserialize or I/O error - %s\n", __func__,
+                          e.what());
+            }
+        }
+        if (nLoaded > 0) {
+            LogPrintf("Loaded %i blocks from external file in %dms\n",
+                      nLoaded, GetTimeMillis() - nStart);
+        }
+        if (ShutdownRequested()) {
+            break;
+        }
+    }
+
+    buffer.Stop();
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+}
+
 void CChainState::CheckBlockIndex(const Consensus::Params &consensusParams) {
     if (!fCheckBlockIndex) {
         return;
@@ -5267,10 +6375,10 @@ void CChainState::CheckBlockIndex(const Consensus::Params &consensusParams) {
 
     // During a reindex, we read the genesis block and call CheckBlockIndex
     // before ActivateBestChain, so we have the genesis block in mapBlockIndex
-    // but no active chain. (A few of the tests when iterating the block tree
-    // require that m_chain has been initialized.)
+    // but no active chain. The headers of a UTXO snapshot are also accepted
+    // before there is an active chain. (A few of the tests when iterating the
+    // block tree require that m_chain has been initialized.)
     if (m_chain.Height() < 0) {
-        assert(mapBlockIndex.size() <= 1);
         return;
     }
 
@@ -5576,7 +6684,29 @@ void CChainState::CheckBlockIndex(const Consensus::Params &consensusParams) {
     assert(nNodes == forward.size());
 }
 
-static const uint64_t MEMPOOL_DUMP_VERSION = 1;
+/**
+ * Version 1 of mempool.dat stores each transaction with its entry time and fee
+ * delta. Version 2 additionally stores the fee and sigchecks count the entry had
+ * in the mempool that was dumped. Both list the transactions in entry id order,
+ * so that parents always come before their children. Version 1 is written
+ * unless -persistmempoolmetadata is set, since older nodes cannot load
+ * version 2.
+ */
+static const uint64_t MEMPOOL_DUMP_VERSION_NO_METADATA = 1;
+static const uint64_t MEMPOOL_DUMP_VERSION = 2;
+
+namespace {
+/** One transaction record of mempool.dat. */
+struct MempoolDumpEntry {
+    CTransactionRef tx;
+    int64_t nTime = 0;
+    Amount nFeeDelta = Amount::zero();
+    //! The recorded fee and sigchecks, only present in version 2 files.
+    bool fHasMetadata = false;
+    Amount nFee = Amount::zero();
+    int64_t nSigChecks = 0;
+};
+} // namespace
 
 bool LoadMempool(const Config &config, CTxMemPool &pool) {
     Tic start;
@@ -5595,52 +6725,109 @@ bool LoadMempool(const Config &config, CTxMemPool &pool) {
     int64_t expired = 0;
     int64_t failed = 0;
     int64_t already_there = 0;
+    int64_t mismatched = 0;
     int64_t nNow = GetTime();
 
     try {
         uint64_t version;
         file >> version;
-        if (version != MEMPOOL_DUMP_VERSION) {
+        if (version != MEMPOOL_DUMP_VERSION_NO_METADATA &&
+            version != MEMPOOL_DUMP_VERSION) {
             return false;
         }
 
         uint64_t num;
         file >> num;
-        while (num--) {
-            CTransactionRef tx;
-            int64_t nTime;
-            int64_t nFeeDelta;
-            file >> tx;
-            file >> nTime;
-            file >> nFeeDelta;
-
-            Amount amountdelta = nFeeDelta * SATOSHI;
-            if (amountdelta != Amount::zero()) {
-                pool.PrioritiseTransaction(tx->GetId(), amountdelta);
+
+        // Reads the next batch of records. The next batch is read on another
+        // thread while the current one is being accepted; file and num are
+        // only touched by whichever thread is reading.
+        const auto readBatch = [&file, &num, version]() {
+            std::vector<MempoolDumpEntry> batch;
+            batch.reserve(std::min<uint64_t>(num, MEMPOOL_BATCH_SIZE));
+            while (num > 0 && batch.size() < MEMPOOL_BATCH_SIZE) {
+                --num;
+                MempoolDumpEntry &entry = batch.emplace_back();
+                int64_t nFeeDelta;
+                file >> entry.tx;
+                file >> entry.nTime;
+                file >> nFeeDelta;
+                entry.nFeeDelta = nFeeDelta * SATOSHI;
+                if (version >= MEMPOOL_DUMP_VERSION) {
+                    entry.fHasMetadata = true;
+                    file >> entry.nFee;
+                    file >> entry.nSigChecks;
+                }
             }
-            CValidationState state;
-            if (nTime + nExpiryTimeout > nNow) {
-                LOCK(cs_main);
-                AcceptToMemoryPoolWithTime(
-                    config, pool, state, tx, nullptr /* pfMissingInputs */,
-                    nTime, false /* bypass_limits */,
-                    Amount::zero() /* nAbsurdFee */, false /* test_accept */);
-                if (state.IsValid()) {
-                    ++count;
+            return batch;
+        };
+
+        std::vector<CTransactionRef> txs;
+        std::vector<int64_t> acceptTimes;
+        std::vector<const MempoolDumpEntry *> accepted;
+        std::future<std::vector<MempoolDumpEntry>> nextBatch =
+            std::async(std::launch::async, readBatch);
+        while (true) {
+            // Rethrows any deserialization error from the reading thread.
+            const std::vector<MempoolDumpEntry> batch = nextBatch.get();
+            if (batch.empty()) {
+                break;
+            }
+            nextBatch = std::async(std::launch::async, readBatch);
+
+            for (const MempoolDumpEntry &entry : batch) {
+                if (entry.nFeeDelta != Amount::zero()) {
+                    pool.PrioritiseTransaction(entry.tx->GetId(),
+                                               entry.nFeeDelta);
+                }
+                if (entry.nTime + nExpiryTimeout > nNow) {
+                    txs.push_back(entry.tx);
+                    acceptTimes.push_back(entry.nTime);
+                    accepted.push_back(&entry);
                 } else {
-                    // mempool may contain the transaction already, e.g. from
-                    // wallet(s) having loaded it while we were processing
-                    // mempool transactions; consider these as valid, instead of
-                    // failed, but mark them as 'already there'
-                    if (pool.exists(tx->GetId())) {
-                        ++already_there;
+                    ++expired;
+                }
+            }
+
+            // The recorded metadata is not trusted: every transaction goes
+            // through full validation, with its scripts checked in parallel,
+            // and the result is compared against what was recorded.
+            const std::vector<MemPoolAcceptResult> results =
+                AcceptToMemoryPoolBatch(config, pool, txs, acceptTimes,
+                                        false /* bypass_limits */,
+                                        Amount::zero() /* nAbsurdFee */);
+            {
+                LOCK(pool.cs);
+                for (size_t i = 0; i < txs.size(); ++i) {
+                    if (results[i].state.IsValid()) {
+                        ++count;
+                        const MempoolDumpEntry &entry = *accepted[i];
+                        if (!entry.fHasMetadata) {
+                            continue;
+                        }
+                        const auto it = pool.mapTx.find(txs[i]->GetId());
+                        if (it != pool.mapTx.end() &&
+                            (it->GetFee() != entry.nFee ||
+                             it->GetSigChecks() != entry.nSigChecks)) {
+                            ++mismatched;
+                        }
                     } else {
-                        ++failed;
+                        // mempool may contain the transaction already, e.g.
+                        // from wallet(s) having loaded it while we were
+                        // processing mempool transactions; consider these as
+                        // valid, instead of failed, but mark them as 'already
+                        // there'
+                        if (pool.exists(txs[i]->GetId())) {
+                            ++already_there;
+                        } else {
+                            ++failed;
+                        }
                     }
                 }
-            } else {
-                ++expired;
             }
+            txs.clear();
+            acceptTimes.clear();
+            accepted.clear();
 
             if (ShutdownRequested()) {
                 return false;
@@ -5660,8 +6847,10 @@ bool LoadMempool(const Config &config, CTxMemPool &pool) {
     }
 
     LogPrintf("Imported mempool transactions from disk: %i succeeded, %i "
-              "failed, %i expired, %i already there, %s msec elapsed\n",
-              count, failed, expired, already_there, start.msecStr());
+              "failed, %i expired, %i already there, %i with a different fee "
+              "or sigchecks count than recorded, %s msec elapsed\n",
+              count, failed, expired, already_there, mismatched,
+              start.msecStr());
     return true;
 }
 
@@ -5669,18 +6858,28 @@ bool DumpMempool(const CTxMemPool &pool) {
     int64_t start = GetTimeMicros();
 
     std::map<uint256, Amount> mapDeltas;
-    std::vector<TxMempoolInfo> vinfo;
+    std::vector<MempoolDumpEntry> entries;
 
     static Mutex dump_mutex;
     LOCK(dump_mutex);
 
     {
+        // Only take copies under the lock; serializing happens after it is
+        // released.
         LOCK(pool.cs);
         for (const auto &i : pool.mapDeltas) {
             mapDeltas[i.first] = i.second;
         }
 
-        vinfo = pool.infoAll();
+        entries.reserve(pool.mapTx.size());
+        for (const CTxMemPoolEntry &e : pool.mapTx.get<entry_id>()) {
+            MempoolDumpEntry &entry = entries.emplace_back();
+            entry.tx = e.GetSharedTx();
+            entry.nTime = e.GetTime();
+            entry.nFeeDelta = e.GetModifiedFee() - e.GetFee();
+            entry.nFee = e.GetFee();
+            entry.nSigChecks = e.GetSigChecks();
+        }
     }
 
     int64_t mid = GetTimeMicros();
@@ -5693,14 +6892,22 @@ bool DumpMempool(const CTxMemPool &pool) {
 
         CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
 
-        uint64_t version = MEMPOOL_DUMP_VERSION;
+        const uint64_t version =
+            gArgs.GetBoolArg("-persistmempoolmetadata",
+                             DEFAULT_PERSIST_MEMPOOL_METADATA)
+                ? MEMPOOL_DUMP_VERSION
+                : MEMPOOL_DUMP_VERSION_NO_METADATA;
         file << version;
 
-        file << uint64_t(vinfo.size());
-        for (const auto &i : vinfo) {
+        file << uint64_t(entries.size());
+        for (const auto &i : entries) {
             file << *(i.tx);
-            file << int64_t(i.nTime);
+            file << i.nTime;
             file << i.nFeeDelta;
+            if (version >= MEMPOOL_DUMP_VERSION) {
+                file << i.nFee;
+                file << i.nSigChecks;
+            }
             mapDeltas.erase(i.tx->GetId());
         }
 
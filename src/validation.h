@@ -55,6 +55,7 @@ struct FlatFilePos;
 struct ChainTxData;
 struct PrecomputedTransactionData;
 struct LockPoints;
+struct SnapshotBlock;
 
 namespace Consensus {
 struct Params;
@@ -93,6 +94,19 @@ static constexpr int MAX_ADDITIONAL_SCRIPTCHECK_THREADS = 255;
 static constexpr int LEGACY_MAX_ADDITIONAL_SCRIPTCHECK_THREADS = 15;
 /** -par default (number of script-checking threads, 0 = auto) */
 static constexpr int DEFAULT_SCRIPTCHECK_THREADS = 0;
+/** Default for -prefetchblockinputs */
+static constexpr bool DEFAULT_PREFETCH_BLOCK_INPUTS = true;
+/** Default for -parallelconnect */
+static constexpr bool DEFAULT_PARALLEL_CONNECT = false;
+/** Maximum number of threads scanning block files during a reindex */
+static constexpr int MAX_REINDEX_THREADS = 16;
+/** -reindexthreads default (number of block file scanning threads, 0 = auto) */
+static constexpr int DEFAULT_REINDEX_THREADS = 0;
+/**
+ * Maximum total serialized size of the blocks that are scanned ahead of the
+ * block file being imported during a reindex.
+ */
+static constexpr size_t MAX_REINDEX_BUFFER_SIZE = 128 * 1024 * 1024;
 /**
  * Number of blocks that can be requested at any given time from a single peer.
  */
@@ -150,10 +164,13 @@ static constexpr int64_t MAX_FEE_ESTIMATION_TIP_AGE = 3 * 60 * 60;
 static constexpr bool DEFAULT_PERMIT_BAREMULTISIG = true;
 static constexpr bool DEFAULT_CHECKPOINTS_ENABLED = true;
 static constexpr bool DEFAULT_TXINDEX = false;
+static constexpr bool DEFAULT_COINSTATSINDEX = false;
 static constexpr unsigned int DEFAULT_BANSCORE_THRESHOLD = 100;
 
 /** Default for -persistmempool */
 static constexpr bool DEFAULT_PERSIST_MEMPOOL = true;
+/** Default for -persistmempoolmetadata */
+static constexpr bool DEFAULT_PERSIST_MEMPOOL_METADATA = false;
 /** Default for using fee filter */
 static constexpr bool DEFAULT_FEEFILTER = true;
 
@@ -201,6 +218,16 @@ extern bool fIsBareMultisigStd;
 extern bool fRequireStandard;
 extern bool fCheckBlockIndex;
 extern bool fCheckpointsEnabled;
+/**
+ * Whether to warm the coins cache with a block's inputs in parallel before
+ * connecting it.
+ */
+extern bool fPrefetchBlockInputs;
+/**
+ * Whether ConnectBlock() checks the transactions of a block in parallel before
+ * applying them to the coins view.
+ */
+extern bool fParallelConnect;
 extern size_t nCoinCacheUsage;
 
 /**
@@ -314,6 +341,14 @@ bool ProcessNewBlockHeaders(const Config &config,
 void LoadExternalBlockFile(const Config &config, FILE *fileIn,
                            FlatFilePos *dbp = nullptr);
 
+/**
+ * Import the blocks of the block files, blk00000.dat onwards until the first
+ * one that is missing, into the block index (-reindex). The files are scanned
+ * and their blocks deserialized and checked on -reindexthreads threads, and
+ * imported in the order of the files.
+ */
+void ReindexBlockFiles(const Config &config);
+
 /**
  * Ensures we have a genesis block in the block tree, possibly writing one to
  * disk.
@@ -336,9 +371,15 @@ bool LoadChainTip(const Config &config) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
  */
 void UnloadBlockIndex(const Config &config);
 
-/** Run instances of script checking worker threads */
+/**
+ * Run instances of script checking worker threads, and as many block input
+ * prefetch, transaction check and mempool check worker threads.
+ */
 void StartScriptCheckWorkerThreads(int threads_num);
-/** Stop all of the script checking worker threads */
+/**
+ * Stop all of the script checking, input prefetch, transaction check and
+ * mempool check worker threads.
+ */
 void StopScriptCheckWorkerThreads();
 
 /**
@@ -406,6 +447,55 @@ AcceptToMemoryPoolWithTime(const Config &config, CTxMemPool &pool,
                            bool test_accept = false)
     EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
+/**
+ * First stage of accepting transactions to the memory pool, which is run in
+ * parallel. Verifies the input scripts of `txs` on the mempool check worker
+ * threads, against a snapshot of the coins they spend taken from the UTXO set,
+ * the mempool and the outputs of the transactions before them in `txs`. The
+ * results of those that pass are stored in the script execution cache, so that
+ * the AcceptToMemoryPool() calls that follow skip script verification and only
+ * serialize the checks against the mempool and its update. Transactions that
+ * passed or failed before are skipped, and so are those whose inputs or fee,
+ * unless bypass_limits is set, already rule them out. Does nothing if there
+ * are no worker threads. Best called without holding cs_main, which is only
+ * taken to take the snapshot and to store the results.
+ */
+void PrevalidateMemPoolTransactions(const Config &config, CTxMemPool &pool,
+                                    const std::vector<CTransactionRef> &txs,
+                                    bool bypass_limits);
+
+/**
+ * The maximum number of transactions AcceptToMemoryPoolBatch() prevalidates
+ * and accepts at once.
+ */
+static constexpr size_t MEMPOOL_BATCH_SIZE = 1000;
+
+/** The outcome of accepting one transaction of AcceptToMemoryPoolBatch(). */
+struct MemPoolAcceptResult {
+    CValidationState state;
+    bool fMissingInputs = false;
+    bool fAccepted = false;
+};
+
+/**
+ * (try to) add transactions that arrived together to the memory pool, e.g. a
+ * package, orphans or transactions to resurrect after a reorg. The
+ * transactions are ordered so that they come after those of `txs` whose
+ * outputs they spend, then in chunks of MEMPOOL_BATCH_SIZE their scripts are
+ * verified in parallel by PrevalidateMemPoolTransactions() and they are added
+ * one after another under a single lock of cs_main. The coins cache is only
+ * flushed once per chunk.
+ *
+ * acceptTimes holds the acceptance time of each transaction, or is empty to
+ * accept them all with the current time. Returns the results in the order of
+ * `txs`.
+ */
+std::vector<MemPoolAcceptResult>
+AcceptToMemoryPoolBatch(const Config &config, CTxMemPool &pool,
+                        const std::vector<CTransactionRef> &txs,
+                        const std::vector<int64_t> &acceptTimes,
+                        bool bypass_limits, const Amount nAbsurdFee);
+
 /** Convert CValidationState to a human-readable message for logging */
 std::string FormatStateMessage(const CValidationState &state);
 
@@ -628,6 +718,19 @@ public:
 /** Replay blocks that aren't fully applied to the database. */
 bool ReplayBlocks(const Consensus::Params &params, CCoinsView *view);
 
+/**
+ * Accept the headers of blocks, the chain from height 1 up to the base block
+ * of a UTXO snapshot that is being loaded into an empty chainstate. The blocks
+ * of that chain whose data was never received are assumed to be valid and are
+ * treated as pruned, with the ABLA states recorded in blocks and a total of
+ * nChainTx transactions, so that the base block can become the tip. The base
+ * block is finalized, as it cannot be disconnected.
+ */
+bool AssumeSnapshotChain(const Config &config,
+                         const std::vector<SnapshotBlock> &blocks,
+                         uint64_t nChainTx, CValidationState &state)
+    EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
 /** Find the last common block between the parameter chain and a locator. */
 CBlockIndex *FindForkInGlobalIndex(const CChain &chain,
                                    const CBlockLocator &locator)
@@ -7,8 +7,13 @@
 - Start a single node and generate 3 blocks.
 - Stop the node and restart it with -reindex. Verify that the node has reindexed up to block 3.
 - Stop the node and restart it with -reindex-chainstate. Verify that the node has reindexed up to block 3.
+- Spread the blocks over several block files, out of order, and verify that
+  -reindex with several -reindexthreads imports all of them.
 """
 
+import os
+import struct
+
 from test_framework.test_framework import BitcoinTestFramework
 from test_framework.util import assert_equal
 
@@ -30,11 +35,42 @@ class ReindexTest(BitcoinTestFramework):
         assert_equal(self.nodes[0].getblockcount(), blockcount)
         self.log.info("Success")
 
+    def reindex_shuffled_files(self):
+        self.generatetoaddress(self.nodes[0],
+            50, self.nodes[0].get_deterministic_priv_key().address)
+        blockcount = self.nodes[0].getblockcount()
+        besthash = self.nodes[0].getbestblockhash()
+        self.stop_nodes()
+
+        # Split the blocks over four files, each with its blocks in reverse
+        # order, so that most blocks are found before their parent and the
+        # files are scanned concurrently.
+        blocks_dir = os.path.join(self.nodes[0].datadir, self.chain, 'blocks')
+        with open(os.path.join(blocks_dir, 'blk00000.dat'), 'rb') as f:
+            data = f.read()
+        magic = data[:4]
+        records = []
+        pos = data.find(magic)
+        while pos >= 0:
+            size = struct.unpack('<I', data[pos + 4:pos + 8])[0]
+            records.append(data[pos:pos + 8 + size])
+            pos = data.find(magic, pos + 8 + size)
+        assert_equal(len(records), blockcount + 1)
+        for n in range(4):
+            with open(os.path.join(blocks_dir, 'blk{:05d}.dat'.format(n)), 'wb') as f:
+                f.write(b''.join(reversed(records[n::4])))
+
+        self.start_nodes([["-reindex", "-reindexthreads=4"]])
+        assert_equal(self.nodes[0].getblockcount(), blockcount)
+        assert_equal(self.nodes[0].getbestblockhash(), besthash)
+        self.log.info("Success")
+
     def run_test(self):
         self.reindex(False)
         self.reindex(True)
         self.reindex(False)
         self.reindex(True)
+        self.reindex_shuffled_files()
 
 
 if __name__ == '__main__':
@@ -0,0 +1,103 @@
+#!/usr/bin/env python3
+# Copyright (c) 2026 The Bitcoin developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test bootstrapping a node from a UTXO snapshot with -loadutxosnapshot.
+
+- node0 mines a chain and writes a snapshot with dumptxoutset.
+- node1, which has never seen that chain, loads the snapshot, assumes the
+  blocks up to its base to be valid and syncs the blocks after it.
+"""
+
+import os
+import shutil
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.test_node import ErrorMatch
+from test_framework.util import (
+    assert_equal,
+    assert_raises_rpc_error,
+    connect_nodes,
+)
+
+SNAPSHOT_HEIGHT = 150
+
+
+class UTXOSnapshotTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.setup_clean_chain = True
+        self.num_nodes = 2
+        self.extra_args = [[], ["-prune=1"]]
+
+    def setup_network(self):
+        # node1 must not learn about the chain of node0 before it loads the
+        # snapshot.
+        self.setup_nodes()
+
+    def run_test(self):
+        node0, node1 = self.nodes
+        address = node0.get_deterministic_priv_key().address
+        node0.generatetoaddress(SNAPSHOT_HEIGHT, address)
+
+        path = os.path.join(node0.datadir, "utxo.dat")
+        dumped = node0.dumptxoutset(path)
+        assert_equal(dumped["base_hash"], node0.getbestblockhash())
+        assert_equal(dumped["base_height"], SNAPSHOT_HEIGHT)
+        txoutset = node0.gettxoutsetinfo()
+
+        self.log.info("Refuse to assume the chain of a snapshot without a "
+                      "committed base block or without pruning")
+        self.stop_node(1)
+        for subdir in ("blocks", "chainstate"):
+            shutil.rmtree(os.path.join(node1.datadir, self.chain, subdir))
+        snapshot_args = [
+            "-loadutxosnapshot={}".format(path),
+            "-loadutxosnapshothash={}".format(dumped["ecmultiset_hash"]),
+        ]
+        block_arg = "-loadutxosnapshotblock={}".format(dumped["base_hash"])
+        load_error = "Error: Unable to load UTXO snapshot"
+        node1.assert_start_raises_init_error(
+            snapshot_args + ["-prune=1"], load_error,
+            match=ErrorMatch.PARTIAL_REGEX)
+        node1.assert_start_raises_init_error(
+            snapshot_args + [block_arg], load_error,
+            match=ErrorMatch.PARTIAL_REGEX)
+        wrong_block = "-loadutxosnapshotblock={}".format(
+            node0.getblockhash(SNAPSHOT_HEIGHT - 1))
+        node1.assert_start_raises_init_error(
+            snapshot_args + [wrong_block, "-prune=1"], load_error,
+            match=ErrorMatch.PARTIAL_REGEX)
+
+        self.log.info("Bootstrap a fresh node from the snapshot")
+        self.start_node(1, snapshot_args + [block_arg, "-prune=1"])
+        assert_equal(node1.getbestblockhash(), dumped["base_hash"])
+        assert_equal(node1.getblockcount(), SNAPSHOT_HEIGHT)
+        assert_equal(node1.getblockchaininfo()["pruned"], True)
+        node1_txoutset = node1.gettxoutsetinfo()
+        for key in ("txouts", "total_amount"):
+            assert_equal(node1_txoutset[key], txoutset[key])
+
+        # The blocks up to the base block were never downloaded.
+        assert_raises_rpc_error(-1, "Block not available (pruned data)",
+                                node1.getblock, dumped["base_hash"])
+        header = node1.getblockheader(dumped["base_hash"])
+        assert_equal(header["height"], SNAPSHOT_HEIGHT)
+        assert_equal(header["confirmations"], 1)
+
+        self.log.info("Sync and mine on top of the snapshot")
+        node0.generatetoaddress(10, address)
+        connect_nodes(node0, node1)
+        self.sync_blocks()
+        node1.generatetoaddress(5, node1.get_deterministic_priv_key().address)
+        self.sync_blocks()
+        assert_equal(node0.getblockcount(), SNAPSHOT_HEIGHT + 15)
+
+        self.log.info("The assumed chain survives a restart")
+        self.restart_node(1, ["-prune=1"])
+        assert_equal(node1.getbestblockhash(), node0.getbestblockhash())
+        assert_raises_rpc_error(-1, "Block not available (pruned data)",
+                                node1.getblock, dumped["base_hash"])
+
+
+if __name__ == '__main__':
+    UTXOSnapshotTest().main()
@@ -82,6 +82,11 @@ class MempoolPackagesTest(BitcoinTestFramework):
             # Check that the descendant calculations are correct
             assert_equal(mempool[x]['fees']['modified'], mempool[x]['fees']['base'])
 
+            # Check that the ancestor count and size are correct
+            in_chain = chain[:chain.index(x) + 1]
+            assert_equal(mempool[x]['ancestorcount'], len(in_chain))
+            assert_equal(mempool[x]['ancestorsize'], sum(mempool[a]['size'] for a in in_chain))
+
             # Check that parent/child list is correct
             assert_equal(mempool[x]['spentby'], descendants[-1:])
             assert_equal(mempool[x]['depends'], ancestors[-2:-1])
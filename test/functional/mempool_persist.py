@@ -29,8 +29,11 @@ Test is as follows:
     transactions in its mempool. This tests that -persistmempool=0
     does not overwrite a previously valid mempool stored on disk.
   - Remove node0 mempool.dat and verify savemempool RPC recreates it
-    and verify that node1 can load it and has 5 transactions in its
-    mempool.
+    in version 1 by default.
+  - Restart node0 with -persistmempoolmetadata, verify that it loads the
+    version 1 file and that savemempool writes version 2, and verify
+    that node1 can load it and has 5 transactions in its mempool, with
+    the fees and sigchecks counts recorded in the file.
   - Verify that savemempool throws when the RPC is called if
     node1 can't write to disk.
 
@@ -41,7 +44,8 @@ import os
 from test_framework.test_framework import BitcoinTestFramework
 from test_framework.util import (
     assert_equal,
-    assert_raises_rpc_error
+    assert_raises_rpc_error,
+    wait_until,
 )
 
 
@@ -130,13 +134,28 @@ class MempoolPersistTest(BitcoinTestFramework):
         os.remove(mempooldat0)
         self.nodes[0].savemempool()
         assert os.path.isfile(mempooldat0)
+        with open(mempooldat0, 'rb') as f:
+            assert_equal(int.from_bytes(f.read(8), 'little'), 1)
+
+        self.log.debug(
+            "Restart node0 with -persistmempoolmetadata. Verify that it loads the version 1 file and writes version 2")
+        self.stop_node(0)
+        self.start_node(0, extra_args=["-persistmempoolmetadata"])
+        wait_until(lambda: self.nodes[0].getmempoolinfo()["loaded"])
+        assert_equal(len(self.nodes[0].getrawmempool()), 5)
+        os.remove(mempooldat0)
+        self.nodes[0].savemempool()
+        with open(mempooldat0, 'rb') as f:
+            # Version 2 records the fee and sigchecks count of every entry
+            assert_equal(int.from_bytes(f.read(8), 'little'), 2)
 
         self.log.debug(
             "Stop nodes, make node1 use mempool.dat from node0. Verify it has 5 transactions")
         os.rename(mempooldat0, mempooldat1)
         self.stop_nodes()
-        self.start_node(1, extra_args=[])
-        assert self.nodes[1].getmempoolinfo()["loaded"]
+        with self.nodes[1].assert_debug_log(["5 succeeded", "0 with a different fee or sigchecks count"]):
+            self.start_node(1, extra_args=[])
+            wait_until(lambda: self.nodes[1].getmempoolinfo()["loaded"])
         assert_equal(len(self.nodes[1].getrawmempool()), 5)
 
         self.log.debug(
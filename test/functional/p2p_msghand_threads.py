@@ -0,0 +1,70 @@
+#!/usr/bin/env python3
+# Copyright (c) 2026 The Bitcoin developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test processing peer messages on several message handler threads.
+
+Peers of a node started with -msghandthreads are spread over the message
+handler threads. Check that every peer is still served, that blocks relay
+between nodes and that invalid values are rejected on startup.
+"""
+
+from test_framework.p2p import P2PInterface
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.test_node import ErrorMatch
+from test_framework.util import assert_equal
+
+NUM_THREADS = 4
+NUM_PEERS = 3 * NUM_THREADS
+
+
+def block_announced(peer, blockhash):
+    inv = peer.last_message.get("inv")
+    if inv and any(i.hash == blockhash for i in inv.inv):
+        return True
+    headers = peer.last_message.get("headers")
+    return bool(headers) and any(h.rehash() == blockhash for h in headers.headers)
+
+
+class MsgHandThreadsTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 2
+        self.extra_args = [["-msghandthreads={}".format(NUM_THREADS)], []]
+
+    def run_test(self):
+        node = self.nodes[0]
+
+        self.log.info("Check that all peers are served")
+        num_node_peers = len(node.getpeerinfo())
+        peers = [node.add_p2p_connection(P2PInterface()) for _ in range(NUM_PEERS)]
+        for peer in peers:
+            peer.sync_with_ping()
+        assert_equal(len(node.getpeerinfo()), num_node_peers + NUM_PEERS)
+
+        self.log.info("Check that new blocks are announced to all peers")
+        tip = self.generatetoaddress(self.nodes[1], 1, self.nodes[1].get_deterministic_priv_key().address)[0]
+        self.sync_all()
+        assert_equal(node.getbestblockhash(), tip)
+        for peer in peers:
+            peer.wait_until(lambda: block_announced(peer, int(tip, 16)))
+
+        self.log.info("Check that blocks relay from the node")
+        tip = self.generatetoaddress(node, 2, node.get_deterministic_priv_key().address)[-1]
+        self.sync_all()
+        assert_equal(self.nodes[1].getbestblockhash(), tip)
+
+        self.log.info("Check that peers disconnect cleanly")
+        node.disconnect_p2ps()
+        assert_equal(len(node.getpeerinfo()), num_node_peers)
+
+        self.log.info("Check that invalid values are rejected")
+        self.stop_node(0)
+        for value in [0, 17]:
+            node.assert_start_raises_init_error(
+                ["-msghandthreads={}".format(value)],
+                "Error: Invalid -msghandthreads ({}), must be between 1 and 16".format(value),
+                match=ErrorMatch.FULL_TEXT)
+
+
+if __name__ == '__main__':
+    MsgHandThreadsTest().main()